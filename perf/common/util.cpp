@@ -1,6 +1,8 @@
 #include "util.hpp"
 
+#include <array>
 #include <bit>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -59,6 +61,26 @@ uint64_t util::deserializeUInt64(std::string_view str, std::size_t& inputOffset)
     return i;
 }
 
+std::size_t util::serializeUInt(uint64_t i, std::size_t byteCount, std::string& str, std::size_t location) {
+    if (byteCount == 4) {
+        return serializeUInt32(static_cast<uint32_t>(i), str, location);
+    } else if (byteCount == 8) {
+        return serializeUInt64(i, str, location);
+    } else {
+        throw std::logic_error(std::string("Cannot serialize uint of byte count ") + std::to_string(byteCount));
+    }
+}
+
+uint64_t util::deserializeUInt(std::string_view str, std::size_t byteCount, std::size_t& inputOffset) {
+    if (byteCount == 4) {
+        return deserializeUInt32(str, inputOffset);
+    } else if (byteCount == 8) {
+        return deserializeUInt64(str, inputOffset);
+    } else {
+        throw std::logic_error(std::string("Cannot deserialize uint of byte count ") + std::to_string(byteCount));
+    }
+}
+
 std::size_t util::serializeFloat(const float& i, std::string& str, std::size_t location) {
     if (location + 4 > str.size()) {
         str.resize(location + 4);
@@ -180,6 +202,30 @@ std::string_view util::ucharVectorToStringView(const std::vector<unsigned char>&
     return std::string_view(reinterpret_cast<const char*>(vec.data()), vec.size());
 }
 
+namespace {
+    std::array<uint32_t, 256> makeCrc32Table() {
+        std::array<uint32_t, 256> table;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320U : crc >> 1;
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+}
+
+uint32_t util::crc32(std::string_view data, uint32_t crc) {
+    static const auto CRC32_TABLE = makeCrc32Table();
+
+    crc = ~crc;
+    for (auto c : data) {
+        crc = CRC32_TABLE[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
 void util::writeFile(const std::filesystem::path& filePath, std::string_view data) {
     std::filesystem::path absoluteFilePath = std::filesystem::absolute(filePath);
     std::filesystem::path unfinishedFilePath = absoluteFilePath;
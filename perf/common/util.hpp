@@ -11,6 +11,9 @@ namespace util {
     uint32_t deserializeUInt32(std::string_view str, std::size_t& inputOffset);
     std::size_t serializeUInt64(const uint64_t& i, std::string& str, std::size_t location);
     uint64_t deserializeUInt64(std::string_view str, std::size_t& inputOffset);
+    // Serializes the low byteCount bytes of i, byteCount must be 4 or 8
+    std::size_t serializeUInt(uint64_t i, std::size_t byteCount, std::string& str, std::size_t location);
+    uint64_t deserializeUInt(std::string_view str, std::size_t byteCount, std::size_t& inputOffset);
     std::size_t serializeFloat(const float& i, std::string& str, std::size_t location);
     float deserializeFloat(std::string_view str, std::size_t& inputOffset);
     std::size_t serializeDouble(const double& i, std::string& str, std::size_t location);
@@ -28,6 +31,9 @@ namespace util {
     std::vector<unsigned char> strToUCharVector(std::string_view str);
     std::string_view ucharVectorToStringView(const std::vector<unsigned char>& vec);
 
+    // CRC-32 (IEEE 802.3) of data, continuing from a prior crc when one is given
+    uint32_t crc32(std::string_view data, uint32_t crc = 0);
+
     void writeFile(const std::filesystem::path& filePath, std::string_view data);
     std::string readFile(const std::filesystem::path& filePath);
     void removeFile(const std::filesystem::path& filePath);
@@ -49,20 +55,21 @@ namespace util {
         };
     };
 
+    // Inserting first finds out whether the item was there in the same probe, so only items that were there are probed twice
     template<class TContainer>
     ToggleReturnType<TContainer> toggle(TContainer& container, const typename TContainer::value_type& item) {
-        if (container.contains(item)) {
-            auto eraseReturn = container.erase(item);
-            return ToggleReturnType<TContainer> {
-                .insertType = ERASED,
-                .eraseReturn = eraseReturn
-            };
-        } else {
-            auto insertReturn = container.insert(item);
+        auto insertReturn = container.insert(item);
+        if (insertReturn.second) {
             return ToggleReturnType<TContainer> {
                 .insertType = INSERTED,
                 .insertReturn = insertReturn
             };
         }
+
+        auto eraseReturn = container.erase(item);
+        return ToggleReturnType<TContainer> {
+            .insertType = ERASED,
+            .eraseReturn = eraseReturn
+        };
     }
 };
\ No newline at end of file
@@ -0,0 +1,230 @@
+// A node addon hosting a tag file maintainer in the node process, built with make addon as perftags.node
+//
+//     const maintainer = new TagFileMaintainer(folder, {"target-bucket-bytes": 4194304});
+//     const output = await maintainer.command("search", Buffer.from(searchCriteria, "binary"));
+//
+// Commands take the same ops and input as perftags does on stdin and run on libuv worker threads, resolving with
+// the output of a read as a Buffer over the bytes the tag file maintainer wrote, or undefined for anything else
+#include <node_api.h>
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+#include "tag-file-maintainer.hpp"
+#include "commands.hpp"
+
+namespace {
+    // a read's output is moved here by the worker running it, and from here into the Buffer it resolves with
+    thread_local std::string* Command_Output = nullptr;
+    void commandOutputWriter(std::string outputData) {
+        *Command_Output = std::move(outputData);
+    }
+
+    struct Maintainer {
+        Maintainer(std::string folderName, TagFileMaintainerOptions options)
+            : tfm(std::move(folderName), options)
+        {}
+
+        TagFileMaintainer tfm;
+        // concurrent reads hold this shared, any other command holds it alone
+        std::shared_mutex contentsMutex;
+        bool closed = false;
+    };
+
+    struct Command {
+        Maintainer* maintainer;
+        std::string op;
+        // the input is read in place, the reference keeps its Buffer alive until the command completes
+        std::string_view input;
+        napi_ref inputRef = nullptr;
+        napi_ref thisRef = nullptr;
+        napi_deferred deferred = nullptr;
+        napi_async_work work = nullptr;
+        std::unique_ptr<std::string> output;
+        std::string error;
+    };
+
+    napi_value throwError(napi_env env, const std::string& message) {
+        napi_throw_error(env, nullptr, message.c_str());
+        return nullptr;
+    }
+
+    std::string toString(napi_env env, napi_value value) {
+        std::size_t length = 0;
+        napi_get_value_string_utf8(env, value, nullptr, 0, &length);
+        std::string str(length, '\0');
+        napi_get_value_string_utf8(env, value, str.data(), length + 1, &length);
+        return str;
+    }
+
+    void finalizeMaintainer(napi_env, void* data, void*) {
+        delete static_cast<Maintainer*>(data);
+    }
+
+    void finalizeOutput(napi_env, void*, void* hint) {
+        delete static_cast<std::string*>(hint);
+    }
+
+    void executeCommand(napi_env, void* data) {
+        auto& command = *static_cast<Command*>(data);
+        auto& maintainer = *command.maintainer;
+        bool concurrent = commands::isConcurrentRead(command.op);
+        try {
+            command.output = std::make_unique<std::string>();
+            Command_Output = command.output.get();
+            if (concurrent) {
+                auto contentsLock = std::shared_lock<std::shared_mutex>(maintainer.contentsMutex);
+                if (maintainer.closed) {
+                    throw std::logic_error("Tag file maintainer is closed");
+                }
+                commands::run(maintainer.tfm, command.op, command.input, commandOutputWriter);
+            } else {
+                auto contentsLock = std::unique_lock<std::shared_mutex>(maintainer.contentsMutex);
+                if (maintainer.closed) {
+                    throw std::logic_error("Tag file maintainer is closed");
+                }
+                if (!commands::run(maintainer.tfm, command.op, command.input, commandOutputWriter)) {
+                    throw std::logic_error(std::string("Unknown op ") + command.op);
+                }
+                maintainer.closed = command.op == "exit";
+                if (!maintainer.closed) {
+                    maintainer.tfm.commitWriteAheadGroup();
+                    maintainer.tfm.evictColdBuckets();
+                }
+                return;
+            }
+
+            // evicting would wait on the reads, so it is left for a command that finds none running
+            auto contentsLock = std::unique_lock<std::shared_mutex>(maintainer.contentsMutex, std::try_to_lock);
+            if (contentsLock.owns_lock() && !maintainer.closed) {
+                maintainer.tfm.commitWriteAheadGroup();
+                maintainer.tfm.evictColdBuckets();
+            }
+        } catch (const std::exception& e) {
+            command.error = e.what();
+        }
+    }
+
+    void completeCommand(napi_env env, napi_status, void* data) {
+        auto command = std::unique_ptr<Command>(static_cast<Command*>(data));
+        if (!command->error.empty()) {
+            napi_value message;
+            napi_value error;
+            napi_create_string_utf8(env, command->error.c_str(), command->error.size(), &message);
+            napi_create_error(env, nullptr, message, &error);
+            napi_reject_deferred(env, command->deferred, error);
+        } else if (commands::isRead(command->op)) {
+            // the Buffer takes ownership of the output string rather than copying it
+            auto output = command->output.release();
+            napi_value buffer;
+            napi_create_external_buffer(env, output->size(), output->data(), finalizeOutput, output, &buffer);
+            napi_resolve_deferred(env, command->deferred, buffer);
+        } else {
+            napi_value undefined;
+            napi_get_undefined(env, &undefined);
+            napi_resolve_deferred(env, command->deferred, undefined);
+        }
+
+        if (command->inputRef != nullptr) {
+            napi_delete_reference(env, command->inputRef);
+        }
+        napi_delete_reference(env, command->thisRef);
+        napi_delete_async_work(env, command->work);
+    }
+
+    // new TagFileMaintainer(folder: string, options?: Record<string, number>)
+    napi_value construct(napi_env env, napi_callback_info info) {
+        std::size_t argc = 2;
+        napi_value argv[2];
+        napi_value self;
+        napi_get_cb_info(env, info, &argc, argv, &self, nullptr);
+        if (argc < 1) {
+            return throwError(env, "TagFileMaintainer takes the folder to keep its files in");
+        }
+
+        TagFileMaintainerOptions options;
+        napi_valuetype optionsType = napi_undefined;
+        if (argc > 1) {
+            napi_typeof(env, argv[1], &optionsType);
+        }
+        if (optionsType == napi_object) {
+            napi_value names;
+            uint32_t nameCount = 0;
+            napi_get_property_names(env, argv[1], &names);
+            napi_get_array_length(env, names, &nameCount);
+            for (uint32_t i = 0; i < nameCount; ++i) {
+                napi_value name;
+                napi_value value;
+                int64_t optionValue = 0;
+                napi_get_element(env, names, i, &name);
+                napi_get_property(env, argv[1], name, &value);
+                napi_get_value_int64(env, value, &optionValue);
+                auto optionName = toString(env, name);
+                if (!options.set(optionName, static_cast<uint64_t>(optionValue))) {
+                    return throwError(env, "Unknown option " + optionName);
+                }
+            }
+        }
+
+        try {
+            auto maintainer = std::make_unique<Maintainer>(toString(env, argv[0]), options);
+            napi_wrap(env, self, maintainer.get(), finalizeMaintainer, nullptr, nullptr);
+            maintainer.release();
+        } catch (const std::exception& e) {
+            return throwError(env, e.what());
+        }
+
+        return self;
+    }
+
+    // command(op: string, input?: Buffer): Promise<Buffer | undefined>, input must not change until the promise settles
+    napi_value command(napi_env env, napi_callback_info info) {
+        std::size_t argc = 2;
+        napi_value argv[2];
+        napi_value self;
+        napi_get_cb_info(env, info, &argc, argv, &self, nullptr);
+        if (argc < 1) {
+            return throwError(env, "command takes an op");
+        }
+
+        auto command = std::make_unique<Command>();
+        napi_unwrap(env, self, reinterpret_cast<void**>(&command->maintainer));
+        command->op = toString(env, argv[0]);
+        if (argc > 1) {
+            bool isBuffer = false;
+            napi_is_buffer(env, argv[1], &isBuffer);
+            if (isBuffer) {
+                void* inputData = nullptr;
+                std::size_t inputLength = 0;
+                napi_get_buffer_info(env, argv[1], &inputData, &inputLength);
+                command->input = std::string_view(static_cast<const char*>(inputData), inputLength);
+                napi_create_reference(env, argv[1], 1, &command->inputRef);
+            }
+        }
+        napi_create_reference(env, self, 1, &command->thisRef);
+
+        napi_value promise;
+        napi_value resourceName;
+        napi_create_promise(env, &command->deferred, &promise);
+        napi_create_string_utf8(env, "perftags", NAPI_AUTO_LENGTH, &resourceName);
+        napi_create_async_work(env, nullptr, resourceName, executeCommand, completeCommand, command.get(), &command->work);
+        napi_queue_async_work(env, command->work);
+        command.release();
+
+        return promise;
+    }
+
+    napi_value init(napi_env env, napi_value exports) {
+        napi_property_descriptor methods[] = {
+            {"command", nullptr, command, nullptr, nullptr, nullptr, napi_default, nullptr}
+        };
+        napi_value tagFileMaintainerClass;
+        napi_define_class(env, "TagFileMaintainer", NAPI_AUTO_LENGTH, construct, nullptr, 1, methods, &tagFileMaintainerClass);
+        napi_set_named_property(env, exports, "TagFileMaintainer", tagFileMaintainerClass);
+        return exports;
+    }
+}
+
+NAPI_MODULE(perftags, init)
\ No newline at end of file
@@ -6,7 +6,7 @@ AtomicOfstream::AtomicOfstream(const std::filesystem::path& path) {
     std::filesystem::create_directories(path_.parent_path());
     tempPath_ = path_;
     tempPath_ += ".atomictemp";
-    ofstream_.open(tempPath_);
+    ofstream_.open(tempPath_, std::ios::out | std::ios::binary);
 }
 
 AtomicOfstream::~AtomicOfstream() {
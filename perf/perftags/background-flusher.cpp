@@ -0,0 +1,74 @@
+#include "background-flusher.hpp"
+
+#include <stdexcept>
+
+BackgroundFlusher::~BackgroundFlusher() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void BackgroundFlusher::start(std::vector<std::function<void()>> writes) {
+    if (isRunning()) {
+        throw std::logic_error("Cannot start a background flush while another is running");
+    }
+
+    done_ = false;
+    error_ = nullptr;
+    bucketsWritten_ = 0;
+    bucketsToWrite_ = writes.size();
+    ++flushesStarted_;
+    thread_ = std::thread([this, writes = std::move(writes)]() {
+        auto startTime = std::chrono::steady_clock::now();
+        try {
+            for (const auto& write : writes) {
+                write();
+                ++bucketsWritten_;
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        lastFlushMilliseconds_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+        done_ = true;
+    });
+}
+
+bool BackgroundFlusher::isRunning() const {
+    return thread_.joinable();
+}
+
+bool BackgroundFlusher::isDone() const {
+    return done_;
+}
+
+void BackgroundFlusher::wait() {
+    if (!isRunning()) {
+        return;
+    }
+
+    thread_.join();
+    if (error_ != nullptr) {
+        std::rethrow_exception(error_);
+    }
+    ++flushesCompleted_;
+}
+
+std::size_t BackgroundFlusher::flushesStarted() const {
+    return flushesStarted_;
+}
+
+std::size_t BackgroundFlusher::flushesCompleted() const {
+    return flushesCompleted_;
+}
+
+std::size_t BackgroundFlusher::bucketsWritten() const {
+    return bucketsWritten_;
+}
+
+std::size_t BackgroundFlusher::bucketsToWrite() const {
+    return bucketsToWrite_;
+}
+
+uint64_t BackgroundFlusher::lastFlushMilliseconds() const {
+    return lastFlushMilliseconds_;
+}
\ No newline at end of file
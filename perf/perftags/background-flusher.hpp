@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs one batch of bucket writes at a time on its own thread
+class BackgroundFlusher {
+    public:
+        BackgroundFlusher() = default;
+        BackgroundFlusher(const BackgroundFlusher& backgroundFlusher) = delete;
+        BackgroundFlusher& operator=(const BackgroundFlusher& backgroundFlusher) = delete;
+        ~BackgroundFlusher();
+
+        void start(std::vector<std::function<void()>> writes);
+        // Whether a batch was started and has not yet been waited on
+        bool isRunning() const;
+        bool isDone() const;
+        // Joins the running batch, rethrowing anything a write threw
+        void wait();
+
+        std::size_t flushesStarted() const;
+        std::size_t flushesCompleted() const;
+        std::size_t bucketsWritten() const;
+        std::size_t bucketsToWrite() const;
+        uint64_t lastFlushMilliseconds() const;
+    private:
+        std::thread thread_;
+        std::exception_ptr error_;
+        std::atomic<bool> done_ = false;
+        std::atomic<std::size_t> bucketsWritten_ = 0;
+        std::size_t bucketsToWrite_ = 0;
+        std::size_t flushesStarted_ = 0;
+        std::size_t flushesCompleted_ = 0;
+        std::atomic<uint64_t> lastFlushMilliseconds_ = 0;
+};
\ No newline at end of file
@@ -1,21 +1,46 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
 #include "../common/util.hpp"
+#include "mapped-file.hpp"
+
+// Versions come from one clock shared by every bucket, so a bucket that replaces another never has a version the other had
+inline uint64_t nextBucketVersion() {
+    static std::atomic<uint64_t> clock = 0;
+    return ++clock;
+}
 
 template <class T, class TMainContainer, class TDiffContainer>
 class Bucket {
     public:
-        Bucket(std::filesystem::path bucketPath, std::size_t size)
-        : mainFileName(bucketPath / "bucket.tbd"), diffFileName(bucketPath / "bucket.ta"), startingSize_(size)
+        // Each write of the main file goes to the next generation's folder, so a main file is never changed once the manifest refers to it
+        Bucket(std::filesystem::path bucketPath, std::size_t generation, std::size_t size)
+        : bucketPath_(std::move(bucketPath)), generation_(generation), committedGeneration_(generation),
+          mainFileName(generationPath(generation_) / "bucket.tbd"), diffFileName(generationPath(generation_) / "bucket.ta"), startingSize_(size)
         {}
         
+        Bucket(Bucket&& bucket) = default;
+        Bucket& operator=(Bucket&& bucket) = default;
         virtual ~Bucket() = default;
 
+        // Safe to call from reads running alongside each other, as long as no write runs alongside them
         const TMainContainer& contents() {
+            std::lock_guard<std::mutex> lock(*readMutex_);
             init();
             return contents_;
         }
 
+        // Where contents() will be found, without reading them, for containers that refer to another bucket's contents
+        const TMainContainer* contentsLocation() const {
+            return &contents_;
+        }
+
         std::size_t size() const {
             if (isRead) {
                 return contents_.size();
@@ -28,14 +53,86 @@ class Bucket {
             return mainFileName;
         }
 
+        std::filesystem::path generationPath(std::size_t generation) const {
+            if (generation == 0) {
+                return bucketPath_;
+            }
+
+            auto path = bucketPath_;
+            path += std::string(".") + std::to_string(generation);
+            return path;
+        }
+
+        std::size_t generation() const {
+            return generation_;
+        }
+
+        // The generation the manifest may refer to, which lags behind while a snapshot of the bucket is being written
+        std::size_t committedGeneration() const {
+            return committedGeneration_;
+        }
+
+        bool isDirty() const {
+            return contentsIsDirty;
+        }
+
+        // Changes whenever the items do, so that what was worked out from them can tell when it is out of date
+        uint64_t version() const {
+            return version_;
+        }
+
+        // Whether the contents are in memory rather than only on disk
+        bool isResident() const {
+            return isRead;
+        }
+
+        // Whether the bucket was resident when it was first used since the last call, nothing when it was not used
+        // A use is recorded as happening at clock, for lastUse
+        std::optional<bool> takeUse(uint64_t clock) {
+            auto use = use_;
+            if (use.has_value()) {
+                lastUse_ = clock;
+            }
+            use_.reset();
+            return use;
+        }
+
+        uint64_t lastUse() const {
+            return lastUse_;
+        }
+
+        // A bucket can be evicted once its contents match its committed main file, as they can then be read back from it
+        // A bucket that was not read may still hold a mapping of its main file, and what was read from it
+        bool canEvict() const {
+            return (isRead || mainFile_.isOpen()) && !inTransaction && !contentsIsDirty && !diffContentsIsDirty_ && diffContents_.empty()
+                && writeAheadDelta_.empty() && !hasRecoveredDiff_ && committedGeneration_ == generation_;
+        }
+
+        // Drops the contents, keeping only what the manifest has for them, so that the next use reads them again
+        void evict() {
+            if (!canEvict()) {
+                return;
+            }
+
+            if (isRead) {
+                startingSize_ = contents_.size();
+            }
+            releaseContents();
+            mainFile_.close();
+            isRead = false;
+        }
+
+        // Roughly how many bytes the contents take up in memory
+        virtual std::size_t residentBytes() const = 0;
+
         void insertItem(T item) {
             init();
         
             auto insertReturn = contents_.insert(item);
             if (insertReturn.second) {
                 contentsIsDirty = true;
-                util::toggle(diffContents_, item);
-                diffContentsIsDirty_ = true;
+                version_ = nextBucketVersion();
+                toggleDiff(item);
             }
         }
 
@@ -44,8 +141,8 @@ class Bucket {
 
             util::toggle(contents_, item);
             contentsIsDirty = true;
-            util::toggle(diffContents_, item);
-            diffContentsIsDirty_ = true;
+            version_ = nextBucketVersion();
+            toggleDiff(item);
         }
 
         void deleteItem(T item) {
@@ -54,8 +151,8 @@ class Bucket {
             auto eraseReturn = contents_.erase(item);
             if (isErased(eraseReturn)) {
                 contentsIsDirty = true;
-                util::toggle(diffContents_, item);
-                diffContentsIsDirty_ = true;
+                version_ = nextBucketVersion();
+                toggleDiff(item);
             }
         }
 
@@ -65,19 +162,74 @@ class Bucket {
             return contents_.contains(item);
         }
 
-        void diffAhead() {
+        // Serializes how the diff changed since it was last diffed ahead into deltaStr, returning false when it did not change
+        // Toggling every delta since the main file was written, in order, reproduces the diff
+        bool diffAhead(std::string& deltaStr) {
             if (inTransaction || !diffContentsIsDirty_) {
-                return;
+                return false;
             }
             
             if (contents_.size() == startingSize_) {
                 util::toggle(contents_, FAKER());
-                util::toggle(diffContents_, FAKER());
-                diffContentsIsDirty_ = true;
+                toggleDiff(FAKER());
             }
         
-            util::writeFile(diffFileName, serializeDiff(diffContents_));
+            deltaStr = serializeDiff(writeAheadDelta_);
+            writeAheadDelta_.clear();
             diffContentsIsDirty_ = false;
+            return true;
+        }
+
+        // Toggles a delta from diffAhead into the diff init() applies to the main file, for recovering from a write ahead log
+        void recoverDiff(std::string_view deltaStr) {
+            recoverDiff(deserializeDiff(deltaStr));
+        }
+
+        void recoverDiff(const TDiffContainer& delta) {
+            mergeDiff(recoveredDiff_, delta);
+            hasRecoveredDiff_ = true;
+        }
+
+        // Reads the whole diff from the per bucket write ahead file that preceded the write ahead log
+        // Main files were rewritten in place back then, so the diff may already be in them
+        void recoverDiffFile() {
+            if (!std::filesystem::exists(diffFileName)) {
+                return;
+            }
+
+            recoveredDiff_ = deserializeDiff(util::readFile(diffFileName));
+            hasRecoveredDiff_ = true;
+            recoveredDiffMayBeInMainFile_ = true;
+        }
+
+        bool hasRecoveredDiff() const {
+            return hasRecoveredDiff_;
+        }
+
+        // The manifest's size counts write ahead records that were lost when the log was recovered, so the contents are taken at the size they are read at
+        void forgetStartingSize() {
+            startingSizeIsKnown_ = false;
+        }
+
+        // The checksum of the committed generation's main file, unknown for main files written before the manifest recorded checksums
+        std::optional<uint32_t> committedChecksum() const {
+            return committedChecksum_;
+        }
+
+        // The main file is checked against this when the bucket is read
+        void expectChecksum(std::optional<uint32_t> checksum) {
+            committedChecksum_ = checksum;
+        }
+
+        // The size on disk of the committed generation's main file, known from writing it, or looked up once when it was written by an earlier process
+        std::size_t committedMainFileBytes() {
+            if (!committedMainFileBytes_.has_value()) {
+                std::error_code error;
+                auto bytes = std::filesystem::file_size(generationPath(committedGeneration_) / "bucket.tbd", error);
+                committedMainFileBytes_ = error ? 0 : bytes;
+            }
+
+            return *committedMainFileBytes_;
         }
 
         void write() {
@@ -85,16 +237,45 @@ class Bucket {
                 return;
             }
         
-            util::writeFile(mainFileName, serialize(contents_));
-            startingSize_ = contents_.size();
-            diffContents_.clear();
-            diffContentsIsDirty_ = false;
-            contentsIsDirty = false;
-            postContentsMatchFile();
+            // the main file is about to be replaced, so any mapping of it is stale
+            mainFile_.close();
+            moveToGeneration(generation_ + 1);
+            committedGeneration_ = generation_;
+            auto mainStr = serialize(contents_);
+            committedChecksum_ = util::crc32(mainStr);
+            committedMainFileBytes_ = mainStr.size();
+            util::writeFile(mainFileName, mainStr);
+            contentsMatchMainFile();
+        }
+
+        // Moves to the next generation as though the current contents were written to it, returning the write for another thread to run
+        // The previous generation stays the committed one until finishSnapshot
+        // The contents are copied for the write here, on the calling thread, so only the serializing and writing are moved off it
+        std::function<void()> snapshot() {
+            auto snapshotContents = std::make_shared<const TMainContainer>(contents_);
+            moveToGeneration(generation_ + 1);
+            contentsMatchMainFile();
+
+            return [this, snapshotContents, snapshotFileName = mainFileName]() {
+                auto mainStr = serialize(*snapshotContents);
+                snapshotChecksum_ = util::crc32(mainStr);
+                snapshotMainFileBytes_ = mainStr.size();
+                util::writeFile(snapshotFileName, mainStr);
+            };
+        }
+
+        void finishSnapshot() {
+            if (committedGeneration_ == generation_) {
+                return;
+            }
+
+            committedGeneration_ = generation_;
+            committedChecksum_ = snapshotChecksum_;
+            committedMainFileBytes_ = snapshotMainFileBytes_;
         }
 
         void purgeUnusedFiles() const {
-            if (diffContents_.empty()) {
+            if (!hasRecoveredDiff_) {
                 util::removeFile(diffFileName);
             }
         }
@@ -105,9 +286,16 @@ class Bucket {
         
         void endTransaction() {
             inTransaction = false;
-            diffAhead();
         }
     protected:
+        std::filesystem::path bucketPath_;
+        std::size_t generation_;
+        std::size_t committedGeneration_;
+        std::optional<uint32_t> committedChecksum_;
+        // written by the thread writing a snapshot, and only read once that thread is joined
+        uint32_t snapshotChecksum_ = 0;
+        std::size_t snapshotMainFileBytes_ = 0;
+        std::optional<std::size_t> committedMainFileBytes_;
         std::filesystem::path mainFileName;
         std::filesystem::path diffFileName;
         bool isRead = false;
@@ -115,42 +303,116 @@ class Bucket {
         TMainContainer contents_;
         bool contentsIsDirty = false;
         TDiffContainer diffContents_;
+        // every item whose membership in diffContents_ flipped since the last diffAhead
+        TDiffContainer writeAheadDelta_;
         bool diffContentsIsDirty_ = false;
+        TDiffContainer recoveredDiff_;
+        bool hasRecoveredDiff_ = false;
+        bool recoveredDiffMayBeInMainFile_ = false;
+        bool startingSizeIsKnown_ = true;
         bool inTransaction = false;
+        MappedFile mainFile_;
+        std::optional<bool> use_;
+        uint64_t lastUse_ = 0;
+        uint64_t version_ = nextBucketVersion();
+        // held while reads that run alongside each other read the contents in, held by pointer so buckets stay movable
+        std::unique_ptr<std::mutex> readMutex_ = std::make_unique<std::mutex>();
+
+        void moveToGeneration(std::size_t generation) {
+            generation_ = generation;
+            mainFileName = generationPath(generation_) / "bucket.tbd";
+            // the manifest has never referred to this generation, so anything there was left by an interrupted write
+            std::filesystem::remove_all(generationPath(generation_));
+        }
+
+        void contentsMatchMainFile() {
+            startingSize_ = contents_.size();
+            diffContents_.clear();
+            writeAheadDelta_.clear();
+            diffContentsIsDirty_ = false;
+            contentsIsDirty = false;
+            postContentsMatchFile();
+        }
+
+        void toggleDiff(const T& item) {
+            util::toggle(diffContents_, item);
+            util::toggle(writeAheadDelta_, item);
+            diffContentsIsDirty_ = true;
+        }
+
+        void insertDiff(const T& item) {
+            if (diffContents_.insert(item).second) {
+                util::toggle(writeAheadDelta_, item);
+            }
+            diffContentsIsDirty_ = true;
+        }
+
+        // Maps the main file if it is not already mapped, a missing main file is viewed as empty
+        std::string_view mainFileView() {
+            if (!mainFile_.isOpen()) {
+                mainFile_.open(mainFileName);
+            }
+
+            return mainFile_.view();
+        }
+
+        // Records the first use since takeUse, and whether the contents were in memory for it
+        void noteUse() {
+            if (!use_.has_value()) {
+                use_ = isRead;
+            }
+        }
 
         void init() {
+            noteUse();
             if (isRead) {
                 return;
             }
         
             isRead = true;
+            preContentsRead();
+            bool startingSizeIsKnown = startingSizeIsKnown_;
+            startingSizeIsKnown_ = true;
         
-            if (startingSize_ == 0) {
+            if (startingSize_ == 0 && startingSizeIsKnown) {
+                recoveredDiff_.clear();
+                hasRecoveredDiff_ = false;
+                // later diffs are against empty contents, so a leftover main file must be emptied to match them
+                if (!mainFileView().empty()) {
+                    contentsIsDirty = true;
+                    writeNow();
+                }
+                mainFile_.close();
                 return;
             }
         
-            std::string mainContents;
-            try {
-                mainContents = util::readFile(mainFileName);
-            } catch(std::logic_error& err) {
-                // do nothing, file not opening is fine, is indicative of only diff file
+            // a main file not opening is fine, is indicative of only diff file
+            auto mainView = mainFileView();
+            if (committedChecksum_.has_value() && util::crc32(mainView) != *committedChecksum_) {
+                throw std::logic_error(std::string("Main file ") + mainFileName.generic_string() + " does not match the checksum the manifest has for it");
             }
-            contents_ = deserialize(mainContents);
+            contents_ = deserialize(mainView);
+            // contents are fully materialized, no need to keep the mapping around
+            mainFile_.close();
 
-            if (contents_.size() == startingSize_) {
+            if (!hasRecoveredDiff_ || (recoveredDiffMayBeInMainFile_ && contents_.size() == startingSize_)) {
+                if (contents_.size() != startingSize_ && startingSizeIsKnown) {
+                    throw std::logic_error(std::string("Could not find write ahead contents for ") + mainFileName.generic_string() + " despite needed write ahead contents for the expected starting size to match");
+                }
+
+                // the main file was written after the recovered diff was, so it already has the diff in it
+                recoveredDiff_.clear();
+                hasRecoveredDiff_ = false;
+                startingSize_ = contents_.size();
                 postContentsMatchFile();
                 return;
             }
 
-            std::string diffContentsStr;
-            try {
-                diffContentsStr = util::readFile(diffFileName);
-            } catch (std::logic_error& err) {
-                throw std::logic_error(std::string("Could not find ") + diffFileName.generic_string() + " despite needed write ahead contents for the expected starting size to match");
-            }
-            applyDiff(deserializeDiff(diffContentsStr));
+            applyDiff(recoveredDiff_);
+            recoveredDiff_.clear();
+            hasRecoveredDiff_ = false;
             contentsIsDirty = true;
-            if (contents_.size() != startingSize_) {
+            if (contents_.size() != startingSize_ && startingSizeIsKnown) {
                 // TODO: allow user intervention while showing both before and after diff, 
                 throw std::logic_error(std::string(
                     "With diff contents included, contents size of ") + mainFileName.generic_string() + " ("
@@ -159,6 +421,11 @@ class Bucket {
             }
         
             // if diff contents were needed, then we need to write immediately to prevent overwriting diffs
+            writeNow();
+        }
+
+        // Writes even when in a transaction
+        void writeNow() {
             if (inTransaction) {
                 inTransaction = false;
                 write();
@@ -186,5 +453,10 @@ class Bucket {
         }
 
         virtual void applyDiff(const TDiffContainer& diffContents) = 0;
+        virtual void mergeDiff(TDiffContainer& diffContents, const TDiffContainer& deltaContents) const = 0;
+        virtual void preContentsRead() {}
         virtual void postContentsMatchFile() {}
+        virtual void releaseContents() {
+            contents_ = TMainContainer();
+        }
 };
\ No newline at end of file
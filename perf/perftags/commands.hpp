@@ -0,0 +1,121 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+// The ops perftags runs against a tag file maintainer, shared by the command loop in main.cpp and the node addon
+namespace commands {
+    // Ops that write their output rather than changing the tag pairings
+    inline bool isRead(std::string_view op) {
+        static const std::unordered_set<std::string_view> READ_OPS = {
+            "read_taggables_tags",
+            "read_taggables_specified_tags",
+            "read_tag_groups_taggable_counts",
+            "search",
+            "explain",
+            "search_count",
+            "search_exists",
+            "search_sorted",
+            "search_sample",
+            "search_cursor_open",
+            "search_cursor_page",
+            "search_cursor_close",
+            "stats",
+            "prewarm"
+        };
+        return READ_OPS.contains(op);
+    }
+
+    // Reads that only look at bucket contents, which can run alongside each other
+    inline bool isConcurrentRead(std::string_view op) {
+        static const std::unordered_set<std::string_view> CONCURRENT_READ_OPS = {
+            "read_taggables_tags",
+            "read_taggables_specified_tags",
+            "read_tag_groups_taggable_counts",
+            "search",
+            "explain",
+            "search_count",
+            "search_exists",
+            "search_sorted",
+            "search_sample",
+            "search_cursor_open",
+            "search_cursor_page",
+            "search_cursor_close"
+        };
+        return CONCURRENT_READ_OPS.contains(op);
+    }
+
+    // Runs op with input, reads handing their output to writer, returns false for an op that does not exist
+    template <class TTagFileMaintainer>
+    bool run(TTagFileMaintainer& tfm, std::string_view op, std::string_view input, void (*writer)(std::string)) {
+        if (op == "insert_taggables") {
+            tfm.insertTaggables(input);
+        } else if (op == "delete_taggables") {
+            tfm.deleteTaggables(input);
+        } else if (op == "insert_tags") {
+            tfm.insertTags(input);
+        } else if (op == "delete_tags") {
+            tfm.deleteTags(input);
+        } else if (op == "insert_tag_pairings") {
+            tfm.insertPairings(input);
+        } else if (op == "toggle_tag_pairings") {
+            tfm.togglePairings(input);
+        } else if (op == "delete_tag_pairings") {
+            tfm.deletePairings(input);
+        } else if (op == "set_metric_values") {
+            tfm.setMetricValues(input);
+        } else if (op == "delete_metric_values") {
+            tfm.deleteMetricValues(input);
+        } else if (op == "read_taggables_tags") {
+            tfm.readTaggablesTags(input, writer);
+        } else if (op == "read_taggables_specified_tags") {
+            tfm.readTaggablesSpecifiedTags(input, writer);
+        } else if (op == "read_tag_groups_taggable_counts") {
+            tfm.readTagGroupsTaggableCountsWithSearch(input, writer);
+        } else if (op == "search") {
+            tfm.search(input, writer);
+        } else if (op == "search_count") {
+            tfm.countSearch(input, writer);
+        } else if (op == "search_exists") {
+            tfm.searchExists(input, writer);
+        } else if (op == "search_sorted") {
+            tfm.searchSorted(input, writer);
+        } else if (op == "search_sample") {
+            tfm.searchSample(input, writer);
+        } else if (op == "explain") {
+            tfm.explainSearch(input, writer);
+        } else if (op == "search_cursor_open") {
+            tfm.openSearchCursor(input, writer);
+        } else if (op == "search_cursor_page") {
+            tfm.readSearchCursorPage(input, writer);
+        } else if (op == "search_cursor_close") {
+            tfm.closeSearchCursor(input);
+        } else if (op == "stats") {
+            tfm.readStats(writer);
+        } else if (op == "prewarm") {
+            tfm.prewarm(writer);
+        } else if (op == "flush_files") {
+            // the buckets are written, and split once past the target size, on another thread, commands carry on against the write ahead log until they are
+            tfm.startBackgroundFlush();
+        } else if (op == "purge_unused_files") {
+            tfm.purgeUnusedFiles();
+        } else if (op == "begin_transaction") {
+            tfm.beginTransaction();
+        } else if (op == "end_transaction") {
+            tfm.endTransaction();
+        } else if (op == "exit") {
+            tfm.close();
+        }
+        #ifdef TESTING_MODE
+        else if (op == "override") {
+            tfm.overrideMode = std::string(input);
+        }
+        #endif
+        else {
+            return false;
+        }
+
+        return true;
+    }
+}
\ No newline at end of file
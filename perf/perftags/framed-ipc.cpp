@@ -0,0 +1,73 @@
+#include "framed-ipc.hpp"
+
+#include <stdexcept>
+
+#include "../common/util.hpp"
+
+const std::vector<std::string>& framedIpc::ops() {
+    // op codes are sent by the binding, so ops are only ever appended
+    static const std::vector<std::string> OPS = {
+        "exit",
+        "insert_taggables",
+        "delete_taggables",
+        "insert_tags",
+        "delete_tags",
+        "insert_tag_pairings",
+        "toggle_tag_pairings",
+        "delete_tag_pairings",
+        "flush_files",
+        "purge_unused_files",
+        "begin_transaction",
+        "end_transaction",
+        "override",
+        "read_taggables_tags",
+        "read_taggables_specified_tags",
+        "read_tag_groups_taggable_counts",
+        "search",
+        "stats",
+        "prewarm",
+        "explain",
+        "search_cursor_open",
+        "search_cursor_page",
+        "search_cursor_close",
+        "search_count",
+        "search_exists",
+        "set_metric_values",
+        "delete_metric_values",
+        "search_sorted",
+        "search_sample"
+    };
+    return OPS;
+}
+
+bool framedIpc::readFrame(std::istream& in, Frame& frame) {
+    std::string header(HEADER_BYTES, '\0');
+    if (!in.read(header.data(), HEADER_BYTES)) {
+        if (in.gcount() != 0) {
+            throw std::logic_error("Input ended partway through a frame header");
+        }
+        return false;
+    }
+
+    std::size_t offset = 0;
+    auto payloadBytes = util::deserializeUInt64(header, offset);
+    frame.opCode = static_cast<uint8_t>(util::deserializeChar(header, offset));
+    frame.requestId = util::deserializeUInt64(header, offset);
+    frame.payload.resize(payloadBytes);
+    if (!in.read(frame.payload.data(), payloadBytes)) {
+        throw std::logic_error(std::string("Input ended partway through a frame payload of ") + std::to_string(payloadBytes) + " bytes");
+    }
+
+    return true;
+}
+
+void framedIpc::writeFrame(std::ostream& out, uint8_t status, uint64_t requestId, std::string_view payload) {
+    std::string header;
+    std::size_t location = util::serializeUInt64(payload.size(), header, 0);
+    location = util::serializeChar(static_cast<char>(status), header, location);
+    util::serializeUInt64(requestId, header, location);
+
+    out.write(header.data(), header.size());
+    out.write(payload.data(), payload.size());
+    out.flush();
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Commands sent as length prefixed binary frames over stdin and stdout, in place of op lines and input and output files
+// A command is {payload bytes}{op code}{request id}{payload} and its reply is {payload bytes}{status}{request id}{payload},
+// where the sizes and request id are little endian uint64s and the op code and status are single bytes
+namespace framedIpc {
+    const std::size_t HEADER_BYTES = 17;
+    const uint8_t STATUS_OK = 0;
+    const uint8_t STATUS_BAD_COMMAND = 1;
+
+    struct Frame {
+        uint8_t opCode = 0;
+        uint64_t requestId = 0;
+        std::string payload;
+    };
+
+    // The op each op code stands for, where an op code is its index
+    const std::vector<std::string>& ops();
+    // Reads the next frame into frame, reusing its payload's buffer, returning false once in has ended
+    bool readFrame(std::istream& in, Frame& frame);
+    // The payload is written straight from where it is, without being copied into the frame
+    void writeFrame(std::ostream& out, uint8_t status, uint64_t requestId, std::string_view payload);
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "id-dictionary.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "../common/util.hpp"
+
+IdDictionary::IdDictionary(std::filesystem::path filePath)
+    : filePath_(std::move(filePath))
+{}
+
+void IdDictionary::load() {
+    clear();
+
+    if (!std::filesystem::exists(filePath_)) {
+        return;
+    }
+
+    auto dictionaryStr = util::readFile(filePath_);
+    // a torn append can only ever leave a partial trailing id, which was never referenced by a bucket
+    std::size_t completeSize = dictionaryStr.size() - (dictionaryStr.size() % 8);
+    if (completeSize != dictionaryStr.size()) {
+        std::filesystem::resize_file(filePath_, completeSize);
+    }
+
+    std::size_t inputOffset = 0;
+    internalToExternal_.reserve(completeSize / 8);
+    externalToInternal_.reserve(completeSize / 8);
+    while (inputOffset < completeSize) {
+        uint64_t external = util::deserializeUInt64(dictionaryStr, inputOffset);
+        externalToInternal_.insert({external, internalToExternal_.size()});
+        internalToExternal_.push_back(external);
+    }
+    persistedCount_ = internalToExternal_.size();
+}
+
+void IdDictionary::persist() {
+    if (persistedCount_ == internalToExternal_.size()) {
+        return;
+    }
+
+    std::string appended;
+    std::size_t location = 0;
+    for (std::size_t i = persistedCount_; i < internalToExternal_.size(); ++i) {
+        location = util::serializeUInt64(internalToExternal_[i], appended, location);
+    }
+
+    std::filesystem::create_directories(std::filesystem::absolute(filePath_).parent_path());
+    auto* file = std::fopen(filePath_.string().c_str(), "ab");
+    if (file == nullptr) {
+        throw std::logic_error(std::string("Could not open id dictionary ") + filePath_.generic_string());
+    }
+    // synced before returning, as the write ahead log may be synced with records using these ids before the next command
+    bool failed = std::fwrite(appended.data(), 1, appended.size(), file) != appended.size() || std::fflush(file) != 0;
+    #ifdef _WIN32
+    failed = _commit(_fileno(file)) != 0 || failed;
+    #else
+    failed = fdatasync(fileno(file)) != 0 || failed;
+    #endif
+    failed = std::fclose(file) != 0 || failed;
+    if (failed) {
+        throw std::logic_error(std::string("Failed to append to id dictionary ") + filePath_.generic_string());
+    }
+
+    persistedCount_ = internalToExternal_.size();
+}
+
+void IdDictionary::clear() {
+    externalToInternal_.clear();
+    internalToExternal_.clear();
+    persistedCount_ = 0;
+}
+
+bool IdDictionary::toInternal(uint64_t external, uint64_t& internal) const {
+    auto it = externalToInternal_.find(external);
+    if (it == externalToInternal_.end()) {
+        return false;
+    }
+
+    internal = it->second;
+    return true;
+}
+
+uint64_t IdDictionary::toInternalOrInsert(uint64_t external) {
+    auto it = externalToInternal_.find(external);
+    if (it != externalToInternal_.end()) {
+        return it->second;
+    }
+
+    uint64_t internal = internalToExternal_.size();
+    if (internal > MAX_INTERNAL_ID) {
+        throw std::logic_error(std::string("Id dictionary ") + filePath_.generic_string() + " ran out of internal ids");
+    }
+    externalToInternal_.insert({external, internal});
+    internalToExternal_.push_back(external);
+
+    return internal;
+}
+
+bool IdDictionary::toExternal(uint64_t internal, uint64_t& external) const {
+    if (internal >= internalToExternal_.size()) {
+        return false;
+    }
+
+    external = internalToExternal_[internal];
+    return true;
+}
+
+uint64_t IdDictionary::toExternal(uint64_t internal) const {
+    return internalToExternal_.at(internal);
+}
+
+std::size_t IdDictionary::size() const {
+    return internalToExternal_.size();
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+// Maps the external (database) ids given to perftags onto dense internal ids assigned in insertion order,
+// persisted as an append-only file of external ids where an id's position is its internal id
+class IdDictionary {
+    public:
+        IdDictionary(std::filesystem::path filePath);
+
+        void load();
+        // Appends any ids assigned since the last persist to the dictionary file, synced to disk before it returns
+        void persist();
+        void clear();
+
+        bool toInternal(uint64_t external, uint64_t& internal) const;
+        uint64_t toInternalOrInsert(uint64_t external);
+        bool toExternal(uint64_t internal, uint64_t& external) const;
+        uint64_t toExternal(uint64_t internal) const;
+        std::size_t size() const;
+
+        // Internal ids are kept below this so they, and the bucket FAKER, always fit in 4 bytes on disk
+        static const uint64_t MAX_INTERNAL_ID = 0xFFFFFFFEULL;
+    private:
+        std::filesystem::path filePath_;
+        std::unordered_map<uint64_t, uint64_t> externalToInternal_;
+        std::vector<uint64_t> internalToExternal_;
+        std::size_t persistedCount_ = 0;
+};
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "id-pair-container.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 
 #include "../common/util.hpp"
+#include "stream-vbyte.hpp"
 
 IdPairDiffContainer::IdPairDiffContainer(std::unordered_map<uint64_t, std::unordered_set<uint64_t>> container)
     : contents_(std::move(container))
@@ -12,11 +14,46 @@ IdPairDiffContainer::IdPairDiffContainer(std::unordered_map<uint64_t, std::unord
     }
 }
 
-std::string IdPairDiffContainer::serialize() const {
+// 4 byte ids are serialized as {magic}{format version}{pair count}{body bytes} then {first delta}{physical size}{stream vbyte seconds} by ascending first
+// where the first delta and physical size are variable length, wider ids are serialized as {first}{physical size}{seconds} all idBytes wide
+std::string IdPairDiffContainer::serialize(std::size_t idBytes) const {
     std::string pairingsStr;
 
-    // 8 bytes for each second, + 16 bytes for each (first + length)
-    pairingsStr.resize((8 * size()) + (16 * contents_.size()));
+    if (idBytes == IdPairFileView::COMPRESSED_ID_BYTES) {
+        std::vector<uint64_t> firsts;
+        firsts.reserve(contents_.size());
+        for (const auto& pair : contents_) {
+            if (pair.second.size() != 0) {
+                firsts.push_back(pair.first);
+            }
+        }
+        std::sort(firsts.begin(), firsts.end());
+
+        std::size_t location = COMPRESSED_HEADER_BYTES;
+        uint64_t previousFirst = 0;
+        std::vector<uint64_t> seconds;
+        for (auto first : firsts) {
+            const auto& secondSet = contents_.at(first);
+            seconds.assign(secondSet.begin(), secondSet.end());
+            std::sort(seconds.begin(), seconds.end());
+            location = streamVByte::serializeVarUInt(first - previousFirst, pairingsStr, location);
+            location = streamVByte::serializeVarUInt(seconds.size(), pairingsStr, location);
+            location = streamVByte::encodeSorted(seconds, pairingsStr, location);
+            previousFirst = first;
+        }
+        pairingsStr.resize(location);
+
+        std::size_t headerLocation = 0;
+        headerLocation = util::serializeUInt32(COMPRESSED_MAGIC, pairingsStr, headerLocation);
+        headerLocation = util::serializeUInt32(COMPRESSED_FORMAT_VERSION, pairingsStr, headerLocation);
+        headerLocation = util::serializeUInt64(firsts.size(), pairingsStr, headerLocation);
+        util::serializeUInt64(location - COMPRESSED_HEADER_BYTES, pairingsStr, headerLocation);
+
+        return pairingsStr;
+    }
+
+    // idBytes for each second, + 2 * idBytes for each (first + length)
+    pairingsStr.resize((idBytes * size()) + (2 * idBytes * contents_.size()));
     std::size_t location = 0;
     for (const auto& pair : contents_) {
         if (pair.second.size() == 0) {
@@ -24,13 +61,13 @@ std::string IdPairDiffContainer::serialize() const {
         }
 
         // {first}
-        location = util::serializeUInt64(pair.first, pairingsStr, location);
+        location = util::serializeUInt(pair.first, idBytes, pairingsStr, location);
         // {physical size}
-        location = util::serializeUInt64(pair.second.size(), pairingsStr, location);
+        location = util::serializeUInt(pair.second.size(), idBytes, pairingsStr, location);
 
         for (auto second : pair.second) {
             // {second}
-            location = util::serializeUInt64(second, pairingsStr, location);
+            location = util::serializeUInt(second, idBytes, pairingsStr, location);
         }
     }
 
@@ -39,21 +76,52 @@ std::string IdPairDiffContainer::serialize() const {
     return pairingsStr;
 }
 
-IdPairDiffContainer IdPairDiffContainer::deserialize(std::string_view str, const std::unordered_set<uint64_t>* secondUniverse) {
-    std::size_t inputOffset = 0;
+// legacy diffs can start with the magic by chance, but will not also describe their own size
+bool IdPairDiffContainer::isCompressedFormat(std::string_view str) {
+    if (str.size() < COMPRESSED_HEADER_BYTES) {
+        return false;
+    }
 
-    if (str.size() % 8 != 0) {
-        throw std::logic_error(std::string("Input is malformed, not an even interval of 8"));
+    std::size_t inputOffset = 0;
+    if (util::deserializeUInt32(str, inputOffset) != COMPRESSED_MAGIC || util::deserializeUInt32(str, inputOffset) != COMPRESSED_FORMAT_VERSION) {
+        return false;
     }
+    util::deserializeUInt64(str, inputOffset);
+    return COMPRESSED_HEADER_BYTES + util::deserializeUInt64(str, inputOffset) == str.size();
+}
 
+IdPairDiffContainer IdPairDiffContainer::deserialize(std::string_view str, const RoaringBitmap* secondUniverse, std::size_t idBytes) {
+    std::size_t inputOffset = 0;
     auto output = std::unordered_map<uint64_t, std::unordered_set<uint64_t>>();
+
+    if (isCompressedFormat(str)) {
+        inputOffset = 8;
+        auto pairCount = util::deserializeUInt64(str, inputOffset);
+        inputOffset = COMPRESSED_HEADER_BYTES;
+        uint64_t first = 0;
+        std::vector<uint64_t> seconds;
+        for (std::size_t i = 0; i < pairCount; ++i) {
+            first += streamVByte::deserializeVarUInt(str, inputOffset);
+            auto count = streamVByte::deserializeVarUInt(str, inputOffset);
+            seconds.clear();
+            streamVByte::decodeSorted(str, count, inputOffset, seconds);
+            output.insert({first, std::unordered_set<uint64_t>(seconds.begin(), seconds.end())});
+        }
+
+        return IdPairDiffContainer(std::move(output));
+    }
+
+    if (str.size() % idBytes != 0) {
+        throw std::logic_error(std::string("Input is malformed, not an even interval of ") + std::to_string(idBytes));
+    }
+
     while (inputOffset < str.size()) {
-        uint64_t first = util::deserializeUInt64(str, inputOffset);
-        uint64_t count = util::deserializeUInt64(str, inputOffset);
+        uint64_t first = util::deserializeUInt(str, idBytes, inputOffset);
+        uint64_t count = util::deserializeUInt(str, idBytes, inputOffset);
         
         auto secondItems = std::unordered_set<uint64_t>();
         for (std::size_t i = 0; i < count; ++i) {
-            uint64_t secondItem = util::deserializeUInt64(str, inputOffset);
+            uint64_t secondItem = util::deserializeUInt(str, idBytes, inputOffset);
             secondItems.insert(secondItem);
         }
 
@@ -122,10 +190,10 @@ const std::unordered_map<uint64_t, std::unordered_set<uint64_t>>& IdPairDiffCont
 }
 
 
-IdPairSecond::IdPairSecond(const std::unordered_set<uint64_t>* universe)
+IdPairSecond::IdPairSecond(const RoaringBitmap* universe)
     : universe_(universe)
 {}
-IdPairSecond::IdPairSecond(const std::unordered_set<uint64_t>* universe, bool isComplement, std::unordered_set<uint64_t> physicalContents)
+IdPairSecond::IdPairSecond(const RoaringBitmap* universe, bool isComplement, RoaringBitmap physicalContents)
     : universe_(universe), isComplement_(isComplement), contents_(std::move(physicalContents))
 {}
 
@@ -140,18 +208,11 @@ IdPairInsertReturnType IdPairSecond::insert(uint64_t second) {
 }
 
 bool IdPairSecond::insert_(uint64_t second) {
-    auto it = contents_.find(second);
     if (isComplement_) {
-        if (it != contents_.end()) {
-            contents_.erase(it);
-            return true;
-        }
-    } else if (it == contents_.end()) {
-        contents_.insert(second);
-        return true;
+        return contents_.erase(second) == 1;
+    } else {
+        return contents_.insert(second).second;
     }
-
-    return false;
 }
 
 IdPairInsertReturnType IdPairSecond::erase(uint64_t second) {
@@ -164,18 +225,11 @@ IdPairInsertReturnType IdPairSecond::erase(uint64_t second) {
     return IdPairInsertReturnType {.second = erased};
 }
 bool IdPairSecond::erase_(uint64_t second) {
-    auto it = contents_.find(second);
     if (isComplement_) {
-        if (it == contents_.end()) {
-            contents_.insert(second);
-            return true;
-        }
-    } else if (it != contents_.end()) {
-        contents_.erase(it);
-        return true;
+        return contents_.insert(second).second;
+    } else {
+        return contents_.erase(second) == 1;
     }
-
-    return false;
 }
 
 #include <iostream>
@@ -185,14 +239,8 @@ void IdPairSecond::updateComplement() {
     }
 }
 void IdPairSecond::flipComplement() {
-    std::unordered_set<uint64_t> newContents;
-    for (auto item : *universe_) {
-        if (!contents_.contains(item)) {
-            newContents.insert(item);
-        }
-    }
-
-    contents_ = std::move(newContents);
+    contents_ = RoaringBitmap::difference(*universe_, contents_);
+    contents_.runOptimize();
     isComplement_ = !isComplement_;
 }
 
@@ -227,8 +275,8 @@ bool IdPairSecond::contains(uint64_t second) const {
     return contents_.contains(second) != isComplement_;
 }
 
-// Returns the underlying unordered_set's size of what items are contained if isComplement() is false
-// or the underlying unordered_set's size of what items aren't contained if isComplement() is true
+// Returns the underlying bitmap's size of what items are contained if isComplement() is false
+// or the underlying bitmap's size of what items aren't contained if isComplement() is true
 std::size_t IdPairSecond::physicalSize() const {
     return contents_.size();
 }
@@ -238,12 +286,12 @@ bool IdPairSecond::isComplement() const {
 char IdPairSecond::complementIndicator() const {
     return isComplement_ ? IS_COMPLEMENT : IS_NOT_COMPLEMENT;
 }
-// Returns the underlying unordered_set containing what items are contained if isComplement() is false
-// or the underlying unordered_set containing what items aren't contained if isComplement() is true
-const std::unordered_set<uint64_t>& IdPairSecond::physicalContents() const {
+// Returns the underlying bitmap containing what items are contained if isComplement() is false
+// or the underlying bitmap containing what items aren't contained if isComplement() is true
+const RoaringBitmap& IdPairSecond::physicalContents() const {
     return contents_;
 }
-const std::unordered_set<uint64_t>* IdPairSecond::universe() const {
+const RoaringBitmap* IdPairSecond::universe() const {
     return universe_;
 }
 // Returns the amount of items that are contained
@@ -255,11 +303,11 @@ std::size_t IdPairSecond::size() const {
     }
 }
 
-IdPairContainer::IdPairContainer(const std::unordered_set<uint64_t>* secondUniverse)
+IdPairContainer::IdPairContainer(const RoaringBitmap* secondUniverse)
     : secondUniverse_(secondUniverse)
 {}
 
-IdPairContainer::IdPairContainer(const std::unordered_set<uint64_t>* secondUniverse, std::unordered_map<uint64_t, IdPairSecond> container)
+IdPairContainer::IdPairContainer(const RoaringBitmap* secondUniverse, std::unordered_map<uint64_t, IdPairSecond> container)
     : secondUniverse_(secondUniverse), container_(std::move(container))
 {
     for (const auto& pair : container_) {
@@ -276,7 +324,7 @@ IdPairInsertReturnType IdPairContainer::insert(std::pair<uint64_t, uint64_t> ite
         throw std::logic_error("Second universe must exist when using IdPairContainer");
     }
     // gross implementation detail leakage, FAKER must be allowed regardless of if it is in second universe
-    if (!secondUniverse_->contains(item.second) && item.second != 0xFFFFFFFFFFFFFFFFULL) {
+    if (!secondUniverse_->contains(item.second) && item.second != 0xFFFFFFFFFFFFFFFFULL && item.second != 0xFFFFFFFFULL) {
         throw std::logic_error(std::string("Second universe must contain second from item (") + std::to_string(item.first) + "," + std::to_string(item.second) + ") in order to insert");
     }
 
@@ -301,7 +349,7 @@ IdPairInsertReturnType IdPairContainer::erase(std::pair<uint64_t, uint64_t> item
         throw std::logic_error("Second universe must exist when using IdPairContainer");
     }
     // gross implementation detail leakage, FAKER must be allowed regardless of if it is in second universe
-    if (!secondUniverse_->contains(item.second) && item.second != 0xFFFFFFFFFFFFFFFFULL) {
+    if (!secondUniverse_->contains(item.second) && item.second != 0xFFFFFFFFFFFFFFFFULL && item.second != 0xFFFFFFFFULL) {
         throw std::logic_error("Second universe must contain second in order to erase");
     }
 
@@ -374,6 +422,15 @@ std::size_t IdPairContainer::physicalSize() const {
     return physicalSize_;
 }
 
+std::size_t IdPairContainer::estimatedBytes() const {
+    // a hash node and roaring container for each first, and two bytes for each second stored
+    constexpr std::size_t FIRST_BYTES = sizeof(std::pair<const uint64_t, IdPairSecond>) + (2 * sizeof(void*)) + sizeof(RoaringContainer) + sizeof(uint64_t);
+    return sizeof(IdPairContainer)
+         + (container_.size() * FIRST_BYTES)
+         + (firstComplements_.size() * (sizeof(uint64_t) + (2 * sizeof(void*))))
+         + (physicalSize_ * sizeof(uint16_t));
+}
+
 void IdPairContainer::clear() {
     container_.clear();
     size_ = 0;
@@ -405,57 +462,229 @@ const std::unordered_set<uint64_t>& IdPairContainer::firstComplements() const {
     return firstComplements_;
 }
 
-// we want to serialize pairings as:
-// {first}{[C]omplement|[N]ot}{physical size}{physical seconds}
-std::string IdPairContainer::serialize() const {
-    std::string pairingsStr;
-
-    // 8 bytes for each second, + 17 bytes for each (first + length + complement indicator)
-    pairingsStr.resize((8 * physicalSize()) + (17 * container_.size()));
-    std::size_t location = 0;
-    std::size_t complementsSerialized = 0;
+// we want to serialize pairings in the sorted format described by IdPairFileView
+// where every first is idBytes wide, every offset is 8 bytes wide, and seconds are stream vbyte deltas when ids are 4 bytes wide
+std::string IdPairContainer::serialize(std::size_t idBytes) const {
+    std::vector<const std::pair<const uint64_t, IdPairSecond>*> pairs;
+    pairs.reserve(container_.size());
+    std::size_t secondCount = 0;
     for (const auto& pair : container_) {
-        if (pair.second.size() == 0) {
+        // sizing a complement reads the universe, which another thread may be changing while a snapshot is serialized
+        if (!pair.second.isComplement() && pair.second.physicalSize() == 0) {
             continue;
         }
 
-        // {first}
-        location = util::serializeUInt64(pair.first, pairingsStr, location);
-        // {complement}
-        location = util::serializeChar(pair.second.complementIndicator(), pairingsStr, location);
-        if (pair.second.complementIndicator() == IdPairSecond::IS_COMPLEMENT) {
-            ++complementsSerialized;
+        pairs.push_back(&pair);
+        secondCount += pair.second.physicalSize();
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const auto* lhs, const auto* rhs) {
+        return lhs->first < rhs->first;
+    });
+
+    // stream vbyte only holds 32 bit deltas, external ids are left fixed width
+    bool isCompressed = idBytes == IdPairFileView::COMPRESSED_ID_BYTES;
+    std::string secondsStr;
+    std::vector<uint64_t> secondOffsets;
+    secondOffsets.reserve(pairs.size() + 1);
+    std::size_t secondsLocation = 0;
+    std::vector<uint64_t> physicalSeconds;
+    for (const auto* pair : pairs) {
+        secondOffsets.push_back(isCompressed ? secondsLocation : secondsLocation / idBytes);
+        if (isCompressed) {
+            physicalSeconds.assign(pair->second.physicalContents().begin(), pair->second.physicalContents().end());
+            // {physical second count}{stream vbyte physical seconds}
+            secondsLocation = streamVByte::serializeVarUInt(physicalSeconds.size(), secondsStr, secondsLocation);
+            secondsLocation = streamVByte::encodeSorted(physicalSeconds, secondsStr, secondsLocation);
+        } else {
+            for (auto physicalSecond : pair->second.physicalContents()) {
+                // {physical second}
+                secondsLocation = util::serializeUInt(physicalSecond, idBytes, secondsStr, secondsLocation);
+            }
         }
-        // {physical size}
-        location = util::serializeUInt64(pair.second.physicalSize(), pairingsStr, location);
+    }
+    secondOffsets.push_back(isCompressed ? secondsLocation : secondsLocation / idBytes);
+    secondsStr.resize(secondsLocation);
 
-        for (auto physicalSecond : pair.second.physicalContents()) {
-            // {physical second}
-            location = util::serializeUInt64(physicalSecond, pairingsStr, location);
-        }
+    std::string pairingsStr;
+    pairingsStr.resize(36 + ((idBytes + 9) * pairs.size()) + 8 + secondsStr.size());
+    std::size_t location = 0;
+    location = util::serializeUInt32(IdPairFileView::MAGIC, pairingsStr, location);
+    location = util::serializeUInt32(isCompressed ? IdPairFileView::FORMAT_VERSION : IdPairFileView::FIXED_WIDTH_FORMAT_VERSION, pairingsStr, location);
+    location = util::serializeUInt32(idBytes, pairingsStr, location);
+    location = util::serializeUInt64(size(), pairingsStr, location);
+    location = util::serializeUInt64(pairs.size(), pairingsStr, location);
+    location = util::serializeUInt64(secondCount, pairingsStr, location);
+
+    for (const auto* pair : pairs) {
+        // {first}
+        location = util::serializeUInt(pair->first, idBytes, pairingsStr, location);
     }
+    for (const auto* pair : pairs) {
+        // {complement}
+        location = util::serializeChar(pair->second.complementIndicator(), pairingsStr, location);
+    }
+    for (auto secondOffset : secondOffsets) {
+        // {second offset}
+        location = util::serializeUInt64(secondOffset, pairingsStr, location);
+    }
+    std::copy(secondsStr.begin(), secondsStr.end(), pairingsStr.begin() + location);
+    location += secondsStr.size();
 
     pairingsStr.resize(location);
 
     return pairingsStr;
 }
 
-IdPairContainer IdPairContainer::deserialize(std::string_view str, const std::unordered_set<uint64_t>* secondUniverse) {
-    std::size_t inputOffset = 0;
-
+IdPairContainer IdPairContainer::deserialize(std::string_view str, const RoaringBitmap* secondUniverse, std::size_t idBytes) {
     auto output = std::unordered_map<uint64_t, IdPairSecond>();
+
+    if (IdPairFileView::isSortedFormat(str)) {
+        auto fileView = IdPairFileView(str, idBytes);
+        output.reserve(fileView.firstCount());
+        for (std::size_t i = 0; i < fileView.firstCount(); ++i) {
+            output.insert({fileView.firstAt(i), fileView.secondsAt(i, secondUniverse)});
+        }
+
+        return IdPairContainer(secondUniverse, std::move(output));
+    }
+
+    // legacy unsorted format, {first}{[C]omplement|[N]ot}{physical size}{physical seconds} repeated
+    std::size_t inputOffset = 0;
     while (inputOffset < str.size()) {
-        uint64_t first = util::deserializeUInt64(str, inputOffset);
+        uint64_t first = util::deserializeUInt(str, idBytes, inputOffset);
         bool isComplement = util::deserializeChar(str, inputOffset) == IdPairSecond::IS_COMPLEMENT;
-        uint64_t count = util::deserializeUInt64(str, inputOffset);
+        uint64_t count = util::deserializeUInt(str, idBytes, inputOffset);
         
-        auto secondItems = std::unordered_set<uint64_t>();
+        auto secondItems = std::vector<uint64_t>();
+        secondItems.reserve(count);
         for (std::size_t i = 0; i < count; ++i) {
-            uint64_t secondItem = util::deserializeUInt64(str, inputOffset);
-            secondItems.insert(secondItem);
+            uint64_t secondItem = util::deserializeUInt(str, idBytes, inputOffset);
+            secondItems.push_back(secondItem);
         }
-        output.insert({first, IdPairSecond(secondUniverse, isComplement, std::move(secondItems))});
+        auto physicalContents = RoaringBitmap::fromValues(std::move(secondItems));
+        physicalContents.runOptimize();
+        output.insert({first, IdPairSecond(secondUniverse, isComplement, std::move(physicalContents))});
     }
 
     return IdPairContainer(secondUniverse, std::move(output));
+}
+
+IdPairFileView::IdPairFileView(std::string_view str, std::size_t idBytes)
+    : str_(str), idBytes_(idBytes)
+{
+    if (!isSortedFormat(str)) {
+        throw std::logic_error("Pairings were not serialized in the sorted format");
+    }
+
+    std::size_t inputOffset = 4;
+    formatVersion_ = util::deserializeUInt32(str, inputOffset);
+    if (formatVersion_ != FORMAT_VERSION && formatVersion_ != FIXED_WIDTH_FORMAT_VERSION) {
+        throw std::logic_error(std::string("Sorted pairings format version ") + std::to_string(formatVersion_) + " is not supported");
+    }
+    auto fileIdBytes = util::deserializeUInt32(str, inputOffset);
+    if (fileIdBytes != idBytes_) {
+        throw std::logic_error(std::string("Sorted pairings were serialized with ") + std::to_string(fileIdBytes) + " byte ids but " + std::to_string(idBytes_) + " byte ids were expected");
+    }
+    size_ = util::deserializeUInt64(str, inputOffset);
+    firstCount_ = util::deserializeUInt64(str, inputOffset);
+    secondCount_ = util::deserializeUInt64(str, inputOffset);
+
+    firstsLocation_ = inputOffset;
+    complementsLocation_ = firstsLocation_ + (idBytes_ * firstCount_);
+    offsetsLocation_ = complementsLocation_ + firstCount_;
+    secondsLocation_ = offsetsLocation_ + (8 * (firstCount_ + 1));
+}
+
+bool IdPairFileView::isSortedFormat(std::string_view str) {
+    if (str.size() < 36) {
+        return false;
+    }
+
+    std::size_t inputOffset = 0;
+    if (util::deserializeUInt32(str, inputOffset) != MAGIC) {
+        return false;
+    }
+    // legacy files can start with the magic by chance, but will not also describe their own size
+    auto formatVersion = util::deserializeUInt32(str, inputOffset);
+    uint64_t idBytes = util::deserializeUInt32(str, inputOffset);
+    util::deserializeUInt64(str, inputOffset);
+    uint64_t firstCount = util::deserializeUInt64(str, inputOffset);
+    uint64_t secondCount = util::deserializeUInt64(str, inputOffset);
+    if ((idBytes != 4 && idBytes != 8) || firstCount > str.size() || secondCount > str.size()) {
+        return false;
+    }
+
+    std::size_t secondsLocation = inputOffset + ((idBytes + 1) * firstCount) + (8 * (firstCount + 1));
+    if (formatVersion == FIXED_WIDTH_FORMAT_VERSION) {
+        return secondsLocation + (idBytes * secondCount) == str.size();
+    }
+    if (secondsLocation > str.size()) {
+        return false;
+    }
+
+    // the last offset is where the compressed seconds end
+    std::size_t lastOffsetLocation = secondsLocation - 8;
+    return secondsLocation + util::deserializeUInt64(str, lastOffsetLocation) == str.size();
+}
+
+std::size_t IdPairFileView::size() const {
+    return size_;
+}
+
+std::size_t IdPairFileView::firstCount() const {
+    return firstCount_;
+}
+
+uint64_t IdPairFileView::firstAt(std::size_t index) const {
+    std::size_t inputOffset = firstsLocation_ + (idBytes_ * index);
+    return util::deserializeUInt(str_, idBytes_, inputOffset);
+}
+
+uint64_t IdPairFileView::offsetAt(std::size_t index) const {
+    std::size_t inputOffset = offsetsLocation_ + (8 * index);
+    return util::deserializeUInt64(str_, inputOffset);
+}
+
+IdPairSecond IdPairFileView::secondsAt(std::size_t index, const RoaringBitmap* universe) const {
+    std::size_t inputOffset = complementsLocation_ + index;
+    bool isComplement = util::deserializeChar(str_, inputOffset) == IdPairSecond::IS_COMPLEMENT;
+
+    auto secondsBegin = offsetAt(index);
+    auto secondsEnd = offsetAt(index + 1);
+    auto secondItems = std::vector<uint64_t>();
+    if (formatVersion_ == FIXED_WIDTH_FORMAT_VERSION) {
+        secondItems.reserve(secondsEnd - secondsBegin);
+        inputOffset = secondsLocation_ + (idBytes_ * secondsBegin);
+        for (auto i = secondsBegin; i < secondsEnd; ++i) {
+            secondItems.push_back(util::deserializeUInt(str_, idBytes_, inputOffset));
+        }
+    } else {
+        auto secondsStr = str_.substr(0, secondsLocation_ + secondsEnd);
+        inputOffset = secondsLocation_ + secondsBegin;
+        auto count = streamVByte::deserializeVarUInt(secondsStr, inputOffset);
+        streamVByte::decodeSorted(secondsStr, count, inputOffset, secondItems);
+    }
+    auto physicalContents = RoaringBitmap::fromValues(std::move(secondItems));
+    physicalContents.runOptimize();
+
+    return IdPairSecond(universe, isComplement, std::move(physicalContents));
+}
+
+std::optional<IdPairSecond> IdPairFileView::firstContents(uint64_t first, const RoaringBitmap* universe) const {
+    std::size_t low = 0;
+    std::size_t high = firstCount_;
+    while (low < high) {
+        std::size_t middle = low + ((high - low) / 2);
+        if (firstAt(middle) < first) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == firstCount_ || firstAt(low) != first) {
+        return std::nullopt;
+    }
+
+    return secondsAt(low, universe);
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "roaring-bitmap.hpp"
+
 
 struct IdPairDiffInsertReturnType {
     bool second;
@@ -16,8 +20,13 @@ class IdPairDiffContainer {
         IdPairDiffContainer() = default;
         using value_type = std::pair<uint64_t, uint64_t>;
 
-        std::string serialize() const;
-        static IdPairDiffContainer deserialize(std::string_view str, const std::unordered_set<uint64_t>* secondUniverse);
+        std::string serialize(std::size_t idBytes) const;
+        static IdPairDiffContainer deserialize(std::string_view str, const RoaringBitmap* secondUniverse, std::size_t idBytes);
+        static bool isCompressedFormat(std::string_view str);
+
+        static constexpr uint32_t COMPRESSED_MAGIC = 0x44435450; // "PTCD"
+        static constexpr uint32_t COMPRESSED_FORMAT_VERSION = 1;
+        static constexpr std::size_t COMPRESSED_HEADER_BYTES = 24;
         
         IdPairDiffInsertReturnType insert(std::pair<uint64_t, uint64_t> item);
         IdPairDiffInsertReturnType erase(std::pair<uint64_t, uint64_t> item);
@@ -41,8 +50,8 @@ struct IdPairInsertReturnType {
 
 class IdPairSecond {
     public:
-        IdPairSecond(const std::unordered_set<uint64_t>* universe);
-        IdPairSecond(const std::unordered_set<uint64_t>* universe, bool isComplement, std::unordered_set<uint64_t> physicalContents);
+        IdPairSecond(const RoaringBitmap* universe);
+        IdPairSecond(const RoaringBitmap* universe, bool isComplement, RoaringBitmap physicalContents);
 
         IdPairInsertReturnType insert(uint64_t second);
         IdPairInsertReturnType erase(uint64_t second);
@@ -53,23 +62,17 @@ class IdPairSecond {
         template <class T>
         void forEach(T callback) const {
             if (isComplement_) {
-                for (auto item : *universe_) {
-                    if (!contents_.contains(item)) {
-                        callback(item);
-                    }
-                }
+                RoaringBitmap::difference(*universe_, contents_).forEach(callback);
             } else {
-                for (auto item : contents_) {
-                    callback(item);
-                }
+                contents_.forEach(callback);
             }
         }
 
         std::size_t physicalSize() const;
         bool isComplement() const;
         char complementIndicator() const;
-        const std::unordered_set<uint64_t>& physicalContents() const;
-        const std::unordered_set<uint64_t>* universe() const;
+        const RoaringBitmap& physicalContents() const;
+        const RoaringBitmap* universe() const;
         std::size_t size() const;
 
         static const char IS_COMPLEMENT = 'C';
@@ -82,19 +85,24 @@ class IdPairSecond {
         void updateComplement();
         void flipComplement();
 
-        const std::unordered_set<uint64_t>* universe_;
+        const RoaringBitmap* universe_;
         bool isComplement_ = false;
-        std::unordered_set<uint64_t> contents_;
+        RoaringBitmap contents_;
 };
 
 class IdPairContainer {
     public:
         using value_type = std::pair<uint64_t, uint64_t>;
+        enum class Modification {
+            INSERT,
+            ERASE,
+            TOGGLE
+        };
 
         IdPairContainer() = default;
-        IdPairContainer(const std::unordered_set<uint64_t>* secondUniverse);
-        std::string serialize() const;
-        static IdPairContainer deserialize(std::string_view str, const std::unordered_set<uint64_t>* secondUniverse);
+        IdPairContainer(const RoaringBitmap* secondUniverse);
+        std::string serialize(std::size_t idBytes) const;
+        static IdPairContainer deserialize(std::string_view str, const RoaringBitmap* secondUniverse, std::size_t idBytes);
 
         IdPairInsertReturnType insert(std::pair<uint64_t, uint64_t> item);
         void insertComplement(uint64_t second);
@@ -107,15 +115,112 @@ class IdPairContainer {
         const std::unordered_map<uint64_t, IdPairSecond>& allContents() const;
         std::size_t size() const;
         std::size_t physicalSize() const;
+        // An estimate of the bytes held in memory, which assumes each first's seconds are held as roaring arrays
+        std::size_t estimatedBytes() const;
         void clear();
+
+        // Applies modification to every item, sorted so that the items of a first are beside each other, calling changed with each item it changed
+        // A first is found and has its complement updated once for all of its items, and a second not in the second universe throws before any item is changed
+        template <class TChanged>
+        void modifyItems(const std::vector<value_type>& sortedItems, Modification modification, TChanged changed) {
+            if (secondUniverse_ == nullptr) {
+                throw std::logic_error("Second universe must exist when using IdPairContainer");
+            }
+            for (const auto& item : sortedItems) {
+                if (!secondUniverse_->contains(item.second)) {
+                    throw std::logic_error(std::string("Second universe must contain second from item (") + std::to_string(item.first) + "," + std::to_string(item.second) + ") in order to modify");
+                }
+            }
+
+            for (std::size_t begin = 0; begin < sortedItems.size();) {
+                auto first = sortedItems[begin].first;
+                auto firstIt = container_.find(first);
+                if (firstIt == container_.end()) {
+                    firstIt = container_.insert({first, IdPairSecond(secondUniverse_)}).first;
+                }
+                auto& seconds = firstIt->second;
+                physicalSize_ -= seconds.physicalSize();
+                bool firstChanged = false;
+                std::size_t end = begin;
+                for (; end < sortedItems.size() && sortedItems[end].first == first; ++end) {
+                    auto second = sortedItems[end].second;
+                    bool erases = modification == Modification::ERASE || (modification == Modification::TOGGLE && seconds.contains(second));
+                    if (erases ? seconds.erase(second).second : seconds.insert(second).second) {
+                        erases ? --size_ : ++size_;
+                        firstChanged = true;
+                        changed(sortedItems[end]);
+                    }
+                }
+                if (firstChanged) {
+                    updateComplement(first);
+                }
+                physicalSize_ += seconds.physicalSize();
+                begin = end;
+            }
+        }
+
+        // Moves every first that shouldMove accepts, along with its seconds, into the returned container
+        template <class T>
+        IdPairContainer extractFirsts(T shouldMove) {
+            std::unordered_map<uint64_t, IdPairSecond> extracted;
+            for (auto it = container_.begin(); it != container_.end();) {
+                if (!shouldMove(it->first)) {
+                    ++it;
+                    continue;
+                }
+
+                size_ -= it->second.size();
+                physicalSize_ -= it->second.physicalSize();
+                firstComplements_.erase(it->first);
+                extracted.insert(container_.extract(it++));
+            }
+
+            return IdPairContainer(secondUniverse_, std::move(extracted));
+        }
     private:
-        IdPairContainer(const std::unordered_set<uint64_t>* secondUniverse, std::unordered_map<uint64_t, IdPairSecond> container);
+        IdPairContainer(const RoaringBitmap* secondUniverse, std::unordered_map<uint64_t, IdPairSecond> container);
         void updateComplement(uint64_t first);
 
         std::unordered_set<uint64_t> firstComplements_;
-        const std::unordered_set<uint64_t>* secondUniverse_;
+        const RoaringBitmap* secondUniverse_;
         std::unordered_map<uint64_t, IdPairSecond> container_;
 
         std::size_t size_ = 0;
         std::size_t physicalSize_ = 0;
+};
+
+// Read-only view over an IdPairContainer serialized in the sorted format, which lays the pairings out as
+// {magic}{format version}{id bytes}{size}{first count}{second count}
+// {sorted firsts}{complement indicators}{first count + 1 second offsets}{physical seconds, sorted per first}
+// so a single first's seconds can be found and decoded without reading the rest of the container
+class IdPairFileView {
+    public:
+        IdPairFileView(std::string_view str, std::size_t idBytes);
+        static bool isSortedFormat(std::string_view str);
+
+        std::size_t size() const;
+        std::size_t firstCount() const;
+        uint64_t firstAt(std::size_t index) const;
+        IdPairSecond secondsAt(std::size_t index, const RoaringBitmap* universe) const;
+        std::optional<IdPairSecond> firstContents(uint64_t first, const RoaringBitmap* universe) const;
+
+        static constexpr uint32_t MAGIC = 0x53435450; // "PTCS"
+        // seconds are stream vbyte deltas, prefixed by their count, and offsets are in bytes
+        static constexpr uint32_t FORMAT_VERSION = 2;
+        // seconds are idBytes wide, and offsets are in seconds
+        static constexpr uint32_t FIXED_WIDTH_FORMAT_VERSION = 1;
+        static constexpr std::size_t COMPRESSED_ID_BYTES = 4;
+    private:
+        uint64_t offsetAt(std::size_t index) const;
+
+        std::string_view str_;
+        uint32_t formatVersion_;
+        std::size_t idBytes_;
+        std::size_t size_;
+        std::size_t firstCount_;
+        std::size_t secondCount_;
+        std::size_t firstsLocation_;
+        std::size_t complementsLocation_;
+        std::size_t offsetsLocation_;
+        std::size_t secondsLocation_;
 };
\ No newline at end of file
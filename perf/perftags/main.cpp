@@ -3,35 +3,93 @@
 #include <fstream>
 #include <sstream>
 #include <istream>
+#include <mutex>
 
-#include "tag-file-maintainer.hpp"
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#endif
 
-std::size_t totalTagsToFiles = 0;
-unsigned short currentBucketCount = 16;
-std::unordered_map<unsigned short, std::unordered_map<uint64_t, std::unordered_set<uint64_t>>> tagHashToTagsToFiles;
-
-unsigned short wantedBucketCount() {
-    // i want each bucket to stay ~4MB
-    // tag to file count * 16 == byte count
-    std::size_t totalByteCount = totalTagsToFiles * 16;
-    // divides by 8MB
-    std::size_t unroundedBucketCount = totalByteCount >> 23;
-    unsigned short roundedBucketCount = 1;
-    while (unroundedBucketCount != 0) {
-        unroundedBucketCount >>= 1;
-        roundedBucketCount <<= 1;
-    }
-}
+#include "tag-file-maintainer.hpp"
+#include "commands.hpp"
+#include "read-executor.hpp"
+#include "framed-ipc.hpp"
 
 namespace {
     std::string Write_Output_File_Name = "perftags-write-output.txt";
     std::string Read_Output_File_Name = "perftags-read-output.txt";
-    void writeOutputFileWriter(const std::string& outputData) {
+    void writeOutputFileWriter(std::string outputData) {
         util::writeFile(Write_Output_File_Name, outputData);
     }
-    void readOutputFileWriter(const std::string& outputData) {
+    void readOutputFileWriter(std::string outputData) {
         util::writeFile(Read_Output_File_Name, outputData);
     }
+    // reads with a request id write to their own output file, named on the thread running the read
+    thread_local std::string Request_Output_File_Name;
+    void requestOutputFileWriter(std::string outputData) {
+        util::writeFile(Request_Output_File_Name, outputData);
+    }
+
+    std::mutex Stdout_Mutex;
+    // Reads with a request id reply from the threads they run on, so replies are written a whole line at a time
+    void writeReply(const std::string& reply) {
+        std::lock_guard<std::mutex> lock(Stdout_Mutex);
+        std::cout << reply << std::endl;
+    }
+
+    // A read that fails is answered with an error rather than left without a reply, and what it threw goes to stderr
+    void writeError(const std::exception& e) {
+        std::lock_guard<std::mutex> lock(Stdout_Mutex);
+        std::cerr << e.what() << std::endl;
+    }
+
+    // a framed command's output is sent as its reply, from the thread running the command
+    thread_local uint64_t Frame_Request_Id = 0;
+    thread_local bool Frame_Replied = false;
+    void writeFrameReply(uint8_t status, std::string_view payload) {
+        std::lock_guard<std::mutex> lock(Stdout_Mutex);
+        framedIpc::writeFrame(std::cout, status, Frame_Request_Id, payload);
+        Frame_Replied = true;
+    }
+    void frameOutputWriter(std::string outputData) {
+        writeFrameReply(framedIpc::STATUS_OK, outputData);
+    }
+
+    struct Options {
+        TagFileMaintainerOptions tagFileMaintainer;
+        // threads to run reads with a request id on, 0 uses one per hardware thread
+        std::size_t readThreads = 0;
+        // commands come as binary frames on stdin rather than op lines naming input files, see framed-ipc.hpp
+        bool framedIpc = false;
+    };
+
+    // Options are passed after the positional arguments as name=value
+    Options parseOptions(int argc, const char** argv, int firstOption) {
+        Options allOptions;
+        auto& options = allOptions.tagFileMaintainer;
+        for (int i = firstOption; i < argc; ++i) {
+            std::string_view option = argv[i];
+            auto separator = option.find('=');
+            if (separator == std::string_view::npos) {
+                throw std::logic_error(std::string("Option ") + std::string(option) + " is not of the form name=value");
+            }
+            auto name = option.substr(0, separator);
+            auto value = std::stoull(std::string(option.substr(separator + 1)));
+            if (options.set(name, value)) {
+                continue;
+            }
+
+            if (name == "read-threads") {
+                allOptions.readThreads = value;
+            } else if (name == "framed-ipc") {
+                allOptions.framedIpc = value != 0;
+            } else {
+                throw std::logic_error(std::string("Unknown option ") + std::string(name));
+            }
+        }
+
+        return allOptions;
+    }
 };
 
 #ifdef TESTING_MODE
@@ -61,101 +119,134 @@ int main(int argc, const char** argv) {
         dataStorageDirectory = argv[5];
     }
 
-    auto tfm = TagFileMaintainer(dataStorageDirectory);
-    std::unordered_set<std::string> WRITE_OPS = {
-        "insert_taggables",
-        "delete_taggables",
-        "insert_tags",
-        "delete_tags",
-        "insert_tag_pairings",
-        "toggle_tag_pairings",
-        "delete_tag_pairings",
-        "flush_files",
-        "purge_unused_files",
-        "begin_transaction",
-        "end_transaction",
-        "exit",
-        "override"
+    auto options = parseOptions(argc, argv, 6);
+    auto tfm = TagFileMaintainer(dataStorageDirectory, options.tagFileMaintainer);
+    auto runCommand = [&tfm](const std::string& op, std::string_view input, void (*writer)(std::string)) {
+        return commands::run(tfm, op, input, writer);
     };
-    std::unordered_set<std::string> READ_OPS = {
-        "read_taggables_tags",
-        "read_taggables_specified_tags",
-        "read_tag_groups_taggable_counts",
-        "search"
+    // declared after tfm so it is destroyed first, answering every read it was given before tfm is
+    auto readExecutor = ReadExecutor(options.readThreads);
+    // Runs command on the read executor when it can run alongside other reads, otherwise on this thread once no read is running
+    auto dispatch = [&tfm, &readExecutor](bool concurrent, const std::string& op, std::function<void()> command) {
+        if (concurrent) {
+            readExecutor.submit(std::move(command));
+            // evicting would wait on the reads, so it is left for a command that finds none running
+            auto contentsLock = readExecutor.tryLockExclusive();
+            if (contentsLock.owns_lock()) {
+                tfm.commitWriteAheadGroup();
+                tfm.evictColdBuckets();
+            }
+            return;
+        }
+
+        if (op == "exit") {
+            readExecutor.drain();
+        }
+        auto contentsLock = readExecutor.lockExclusive();
+        command();
+        // syncing and evicting after the reply keeps them off the command's latency
+        tfm.commitWriteAheadGroup();
+        tfm.evictColdBuckets();
     };
+
+    if (options.framedIpc) {
+        #ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+            _setmode(_fileno(stdout), _O_BINARY);
+        #endif
+
+        const auto& frameOps = framedIpc::ops();
+        framedIpc::Frame frame;
+        while (framedIpc::readFrame(std::cin, frame)) {
+            if (frame.opCode >= frameOps.size()) {
+                Frame_Request_Id = frame.requestId;
+                writeFrameReply(framedIpc::STATUS_BAD_COMMAND, "");
+                continue;
+            }
+
+            const auto& op = frameOps[frame.opCode];
+            // the payload is moved into the command, which hands views of it to the tag file maintainer
+            bool concurrent = commands::isConcurrentRead(op);
+            dispatch(concurrent, op, [&runCommand, &op, concurrent, requestId = frame.requestId, payload = std::move(frame.payload)]() {
+                Frame_Request_Id = requestId;
+                Frame_Replied = false;
+                try {
+                    if (!runCommand(op, payload, frameOutputWriter)) {
+                        writeFrameReply(framedIpc::STATUS_BAD_COMMAND, "");
+                    } else if (!Frame_Replied) {
+                        writeFrameReply(framedIpc::STATUS_OK, "");
+                    }
+                } catch (const std::exception& e) {
+                    // a read has not changed anything, so it is failed on its own rather than taking the process down
+                    if (!concurrent) {
+                        throw;
+                    }
+                    writeError(e);
+                    writeFrameReply(framedIpc::STATUS_BAD_COMMAND, "");
+                }
+            });
+            if (op == "exit") {
+                break;
+            }
+        }
+
+        return 0;
+    }
+
     std::string op;
     while (op != "exit") {
-        bool badCommand = false;
         std::getline(std::cin, op);
 
-        std::string inputFileName = writeInputFileName;
-        if (READ_OPS.contains(op)) {
-            inputFileName = readInputFileName;
-        }
-
-        std::ifstream file(inputFileName, std::ios::in | std::ios::binary);
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        std::string input = buffer.str();
-
-        if (op == "insert_taggables") {
-            tfm.insertTaggables(input);
-        } else if (op == "delete_taggables") {
-            tfm.deleteTaggables(input);
-        } else if (op == "insert_tags") {
-            tfm.insertTags(input);
-        } else if (op == "delete_tags") {
-            tfm.deleteTags(input);
-        } else if (op == "insert_tag_pairings") {
-            tfm.insertPairings(input);
-        } else if (op == "toggle_tag_pairings") {
-            tfm.togglePairings(input);
-        } else if (op == "delete_tag_pairings") {
-            tfm.deletePairings(input);
-        } else if (op == "read_taggables_tags") {
-            tfm.readTaggablesTags(input, readOutputFileWriter);
-        } else if (op == "read_taggables_specified_tags") {
-            tfm.readTaggablesSpecifiedTags(input, readOutputFileWriter);
-        } else if (op == "read_tag_groups_taggable_counts") {
-            tfm.readTagGroupsTaggableCountsWithSearch(input, readOutputFileWriter);
-        } else if (op == "search") {
-            tfm.search(input, readOutputFileWriter);
-        } else if (op == "flush_files") {
-            tfm.flushFiles();
-        } else if (op == "purge_unused_files") {
-            tfm.purgeUnusedFiles();
-        } else if (op == "begin_transaction") {
-            tfm.beginTransaction();
-        } else if (op == "end_transaction") {
-            tfm.endTransaction();
-        } else if (op == "exit") {
-            if (tfm.needsMaintenance()) {
-                std::cout << "DO MAINTENANCE?" << std::endl;
-                std::getline(std::cin, op);
-                if (op == "OK") {
-                    tfm.doMaintenance();
-                }
+        // an op followed by a request id, as in "search 12", reads {read input}.12 and writes {read output}.12,
+        // replying READ_OK! 12 once it has, which may be after commands that came later, or READ_ERROR! 12 if it failed
+        auto requestSeparator = op.find(' ');
+        if (requestSeparator != std::string::npos) {
+            auto requestId = op.substr(requestSeparator + 1);
+            op.resize(requestSeparator);
+            if (!commands::isRead(op)) {
+                writeReply("BAD COMMAND!");
+                continue;
             }
 
-            tfm.close();
-        }
-        #ifdef TESTING_MODE
-        else if (op == "override") {
-            tfm.overrideMode = input;
+            auto input = util::readFile(readInputFileName + "." + requestId);
+            bool concurrent = commands::isConcurrentRead(op);
+            dispatch(concurrent, op, [&runCommand, op, concurrent, requestId, input = std::move(input)]() {
+                Request_Output_File_Name = Read_Output_File_Name + "." + requestId;
+                try {
+                    runCommand(op, input, requestOutputFileWriter);
+                } catch (const std::exception& e) {
+                    if (!concurrent) {
+                        throw;
+                    }
+                    writeError(e);
+                    writeReply("READ_ERROR! " + requestId);
+                    return;
+                }
+                writeReply("READ_OK! " + requestId);
+            });
+            continue;
         }
-        #endif
-        else {
-            std::cout << "BAD COMMAND!" << std::endl;
-            badCommand = true;
+
+        std::string inputFileName = writeInputFileName;
+        if (commands::isRead(op)) {
+            inputFileName = readInputFileName;
         }
 
-        if (!badCommand) {
-            if (inputFileName == writeInputFileName) {
-                std::cout << "WRITE_OK!" << std::endl;
+        // the read input and output files are shared, so commands without a request id run one at a time
+        dispatch(false, op, [&runCommand, &op, &inputFileName, &writeInputFileName]() {
+            std::ifstream file(inputFileName, std::ios::in | std::ios::binary);
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            std::string input = buffer.str();
+
+            if (!runCommand(op, input, readOutputFileWriter)) {
+                writeReply("BAD COMMAND!");
+            } else if (inputFileName == writeInputFileName) {
+                writeReply("WRITE_OK!");
             } else {
-                std::cout << "READ_OK!" << std::endl;
+                writeReply("READ_OK!");
             }
-        }
+        });
     }
     
-}
\ No newline at end of file
+}
@@ -0,0 +1,158 @@
+#include "mapped-file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& mappedFile) {
+    moveFrom(mappedFile);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& mappedFile) {
+    if (this != &mappedFile) {
+        close();
+        moveFrom(mappedFile);
+    }
+
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+void MappedFile::moveFrom(MappedFile& mappedFile) {
+    isOpen_ = mappedFile.isOpen_;
+    data_ = mappedFile.data_;
+    size_ = mappedFile.size_;
+    #ifdef _WIN32
+    fileHandle_ = mappedFile.fileHandle_;
+    mappingHandle_ = mappedFile.mappingHandle_;
+    mappedFile.fileHandle_ = nullptr;
+    mappedFile.mappingHandle_ = nullptr;
+    #endif
+    mappedFile.isOpen_ = false;
+    mappedFile.data_ = nullptr;
+    mappedFile.size_ = 0;
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::filesystem::path& filePath) {
+    close();
+
+    HANDLE fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    isOpen_ = true;
+    size_ = static_cast<std::size_t>(fileSize.QuadPart);
+    if (size_ == 0) {
+        CloseHandle(fileHandle);
+        return true;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        CloseHandle(fileHandle);
+        throw std::logic_error(std::string("Could not create file mapping for ") + filePath.generic_string());
+    }
+    const void* data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        throw std::logic_error(std::string("Could not map view of ") + filePath.generic_string());
+    }
+
+    fileHandle_ = fileHandle;
+    mappingHandle_ = mappingHandle;
+    data_ = static_cast<const char*>(data);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+    if (mappingHandle_ != nullptr) {
+        CloseHandle(mappingHandle_);
+    }
+    if (fileHandle_ != nullptr) {
+        CloseHandle(fileHandle_);
+    }
+    fileHandle_ = nullptr;
+    mappingHandle_ = nullptr;
+    isOpen_ = false;
+    data_ = nullptr;
+    size_ = 0;
+}
+#else
+bool MappedFile::open(const std::filesystem::path& filePath) {
+    close();
+
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    isOpen_ = true;
+    size_ = static_cast<std::size_t>(fileStat.st_size);
+    if (size_ == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        isOpen_ = false;
+        size_ = 0;
+        throw std::logic_error(std::string("Could not memory map ") + filePath.generic_string());
+    }
+
+    data_ = static_cast<const char*>(data);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    isOpen_ = false;
+    data_ = nullptr;
+    size_ = 0;
+}
+#endif
+
+bool MappedFile::isOpen() const {
+    return isOpen_;
+}
+
+std::string_view MappedFile::view() const {
+    if (data_ == nullptr) {
+        return std::string_view();
+    }
+
+    return std::string_view(data_, size_);
+}
\ No newline at end of file
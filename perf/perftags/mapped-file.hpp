@@ -0,0 +1,31 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+// Read-only memory mapping of a whole file, the mapping lives until close() or destruction
+class MappedFile {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile& mappedFile) = delete;
+        MappedFile& operator=(const MappedFile& mappedFile) = delete;
+        MappedFile(MappedFile&& mappedFile);
+        MappedFile& operator=(MappedFile&& mappedFile);
+        ~MappedFile();
+
+        // Returns false if the file could not be opened, an empty file opens successfully with an empty view
+        bool open(const std::filesystem::path& filePath);
+        void close();
+        bool isOpen() const;
+        std::string_view view() const;
+    private:
+        void moveFrom(MappedFile& mappedFile);
+
+        bool isOpen_ = false;
+        const char* data_ = nullptr;
+        std::size_t size_ = 0;
+        #ifdef _WIN32
+        void* fileHandle_ = nullptr;
+        void* mappingHandle_ = nullptr;
+        #endif
+};
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "metric-columns.hpp"
+
+#include <bit>
+#include <stdexcept>
+
+#include "../common/util.hpp"
+
+namespace {
+    // {metric}{taggable}{value} are 8+8+8 bytes
+    const std::size_t METRIC_VALUE_BYTES = 24;
+
+    template <class T>
+    void processMetricValues(std::string_view str, T callback) {
+        if (str.size() % METRIC_VALUE_BYTES != 0) {
+            throw std::logic_error(std::string("Metric values are malformed, not an even interval of ") + std::to_string(METRIC_VALUE_BYTES));
+        }
+
+        std::size_t inputOffset = 0;
+        while (inputOffset < str.size()) {
+            MetricValue item;
+            item.metric = util::deserializeUInt64(str, inputOffset);
+            item.taggable = util::deserializeUInt64(str, inputOffset);
+            item.value = util::deserializeDouble(str, inputOffset);
+            callback(item);
+        }
+    }
+
+    std::size_t serializeMetricValue(const MetricValue& item, std::string& str, std::size_t location) {
+        location = util::serializeUInt64(item.metric, str, location);
+        location = util::serializeUInt64(item.taggable, str, location);
+        return util::serializeDouble(item.value, str, location);
+    }
+}
+
+std::size_t MetricValueHash::operator()(const MetricValue& item) const {
+    auto hash = std::hash<uint64_t>()(item.metric);
+    hash ^= std::hash<uint64_t>()(item.taggable) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<uint64_t>()(std::bit_cast<uint64_t>(item.value)) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+// Serialized as {metric}{taggable}{value} for each value, by metric and then by ascending value
+std::string MetricColumns::serialize() const {
+    std::string valuesStr;
+    valuesStr.resize(METRIC_VALUE_BYTES * size_);
+    std::size_t location = 0;
+    for (const auto& [metric, column] : columns_) {
+        for (const auto& [value, taggable] : column) {
+            location = serializeMetricValue(MetricValue{metric, taggable, value}, valuesStr, location);
+        }
+    }
+
+    return valuesStr;
+}
+
+MetricColumns MetricColumns::deserialize(std::string_view str) {
+    MetricColumns columns;
+    processMetricValues(str, [&columns](const MetricValue& item) {
+        columns.insert(item);
+    });
+
+    return columns;
+}
+
+std::string MetricColumns::serializeDiff(const MetricDiffContainer& diffContents) {
+    std::string valuesStr;
+    valuesStr.resize(METRIC_VALUE_BYTES * diffContents.size());
+    std::size_t location = 0;
+    for (const auto& item : diffContents) {
+        location = serializeMetricValue(item, valuesStr, location);
+    }
+
+    return valuesStr;
+}
+
+MetricDiffContainer MetricColumns::deserializeDiff(std::string_view str) {
+    MetricDiffContainer diffContents;
+    processMetricValues(str, [&diffContents](const MetricValue& item) {
+        diffContents.insert(item);
+    });
+
+    return diffContents;
+}
+
+MetricInsertReturnType MetricColumns::insert(MetricValue item) {
+    if (!columns_[item.metric].insert({item.value, item.taggable}).second) {
+        return {false};
+    }
+
+    taggableValues_.emplace(item.taggable, std::pair<uint64_t, double>(item.metric, item.value));
+    ++size_;
+    return {true};
+}
+
+std::size_t MetricColumns::erase(MetricValue item) {
+    auto columnIt = columns_.find(item.metric);
+    if (columnIt == columns_.end() || columnIt->second.erase({item.value, item.taggable}) == 0) {
+        return 0;
+    }
+    if (columnIt->second.empty()) {
+        columns_.erase(columnIt);
+    }
+
+    auto [begin, end] = taggableValues_.equal_range(item.taggable);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second.first == item.metric && it->second.second == item.value) {
+            taggableValues_.erase(it);
+            break;
+        }
+    }
+    --size_;
+    return 1;
+}
+
+bool MetricColumns::contains(MetricValue item) const {
+    auto columnIt = columns_.find(item.metric);
+    return columnIt != columns_.end() && columnIt->second.contains({item.value, item.taggable});
+}
+
+std::vector<MetricValue> MetricColumns::taggableValues(uint64_t taggable) const {
+    std::vector<MetricValue> values;
+    auto [begin, end] = taggableValues_.equal_range(taggable);
+    for (auto it = begin; it != end; ++it) {
+        values.push_back(MetricValue{it->second.first, taggable, it->second.second});
+    }
+
+    return values;
+}
+
+std::optional<double> MetricColumns::value(uint64_t metric, uint64_t taggable) const {
+    auto [begin, end] = taggableValues_.equal_range(taggable);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second.first == metric) {
+            return it->second.second;
+        }
+    }
+
+    return std::nullopt;
+}
+
+const MetricColumns::Column* MetricColumns::column(uint64_t metric) const {
+    auto columnIt = columns_.find(metric);
+    if (columnIt == columns_.end()) {
+        return nullptr;
+    }
+
+    return &columnIt->second;
+}
+
+RoaringBitmap MetricColumns::range(uint64_t metric, double lowest, double highest) const {
+    const auto* metricColumn = column(metric);
+    if (metricColumn == nullptr || !(lowest <= highest)) {
+        return RoaringBitmap();
+    }
+
+    // pairing highest with the largest id sorts it after every taggable with a value of highest
+    std::vector<uint64_t> taggables;
+    auto end = metricColumn->upper_bound({highest, UINT64_MAX});
+    for (auto it = metricColumn->lower_bound({lowest, 0}); it != end; ++it) {
+        taggables.push_back(it->second);
+    }
+
+    return RoaringBitmap::fromValues(std::move(taggables));
+}
+
+std::size_t MetricColumns::size() const {
+    return size_;
+}
+
+std::size_t MetricColumns::estimatedBytes() const {
+    // a red black tree node holds three pointers and a color beside its value, a hash node holds a pointer and the hash
+    const std::size_t TREE_NODE_BYTES = sizeof(Column::value_type) + (4 * sizeof(void*));
+    const std::size_t HASH_NODE_BYTES = sizeof(decltype(taggableValues_)::value_type) + (2 * sizeof(void*));
+    return size_ * (TREE_NODE_BYTES + HASH_NODE_BYTES);
+}
+
+void MetricColumns::clear() {
+    columns_.clear();
+    taggableValues_.clear();
+    size_ = 0;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "roaring-bitmap.hpp"
+
+// A taggable's value for a metric, where the metric is an id of the caller's choosing and the taggable is an internal id
+struct MetricValue {
+    uint64_t metric;
+    uint64_t taggable;
+    double value;
+
+    bool operator==(const MetricValue& other) const = default;
+};
+
+struct MetricValueHash {
+    std::size_t operator()(const MetricValue& item) const;
+};
+
+using MetricDiffContainer = std::unordered_set<MetricValue, MetricValueHash>;
+
+struct MetricInsertReturnType {
+    bool second;
+};
+
+// Every metric's values kept sorted by value, so the taggables with a value in a range are found without looking at the rest
+// Holds a set of values like any bucket's contents, a taggable is only given a single value of a metric by whoever inserts them
+class MetricColumns {
+    public:
+        using value_type = MetricValue;
+        // {value, taggable} in ascending order of value
+        using Column = std::set<std::pair<double, uint64_t>>;
+
+        std::string serialize() const;
+        static MetricColumns deserialize(std::string_view str);
+        static std::string serializeDiff(const MetricDiffContainer& diffContents);
+        static MetricDiffContainer deserializeDiff(std::string_view str);
+
+        MetricInsertReturnType insert(MetricValue item);
+        std::size_t erase(MetricValue item);
+        bool contains(MetricValue item) const;
+        // The values of every metric taggable has a value of
+        std::vector<MetricValue> taggableValues(uint64_t taggable) const;
+        // taggable's value of metric, nothing when it has none
+        std::optional<double> value(uint64_t metric, uint64_t taggable) const;
+        // metric's values, nullptr when the metric has none
+        const Column* column(uint64_t metric) const;
+        // The taggables with a value of metric from lowest to highest, both included
+        RoaringBitmap range(uint64_t metric, double lowest, double highest) const;
+        std::size_t size() const;
+        // An estimate of the bytes held in memory, counting a tree node and a hash node for each value
+        std::size_t estimatedBytes() const;
+        void clear();
+    private:
+        std::unordered_map<uint64_t, Column> columns_;
+        // taggable to {metric, value}, so a taggable's values can be found without looking through every column
+        std::unordered_multimap<uint64_t, std::pair<uint64_t, double>> taggableValues_;
+        std::size_t size_ = 0;
+};
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs body for every index below count on up to threadCount threads, rethrowing the first exception a body threw
+inline void parallelFor(std::size_t count, std::size_t threadCount, const std::function<void(std::size_t)>& body) {
+    if (threadCount == 0) {
+        threadCount = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    threadCount = std::min(threadCount, count);
+
+    std::atomic<std::size_t> nextIndex = 0;
+    std::exception_ptr error;
+    std::atomic<bool> failed = false;
+    auto worker = [&]() {
+        for (auto i = nextIndex++; i < count && !failed; i = nextIndex++) {
+            try {
+                body(i);
+            } catch (...) {
+                if (!failed.exchange(true)) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
\ No newline at end of file
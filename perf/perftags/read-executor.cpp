@@ -0,0 +1,81 @@
+#include "read-executor.hpp"
+
+#include <algorithm>
+
+ReadExecutor::ReadExecutor(std::size_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        threads_.emplace_back([this]() {
+            run();
+        });
+    }
+}
+
+ReadExecutor::~ReadExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping_ = true;
+    }
+    queueChanged_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ReadExecutor::submit(std::function<void()> read) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        queue_.push_back(std::move(read));
+    }
+    queueChanged_.notify_one();
+}
+
+std::unique_lock<std::shared_mutex> ReadExecutor::lockExclusive() {
+    return std::unique_lock<std::shared_mutex>(contentsMutex_);
+}
+
+std::unique_lock<std::shared_mutex> ReadExecutor::tryLockExclusive() {
+    return std::unique_lock<std::shared_mutex>(contentsMutex_, std::try_to_lock);
+}
+
+void ReadExecutor::drain() {
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    queueChanged_.wait(lock, [this]() {
+        return queue_.empty() && runningReads_ == 0;
+    });
+}
+
+void ReadExecutor::run() {
+    while (true) {
+        std::function<void()> read;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueChanged_.wait(lock, [this]() {
+                return stopping_ || !queue_.empty();
+            });
+            // queued reads still run when stopping, so every submitted read is answered
+            if (queue_.empty()) {
+                return;
+            }
+
+            read = std::move(queue_.front());
+            queue_.pop_front();
+            ++runningReads_;
+        }
+
+        {
+            std::shared_lock<std::shared_mutex> contentsLock(contentsMutex_);
+            read();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            --runningReads_;
+        }
+        // drain waits on the same condition as the threads
+        queueChanged_.notify_all();
+    }
+}
\ No newline at end of file
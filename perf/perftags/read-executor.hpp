@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+// Runs reads on a pool of threads, where reads run alongside each other but never alongside a write
+class ReadExecutor {
+    public:
+        // 0 threads uses one per hardware thread
+        ReadExecutor(std::size_t threadCount);
+        ReadExecutor(const ReadExecutor& readExecutor) = delete;
+        ReadExecutor& operator=(const ReadExecutor& readExecutor) = delete;
+        ~ReadExecutor();
+
+        // read answers its own errors, anything it lets escape ends the process from the thread it ran on
+        void submit(std::function<void()> read);
+        // Waits for the running reads to finish and holds off any others until the lock is released
+        std::unique_lock<std::shared_mutex> lockExclusive();
+        // Like lockExclusive, but returns a lock that is not held rather than waiting when a read is running
+        std::unique_lock<std::shared_mutex> tryLockExclusive();
+        // Waits for every submitted read to finish
+        void drain();
+    private:
+        void run();
+
+        std::shared_mutex contentsMutex_;
+        std::mutex queueMutex_;
+        std::condition_variable queueChanged_;
+        std::deque<std::function<void()>> queue_;
+        std::size_t runningReads_ = 0;
+        bool stopping_ = false;
+        std::vector<std::thread> threads_;
+};
\ No newline at end of file
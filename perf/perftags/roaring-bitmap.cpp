@@ -0,0 +1,1156 @@
+#include "roaring-bitmap.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+    // below this ratio of sizes merging two arrays is slower than binary searching the larger array for each element of the smaller one
+    const std::size_t GALLOP_RATIO = 64;
+
+    bool bitmapContains(const std::vector<uint64_t>& bitmap, uint16_t low) {
+        return (bitmap[low >> 6] >> (low & 63)) & 1;
+    }
+
+    void bitmapSet(std::vector<uint64_t>& bitmap, uint16_t low) {
+        bitmap[low >> 6] |= 1ULL << (low & 63);
+    }
+
+    void bitmapClear(std::vector<uint64_t>& bitmap, uint16_t low) {
+        bitmap[low >> 6] &= ~(1ULL << (low & 63));
+    }
+
+    void bitmapFlip(std::vector<uint64_t>& bitmap, uint16_t low) {
+        bitmap[low >> 6] ^= 1ULL << (low & 63);
+    }
+
+    // Finds the first element of array at or after position that is not below low, probing 1, 2, 4... elements ahead before binary searching
+    std::size_t gallop(const std::vector<uint16_t>& array, std::size_t position, uint16_t low) {
+        std::size_t step = 1;
+        auto end = position;
+        while (end < array.size() && array[end] < low) {
+            position = end + 1;
+            end += step;
+            step <<= 1;
+        }
+
+        return std::lower_bound(array.begin() + position, array.begin() + std::min(end, array.size()), low) - array.begin();
+    }
+
+    // Writes the elements of smallerArray that are in largerArray to output, when it is not nullptr, and returns how many there were
+    std::size_t gallopingIntersect(const std::vector<uint16_t>& smallerArray, const std::vector<uint16_t>& largerArray, uint16_t* output) {
+        std::size_t count = 0;
+        std::size_t largerPosition = 0;
+        for (auto low : smallerArray) {
+            largerPosition = gallop(largerArray, largerPosition, low);
+            if (largerPosition == largerArray.size()) {
+                break;
+            }
+            if (largerArray[largerPosition] == low) {
+                if (output != nullptr) {
+                    output[count] = low;
+                }
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+    // Intersects sorted arrays from lhsPosition and rhsPosition on, writing to output from count on the same way gallopingIntersect does
+    std::size_t scalarIntersect(const uint16_t* lhs, std::size_t lhsSize, std::size_t lhsPosition, const uint16_t* rhs, std::size_t rhsSize, std::size_t rhsPosition, uint16_t* output, std::size_t count) {
+        while (lhsPosition < lhsSize && rhsPosition < rhsSize) {
+            if (lhs[lhsPosition] < rhs[rhsPosition]) {
+                ++lhsPosition;
+            } else if (rhs[rhsPosition] < lhs[lhsPosition]) {
+                ++rhsPosition;
+            } else {
+                if (output != nullptr) {
+                    output[count] = lhs[lhsPosition];
+                }
+                ++count;
+                ++lhsPosition;
+                ++rhsPosition;
+            }
+        }
+
+        return count;
+    }
+
+    #if defined(__x86_64__) || defined(__i386__)
+    // Every element of a block of lhs is compared against every element of a block of rhs at once, then the block with the smaller last element
+    // moves on, as nothing after it in the other array can match it
+    // the elements of lhs that matched are found from the mask of the comparisons, two bits per element
+    std::size_t emitMatches(const uint16_t* lhsBlock, uint32_t mask, uint16_t* output, std::size_t count) {
+        if (output == nullptr) {
+            return count + std::popcount(mask) / 2;
+        }
+        while (mask != 0) {
+            auto bit = std::countr_zero(mask);
+            output[count++] = lhsBlock[bit / 2];
+            mask &= ~(3u << bit);
+        }
+
+        return count;
+    }
+
+    // SSE2 is part of every x86-64 processor, so this is the kernel when AVX2 is missing
+    __attribute__((target("sse2")))
+    std::size_t sse2Intersect(const uint16_t* lhs, std::size_t lhsSize, const uint16_t* rhs, std::size_t rhsSize, uint16_t* output) {
+        const std::size_t BLOCK_SIZE = 8;
+        std::size_t count = 0;
+        std::size_t lhsPosition = 0;
+        std::size_t rhsPosition = 0;
+        while (lhsPosition + BLOCK_SIZE <= lhsSize && rhsPosition + BLOCK_SIZE <= rhsSize) {
+            auto lhsBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + lhsPosition));
+            auto matches = _mm_setzero_si128();
+            for (std::size_t i = 0; i < BLOCK_SIZE; ++i) {
+                matches = _mm_or_si128(matches, _mm_cmpeq_epi16(lhsBlock, _mm_set1_epi16(static_cast<short>(rhs[rhsPosition + i]))));
+            }
+            count = emitMatches(lhs + lhsPosition, static_cast<uint32_t>(_mm_movemask_epi8(matches)), output, count);
+
+            auto lhsLast = lhs[lhsPosition + BLOCK_SIZE - 1];
+            auto rhsLast = rhs[rhsPosition + BLOCK_SIZE - 1];
+            lhsPosition += lhsLast <= rhsLast ? BLOCK_SIZE : 0;
+            rhsPosition += rhsLast <= lhsLast ? BLOCK_SIZE : 0;
+        }
+
+        return scalarIntersect(lhs, lhsSize, lhsPosition, rhs, rhsSize, rhsPosition, output, count);
+    }
+
+    __attribute__((target("avx2")))
+    std::size_t avx2Intersect(const uint16_t* lhs, std::size_t lhsSize, const uint16_t* rhs, std::size_t rhsSize, uint16_t* output) {
+        const std::size_t BLOCK_SIZE = 16;
+        std::size_t count = 0;
+        std::size_t lhsPosition = 0;
+        std::size_t rhsPosition = 0;
+        while (lhsPosition + BLOCK_SIZE <= lhsSize && rhsPosition + BLOCK_SIZE <= rhsSize) {
+            auto lhsBlock = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + lhsPosition));
+            auto matches = _mm256_setzero_si256();
+            for (std::size_t i = 0; i < BLOCK_SIZE; ++i) {
+                matches = _mm256_or_si256(matches, _mm256_cmpeq_epi16(lhsBlock, _mm256_set1_epi16(static_cast<short>(rhs[rhsPosition + i]))));
+            }
+            count = emitMatches(lhs + lhsPosition, static_cast<uint32_t>(_mm256_movemask_epi8(matches)), output, count);
+
+            auto lhsLast = lhs[lhsPosition + BLOCK_SIZE - 1];
+            auto rhsLast = rhs[rhsPosition + BLOCK_SIZE - 1];
+            lhsPosition += lhsLast <= rhsLast ? BLOCK_SIZE : 0;
+            rhsPosition += rhsLast <= lhsLast ? BLOCK_SIZE : 0;
+        }
+
+        return scalarIntersect(lhs, lhsSize, lhsPosition, rhs, rhsSize, rhsPosition, output, count);
+    }
+    #endif
+
+    std::size_t portableIntersect(const uint16_t* lhs, std::size_t lhsSize, const uint16_t* rhs, std::size_t rhsSize, uint16_t* output) {
+        return scalarIntersect(lhs, lhsSize, 0, rhs, rhsSize, 0, output, 0);
+    }
+
+    using IntersectKernel = std::size_t (*)(const uint16_t* lhs, std::size_t lhsSize, const uint16_t* rhs, std::size_t rhsSize, uint16_t* output);
+
+    // The widest kernel the processor running perftags supports, chosen the first time arrays are intersected
+    IntersectKernel intersectKernel() {
+        static const IntersectKernel KERNEL = []() -> IntersectKernel {
+            #if defined(__x86_64__) || defined(__i386__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return avx2Intersect;
+            }
+            if (__builtin_cpu_supports("sse2")) {
+                return sse2Intersect;
+            }
+            #endif
+            return portableIntersect;
+        }();
+        return KERNEL;
+    }
+
+    // Writes the elements in both arrays to output, when it is not nullptr, and returns how many there were
+    std::size_t arrayIntersect(const std::vector<uint16_t>& lhs, const std::vector<uint16_t>& rhs, uint16_t* output) {
+        const auto& smallerArray = lhs.size() <= rhs.size() ? lhs : rhs;
+        const auto& largerArray = lhs.size() <= rhs.size() ? rhs : lhs;
+        if (smallerArray.size() * GALLOP_RATIO < largerArray.size()) {
+            return gallopingIntersect(smallerArray, largerArray, output);
+        }
+
+        return intersectKernel()(lhs.data(), lhs.size(), rhs.data(), rhs.size(), output);
+    }
+}
+
+RoaringContainer RoaringContainer::fromSorted(const uint16_t* values, std::size_t count) {
+    return fromArray(std::vector<uint16_t>(values, values + count));
+}
+
+RoaringContainer RoaringContainer::fromArray(std::vector<uint16_t> array) {
+    RoaringContainer container;
+    container.cardinality_ = static_cast<uint32_t>(array.size());
+    container.array_ = std::move(array);
+    if (container.cardinality_ > ARRAY_MAX_SIZE) {
+        container.toBitmap();
+    }
+
+    return container;
+}
+
+RoaringContainer RoaringContainer::fromBitmap(std::vector<uint64_t> bitmap) {
+    RoaringContainer container;
+    container.type_ = Type::BITMAP;
+    container.bitmap_ = std::move(bitmap);
+    for (auto word : container.bitmap_) {
+        container.cardinality_ += std::popcount(word);
+    }
+    if (container.cardinality_ <= ARRAY_MAX_SIZE) {
+        container.toArray();
+    }
+
+    return container;
+}
+
+RoaringContainer::Type RoaringContainer::type() const {
+    return type_;
+}
+
+std::size_t RoaringContainer::size() const {
+    return cardinality_;
+}
+
+bool RoaringContainer::empty() const {
+    return cardinality_ == 0;
+}
+
+bool RoaringContainer::contains(uint16_t low) const {
+    if (type_ == Type::ARRAY) {
+        return std::binary_search(array_.begin(), array_.end(), low);
+    } else if (type_ == Type::BITMAP) {
+        return bitmapContains(bitmap_, low);
+    } else {
+        auto it = std::upper_bound(runs_.begin(), runs_.end(), low, [](uint16_t value, const Run& run) {
+            return value < run.start;
+        });
+        if (it == runs_.begin()) {
+            return false;
+        }
+        --it;
+        return low - it->start <= it->length;
+    }
+}
+
+uint16_t RoaringContainer::select(std::size_t rank) const {
+    if (rank >= cardinality_) {
+        throw std::logic_error(std::string("Cannot select rank ") + std::to_string(rank) + " of a container of " + std::to_string(cardinality_) + " values");
+    }
+
+    if (type_ == Type::ARRAY) {
+        return array_[rank];
+    } else if (type_ == Type::BITMAP) {
+        for (std::size_t i = 0;; ++i) {
+            uint64_t word = bitmap_[i];
+            auto wordCount = static_cast<std::size_t>(std::popcount(word));
+            if (rank >= wordCount) {
+                rank -= wordCount;
+                continue;
+            }
+
+            for (; rank != 0; --rank) {
+                word &= word - 1;
+            }
+            return static_cast<uint16_t>((i << 6) | static_cast<std::size_t>(std::countr_zero(word)));
+        }
+    } else {
+        for (const auto& run : runs_) {
+            if (rank <= run.length) {
+                return static_cast<uint16_t>(run.start + rank);
+            }
+            rank -= static_cast<std::size_t>(run.length) + 1;
+        }
+        // cardinality_ counts every run, so a rank below it is always found
+        return 0;
+    }
+}
+
+bool RoaringContainer::insert(uint16_t low) {
+    if (type_ == Type::RUN) {
+        if (contains(low)) {
+            return false;
+        }
+        toSmallestNonRun();
+    }
+
+    if (type_ == Type::ARRAY) {
+        auto it = std::lower_bound(array_.begin(), array_.end(), low);
+        if (it != array_.end() && *it == low) {
+            return false;
+        }
+        if (cardinality_ == ARRAY_MAX_SIZE) {
+            toBitmap();
+            bitmapSet(bitmap_, low);
+        } else {
+            array_.insert(it, low);
+        }
+    } else {
+        if (bitmapContains(bitmap_, low)) {
+            return false;
+        }
+        bitmapSet(bitmap_, low);
+    }
+
+    ++cardinality_;
+    return true;
+}
+
+bool RoaringContainer::erase(uint16_t low) {
+    if (type_ == Type::RUN) {
+        if (!contains(low)) {
+            return false;
+        }
+        toSmallestNonRun();
+    }
+
+    if (type_ == Type::ARRAY) {
+        auto it = std::lower_bound(array_.begin(), array_.end(), low);
+        if (it == array_.end() || *it != low) {
+            return false;
+        }
+        array_.erase(it);
+        --cardinality_;
+    } else {
+        if (!bitmapContains(bitmap_, low)) {
+            return false;
+        }
+        bitmapClear(bitmap_, low);
+        --cardinality_;
+        if (cardinality_ <= ARRAY_MAX_SIZE) {
+            toArray();
+        }
+    }
+
+    return true;
+}
+
+std::size_t RoaringContainer::runCount() const {
+    if (type_ == Type::RUN) {
+        return runs_.size();
+    } else if (type_ == Type::ARRAY) {
+        std::size_t runs = 0;
+        for (std::size_t i = 0; i < array_.size(); ++i) {
+            if (i == 0 || array_[i - 1] + 1 != array_[i]) {
+                ++runs;
+            }
+        }
+        return runs;
+    } else {
+        std::size_t runs = 0;
+        uint64_t carry = 0;
+        for (auto word : bitmap_) {
+            // a run starts wherever a set bit does not have a set bit directly below it
+            runs += std::popcount(word & ~((word << 1) | carry));
+            carry = word >> 63;
+        }
+        return runs;
+    }
+}
+
+void RoaringContainer::runOptimize() {
+    if (cardinality_ == 0) {
+        return;
+    }
+
+    std::size_t runBytes = runCount() * sizeof(Run);
+    std::size_t nonRunBytes = cardinality_ <= ARRAY_MAX_SIZE ? cardinality_ * sizeof(uint16_t) : BITMAP_WORD_COUNT * sizeof(uint64_t);
+    if (runBytes >= nonRunBytes) {
+        if (type_ == Type::RUN) {
+            toSmallestNonRun();
+        }
+        return;
+    }
+    if (type_ == Type::RUN) {
+        return;
+    }
+
+    std::vector<Run> runs;
+    runs.reserve(runBytes / sizeof(Run));
+    forEach(0, [&runs](uint64_t value) {
+        auto low = static_cast<uint16_t>(value);
+        if (!runs.empty() && static_cast<uint32_t>(runs.back().start) + runs.back().length + 1 == low) {
+            ++runs.back().length;
+        } else {
+            runs.push_back(Run {.start = low, .length = 0});
+        }
+    });
+
+    runs_ = std::move(runs);
+    array_ = std::vector<uint16_t>();
+    bitmap_ = std::vector<uint64_t>();
+    type_ = Type::RUN;
+}
+
+std::size_t RoaringContainer::physicalBytes() const {
+    return sizeof(RoaringContainer)
+         + (array_.capacity() * sizeof(uint16_t))
+         + (bitmap_.capacity() * sizeof(uint64_t))
+         + (runs_.capacity() * sizeof(Run));
+}
+
+bool RoaringContainer::operator==(const RoaringContainer& other) const {
+    if (cardinality_ != other.cardinality_) {
+        return false;
+    }
+    if (type_ == other.type_ && type_ == Type::ARRAY) {
+        return array_ == other.array_;
+    }
+
+    return intersectSize(*this, other) == cardinality_;
+}
+
+void RoaringContainer::toArray() {
+    std::vector<uint16_t> array;
+    array.reserve(cardinality_);
+    forEach(0, [&array](uint64_t value) {
+        array.push_back(static_cast<uint16_t>(value));
+    });
+
+    array_ = std::move(array);
+    bitmap_ = std::vector<uint64_t>();
+    runs_ = std::vector<Run>();
+    type_ = Type::ARRAY;
+}
+
+void RoaringContainer::toBitmap() {
+    std::vector<uint64_t> bitmap(BITMAP_WORD_COUNT, 0);
+    forEach(0, [&bitmap](uint64_t value) {
+        bitmapSet(bitmap, static_cast<uint16_t>(value));
+    });
+
+    bitmap_ = std::move(bitmap);
+    array_ = std::vector<uint16_t>();
+    runs_ = std::vector<Run>();
+    type_ = Type::BITMAP;
+}
+
+void RoaringContainer::toSmallestNonRun() {
+    if (cardinality_ <= ARRAY_MAX_SIZE) {
+        toArray();
+    } else {
+        toBitmap();
+    }
+}
+
+RoaringContainer RoaringContainer::materialized(const RoaringContainer& container) {
+    RoaringContainer copy = container;
+    copy.toSmallestNonRun();
+    return copy;
+}
+
+bool RoaringContainer::valueAt(uint32_t& position, uint32_t& subPosition, uint16_t& value) const {
+    if (type_ == Type::ARRAY) {
+        if (position >= array_.size()) {
+            return false;
+        }
+        value = array_[position];
+        return true;
+    } else if (type_ == Type::BITMAP) {
+        std::size_t wordIndex = position >> 6;
+        if (wordIndex >= BITMAP_WORD_COUNT) {
+            return false;
+        }
+        uint64_t word = bitmap_[wordIndex] & (~0ULL << (position & 63));
+        while (word == 0) {
+            ++wordIndex;
+            if (wordIndex >= BITMAP_WORD_COUNT) {
+                position = BITMAP_WORD_COUNT << 6;
+                return false;
+            }
+            word = bitmap_[wordIndex];
+        }
+        position = static_cast<uint32_t>((wordIndex << 6) | std::countr_zero(word));
+        value = static_cast<uint16_t>(position);
+        return true;
+    } else {
+        while (position < runs_.size() && subPosition > runs_[position].length) {
+            ++position;
+            subPosition = 0;
+        }
+        if (position >= runs_.size()) {
+            return false;
+        }
+        value = static_cast<uint16_t>(runs_[position].start + subPosition);
+        return true;
+    }
+}
+
+void RoaringContainer::advance(uint32_t& position, uint32_t& subPosition) const {
+    if (type_ == Type::RUN) {
+        ++subPosition;
+    } else {
+        ++position;
+    }
+}
+
+RoaringContainer RoaringContainer::intersect(const RoaringContainer& lhs, const RoaringContainer& rhs) {
+    if (lhs.type_ == Type::RUN) {
+        return intersect(materialized(lhs), rhs);
+    }
+    if (rhs.type_ == Type::RUN) {
+        return intersect(lhs, materialized(rhs));
+    }
+
+    if (lhs.type_ == Type::ARRAY && rhs.type_ == Type::ARRAY) {
+        std::vector<uint16_t> result(std::min(lhs.array_.size(), rhs.array_.size()));
+        result.resize(arrayIntersect(lhs.array_, rhs.array_, result.data()));
+        return fromArray(std::move(result));
+    } else if (lhs.type_ == Type::BITMAP && rhs.type_ == Type::BITMAP) {
+        std::vector<uint64_t> result(BITMAP_WORD_COUNT);
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            result[i] = lhs.bitmap_[i] & rhs.bitmap_[i];
+        }
+        return fromBitmap(std::move(result));
+    } else {
+        const auto& arrayContainer = lhs.type_ == Type::ARRAY ? lhs : rhs;
+        const auto& bitmapContainer = lhs.type_ == Type::ARRAY ? rhs : lhs;
+        std::vector<uint16_t> result;
+        result.reserve(arrayContainer.cardinality_);
+        for (auto low : arrayContainer.array_) {
+            if (bitmapContains(bitmapContainer.bitmap_, low)) {
+                result.push_back(low);
+            }
+        }
+        return fromArray(std::move(result));
+    }
+}
+
+RoaringContainer RoaringContainer::setUnion(const RoaringContainer& lhs, const RoaringContainer& rhs) {
+    if (lhs.type_ == Type::RUN) {
+        return setUnion(materialized(lhs), rhs);
+    }
+    if (rhs.type_ == Type::RUN) {
+        return setUnion(lhs, materialized(rhs));
+    }
+
+    if (lhs.type_ == Type::ARRAY && rhs.type_ == Type::ARRAY) {
+        std::vector<uint16_t> result;
+        result.reserve(lhs.cardinality_ + rhs.cardinality_);
+        std::set_union(lhs.array_.begin(), lhs.array_.end(), rhs.array_.begin(), rhs.array_.end(), std::back_inserter(result));
+        return fromArray(std::move(result));
+    } else if (lhs.type_ == Type::BITMAP && rhs.type_ == Type::BITMAP) {
+        std::vector<uint64_t> result(BITMAP_WORD_COUNT);
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            result[i] = lhs.bitmap_[i] | rhs.bitmap_[i];
+        }
+        return fromBitmap(std::move(result));
+    } else {
+        const auto& arrayContainer = lhs.type_ == Type::ARRAY ? lhs : rhs;
+        const auto& bitmapContainer = lhs.type_ == Type::ARRAY ? rhs : lhs;
+        std::vector<uint64_t> result = bitmapContainer.bitmap_;
+        for (auto low : arrayContainer.array_) {
+            bitmapSet(result, low);
+        }
+        return fromBitmap(std::move(result));
+    }
+}
+
+RoaringContainer RoaringContainer::difference(const RoaringContainer& lhs, const RoaringContainer& rhs) {
+    if (lhs.type_ == Type::RUN) {
+        return difference(materialized(lhs), rhs);
+    }
+    if (rhs.type_ == Type::RUN) {
+        return difference(lhs, materialized(rhs));
+    }
+
+    if (lhs.type_ == Type::ARRAY && rhs.type_ == Type::ARRAY) {
+        std::vector<uint16_t> result;
+        result.reserve(lhs.cardinality_);
+        std::set_difference(lhs.array_.begin(), lhs.array_.end(), rhs.array_.begin(), rhs.array_.end(), std::back_inserter(result));
+        return fromArray(std::move(result));
+    } else if (lhs.type_ == Type::BITMAP && rhs.type_ == Type::BITMAP) {
+        std::vector<uint64_t> result(BITMAP_WORD_COUNT);
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            result[i] = lhs.bitmap_[i] & ~rhs.bitmap_[i];
+        }
+        return fromBitmap(std::move(result));
+    } else if (lhs.type_ == Type::ARRAY) {
+        std::vector<uint16_t> result;
+        result.reserve(lhs.cardinality_);
+        for (auto low : lhs.array_) {
+            if (!bitmapContains(rhs.bitmap_, low)) {
+                result.push_back(low);
+            }
+        }
+        return fromArray(std::move(result));
+    } else {
+        std::vector<uint64_t> result = lhs.bitmap_;
+        for (auto low : rhs.array_) {
+            bitmapClear(result, low);
+        }
+        return fromBitmap(std::move(result));
+    }
+}
+
+RoaringContainer RoaringContainer::symmetricDifference(const RoaringContainer& lhs, const RoaringContainer& rhs) {
+    if (lhs.type_ == Type::RUN) {
+        return symmetricDifference(materialized(lhs), rhs);
+    }
+    if (rhs.type_ == Type::RUN) {
+        return symmetricDifference(lhs, materialized(rhs));
+    }
+
+    if (lhs.type_ == Type::ARRAY && rhs.type_ == Type::ARRAY) {
+        std::vector<uint16_t> result;
+        result.reserve(lhs.cardinality_ + rhs.cardinality_);
+        std::set_symmetric_difference(lhs.array_.begin(), lhs.array_.end(), rhs.array_.begin(), rhs.array_.end(), std::back_inserter(result));
+        return fromArray(std::move(result));
+    } else if (lhs.type_ == Type::BITMAP && rhs.type_ == Type::BITMAP) {
+        std::vector<uint64_t> result(BITMAP_WORD_COUNT);
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            result[i] = lhs.bitmap_[i] ^ rhs.bitmap_[i];
+        }
+        return fromBitmap(std::move(result));
+    } else {
+        const auto& arrayContainer = lhs.type_ == Type::ARRAY ? lhs : rhs;
+        const auto& bitmapContainer = lhs.type_ == Type::ARRAY ? rhs : lhs;
+        std::vector<uint64_t> result = bitmapContainer.bitmap_;
+        for (auto low : arrayContainer.array_) {
+            bitmapFlip(result, low);
+        }
+        return fromBitmap(std::move(result));
+    }
+}
+
+std::size_t RoaringContainer::intersectSize(const RoaringContainer& lhs, const RoaringContainer& rhs) {
+    if (lhs.type_ == Type::RUN) {
+        return intersectSize(materialized(lhs), rhs);
+    }
+    if (rhs.type_ == Type::RUN) {
+        return intersectSize(lhs, materialized(rhs));
+    }
+
+    std::size_t count = 0;
+    if (lhs.type_ == Type::ARRAY && rhs.type_ == Type::ARRAY) {
+        count = arrayIntersect(lhs.array_, rhs.array_, nullptr);
+    } else if (lhs.type_ == Type::BITMAP && rhs.type_ == Type::BITMAP) {
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            count += std::popcount(lhs.bitmap_[i] & rhs.bitmap_[i]);
+        }
+    } else {
+        const auto& arrayContainer = lhs.type_ == Type::ARRAY ? lhs : rhs;
+        const auto& bitmapContainer = lhs.type_ == Type::ARRAY ? rhs : lhs;
+        for (auto low : arrayContainer.array_) {
+            count += bitmapContains(bitmapContainer.bitmap_, low);
+        }
+    }
+
+    return count;
+}
+
+// ORs every container into a single bitmap, which is turned back into an array when it holds few enough values
+RoaringContainer RoaringContainer::setUnionAll(const std::vector<const RoaringContainer*>& containers) {
+    if (containers.size() == 1) {
+        return *containers.front();
+    }
+
+    std::vector<uint64_t> result(BITMAP_WORD_COUNT, 0);
+    for (const auto* container : containers) {
+        if (container->type_ == Type::BITMAP) {
+            for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+                result[i] |= container->bitmap_[i];
+            }
+        } else {
+            container->forEach(0, [&result](uint64_t value) {
+                bitmapSet(result, static_cast<uint16_t>(value));
+            });
+        }
+    }
+
+    return fromBitmap(std::move(result));
+}
+
+void RoaringContainer::settleBitmap() {
+    cardinality_ = 0;
+    for (auto word : bitmap_) {
+        cardinality_ += std::popcount(word);
+    }
+    if (cardinality_ <= ARRAY_MAX_SIZE) {
+        toArray();
+    }
+}
+
+void RoaringContainer::intersectWith(const RoaringContainer& other) {
+    if (type_ == Type::BITMAP && other.type_ == Type::BITMAP) {
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            bitmap_[i] &= other.bitmap_[i];
+        }
+        settleBitmap();
+    } else if (type_ == Type::ARRAY && other.type_ == Type::ARRAY) {
+        // every kernel writes a value at or before where it read it from, so the array can be intersected into itself
+        array_.resize(arrayIntersect(array_, other.array_, array_.data()));
+        cardinality_ = static_cast<uint32_t>(array_.size());
+    } else if (type_ == Type::ARRAY && other.type_ == Type::BITMAP) {
+        std::erase_if(array_, [&other](uint16_t low) {
+            return !bitmapContains(other.bitmap_, low);
+        });
+        cardinality_ = static_cast<uint32_t>(array_.size());
+    } else {
+        *this = intersect(*this, other);
+    }
+}
+
+void RoaringContainer::unionWith(const RoaringContainer& other) {
+    if (type_ == Type::BITMAP && other.type_ == Type::BITMAP) {
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            bitmap_[i] |= other.bitmap_[i];
+        }
+        settleBitmap();
+    } else if (type_ == Type::BITMAP && other.type_ == Type::ARRAY) {
+        for (auto low : other.array_) {
+            bitmapSet(bitmap_, low);
+        }
+        settleBitmap();
+    } else {
+        *this = setUnion(*this, other);
+    }
+}
+
+void RoaringContainer::subtract(const RoaringContainer& other) {
+    if (type_ == Type::BITMAP && other.type_ == Type::BITMAP) {
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            bitmap_[i] &= ~other.bitmap_[i];
+        }
+        settleBitmap();
+    } else if (type_ == Type::BITMAP && other.type_ == Type::ARRAY) {
+        for (auto low : other.array_) {
+            bitmapClear(bitmap_, low);
+        }
+        settleBitmap();
+    } else if (type_ == Type::ARRAY && other.type_ == Type::BITMAP) {
+        std::erase_if(array_, [&other](uint16_t low) {
+            return bitmapContains(other.bitmap_, low);
+        });
+        cardinality_ = static_cast<uint32_t>(array_.size());
+    } else if (type_ == Type::ARRAY && other.type_ == Type::ARRAY) {
+        auto otherIt = other.array_.begin();
+        std::erase_if(array_, [&otherIt, &other](uint16_t low) {
+            otherIt = std::lower_bound(otherIt, other.array_.end(), low);
+            return otherIt != other.array_.end() && *otherIt == low;
+        });
+        cardinality_ = static_cast<uint32_t>(array_.size());
+    } else {
+        *this = difference(*this, other);
+    }
+}
+
+void RoaringContainer::symmetricDifferenceWith(const RoaringContainer& other) {
+    if (type_ == Type::BITMAP && other.type_ == Type::BITMAP) {
+        for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+            bitmap_[i] ^= other.bitmap_[i];
+        }
+        settleBitmap();
+    } else if (type_ == Type::BITMAP && other.type_ == Type::ARRAY) {
+        for (auto low : other.array_) {
+            bitmapFlip(bitmap_, low);
+        }
+        settleBitmap();
+    } else {
+        *this = symmetricDifference(*this, other);
+    }
+}
+
+RoaringBitmap::const_iterator::const_iterator(const RoaringBitmap* bitmap, std::size_t containerIndex)
+    : bitmap_(bitmap), containerIndex_(containerIndex)
+{
+    settle();
+}
+
+uint64_t RoaringBitmap::const_iterator::operator*() const {
+    return current_;
+}
+
+RoaringBitmap::const_iterator& RoaringBitmap::const_iterator::operator++() {
+    bitmap_->containers_[containerIndex_].advance(position_, subPosition_);
+    settle();
+    return *this;
+}
+
+RoaringBitmap::const_iterator RoaringBitmap::const_iterator::operator++(int) {
+    auto previous = *this;
+    ++(*this);
+    return previous;
+}
+
+bool RoaringBitmap::const_iterator::operator==(const const_iterator& other) const {
+    return containerIndex_ == other.containerIndex_ && position_ == other.position_ && subPosition_ == other.subPosition_;
+}
+
+void RoaringBitmap::const_iterator::settle() {
+    while (containerIndex_ < bitmap_->containers_.size()) {
+        uint16_t low;
+        if (bitmap_->containers_[containerIndex_].valueAt(position_, subPosition_, low)) {
+            current_ = (bitmap_->keys_[containerIndex_] << 16) | low;
+            return;
+        }
+
+        ++containerIndex_;
+        position_ = 0;
+        subPosition_ = 0;
+    }
+}
+
+RoaringBitmap RoaringBitmap::fromValues(std::vector<uint64_t> values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+
+    RoaringBitmap bitmap;
+    std::vector<uint16_t> lows;
+    std::size_t i = 0;
+    while (i < values.size()) {
+        uint64_t key = values[i] >> 16;
+        lows.clear();
+        for (; i < values.size() && (values[i] >> 16) == key; ++i) {
+            lows.push_back(static_cast<uint16_t>(values[i]));
+        }
+        bitmap.appendContainer(key, RoaringContainer::fromSorted(lows.data(), lows.size()));
+    }
+
+    return bitmap;
+}
+
+std::size_t RoaringBitmap::findContainer(uint64_t key) const {
+    return std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin();
+}
+
+void RoaringBitmap::appendContainer(uint64_t key, RoaringContainer container) {
+    if (container.empty()) {
+        return;
+    }
+
+    size_ += container.size();
+    keys_.push_back(key);
+    containers_.push_back(std::move(container));
+}
+
+RoaringInsertReturnType RoaringBitmap::insert(uint64_t item) {
+    uint64_t key = item >> 16;
+    std::size_t index = findContainer(key);
+    if (index == keys_.size() || keys_[index] != key) {
+        keys_.insert(keys_.begin() + index, key);
+        containers_.insert(containers_.begin() + index, RoaringContainer());
+    }
+
+    bool inserted = containers_[index].insert(static_cast<uint16_t>(item));
+    if (inserted) {
+        ++size_;
+    }
+
+    return RoaringInsertReturnType {.second = inserted};
+}
+
+std::size_t RoaringBitmap::erase(uint64_t item) {
+    uint64_t key = item >> 16;
+    std::size_t index = findContainer(key);
+    if (index == keys_.size() || keys_[index] != key) {
+        return 0;
+    }
+
+    if (!containers_[index].erase(static_cast<uint16_t>(item))) {
+        return 0;
+    }
+
+    --size_;
+    if (containers_[index].empty()) {
+        keys_.erase(keys_.begin() + index);
+        containers_.erase(containers_.begin() + index);
+    }
+
+    return 1;
+}
+
+bool RoaringBitmap::contains(uint64_t item) const {
+    uint64_t key = item >> 16;
+    std::size_t index = findContainer(key);
+    if (index == keys_.size() || keys_[index] != key) {
+        return false;
+    }
+
+    return containers_[index].contains(static_cast<uint16_t>(item));
+}
+
+std::vector<uint64_t> RoaringBitmap::select(const std::vector<std::size_t>& ranks) const {
+    std::vector<uint64_t> values;
+    values.reserve(ranks.size());
+    std::size_t containerIndex = 0;
+    // how many values the containers before containerIndex hold
+    std::size_t containerRank = 0;
+    for (auto rank : ranks) {
+        if (rank >= size_) {
+            throw std::logic_error(std::string("Cannot select rank ") + std::to_string(rank) + " of a bitmap of " + std::to_string(size_) + " values");
+        }
+        while (rank - containerRank >= containers_[containerIndex].size()) {
+            containerRank += containers_[containerIndex].size();
+            ++containerIndex;
+        }
+
+        values.push_back((keys_[containerIndex] << 16) | containers_[containerIndex].select(rank - containerRank));
+    }
+
+    return values;
+}
+
+std::size_t RoaringBitmap::size() const {
+    return size_;
+}
+
+bool RoaringBitmap::empty() const {
+    return size_ == 0;
+}
+
+void RoaringBitmap::clear() {
+    keys_.clear();
+    containers_.clear();
+    size_ = 0;
+}
+
+void RoaringBitmap::runOptimize() {
+    for (auto& container : containers_) {
+        container.runOptimize();
+    }
+}
+
+std::size_t RoaringBitmap::physicalBytes() const {
+    std::size_t bytes = sizeof(RoaringBitmap) + (keys_.capacity() * sizeof(uint64_t));
+    for (const auto& container : containers_) {
+        bytes += container.physicalBytes();
+    }
+
+    return bytes;
+}
+
+bool RoaringBitmap::operator==(const RoaringBitmap& other) const {
+    return size_ == other.size_ && keys_ == other.keys_ && containers_ == other.containers_;
+}
+
+RoaringBitmap::const_iterator RoaringBitmap::begin() const {
+    return const_iterator(this, 0);
+}
+
+RoaringBitmap::const_iterator RoaringBitmap::end() const {
+    return const_iterator(this, containers_.size());
+}
+
+RoaringBitmap RoaringBitmap::intersect(const RoaringBitmap& lhs, const RoaringBitmap& rhs) {
+    RoaringBitmap result;
+    std::size_t lhsIndex = 0;
+    std::size_t rhsIndex = 0;
+    while (lhsIndex < lhs.keys_.size() && rhsIndex < rhs.keys_.size()) {
+        if (lhs.keys_[lhsIndex] < rhs.keys_[rhsIndex]) {
+            ++lhsIndex;
+        } else if (rhs.keys_[rhsIndex] < lhs.keys_[lhsIndex]) {
+            ++rhsIndex;
+        } else {
+            result.appendContainer(lhs.keys_[lhsIndex], RoaringContainer::intersect(lhs.containers_[lhsIndex], rhs.containers_[rhsIndex]));
+            ++lhsIndex;
+            ++rhsIndex;
+        }
+    }
+
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::setUnion(const RoaringBitmap& lhs, const RoaringBitmap& rhs) {
+    RoaringBitmap result;
+    std::size_t lhsIndex = 0;
+    std::size_t rhsIndex = 0;
+    while (lhsIndex < lhs.keys_.size() || rhsIndex < rhs.keys_.size()) {
+        if (rhsIndex == rhs.keys_.size() || (lhsIndex < lhs.keys_.size() && lhs.keys_[lhsIndex] < rhs.keys_[rhsIndex])) {
+            result.appendContainer(lhs.keys_[lhsIndex], lhs.containers_[lhsIndex]);
+            ++lhsIndex;
+        } else if (lhsIndex == lhs.keys_.size() || rhs.keys_[rhsIndex] < lhs.keys_[lhsIndex]) {
+            result.appendContainer(rhs.keys_[rhsIndex], rhs.containers_[rhsIndex]);
+            ++rhsIndex;
+        } else {
+            result.appendContainer(lhs.keys_[lhsIndex], RoaringContainer::setUnion(lhs.containers_[lhsIndex], rhs.containers_[rhsIndex]));
+            ++lhsIndex;
+            ++rhsIndex;
+        }
+    }
+
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::setUnionAll(const std::vector<const RoaringBitmap*>& bitmaps) {
+    // the next container of each bitmap, by key then by which bitmap it is in
+    using NextContainer = std::pair<uint64_t, std::size_t>;
+    std::priority_queue<NextContainer, std::vector<NextContainer>, std::greater<NextContainer>> nextContainers;
+    std::vector<std::size_t> containerIndices(bitmaps.size(), 0);
+    for (std::size_t i = 0; i < bitmaps.size(); ++i) {
+        if (!bitmaps[i]->keys_.empty()) {
+            nextContainers.emplace(bitmaps[i]->keys_.front(), i);
+        }
+    }
+
+    RoaringBitmap result;
+    std::vector<const RoaringContainer*> keyContainers;
+    while (!nextContainers.empty()) {
+        auto key = nextContainers.top().first;
+        while (!nextContainers.empty() && nextContainers.top().first == key) {
+            auto bitmapIndex = nextContainers.top().second;
+            nextContainers.pop();
+            const auto& bitmap = *bitmaps[bitmapIndex];
+            auto& containerIndex = containerIndices[bitmapIndex];
+            keyContainers.push_back(&bitmap.containers_[containerIndex]);
+            if (++containerIndex < bitmap.keys_.size()) {
+                nextContainers.emplace(bitmap.keys_[containerIndex], bitmapIndex);
+            }
+        }
+
+        result.appendContainer(key, RoaringContainer::setUnionAll(keyContainers));
+        keyContainers.clear();
+    }
+
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::difference(const RoaringBitmap& lhs, const RoaringBitmap& rhs) {
+    RoaringBitmap result;
+    std::size_t rhsIndex = 0;
+    for (std::size_t lhsIndex = 0; lhsIndex < lhs.keys_.size(); ++lhsIndex) {
+        while (rhsIndex < rhs.keys_.size() && rhs.keys_[rhsIndex] < lhs.keys_[lhsIndex]) {
+            ++rhsIndex;
+        }
+
+        if (rhsIndex < rhs.keys_.size() && rhs.keys_[rhsIndex] == lhs.keys_[lhsIndex]) {
+            result.appendContainer(lhs.keys_[lhsIndex], RoaringContainer::difference(lhs.containers_[lhsIndex], rhs.containers_[rhsIndex]));
+        } else {
+            result.appendContainer(lhs.keys_[lhsIndex], lhs.containers_[lhsIndex]);
+        }
+    }
+
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::symmetricDifference(const RoaringBitmap& lhs, const RoaringBitmap& rhs) {
+    RoaringBitmap result;
+    std::size_t lhsIndex = 0;
+    std::size_t rhsIndex = 0;
+    while (lhsIndex < lhs.keys_.size() || rhsIndex < rhs.keys_.size()) {
+        if (rhsIndex == rhs.keys_.size() || (lhsIndex < lhs.keys_.size() && lhs.keys_[lhsIndex] < rhs.keys_[rhsIndex])) {
+            result.appendContainer(lhs.keys_[lhsIndex], lhs.containers_[lhsIndex]);
+            ++lhsIndex;
+        } else if (lhsIndex == lhs.keys_.size() || rhs.keys_[rhsIndex] < lhs.keys_[lhsIndex]) {
+            result.appendContainer(rhs.keys_[rhsIndex], rhs.containers_[rhsIndex]);
+            ++rhsIndex;
+        } else {
+            result.appendContainer(lhs.keys_[lhsIndex], RoaringContainer::symmetricDifference(lhs.containers_[lhsIndex], rhs.containers_[rhsIndex]));
+            ++lhsIndex;
+            ++rhsIndex;
+        }
+    }
+
+    return result;
+}
+
+template <class T>
+void RoaringBitmap::applyToMatchingContainers(const RoaringBitmap& other, bool keepUnmatched, T containerOperation) {
+    std::size_t keptCount = 0;
+    std::size_t otherIndex = 0;
+    size_ = 0;
+    for (std::size_t i = 0; i < keys_.size(); ++i) {
+        while (otherIndex < other.keys_.size() && other.keys_[otherIndex] < keys_[i]) {
+            ++otherIndex;
+        }
+        if (otherIndex < other.keys_.size() && other.keys_[otherIndex] == keys_[i]) {
+            containerOperation(containers_[i], other.containers_[otherIndex]);
+        } else if (!keepUnmatched) {
+            continue;
+        }
+        if (containers_[i].empty()) {
+            continue;
+        }
+
+        size_ += containers_[i].size();
+        if (keptCount != i) {
+            keys_[keptCount] = keys_[i];
+            containers_[keptCount] = std::move(containers_[i]);
+        }
+        ++keptCount;
+    }
+
+    keys_.resize(keptCount);
+    containers_.resize(keptCount);
+}
+
+template <class T>
+void RoaringBitmap::mergeContainers(const RoaringBitmap& other, T containerOperation) {
+    bool hasEveryKey = std::includes(keys_.begin(), keys_.end(), other.keys_.begin(), other.keys_.end());
+    if (hasEveryKey) {
+        applyToMatchingContainers(other, true, containerOperation);
+        return;
+    }
+
+    // this bitmap's containers are moved into the merged one rather than copied
+    RoaringBitmap result;
+    std::size_t index = 0;
+    std::size_t otherIndex = 0;
+    while (index < keys_.size() || otherIndex < other.keys_.size()) {
+        if (otherIndex == other.keys_.size() || (index < keys_.size() && keys_[index] < other.keys_[otherIndex])) {
+            result.appendContainer(keys_[index], std::move(containers_[index]));
+            ++index;
+        } else if (index == keys_.size() || other.keys_[otherIndex] < keys_[index]) {
+            result.appendContainer(other.keys_[otherIndex], other.containers_[otherIndex]);
+            ++otherIndex;
+        } else {
+            containerOperation(containers_[index], other.containers_[otherIndex]);
+            result.appendContainer(keys_[index], std::move(containers_[index]));
+            ++index;
+            ++otherIndex;
+        }
+    }
+
+    *this = std::move(result);
+}
+
+void RoaringBitmap::intersectWith(const RoaringBitmap& other) {
+    applyToMatchingContainers(other, false, [](RoaringContainer& container, const RoaringContainer& otherContainer) {
+        container.intersectWith(otherContainer);
+    });
+}
+
+void RoaringBitmap::unionWith(const RoaringBitmap& other) {
+    mergeContainers(other, [](RoaringContainer& container, const RoaringContainer& otherContainer) {
+        container.unionWith(otherContainer);
+    });
+}
+
+void RoaringBitmap::subtract(const RoaringBitmap& other) {
+    applyToMatchingContainers(other, true, [](RoaringContainer& container, const RoaringContainer& otherContainer) {
+        container.subtract(otherContainer);
+    });
+}
+
+void RoaringBitmap::symmetricDifferenceWith(const RoaringBitmap& other) {
+    mergeContainers(other, [](RoaringContainer& container, const RoaringContainer& otherContainer) {
+        container.symmetricDifferenceWith(otherContainer);
+    });
+}
+
+std::size_t RoaringBitmap::intersectSize(const RoaringBitmap& lhs, const RoaringBitmap& rhs) {
+    std::size_t count = 0;
+    std::size_t lhsIndex = 0;
+    std::size_t rhsIndex = 0;
+    while (lhsIndex < lhs.keys_.size() && rhsIndex < rhs.keys_.size()) {
+        if (lhs.keys_[lhsIndex] < rhs.keys_[rhsIndex]) {
+            ++lhsIndex;
+        } else if (rhs.keys_[rhsIndex] < lhs.keys_[lhsIndex]) {
+            ++rhsIndex;
+        } else {
+            count += RoaringContainer::intersectSize(lhs.containers_[lhsIndex], rhs.containers_[rhsIndex]);
+            ++lhsIndex;
+            ++rhsIndex;
+        }
+    }
+
+    return count;
+}
\ No newline at end of file
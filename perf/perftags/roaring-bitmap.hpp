@@ -0,0 +1,186 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+struct RoaringInsertReturnType {
+    bool second;
+};
+
+// A single 2^16 chunk of a RoaringBitmap, stored as whichever of a sorted array, a 65536-bit bitmap, or a list of runs is cheapest
+class RoaringContainer {
+    public:
+        enum class Type : unsigned char {
+            ARRAY,
+            BITMAP,
+            RUN
+        };
+
+        struct Run {
+            uint16_t start;
+            // amount of values in the run minus one, so a full container is representable
+            uint16_t length;
+        };
+
+        static const std::size_t ARRAY_MAX_SIZE = 4096;
+        static const std::size_t BITMAP_WORD_COUNT = 1024;
+
+        RoaringContainer() = default;
+        static RoaringContainer fromSorted(const uint16_t* values, std::size_t count);
+
+        Type type() const;
+        std::size_t size() const;
+        bool empty() const;
+        bool contains(uint16_t low) const;
+        // The value with rank values before it, which must be less than size()
+        uint16_t select(std::size_t rank) const;
+        bool insert(uint16_t low);
+        bool erase(uint16_t low);
+        // Converts to a run container when that is smaller than the array or bitmap representation
+        void runOptimize();
+        std::size_t physicalBytes() const;
+        bool operator==(const RoaringContainer& other) const;
+
+        template <class T>
+        void forEach(uint64_t high, T callback) const {
+            if (type_ == Type::ARRAY) {
+                for (auto low : array_) {
+                    callback(high | low);
+                }
+            } else if (type_ == Type::BITMAP) {
+                for (std::size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+                    uint64_t word = bitmap_[i];
+                    while (word != 0) {
+                        uint64_t low = (i << 6) | static_cast<uint64_t>(std::countr_zero(word));
+                        callback(high | low);
+                        word &= word - 1;
+                    }
+                }
+            } else {
+                for (const auto& run : runs_) {
+                    uint64_t end = static_cast<uint64_t>(run.start) + run.length;
+                    for (uint64_t low = run.start; low <= end; ++low) {
+                        callback(high | low);
+                    }
+                }
+            }
+        }
+
+        // Iteration primitives used by RoaringBitmap::const_iterator, position/subPosition are opaque cursors
+        bool valueAt(uint32_t& position, uint32_t& subPosition, uint16_t& value) const;
+        void advance(uint32_t& position, uint32_t& subPosition) const;
+
+        static RoaringContainer intersect(const RoaringContainer& lhs, const RoaringContainer& rhs);
+        static RoaringContainer setUnion(const RoaringContainer& lhs, const RoaringContainer& rhs);
+        static RoaringContainer difference(const RoaringContainer& lhs, const RoaringContainer& rhs);
+        static RoaringContainer symmetricDifference(const RoaringContainer& lhs, const RoaringContainer& rhs);
+        static std::size_t intersectSize(const RoaringContainer& lhs, const RoaringContainer& rhs);
+        static RoaringContainer setUnionAll(const std::vector<const RoaringContainer*>& containers);
+        // The same operations applied to this container in place, reusing its array or bitmap where the result fits it
+        void intersectWith(const RoaringContainer& other);
+        void unionWith(const RoaringContainer& other);
+        void subtract(const RoaringContainer& other);
+        void symmetricDifferenceWith(const RoaringContainer& other);
+    private:
+        static RoaringContainer fromArray(std::vector<uint16_t> array);
+        static RoaringContainer fromBitmap(std::vector<uint64_t> bitmap);
+        void toArray();
+        void toBitmap();
+        void toSmallestNonRun();
+        // Recounts a bitmap container after its words were changed, turning it into an array when it holds few enough values
+        void settleBitmap();
+        std::size_t runCount() const;
+        static RoaringContainer materialized(const RoaringContainer& container);
+
+        Type type_ = Type::ARRAY;
+        uint32_t cardinality_ = 0;
+        std::vector<uint16_t> array_;
+        std::vector<uint64_t> bitmap_;
+        std::vector<Run> runs_;
+};
+
+// Compressed set of 64 bit ids, split by the high 48 bits into RoaringContainer chunks holding the low 16 bits
+class RoaringBitmap {
+    public:
+        using value_type = uint64_t;
+
+        class const_iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = uint64_t;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const uint64_t*;
+                using reference = uint64_t;
+
+                const_iterator() = default;
+                const_iterator(const RoaringBitmap* bitmap, std::size_t containerIndex);
+
+                uint64_t operator*() const;
+                const_iterator& operator++();
+                const_iterator operator++(int);
+                bool operator==(const const_iterator& other) const;
+            private:
+                void settle();
+
+                const RoaringBitmap* bitmap_ = nullptr;
+                std::size_t containerIndex_ = 0;
+                uint32_t position_ = 0;
+                uint32_t subPosition_ = 0;
+                uint64_t current_ = 0;
+        };
+
+        RoaringBitmap() = default;
+        static RoaringBitmap fromValues(std::vector<uint64_t> values);
+
+        RoaringInsertReturnType insert(uint64_t item);
+        std::size_t erase(uint64_t item);
+        bool contains(uint64_t item) const;
+        // The value at each of ranks, which must be ascending and less than size(), found in a single pass over the containers
+        std::vector<uint64_t> select(const std::vector<std::size_t>& ranks) const;
+        std::size_t size() const;
+        bool empty() const;
+        void clear();
+        void runOptimize();
+        std::size_t physicalBytes() const;
+        bool operator==(const RoaringBitmap& other) const;
+
+        const_iterator begin() const;
+        const_iterator end() const;
+
+        template <class T>
+        void forEach(T callback) const {
+            for (std::size_t i = 0; i < keys_.size(); ++i) {
+                containers_[i].forEach(keys_[i] << 16, callback);
+            }
+        }
+
+        static RoaringBitmap intersect(const RoaringBitmap& lhs, const RoaringBitmap& rhs);
+        static RoaringBitmap setUnion(const RoaringBitmap& lhs, const RoaringBitmap& rhs);
+        // lhs ANDNOT rhs
+        static RoaringBitmap difference(const RoaringBitmap& lhs, const RoaringBitmap& rhs);
+        static RoaringBitmap symmetricDifference(const RoaringBitmap& lhs, const RoaringBitmap& rhs);
+        static std::size_t intersectSize(const RoaringBitmap& lhs, const RoaringBitmap& rhs);
+        // The union of every bitmap, merging them all at once rather than a pair at a time
+        static RoaringBitmap setUnionAll(const std::vector<const RoaringBitmap*>& bitmaps);
+        // The same operations applied to this bitmap in place, so a result being built up does not allocate a new bitmap for every operand
+        void intersectWith(const RoaringBitmap& other);
+        void unionWith(const RoaringBitmap& other);
+        // this ANDNOT other
+        void subtract(const RoaringBitmap& other);
+        void symmetricDifferenceWith(const RoaringBitmap& other);
+    private:
+        std::size_t findContainer(uint64_t key) const;
+        void appendContainer(uint64_t key, RoaringContainer container);
+        // Applies containerOperation to each of this bitmap's containers that other has a container with the same key for, dropping those left empty
+        template <class T>
+        void applyToMatchingContainers(const RoaringBitmap& other, bool keepUnmatched, T containerOperation);
+        // Applies containerOperation to matching containers and takes other's containers with keys this has none for
+        template <class T>
+        void mergeContainers(const RoaringBitmap& other, T containerOperation);
+
+        std::vector<uint64_t> keys_;
+        std::vector<RoaringContainer> containers_;
+        std::size_t size_ = 0;
+};
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "search-cache.hpp"
+
+SearchCache::SearchCache(std::size_t capacity)
+    : capacity_(capacity)
+{}
+
+std::size_t SearchCache::capacity() const {
+    return capacity_;
+}
+
+std::optional<RoaringBitmap> SearchCache::find(const std::string& key, const std::vector<uint64_t>& versions) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entryLocation = entryLocations_.find(key);
+    if (entryLocation == entryLocations_.end()) {
+        ++misses_;
+        return std::nullopt;
+    }
+
+    auto entry = entryLocation->second;
+    if (entry->versions != versions) {
+        // a bucket it was worked out from has changed since, so it will never be found again
+        entryLocations_.erase(entryLocation);
+        entries_.erase(entry);
+        ++misses_;
+        return std::nullopt;
+    }
+
+    entries_.splice(entries_.begin(), entries_, entry);
+    ++hits_;
+    return entry->result;
+}
+
+void SearchCache::insert(std::string key, std::vector<uint64_t> versions, RoaringBitmap result) {
+    if (capacity_ == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entryLocation = entryLocations_.find(key);
+    if (entryLocation != entryLocations_.end()) {
+        entries_.erase(entryLocation->second);
+        entryLocations_.erase(entryLocation);
+    }
+
+    entries_.push_front(Entry{key, std::move(versions), std::move(result)});
+    entryLocations_.insert({std::move(key), entries_.begin()});
+    while (entries_.size() > capacity_) {
+        entryLocations_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+std::size_t SearchCache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+uint64_t SearchCache::hits() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t SearchCache::misses() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "roaring-bitmap.hpp"
+
+// Results of recent searches by their canonical search, each kept with the versions of the buckets it was worked out from
+// A result is only found while those buckets are still at the same versions, and the least recently used is dropped past capacity
+class SearchCache {
+    public:
+        // 0 entries caches nothing
+        SearchCache(std::size_t capacity);
+        SearchCache(const SearchCache& searchCache) = delete;
+        SearchCache& operator=(const SearchCache& searchCache) = delete;
+
+        std::size_t capacity() const;
+        // Safe to call from reads running alongside each other
+        std::optional<RoaringBitmap> find(const std::string& key, const std::vector<uint64_t>& versions);
+        void insert(std::string key, std::vector<uint64_t> versions, RoaringBitmap result);
+
+        std::size_t size();
+        uint64_t hits();
+        uint64_t misses();
+    private:
+        struct Entry {
+            std::string key;
+            std::vector<uint64_t> versions;
+            RoaringBitmap result;
+        };
+
+        std::size_t capacity_;
+        std::mutex mutex_;
+        // most recently used first
+        std::list<Entry> entries_;
+        std::unordered_map<std::string, std::list<Entry>::iterator> entryLocations_;
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+};
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "search-cursors.hpp"
+
+#include <algorithm>
+
+#include "../common/util.hpp"
+
+SearchCursors::SearchCursors(std::chrono::milliseconds expiry)
+    : expiry_(expiry)
+{}
+
+uint64_t SearchCursors::open(std::vector<uint64_t> taggables) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    removeExpired(now);
+
+    auto cursorId = ++nextCursorId_;
+    cursors_.insert({cursorId, Cursor{std::move(taggables), now}});
+    return cursorId;
+}
+
+std::optional<std::string> SearchCursors::page(uint64_t cursorId, uint64_t offset, uint64_t limit) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    removeExpired(now);
+
+    auto cursor = cursors_.find(cursorId);
+    if (cursor == cursors_.end()) {
+        return std::nullopt;
+    }
+    cursor->second.lastUse = now;
+
+    const auto& taggables = cursor->second.taggables;
+    auto begin = std::min<uint64_t>(offset, taggables.size());
+    auto end = begin + std::min<uint64_t>(limit, taggables.size() - begin);
+    std::string output;
+    output.resize(8 * (1 + end - begin));
+    std::size_t location = util::serializeUInt64(taggables.size(), output, 0);
+    for (auto i = begin; i < end; ++i) {
+        location = util::serializeUInt64(taggables[i], output, location);
+    }
+
+    return output;
+}
+
+void SearchCursors::close(uint64_t cursorId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cursors_.erase(cursorId);
+}
+
+std::size_t SearchCursors::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cursors_.size();
+}
+
+void SearchCursors::removeExpired(std::chrono::steady_clock::time_point now) {
+    std::erase_if(cursors_, [this, now](const auto& cursor) {
+        return now - cursor.second.lastUse > expiry_;
+    });
+}
\ No newline at end of file
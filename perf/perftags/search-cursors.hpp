@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Sorted search results kept under an id, so that they can be read a page at a time rather than all at once
+// A cursor that goes unread for longer than the expiry is dropped
+class SearchCursors {
+    public:
+        SearchCursors(std::chrono::milliseconds expiry);
+        SearchCursors(const SearchCursors& searchCursors) = delete;
+        SearchCursors& operator=(const SearchCursors& searchCursors) = delete;
+
+        // Safe to call from reads running alongside each other, as are the rest
+        // Keeps taggables, which must be sorted, returning the id of the cursor they are kept under
+        uint64_t open(std::vector<uint64_t> taggables);
+        // Serializes how many taggables the cursor has, followed by up to limit of them starting from offset
+        // Returns nothing when there is no such cursor, as when it expired
+        std::optional<std::string> page(uint64_t cursorId, uint64_t offset, uint64_t limit);
+        void close(uint64_t cursorId);
+        std::size_t size();
+    private:
+        struct Cursor {
+            std::vector<uint64_t> taggables;
+            std::chrono::steady_clock::time_point lastUse;
+        };
+
+        void removeExpired(std::chrono::steady_clock::time_point now);
+
+        std::chrono::milliseconds expiry_;
+        std::mutex mutex_;
+        std::unordered_map<uint64_t, Cursor> cursors_;
+        uint64_t nextCursorId_ = 0;
+};
\ No newline at end of file
@@ -0,0 +1,394 @@
+#include "search-plan.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "parallel-for.hpp"
+
+namespace {
+    // conditional expression lists shorter than this are checked on the calling thread, as starting threads would cost more than it saves
+    const std::size_t PARALLEL_CONDITION_EXPRESSIONS = 256;
+
+    struct PreemptiveComparison {
+        bool isPossible;
+        bool comparison;
+    };
+
+    template <class T>
+    PreemptiveComparison tryPreemptiveCompare(T lhs, std::string_view comparator, T rhs) {
+        if (comparator == "< ") {
+            return PreemptiveComparison {
+                .isPossible = lhs < rhs,
+                .comparison = true
+            };
+        } else if (comparator == "<=") {
+            return PreemptiveComparison {
+                .isPossible = lhs <= rhs,
+                .comparison = true
+            };
+        } else if (comparator == "> ") {
+            return PreemptiveComparison {
+                .isPossible = lhs <= rhs,
+                .comparison = false
+            };
+        } else if (comparator == ">=") {
+            return PreemptiveComparison {
+                .isPossible = lhs < rhs,
+                .comparison = false
+            };
+        } else if (comparator == "==") {
+            return PreemptiveComparison {
+                .isPossible = lhs < rhs,
+                .comparison = false
+            };
+        } else if (comparator == "<>") {
+            return PreemptiveComparison {
+                .isPossible = lhs < rhs,
+                .comparison = true
+            };
+        } else {
+            throw std::logic_error(std::string("Invalid comparator '" + std::string(comparator) + "' was provided to preemptive compare"));
+        }
+    }
+
+    template <class T>
+    bool compare(T lhs, std::string_view comparator, T rhs) {
+        if (comparator == "< ") {
+            return lhs < rhs;
+        } else if (comparator == "<=") {
+            return lhs <= rhs;
+        } else if (comparator == "> ") {
+            return lhs > rhs;
+        } else if (comparator == ">=") {
+            return lhs >= rhs;
+        } else if (comparator == "==") {
+            return lhs == rhs;
+        } else if (comparator == "<>") {
+            return lhs != rhs;
+        } else {
+            throw std::logic_error(std::string("Invalid comparator '" + std::string(comparator) + "' was provided to compare"));
+        }
+    }
+
+    bool isCommutative(char op) {
+        return op == '&' || op == '|' || op == '^';
+    }
+
+    const std::unordered_map<char, SetEvaluation(*)(SetEvaluation&& set1, SetEvaluation&& set2)> SET_OPERATIONS = {
+        {'^', SetEvaluation::symmetricDifference},
+        {'-', SetEvaluation::difference},
+        {'&', SetEvaluation::intersect},
+        {'|', SetEvaluation::setUnion}
+    };
+
+    // Whether no further operand can change lhs under op, an intersection or difference that is already empty or a union that is already everything
+    bool isSettled(char op, const SetEvaluation& lhsSet, std::size_t universeSize) {
+        if (op == '&' || op == '-') {
+            return lhsSet.size() == 0;
+        } else if (op == '|') {
+            return lhsSet.size() == universeSize;
+        } else {
+            return false;
+        }
+    }
+
+    // Removes the expressions that do not meet condition, checking them on up to threadCount threads once there are enough to be worth it
+    void applyCondition(std::vector<SetEvaluation>& expressions, SearchCondition& condition, const RoaringBitmap* universe, std::size_t threadCount) {
+        std::vector<SetEvaluation> contexts;
+        for (auto& context : condition.contexts) {
+            contexts.push_back(searchPlan::evaluate(context, universe, threadCount));
+        }
+
+        std::function<bool(const SetEvaluation&)> meetsCondition;
+        if (condition.type == SearchCondition::COUNT_OP) {
+            // Restricts {expressions} to where the expression is represented with {comparator} {occurrences} within {compareExpression}
+            meetsCondition = [&condition, &compareExpressionContext = contexts[0]](const SetEvaluation& expression) {
+                auto preemptiveComparison = tryPreemptiveCompare(expression.size(), condition.comparator, condition.occurrences);
+                if (preemptiveComparison.isPossible) {
+                    return preemptiveComparison.comparison;
+                }
+
+                auto expressionRepresentationSize = SetEvaluation::intersectSize(compareExpressionContext, expression);
+                return compare(expressionRepresentationSize, condition.comparator, condition.occurrences);
+            };
+        } else if (condition.type == SearchCondition::PERCENTAGE_OP) {
+            // Restricts {tags} to where the tag is represented with {comparator} {percentage} within {LHS}
+            meetsCondition = [&condition, &compareExpressionContext = contexts[0]](const SetEvaluation& expression) {
+                if (expression.size() == 0) {
+                    return false;
+                }
+
+                auto expressionRepresentationSize = SetEvaluation::intersectSize(compareExpressionContext, expression);
+                return compare(static_cast<float>(expressionRepresentationSize) / static_cast<float>(expression.size()), condition.comparator, condition.percentage);
+            };
+        } else if (condition.type == SearchCondition::FILTERED_PERCENTAGE_OP) {
+            // Gets a union of all {tags} where the tag's taggables that are filtered by {LHS} are represented with {comparator} {percentage} within {expression}
+            meetsCondition = [&condition, &filteringContext = contexts[0], &representationContext = contexts[1]](const SetEvaluation& expression) {
+                auto filteredExpressionContext = SetEvaluation::intersect(filteringContext, expression);
+                auto filteredExpressionCount = filteredExpressionContext.size();
+                if (filteredExpressionCount == 0) {
+                    return false;
+                }
+
+                auto tagsRepresentationSize = SetEvaluation::intersectSize(representationContext, filteredExpressionContext);
+                return compare(static_cast<float>(tagsRepresentationSize) / static_cast<float>(filteredExpressionCount), condition.comparator, condition.percentage);
+            };
+        } else {
+            return;
+        }
+
+        // chars rather than bools, which threads could not write beside each other
+        std::vector<char> meetsConditions(expressions.size(), 0);
+        auto checkExpression = [&meetsConditions, &meetsCondition, &expressions](std::size_t i) {
+            meetsConditions[i] = meetsCondition(expressions[i]);
+        };
+        if (expressions.size() < PARALLEL_CONDITION_EXPRESSIONS) {
+            for (std::size_t i = 0; i < expressions.size(); ++i) {
+                checkExpression(i);
+            }
+        } else {
+            parallelFor(expressions.size(), threadCount, checkExpression);
+        }
+
+        for (std::size_t i = expressions.size(); i-- > 0;) {
+            if (!meetsConditions[i]) {
+                expressions[i] = std::move(expressions.back());
+                expressions.pop_back();
+            }
+        }
+    }
+
+    void canonicalizeNode(const SearchNode& node, std::string& output) {
+        if (node.isComplement) {
+            output += '~';
+        }
+        if (node.kind == SearchNode::Kind::UNIVERSE) {
+            output += 'U';
+        } else if (node.kind == SearchNode::Kind::EMPTY) {
+            output += 'E';
+        } else if (node.kind == SearchNode::Kind::TAG) {
+            output += 'T' + std::to_string(node.externalTag);
+        } else if (node.kind == SearchNode::Kind::TAGGABLE_LIST) {
+            output += 'L';
+            node.taggableList.forEach([&output](uint64_t taggable) {
+                output += std::to_string(taggable) + ',';
+            });
+        } else if (node.kind == SearchNode::Kind::METRIC_RANGE) {
+            output += 'M' + std::to_string(node.metric) + ':' + std::to_string(std::bit_cast<uint64_t>(node.lowest)) + ':' + std::to_string(std::bit_cast<uint64_t>(node.highest));
+        } else if (node.kind == SearchNode::Kind::OPERATION) {
+            std::vector<std::string> operands;
+            for (const auto& child : node.children) {
+                operands.emplace_back();
+                canonicalizeNode(child, operands.back());
+            }
+            if (isCommutative(node.op)) {
+                std::sort(operands.begin(), operands.end());
+            }
+            output += '(';
+            for (const auto& operand : operands) {
+                output += operand + node.op;
+            }
+            output += ')';
+        } else {
+            output += "X(";
+            for (const auto& child : node.children) {
+                canonicalizeNode(child, output);
+                output += ',';
+            }
+            for (const auto& condition : node.conditions) {
+                output += condition.type + std::string(condition.comparator) + std::to_string(condition.occurrences) + ':' + std::to_string(std::bit_cast<uint32_t>(condition.percentage));
+                for (const auto& context : condition.contexts) {
+                    canonicalizeNode(context, output);
+                }
+            }
+            output += ')';
+        }
+    }
+
+    void explainNode(const SearchNode& node, std::size_t depth, std::string& output) {
+        output.append(2 * depth, ' ');
+        if (node.isComplement) {
+            output += "not ";
+        }
+        if (node.kind == SearchNode::Kind::UNIVERSE) {
+            output += "universe";
+        } else if (node.kind == SearchNode::Kind::EMPTY) {
+            output += "empty";
+        } else if (node.kind == SearchNode::Kind::TAG) {
+            output += "tag " + std::to_string(node.externalTag);
+        } else if (node.kind == SearchNode::Kind::TAGGABLE_LIST) {
+            output += "taggables";
+        } else if (node.kind == SearchNode::Kind::METRIC_RANGE) {
+            output += "metric " + std::to_string(node.metric) + " from " + std::to_string(node.lowest) + " to " + std::to_string(node.highest);
+        } else if (node.kind == SearchNode::Kind::OPERATION) {
+            output += node.op == '&' ? "intersect" : node.op == '|' ? "union" : node.op == '-' ? "difference" : "symmetric difference";
+        } else {
+            output += "conditional union";
+        }
+        output += " estimated " + std::to_string(node.estimatedSize) + " actual ";
+        output += node.actualSize.has_value() ? std::to_string(node.actualSize.value()) : "skipped";
+        output += '\n';
+
+        for (const auto& child : node.children) {
+            explainNode(child, depth + 1, output);
+        }
+        for (const auto& condition : node.conditions) {
+            output.append(2 * (depth + 1), ' ');
+            output += std::string("condition ") + condition.type + " " + std::string(condition.comparator) + "\n";
+            for (const auto& context : condition.contexts) {
+                explainNode(context, depth + 2, output);
+            }
+        }
+    }
+}
+
+void searchPlan::plan(SearchNode& node, std::size_t universeSize) {
+    for (auto& child : node.children) {
+        plan(child, universeSize);
+    }
+    for (auto& condition : node.conditions) {
+        for (auto& context : condition.contexts) {
+            plan(context, universeSize);
+        }
+    }
+
+    std::size_t size = universeSize;
+    if (node.kind == SearchNode::Kind::EMPTY) {
+        size = 0;
+    } else if (node.kind == SearchNode::Kind::TAG) {
+        size = node.taggables == nullptr ? 0 : node.taggables->size();
+    } else if (node.kind == SearchNode::Kind::TAGGABLE_LIST) {
+        size = node.taggableList.size();
+    } else if (node.kind == SearchNode::Kind::METRIC_RANGE) {
+        // counting the values in the range would walk them, so every value of the metric is the estimate
+        const auto* column = node.metricColumns->column(node.metric);
+        size = std::min(column == nullptr ? 0 : column->size(), universeSize);
+    } else if (node.kind == SearchNode::Kind::OPERATION) {
+        if (isCommutative(node.op)) {
+            // an intersection starting from its smallest operand never holds more than that operand does
+            std::stable_sort(node.children.begin(), node.children.end(), [](const SearchNode& lhs, const SearchNode& rhs) {
+                return lhs.estimatedSize < rhs.estimatedSize;
+            });
+        }
+
+        size = node.children.front().estimatedSize;
+        for (std::size_t i = 1; i < node.children.size(); ++i) {
+            auto childSize = node.children[i].estimatedSize;
+            if (node.op == '&') {
+                size = std::min(size, childSize);
+            } else if (node.op == '|' || node.op == '^') {
+                size = std::min(size + childSize, universeSize);
+            }
+        }
+    }
+
+    node.estimatedSize = node.isComplement ? universeSize - std::min(size, universeSize) : size;
+    // the size of a conditional union is not known until its conditions are, so it is estimated as everything either way
+    if (node.kind == SearchNode::Kind::CONDITIONAL_EXPRESSION_LIST_UNION) {
+        node.estimatedSize = universeSize;
+    }
+}
+
+SetEvaluation searchPlan::evaluate(SearchNode& node, const RoaringBitmap* universe, std::size_t threadCount) {
+    auto result = SetEvaluation(false, universe, RoaringBitmap());
+    if (node.kind == SearchNode::Kind::UNIVERSE) {
+        result = SetEvaluation(false, universe, universe);
+    } else if (node.kind == SearchNode::Kind::EMPTY) {
+        result = SetEvaluation(false, universe, RoaringBitmap());
+    } else if (node.kind == SearchNode::Kind::TAG) {
+        if (node.taggables != nullptr) {
+            result = SetEvaluation(node.taggables->isComplement(), universe, &node.taggables->physicalContents());
+        }
+    } else if (node.kind == SearchNode::Kind::TAGGABLE_LIST) {
+        result = SetEvaluation(false, universe, std::move(node.taggableList));
+    } else if (node.kind == SearchNode::Kind::METRIC_RANGE) {
+        result = SetEvaluation(false, universe, node.metricColumns->range(node.metric, node.lowest, node.highest));
+    } else if (node.kind == SearchNode::Kind::OPERATION) {
+        // the first set made by an operation is changed in place by each operand after it, the sets of tags are only ever borrowed
+        result = evaluate(node.children.front(), universe, threadCount);
+        for (std::size_t i = 1; i < node.children.size(); ++i) {
+            if (isSettled(node.op, result, universe->size())) {
+                break;
+            }
+            result = SET_OPERATIONS.at(node.op)(std::move(result), evaluate(node.children[i], universe, threadCount));
+        }
+    } else {
+        std::vector<SetEvaluation> expressions;
+        for (auto& child : node.children) {
+            expressions.push_back(evaluate(child, universe, threadCount));
+        }
+        for (auto& condition : node.conditions) {
+            applyCondition(expressions, condition, universe, threadCount);
+        }
+        result = SetEvaluation::setUnionAll(expressions, universe);
+    }
+
+    if (node.isComplement) {
+        result.complement();
+    }
+    node.actualSize = result.size();
+    return result;
+}
+
+std::size_t searchPlan::count(SearchNode& node, const RoaringBitmap* universe, std::size_t threadCount) {
+    if (node.kind != SearchNode::Kind::OPERATION) {
+        return evaluate(node, universe, threadCount).size();
+    }
+
+    // every operand but the last is evaluated as usual, the last is only counted against them
+    auto& lastChild = node.children.back();
+    auto lhsSet = evaluate(node.children.front(), universe, threadCount);
+    for (std::size_t i = 1; i + 1 < node.children.size() && !isSettled(node.op, lhsSet, universe->size()); ++i) {
+        lhsSet = SET_OPERATIONS.at(node.op)(std::move(lhsSet), evaluate(node.children[i], universe, threadCount));
+    }
+
+    std::size_t size = lhsSet.size();
+    if (!isSettled(node.op, lhsSet, universe->size())) {
+        auto rhsSet = evaluate(lastChild, universe, threadCount);
+        auto intersectSize = SetEvaluation::intersectSize(lhsSet, rhsSet);
+        if (node.op == '&') {
+            size = intersectSize;
+        } else if (node.op == '|') {
+            size = lhsSet.size() + rhsSet.size() - intersectSize;
+        } else if (node.op == '-') {
+            size = lhsSet.size() - intersectSize;
+        } else {
+            size = lhsSet.size() + rhsSet.size() - 2 * intersectSize;
+        }
+    }
+
+    if (node.isComplement) {
+        size = universe->size() - size;
+    }
+    node.actualSize = size;
+    return size;
+}
+
+std::string searchPlan::canonicalize(const SearchNode& node) {
+    std::string output;
+    canonicalizeNode(node, output);
+    return output;
+}
+
+void searchPlan::collectVersions(const SearchNode& node, std::vector<uint64_t>& versions) {
+    if (node.kind == SearchNode::Kind::TAG || node.kind == SearchNode::Kind::METRIC_RANGE) {
+        versions.push_back(node.version);
+    }
+    for (const auto& child : node.children) {
+        collectVersions(child, versions);
+    }
+    for (const auto& condition : node.conditions) {
+        for (const auto& context : condition.contexts) {
+            collectVersions(context, versions);
+        }
+    }
+}
+
+std::string searchPlan::explain(const SearchNode& node) {
+    std::string output;
+    explainNode(node, 0, output);
+    return output;
+}
\ No newline at end of file
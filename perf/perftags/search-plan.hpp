@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "roaring-bitmap.hpp"
+#include "id-pair-container.hpp"
+#include "metric-columns.hpp"
+#include "set-evaluation.hpp"
+
+struct SearchCondition;
+
+// A search expression parsed into a tree, so that it can be evaluated in a cheaper order than it was written in
+struct SearchNode {
+    enum class Kind {
+        UNIVERSE,
+        EMPTY,
+        TAG,
+        TAGGABLE_LIST,
+        // the taggables with a value of metric from lowest to highest
+        METRIC_RANGE,
+        // applies op between each of children in turn
+        OPERATION,
+        CONDITIONAL_EXPRESSION_LIST_UNION
+    };
+
+    Kind kind = Kind::UNIVERSE;
+    bool isComplement = false;
+    char op = 0;
+    std::vector<SearchNode> children;
+    // a tag's taggables, nullptr when the tag has none
+    uint64_t externalTag = 0;
+    const IdPairSecond* taggables = nullptr;
+    // the version of the bucket the taggables were found in, or of the bucket of tags when the tag was not found, or of the metric bucket for a metric range
+    uint64_t version = 0;
+    RoaringBitmap taggableList;
+    uint64_t metric = 0;
+    double lowest = 0;
+    double highest = 0;
+    const MetricColumns* metricColumns = nullptr;
+    std::vector<SearchCondition> conditions;
+
+    std::size_t estimatedSize = 0;
+    // left empty for a node that was never evaluated because its operation already had its result
+    std::optional<std::size_t> actualSize;
+};
+
+// A condition of a conditional expression list union, one of the ops below followed by what it compares against
+struct SearchCondition {
+    static const char COUNT_OP = 'C';
+    static const char PERCENTAGE_OP = 'P';
+    static const char FILTERED_PERCENTAGE_OP = 'F';
+
+    char type;
+    std::string_view comparator;
+    uint64_t occurrences = 0;
+    float percentage = 0;
+    // the compare expression, preceded by the filtering expression for F
+    std::vector<SearchNode> contexts;
+};
+
+namespace searchPlan {
+    // Estimates the size of node and everything under it, reordering the operands of commutative operations from smallest estimate to largest
+    void plan(SearchNode& node, std::size_t universeSize);
+    // Evaluates a planned node, skipping the rest of an operation's operands once they cannot change its result
+    // long conditional expression lists are checked on up to threadCount threads, 0 uses one per hardware thread
+    SetEvaluation evaluate(SearchNode& node, const RoaringBitmap* universe, std::size_t threadCount);
+    // The size evaluate would give, where the last operand of an operation is only counted against the rest rather than applied to them
+    std::size_t count(SearchNode& node, const RoaringBitmap* universe, std::size_t threadCount);
+    // Writes node as an indented tree of operations with their estimated and actual sizes
+    std::string explain(const SearchNode& node);
+    // Writes node the same way for every order the operands of its commutative operations could be written in
+    std::string canonicalize(const SearchNode& node);
+    // Adds the version of every bucket node's tags and metric values were found in to versions
+    void collectVersions(const SearchNode& node, std::vector<uint64_t>& versions);
+}
\ No newline at end of file
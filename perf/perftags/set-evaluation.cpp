@@ -1,13 +1,14 @@
 #include "set-evaluation.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 
-SetEvaluation::SetEvaluation(bool isComplement, const std::unordered_set<uint64_t>* universe, std::unordered_set<uint64_t> items)
+SetEvaluation::SetEvaluation(bool isComplement, const RoaringBitmap* universe, RoaringBitmap items)
     : isComplement_(isComplement), universe_(universe), items_(std::move(items)), itemsPtr_(&this->items_.value())
 {}
 
-SetEvaluation::SetEvaluation(bool isComplement, const std::unordered_set<uint64_t>* universe, const std::unordered_set<uint64_t>* items)
+SetEvaluation::SetEvaluation(bool isComplement, const RoaringBitmap* universe, const RoaringBitmap* items)
     : isComplement_(isComplement), universe_(universe), itemsPtr_(items)
 {}
 
@@ -28,6 +29,8 @@ SetEvaluation& SetEvaluation::operator=(SetEvaluation&& setEvaluation) {
         items_ = std::move(setEvaluation.items_);
         itemsPtr_ = &items_.value();
     } else {
+        // items this held before would otherwise be taken for its own when it is moved again
+        items_.reset();
         itemsPtr_ = setEvaluation.itemsPtr_;
     }
     
@@ -37,15 +40,30 @@ SetEvaluation& SetEvaluation::operator=(SetEvaluation&& setEvaluation) {
     return *this;
 }
 
-std::unordered_set<uint64_t> SetEvaluation::releaseResult() {
+RoaringBitmap* SetEvaluation::ownedItems() {
+    return items_.has_value() ? &items_.value() : nullptr;
+}
+
+SetEvaluation SetEvaluation::inPlace(SetEvaluation&& target, bool isComplement, SetEvaluation&& operand, void (RoaringBitmap::*operation)(const RoaringBitmap&), RoaringBitmap (*makeResult)(const RoaringBitmap&, const RoaringBitmap&)) {
+    if (auto* items = target.ownedItems()) {
+        (items->*operation)(*operand.itemsPtr_);
+        target.isComplement_ = isComplement;
+        return std::move(target);
+    }
+    // subtracting is the only operation whose operands cannot be swapped
+    auto* operandItems = operand.ownedItems();
+    if (operandItems != nullptr && operation != &RoaringBitmap::subtract) {
+        (operandItems->*operation)(*target.itemsPtr_);
+        operand.isComplement_ = isComplement;
+        return std::move(operand);
+    }
+
+    return SetEvaluation(isComplement, target.universe_, makeResult(*target.itemsPtr_, *operand.itemsPtr_));
+}
+
+RoaringBitmap SetEvaluation::releaseResult() {
     if (isComplement_) {
-        std::unordered_set<uint64_t> itemsComplement;
-        for (auto item : *universe_) {
-            if (!itemsPtr_->contains(item)) {
-                itemsComplement.insert(item);
-            }
-        }
-        return itemsComplement;
+        return RoaringBitmap::difference(*universe_, *itemsPtr_);
     } else if (items_) {
         return std::move(items_.value());
     } else {
@@ -66,54 +84,34 @@ std::size_t SetEvaluation::size() const {
 }
 
 SetEvaluation SetEvaluation::rightHandSide(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet) {
-    return SetEvaluation(rhsSet.isComplement_, rhsSet.universe_, std::unordered_set<uint64_t>(*rhsSet.itemsPtr_));
+    return std::move(rhsSet);
 }
 SetEvaluation SetEvaluation::symmetricDifference(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet) {
     if (lhsSet.universe_ != rhsSet.universe_) {
         throw std::logic_error("Sets had different universe values");
     }
-    const auto* universe = lhsSet.universe_;
 
-    if (lhsSet.isComplement_) {
-        if (rhsSet.isComplement_) {
-            // ~A ^ ~B <=> A ^ B
-            return SetEvaluation(false, universe, usetSymmetricDifference_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        } else {
-            // (A ^ ~B) <=> (A N B) U (~A N ~B)  <=> (A U (~A U ~B)) N (B U (~A U ~B)) <=> (A U ~B) N (~A U B) <=> ~(~A N B) N ~(A N ~B) <=> ~((~A N B) U (A N ~B)) <=> ~(A ^ B)
-            return SetEvaluation(true, universe, usetSymmetricDifference_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        }
-    } else {
-        if (rhsSet.isComplement_) {
-            // (A ^ ~B) <=> (A N B) U (~A N ~B)  <=> (A U (~A U ~B)) N (B U (~A U ~B)) <=> (A U ~B) N (~A U B) <=> ~(~A N B) N ~(A N ~B) <=> ~((~A N B) U (A N ~B)) <=> ~(A ^ B)
-            return SetEvaluation(true, universe, usetSymmetricDifference_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        } else {
-            // A ^ B
-            return SetEvaluation(false, universe, usetSymmetricDifference_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        }
-    }
+    // ~A ^ ~B <=> A ^ B
+    // (A ^ ~B) <=> (A N B) U (~A N ~B)  <=> (A U (~A U ~B)) N (B U (~A U ~B)) <=> (A U ~B) N (~A U B) <=> ~(~A N B) N ~(A N ~B) <=> ~((~A N B) U (A N ~B)) <=> ~(A ^ B)
+    return inPlace(std::move(lhsSet), lhsSet.isComplement_ != rhsSet.isComplement_, std::move(rhsSet), &RoaringBitmap::symmetricDifferenceWith, RoaringBitmap::symmetricDifference);
 }
 SetEvaluation SetEvaluation::difference(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet) {
     if (lhsSet.universe_ != rhsSet.universe_) {
         throw std::logic_error("Sets had different universe values");
     }
-    const auto* universe = lhsSet.universe_;
 
-    if (lhsSet.isComplement_) {
-        if (rhsSet.isComplement_) {
-            // ~A - ~B <=> ~A N B <=> B N ~A
-            return SetEvaluation(false, universe, usetIntersectRHSComplement_(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
-        } else {
-            // ~A - B <=> ~A N ~B <=> ~(A U B)
-            return SetEvaluation(true, universe, usetUnion_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        }
+    if (lhsSet.isComplement_ && rhsSet.isComplement_) {
+        // ~A - ~B <=> ~A N B <=> B N ~A
+        return inPlace(std::move(rhsSet), false, std::move(lhsSet), &RoaringBitmap::subtract, RoaringBitmap::difference);
+    } else if (lhsSet.isComplement_) {
+        // ~A - B <=> ~A N ~B <=> ~(A U B)
+        return inPlace(std::move(lhsSet), true, std::move(rhsSet), &RoaringBitmap::unionWith, RoaringBitmap::setUnion);
+    } else if (rhsSet.isComplement_) {
+        // A - ~B <=> A N B
+        return inPlace(std::move(lhsSet), false, std::move(rhsSet), &RoaringBitmap::intersectWith, RoaringBitmap::intersect);
     } else {
-        if (rhsSet.isComplement_) {
-            // A - ~B <=> A N B
-            return SetEvaluation(false, universe, usetIntersect_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        } else {
-            // A - B <=> A N ~B
-            return SetEvaluation(false, universe, usetIntersectRHSComplement_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        }
+        // A - B <=> A N ~B
+        return inPlace(std::move(lhsSet), false, std::move(rhsSet), &RoaringBitmap::subtract, RoaringBitmap::difference);
     }
 }
 
@@ -126,18 +124,18 @@ SetEvaluation SetEvaluation::intersect(const SetEvaluation& lhsSet, SetEvaluatio
     if (lhsSet.isComplement_) {
         if (rhsSet.isComplement_) {
             // ~A N ~B <=> ~(A U B)
-            return SetEvaluation(true, universe, usetUnion_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            return SetEvaluation(true, universe, RoaringBitmap::setUnion(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         } else {
             // ~A N B <=> B N ~A
-            return SetEvaluation(false, universe, usetIntersectRHSComplement_(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
+            return SetEvaluation(false, universe, RoaringBitmap::difference(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
         }
     } else {
         if (rhsSet.isComplement_) {
             // A N ~B
-            return SetEvaluation(false, universe, usetIntersectRHSComplement_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            return SetEvaluation(false, universe, RoaringBitmap::difference(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         } else {
             // A N B
-            return SetEvaluation(false, universe, usetIntersect_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            return SetEvaluation(false, universe, RoaringBitmap::intersect(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         }
     }
 }
@@ -151,147 +149,137 @@ SetEvaluation SetEvaluation::intersect(const SetEvaluation& lhsSet, const SetEva
     if (lhsSet.isComplement_) {
         if (rhsSet.isComplement_) {
             // ~A N ~B <=> ~(A U B)
-            return SetEvaluation(true, universe, usetUnion_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            return SetEvaluation(true, universe, RoaringBitmap::setUnion(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         } else {
             // ~A N B <=> B N ~A
-            return SetEvaluation(false, universe, usetIntersectRHSComplement_(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
+            return SetEvaluation(false, universe, RoaringBitmap::difference(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
         }
     } else {
         if (rhsSet.isComplement_) {
             // A N ~B
-            return SetEvaluation(false, universe, usetIntersectRHSComplement_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            return SetEvaluation(false, universe, RoaringBitmap::difference(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         } else {
             // A N B
-            return SetEvaluation(false, universe, usetIntersect_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            return SetEvaluation(false, universe, RoaringBitmap::intersect(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         }
     }
 }
 
-SetEvaluation SetEvaluation::intersect(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet) {
-    const auto& immutableLHSSet = lhsSet;
-    return intersect(immutableLHSSet, std::move(rhsSet));
-}
-
-SetEvaluation SetEvaluation::setUnion(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet) {
-    if (!lhsSet.items_.has_value()) {
-        throw std::logic_error("LHS did not have real value");
+SetEvaluation SetEvaluation::setUnionAll(const std::vector<SetEvaluation>& sets, const RoaringBitmap* universe) {
+    std::vector<const RoaringBitmap*> items;
+    std::vector<const RoaringBitmap*> complementItems;
+    for (const auto& set : sets) {
+        if (set.universe_ != universe) {
+            throw std::logic_error("Sets had different universe values");
+        }
+        (set.isComplement_ ? complementItems : items).push_back(set.itemsPtr_);
     }
-    if (lhsSet.universe_ != rhsSet.universe_) {
-        throw std::logic_error("Sets had different universe values");
+
+    if (complementItems.empty()) {
+        return SetEvaluation(false, universe, RoaringBitmap::setUnionAll(items));
     }
-    const auto* universe_ = lhsSet.universe_;
 
-    if (lhsSet.isComplement_) {
-        if (rhsSet.isComplement_) {
-            // ~A U ~B <=> ~(A N B)
-            return SetEvaluation(true, universe_, usetIntersect_(std::move(*lhsSet.items_), *rhsSet.itemsPtr_));
-        } else {
-            // ~A U B <=> ~(A N ~B)
-            return SetEvaluation(true, universe_, usetIntersectRHSComplement_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
-        }
-    } else {
-        if (rhsSet.isComplement_) {
-            // A U ~B <=> ~(~A N B) <=> ~(B N ~A)
-            return SetEvaluation(true, universe_, usetIntersectRHSComplement_(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
-        } else {
-            // A U B
-            usetUnion_(*lhsSet.items_, *rhsSet.itemsPtr_);
-            return SetEvaluation(false, universe_, std::move(*lhsSet.items_));
-        }
+    // ~A U ~B U C U D <=> ~((A N B) - (C U D))
+    std::sort(complementItems.begin(), complementItems.end(), [](const RoaringBitmap* lhs, const RoaringBitmap* rhs) {
+        return lhs->size() < rhs->size();
+    });
+    auto complementIntersection = *complementItems.front();
+    for (std::size_t i = 1; i < complementItems.size() && !complementIntersection.empty(); ++i) {
+        complementIntersection = RoaringBitmap::intersect(complementIntersection, *complementItems[i]);
     }
+    if (!items.empty() && !complementIntersection.empty()) {
+        complementIntersection = RoaringBitmap::difference(complementIntersection, RoaringBitmap::setUnionAll(items));
+    }
+
+    return SetEvaluation(true, universe, std::move(complementIntersection));
 }
 
-SetEvaluation SetEvaluation::setUnion(const SetEvaluation& lhsSet, const SetEvaluation& rhsSet) {
-    if (!lhsSet.items_.has_value()) {
-        throw std::logic_error("LHS did not have real value");
-    }
+std::size_t SetEvaluation::intersectSize(const SetEvaluation& lhsSet, const SetEvaluation& rhsSet) {
     if (lhsSet.universe_ != rhsSet.universe_) {
         throw std::logic_error("Sets had different universe values");
     }
-    const auto* universe_ = lhsSet.universe_;
 
+    auto physicalIntersectSize = RoaringBitmap::intersectSize(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_);
     if (lhsSet.isComplement_) {
         if (rhsSet.isComplement_) {
-            // ~A U ~B <=> ~(A N B)
-            return SetEvaluation(true, universe_, usetIntersect_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            // |~A N ~B| <=> |~(A U B)| <=> |U| - (|A| + |B| - |A N B|)
+            return lhsSet.universe_->size() - (lhsSet.itemsPtr_->size() + rhsSet.itemsPtr_->size() - physicalIntersectSize);
         } else {
-            // ~A U B <=> ~(A N ~B)
-            return SetEvaluation(true, universe_, usetIntersectRHSComplement_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            // |~A N B| <=> |B| - |A N B|
+            return rhsSet.itemsPtr_->size() - physicalIntersectSize;
         }
     } else {
         if (rhsSet.isComplement_) {
-            // A U ~B <=> ~(~A N B) <=> ~(B N ~A)
-            return SetEvaluation(true, universe_, usetIntersectRHSComplement_(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
+            // |A N ~B| <=> |A| - |A N B|
+            return lhsSet.itemsPtr_->size() - physicalIntersectSize;
         } else {
-            // A U B
-            return SetEvaluation(false, universe_, usetUnion_(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+            // |A N B|
+            return physicalIntersectSize;
         }
     }
 }
 
-std::unordered_set<uint64_t>& SetEvaluation::usetUnion_(std::unordered_set<uint64_t>& modifiableSet, const std::unordered_set<uint64_t>& unmodifiableSet) {
-    for (auto item : unmodifiableSet) {
-        modifiableSet.insert(item);
-    }
-
-    return modifiableSet;
-}
-
-std::unordered_set<uint64_t> SetEvaluation::usetUnion_(const std::unordered_set<uint64_t>& smallerSet, const std::unordered_set<uint64_t>& largerSet) {
-    if (smallerSet.size() > largerSet.size()) {
-        return usetUnion_(largerSet, smallerSet);
+SetEvaluation SetEvaluation::intersect(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet) {
+    if (lhsSet.universe_ != rhsSet.universe_) {
+        throw std::logic_error("Sets had different universe values");
     }
 
-    std::unordered_set<uint64_t> result = largerSet;
-
-    for (auto item : smallerSet) {
-        result.insert(item);
+    if (lhsSet.isComplement_ && rhsSet.isComplement_) {
+        // ~A N ~B <=> ~(A U B)
+        return inPlace(std::move(lhsSet), true, std::move(rhsSet), &RoaringBitmap::unionWith, RoaringBitmap::setUnion);
+    } else if (lhsSet.isComplement_) {
+        // ~A N B <=> B N ~A
+        return inPlace(std::move(rhsSet), false, std::move(lhsSet), &RoaringBitmap::subtract, RoaringBitmap::difference);
+    } else if (rhsSet.isComplement_) {
+        // A N ~B
+        return inPlace(std::move(lhsSet), false, std::move(rhsSet), &RoaringBitmap::subtract, RoaringBitmap::difference);
+    } else {
+        // A N B
+        return inPlace(std::move(lhsSet), false, std::move(rhsSet), &RoaringBitmap::intersectWith, RoaringBitmap::intersect);
     }
-
-    return result;
 }
 
-std::unordered_set<uint64_t> SetEvaluation::usetIntersect_(const std::unordered_set<uint64_t>& smallerSet, const std::unordered_set<uint64_t>& largerSet) {
-    if (smallerSet.size() > largerSet.size()) {
-        return usetIntersect_(largerSet, smallerSet);
+SetEvaluation SetEvaluation::setUnion(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet) {
+    if (lhsSet.universe_ != rhsSet.universe_) {
+        throw std::logic_error("Sets had different universe values");
     }
 
-    std::unordered_set<uint64_t> result;
-
-    for (auto item : smallerSet) {
-        if (largerSet.contains(item)) {
-            result.insert(item);
-        }
+    if (lhsSet.isComplement_ && rhsSet.isComplement_) {
+        // ~A U ~B <=> ~(A N B)
+        return inPlace(std::move(lhsSet), true, std::move(rhsSet), &RoaringBitmap::intersectWith, RoaringBitmap::intersect);
+    } else if (lhsSet.isComplement_) {
+        // ~A U B <=> ~(A N ~B)
+        return inPlace(std::move(lhsSet), true, std::move(rhsSet), &RoaringBitmap::subtract, RoaringBitmap::difference);
+    } else if (rhsSet.isComplement_) {
+        // A U ~B <=> ~(~A N B) <=> ~(B N ~A)
+        return inPlace(std::move(rhsSet), true, std::move(lhsSet), &RoaringBitmap::subtract, RoaringBitmap::difference);
+    } else {
+        // A U B
+        return inPlace(std::move(lhsSet), false, std::move(rhsSet), &RoaringBitmap::unionWith, RoaringBitmap::setUnion);
     }
-
-    return result;
 }
 
-std::unordered_set<uint64_t> SetEvaluation::usetIntersectRHSComplement_(const std::unordered_set<uint64_t>& lhsSet, const std::unordered_set<uint64_t>& rhsSet) {
-    std::unordered_set<uint64_t> result;
-
-    for (auto item : lhsSet) {
-        if (!rhsSet.contains(item)) {
-            result.insert(item);
-        }
+SetEvaluation SetEvaluation::setUnion(const SetEvaluation& lhsSet, const SetEvaluation& rhsSet) {
+    if (lhsSet.universe_ != rhsSet.universe_) {
+        throw std::logic_error("Sets had different universe values");
     }
-    return result;
-}
-
-std::unordered_set<uint64_t> SetEvaluation::usetSymmetricDifference_(const std::unordered_set<uint64_t>& lhsSet, const std::unordered_set<uint64_t>& rhsSet) {
-    std::unordered_set<uint64_t> result;
+    const auto* universe_ = lhsSet.universe_;
 
-    for (auto item : lhsSet) {
-        if (!rhsSet.contains(item)) {
-            result.insert(item);
+    if (lhsSet.isComplement_) {
+        if (rhsSet.isComplement_) {
+            // ~A U ~B <=> ~(A N B)
+            return SetEvaluation(true, universe_, RoaringBitmap::intersect(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
+        } else {
+            // ~A U B <=> ~(A N ~B)
+            return SetEvaluation(true, universe_, RoaringBitmap::difference(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         }
-    }
-    
-    for (auto item : rhsSet) {
-        if (!lhsSet.contains(item)) {
-            result.insert(item);
+    } else {
+        if (rhsSet.isComplement_) {
+            // A U ~B <=> ~(~A N B) <=> ~(B N ~A)
+            return SetEvaluation(true, universe_, RoaringBitmap::difference(*rhsSet.itemsPtr_, *lhsSet.itemsPtr_));
+        } else {
+            // A U B
+            return SetEvaluation(false, universe_, RoaringBitmap::setUnion(*lhsSet.itemsPtr_, *rhsSet.itemsPtr_));
         }
     }
-
-    return result;
 }
\ No newline at end of file
@@ -1,19 +1,21 @@
 #pragma once
 
-#include <unordered_set>
 #include <optional>
 #include <cstdint>
+#include <vector>
+
+#include "roaring-bitmap.hpp"
 
 class SetEvaluation {
     public:
-        SetEvaluation(bool isComplement, const std::unordered_set<uint64_t>* universe, std::unordered_set<uint64_t> items);
-        SetEvaluation(bool isComplement, const std::unordered_set<uint64_t>* universe, const std::unordered_set<uint64_t>* items);
+        SetEvaluation(bool isComplement, const RoaringBitmap* universe, RoaringBitmap items);
+        SetEvaluation(bool isComplement, const RoaringBitmap* universe, const RoaringBitmap* items);
         SetEvaluation(const SetEvaluation& setEvaluation) = delete;
         SetEvaluation operator=(const SetEvaluation& setEvaluation) = delete;
         SetEvaluation(SetEvaluation&& setEvaluation);
         SetEvaluation& operator=(SetEvaluation&& setEvaluation);
         // Note: this will invalidate the SetEvaluation that the result was moved from
-        std::unordered_set<uint64_t> releaseResult();
+        RoaringBitmap releaseResult();
 
         void complement();
         std::size_t size() const;
@@ -25,14 +27,19 @@ class SetEvaluation {
         static SetEvaluation intersect(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet);
         static SetEvaluation setUnion(SetEvaluation&& lhsSet, SetEvaluation&& rhsSet);
         static SetEvaluation setUnion(const SetEvaluation& lhsSet, const SetEvaluation& rhsSet);
+        // The union of every set in sets, which all have universe as their universe
+        static SetEvaluation setUnionAll(const std::vector<SetEvaluation>& sets, const RoaringBitmap* universe);
+        // The size of the intersection, without making it
+        static std::size_t intersectSize(const SetEvaluation& lhsSet, const SetEvaluation& rhsSet);
     private:
-        static std::unordered_set<uint64_t> usetIntersect_(const std::unordered_set<uint64_t>& smallerSet, const std::unordered_set<uint64_t>& largerSet);
-        static std::unordered_set<uint64_t>& usetUnion_(std::unordered_set<uint64_t>& modifiableSet, const std::unordered_set<uint64_t>& unmodifiableSet);
-        static std::unordered_set<uint64_t> usetUnion_(const std::unordered_set<uint64_t>& smallerSet, const std::unordered_set<uint64_t>& largerSet);
-        static std::unordered_set<uint64_t> usetIntersectRHSComplement_(const std::unordered_set<uint64_t>& lhsSet, const std::unordered_set<uint64_t>& rhsSet);
-        static std::unordered_set<uint64_t> usetSymmetricDifference_(const std::unordered_set<uint64_t>& lhsSet, const std::unordered_set<uint64_t>& rhsSet);
+        // The items when this set owns them rather than borrowing them, so they can be changed in place
+        RoaringBitmap* ownedItems();
+        // target's items with operation applied to them, in place when target owns them or when operand does and the operation is commutative,
+        // otherwise made with makeResult
+        static SetEvaluation inPlace(SetEvaluation&& target, bool isComplement, SetEvaluation&& operand, void (RoaringBitmap::*operation)(const RoaringBitmap&), RoaringBitmap (*makeResult)(const RoaringBitmap&, const RoaringBitmap&));
+
         bool isComplement_;
-        const std::unordered_set<uint64_t>* universe_;
-        std::optional<std::unordered_set<uint64_t>> items_;
-        const std::unordered_set<uint64_t>* itemsPtr_;
+        const RoaringBitmap* universe_;
+        std::optional<RoaringBitmap> items_;
+        const RoaringBitmap* itemsPtr_;
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "stream-vbyte.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    unsigned char byteLength(uint32_t delta) {
+        if (delta < (1U << 8)) {
+            return 1;
+        } else if (delta < (1U << 16)) {
+            return 2;
+        } else if (delta < (1U << 24)) {
+            return 3;
+        }
+        return 4;
+    }
+}
+
+std::size_t streamVByte::maxEncodedBytes(std::size_t count) {
+    return ((count + 3) / 4) + (4 * count);
+}
+
+std::size_t streamVByte::encodeSorted(const std::vector<uint64_t>& sortedIds, std::string& str, std::size_t location) {
+    auto controlBytes = (sortedIds.size() + 3) / 4;
+    if (location + maxEncodedBytes(sortedIds.size()) > str.size()) {
+        str.resize(location + maxEncodedBytes(sortedIds.size()));
+    }
+
+    auto* control = reinterpret_cast<unsigned char*>(str.data() + location);
+    auto* data = control + controlBytes;
+    std::fill(control, data, 0);
+    uint64_t previous = 0;
+    for (std::size_t i = 0; i < sortedIds.size(); ++i) {
+        auto id = sortedIds[i];
+        if (id > UINT32_MAX || id < previous) {
+            throw std::logic_error(std::string("Id ") + std::to_string(id) + " is not an ascending 32 bit id, which is all stream vbyte encodes");
+        }
+
+        auto delta = static_cast<uint32_t>(id - previous);
+        previous = id;
+        auto length = byteLength(delta);
+        control[i / 4] |= (length - 1) << ((i % 4) * 2);
+        for (unsigned char byte = 0; byte < length; ++byte) {
+            *data++ = static_cast<unsigned char>(delta >> (8 * byte));
+        }
+    }
+
+    return data - reinterpret_cast<unsigned char*>(str.data());
+}
+
+void streamVByte::decodeSorted(std::string_view str, std::size_t count, std::size_t& inputOffset, std::vector<uint64_t>& output) {
+    auto controlBytes = (count + 3) / 4;
+    if (inputOffset + controlBytes + count > str.size()) {
+        throw std::logic_error(std::string("Stream vbyte of ") + std::to_string(count) + " ids runs past the end of its input");
+    }
+
+    const auto* control = reinterpret_cast<const unsigned char*>(str.data() + inputOffset);
+    const auto* data = control + controlBytes;
+    std::size_t dataBytes = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        dataBytes += ((control[i / 4] >> ((i % 4) * 2)) & 0x3) + 1;
+    }
+    if (inputOffset + controlBytes + dataBytes > str.size()) {
+        throw std::logic_error(std::string("Stream vbyte of ") + std::to_string(count) + " ids runs past the end of its input");
+    }
+
+    output.reserve(output.size() + count);
+    uint64_t previous = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto length = ((control[i / 4] >> ((i % 4) * 2)) & 0x3) + 1;
+        uint32_t delta = 0;
+        for (int byte = 0; byte < length; ++byte) {
+            delta |= static_cast<uint32_t>(*data++) << (8 * byte);
+        }
+        previous += delta;
+        output.push_back(previous);
+    }
+
+    inputOffset += controlBytes + dataBytes;
+}
+
+std::size_t streamVByte::serializeVarUInt(uint64_t i, std::string& str, std::size_t location) {
+    do {
+        unsigned char byte = i & 0x7F;
+        i >>= 7;
+        if (i != 0) {
+            byte |= 0x80;
+        }
+        if (location >= str.size()) {
+            str.resize(location + 1);
+        }
+        str[location++] = static_cast<char>(byte);
+    } while (i != 0);
+
+    return location;
+}
+
+uint64_t streamVByte::deserializeVarUInt(std::string_view str, std::size_t& inputOffset) {
+    uint64_t i = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (inputOffset >= str.size()) {
+            throw std::logic_error("Variable length integer runs past the end of its input");
+        }
+
+        auto byte = static_cast<unsigned char>(str[inputOffset++]);
+        i |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return i;
+        }
+    }
+
+    throw std::logic_error("Variable length integer is longer than 64 bits");
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Sorted ids are stored as the deltas between them in the StreamVByte layout, where the 2 bit byte lengths of every delta come first as
+// control bytes, 4 to a byte, followed by the delta bytes themselves, which keeps the lengths apart from the data so it can be decoded in bulk
+namespace streamVByte {
+    // The most bytes encoding count ids can take
+    std::size_t maxEncodedBytes(std::size_t count);
+    // Encodes ascending 32 bit ids, returning the location after them
+    std::size_t encodeSorted(const std::vector<uint64_t>& sortedIds, std::string& str, std::size_t location);
+    // Decodes count ids written by encodeSorted, appending them to output
+    void decodeSorted(std::string_view str, std::size_t count, std::size_t& inputOffset, std::vector<uint64_t>& output);
+
+    // LEB128, 7 bits a byte with the high bit set on every byte but the last
+    std::size_t serializeVarUInt(uint64_t i, std::string& str, std::size_t location);
+    uint64_t deserializeVarUInt(std::string_view str, std::size_t& inputOffset);
+}
\ No newline at end of file
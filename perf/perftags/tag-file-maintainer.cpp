@@ -3,158 +3,965 @@
 #include <fstream>
 #include <istream>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <random>
+#include <thread>
 
 #include "atomic-ofstream.hpp"
+#include "parallel-for.hpp"
+#include "stream-vbyte.hpp"
 #include "../common/util.hpp"
 
-const int TagFileMaintainer::VERSION = 1;
+// Version 1 stored external ids in 8 bytes, version 2 stores dense internal ids from the id dictionaries in 4 bytes
+// Version 3 replaces the text cache file with a binary manifest holding the generation and checksum of every bucket's main file,
+// commits bucket diffs to two alternating write ahead logs instead of a write ahead file per bucket, and adds a bucket of metric values
+const int TagFileMaintainer::VERSION = 3;
 
 namespace {
-    std::string serializeSingles(const std::unordered_set<uint64_t>& contents) {
+    const int FIRST_INTERNAL_ID_VERSION = 2;
+    const int FIRST_MANIFEST_VERSION = 3;
+    // "PTMF" read as a little endian uint32
+    const uint32_t MANIFEST_MAGIC = 0x464D5450;
+    const std::size_t EXTERNAL_ID_BYTES = 8;
+    const std::size_t INTERNAL_ID_BYTES = 4;
+    const uint64_t EXTERNAL_ID_FAKER = 0xFFFFFFFFFFFFFFFFULL;
+    // the metric bucket's faker is a value of this metric, so it can never be given a value of its own
+    const uint64_t METRIC_FAKER = 0xFFFFFFFFFFFFFFFFULL;
+
+    template <class TContainer>
+    std::string serializeSingles(const TContainer& contents, std::size_t idBytes = EXTERNAL_ID_BYTES) {
         std::string filesStr;
 
-        filesStr.resize(8 * contents.size());
+        filesStr.resize(idBytes * contents.size());
         std::size_t location = 0;
         for (auto file : contents) {
-            location = util::serializeUInt64(file, filesStr, location);
+            location = util::serializeUInt(file, idBytes, filesStr, location);
         }
 
         return filesStr;
     }
 
+    // Serializes internal ids as their external ids, ids without an external id (FAKER) are never handed out
+    std::string serializeExternalSingles(const RoaringBitmap& contents, const IdDictionary& dictionary) {
+        std::string filesStr;
+
+        filesStr.resize(8 * contents.size());
+        std::size_t location = 0;
+        contents.forEach([&filesStr, &location, &dictionary](uint64_t internal) {
+            uint64_t external;
+            if (dictionary.toExternal(internal, external)) {
+                location = util::serializeUInt64(external, filesStr, location);
+            }
+        });
+        filesStr.resize(location);
+
+        return filesStr;
+    }
+
     template <class T>
-    void processSingles(std::string_view str, T callback) {
+    void processSingles(std::string_view str, T callback, std::size_t idBytes = EXTERNAL_ID_BYTES) {
         std::size_t inputOffset = 0;
 
-        if (str.size() % 8 != 0) {
-            throw std::logic_error(std::string("Input is malformed, not an even interval of 8"));
+        if (str.size() % idBytes != 0) {
+            throw std::logic_error(std::string("Input is malformed, not an even interval of ") + std::to_string(idBytes));
         }
         while (inputOffset < str.size()) {
-            uint64_t single = util::deserializeUInt64(str, inputOffset);
+            uint64_t single = util::deserializeUInt(str, idBytes, inputOffset);
             callback(single);
         }
     }
-}
 
-TagFileMaintainer::TagFileMaintainer(std::string folderName)
-    : folderPath_(std::move(folderName))
-{
-    cacheFilePath_ = folderPath_ / "cache.tdb";
-    readCacheFile();
-}
+    // "PTSS" read as a little endian uint32
+    const uint32_t COMPRESSED_SINGLES_MAGIC = 0x53535450;
+    const uint32_t COMPRESSED_SINGLES_FORMAT_VERSION = 1;
+    // {magic}{format version}{count}{data bytes} are 4+4+8+8 bytes
+    const std::size_t COMPRESSED_SINGLES_HEADER_BYTES = 24;
 
-TagFileMaintainer::~TagFileMaintainer() {
-    if (!closed_) {
-        close();
+    // Internal ids are serialized as stream vbyte deltas behind a header, external ids stay idBytes wide as they would not fit
+    std::string serializeCompressedSingles(std::vector<uint64_t> singles, std::size_t idBytes) {
+        if (idBytes != INTERNAL_ID_BYTES) {
+            return serializeSingles(singles, idBytes);
+        }
+
+        std::sort(singles.begin(), singles.end());
+        std::string singlesStr;
+        auto location = streamVByte::encodeSorted(singles, singlesStr, COMPRESSED_SINGLES_HEADER_BYTES);
+        singlesStr.resize(location);
+        std::size_t headerLocation = 0;
+        headerLocation = util::serializeUInt32(COMPRESSED_SINGLES_MAGIC, singlesStr, headerLocation);
+        headerLocation = util::serializeUInt32(COMPRESSED_SINGLES_FORMAT_VERSION, singlesStr, headerLocation);
+        headerLocation = util::serializeUInt64(singles.size(), singlesStr, headerLocation);
+        util::serializeUInt64(location - COMPRESSED_SINGLES_HEADER_BYTES, singlesStr, headerLocation);
+
+        return singlesStr;
     }
-}
 
-void TagFileMaintainer::readCacheFile() {
-    auto cacheFile = std::ifstream(cacheFilePath_);
-    int version = VERSION;
-    std::size_t totalFiles = 0;
-    std::size_t totalTags = 0;
+    // Legacy singles can start with the magic by chance, but will not also describe their own size
+    bool isCompressedSingles(std::string_view str) {
+        if (str.size() < COMPRESSED_SINGLES_HEADER_BYTES) {
+            return false;
+        }
+
+        std::size_t inputOffset = 0;
+        if (util::deserializeUInt32(str, inputOffset) != COMPRESSED_SINGLES_MAGIC || util::deserializeUInt32(str, inputOffset) != COMPRESSED_SINGLES_FORMAT_VERSION) {
+            return false;
+        }
+        util::deserializeUInt64(str, inputOffset);
+        return COMPRESSED_SINGLES_HEADER_BYTES + util::deserializeUInt64(str, inputOffset) == str.size();
+    }
+
+    std::vector<uint64_t> deserializeCompressedSingles(std::string_view str, std::size_t idBytes) {
+        std::vector<uint64_t> singles;
+        if (isCompressedSingles(str)) {
+            std::size_t inputOffset = 8;
+            auto count = util::deserializeUInt64(str, inputOffset);
+            inputOffset = COMPRESSED_SINGLES_HEADER_BYTES;
+            streamVByte::decodeSorted(str, count, inputOffset, singles);
+            return singles;
+        }
+
+        singles.reserve(str.size() / idBytes);
+        processSingles(str, [&singles](uint64_t single) {
+            singles.push_back(single);
+        }, idBytes);
+        return singles;
+    }
+
+    struct BucketManifestEntry {
+        std::size_t size = 0;
+        std::size_t complementCount = 0;
+        std::size_t generation = 0;
+        std::optional<uint32_t> checksum;
+    };
+
+    // Everything needed to find the committed state of a database, in either the binary manifest or the legacy text cache file
+    struct Manifest {
+        int version;
+        std::size_t writeAheadLogSize = 0;
+        std::size_t writeAheadLogIndex = 0;
+        std::size_t flushingWriteAheadLogSize = 0;
+        BucketManifestEntry taggableBucket;
+        BucketManifestEntry tagBucket;
+        std::vector<BucketManifestEntry> tagTaggableBuckets;
+        std::vector<BucketManifestEntry> taggableTagBuckets;
+        BucketManifestEntry metricBucket;
+    };
 
-    std::string fillerNull;
+    // {magic}{version}{write ahead log size}{write ahead log index}{flushing write ahead log size}{bucket count} are 4+4+8+8+8+8 bytes
+    const std::size_t MANIFEST_HEADER_BYTES = 40;
+    // {size}{complement count}{generation}{has checksum}{checksum} are 8+8+8+1+4 bytes
+    const std::size_t MANIFEST_ENTRY_BYTES = 29;
 
-    if (!cacheFile.fail()) {
-        cacheFile >> version;
+    // the taggable, tag and metric buckets each have an entry beside the pairing buckets'
+    std::size_t manifestBytes(std::size_t bucketCount) {
+        return MANIFEST_HEADER_BYTES + (MANIFEST_ENTRY_BYTES * (3 + (2 * bucketCount))) + 4;
+    }
+
+    std::size_t serializeManifestEntry(const BucketManifestEntry& entry, std::string& str, std::size_t location) {
+        location = util::serializeUInt64(entry.size, str, location);
+        location = util::serializeUInt64(entry.complementCount, str, location);
+        location = util::serializeUInt64(entry.generation, str, location);
+        location = util::serializeChar(entry.checksum.has_value() ? 1 : 0, str, location);
+        return util::serializeUInt32(entry.checksum.value_or(0), str, location);
+    }
+
+    BucketManifestEntry deserializeManifestEntry(std::string_view str, std::size_t& inputOffset) {
+        BucketManifestEntry entry;
+        entry.size = util::deserializeUInt64(str, inputOffset);
+        entry.complementCount = util::deserializeUInt64(str, inputOffset);
+        entry.generation = util::deserializeUInt64(str, inputOffset);
+        bool hasChecksum = util::deserializeChar(str, inputOffset) != 0;
+        auto checksum = util::deserializeUInt32(str, inputOffset);
+        if (hasChecksum) {
+            entry.checksum = checksum;
+        }
+
+        return entry;
+    }
+
+    // The manifest is a fixed header, an entry for the taggable and tag buckets, an entry for each pairing bucket by index,
+    // an entry for the metric bucket, then a crc32 of everything before it
+    std::string serializeManifest(const Manifest& manifest) {
+        std::string manifestStr;
+        auto bucketCount = manifest.tagTaggableBuckets.size();
+        manifestStr.resize(manifestBytes(bucketCount));
+        std::size_t location = 0;
+        location = util::serializeUInt32(MANIFEST_MAGIC, manifestStr, location);
+        location = util::serializeUInt32(manifest.version, manifestStr, location);
+        location = util::serializeUInt64(manifest.writeAheadLogSize, manifestStr, location);
+        location = util::serializeUInt64(manifest.writeAheadLogIndex, manifestStr, location);
+        location = util::serializeUInt64(manifest.flushingWriteAheadLogSize, manifestStr, location);
+        location = util::serializeUInt64(bucketCount, manifestStr, location);
+        location = serializeManifestEntry(manifest.taggableBucket, manifestStr, location);
+        location = serializeManifestEntry(manifest.tagBucket, manifestStr, location);
+        for (std::size_t i = 0; i < bucketCount; ++i) {
+            location = serializeManifestEntry(manifest.tagTaggableBuckets.at(i), manifestStr, location);
+            location = serializeManifestEntry(manifest.taggableTagBuckets.at(i), manifestStr, location);
+        }
+        location = serializeManifestEntry(manifest.metricBucket, manifestStr, location);
+        util::serializeUInt32(util::crc32(std::string_view(manifestStr).substr(0, location)), manifestStr, location);
+
+        return manifestStr;
+    }
+
+    // Validates the manifest in time linear to its bucket count, throwing on anything that does not add up
+    Manifest deserializeManifest(std::string_view manifestStr, const std::filesystem::path& manifestPath, int latestVersion) {
+        auto corrupt = [&manifestPath](const std::string& reason) {
+            return std::logic_error(std::string("Manifest ") + manifestPath.generic_string() + " is corrupt, " + reason);
+        };
+        if (manifestStr.size() < MANIFEST_HEADER_BYTES + 4) {
+            throw corrupt("it is too short to hold a header");
+        }
+        std::size_t checksumOffset = manifestStr.size() - 4;
+        if (util::deserializeUInt32(manifestStr, checksumOffset) != util::crc32(manifestStr.substr(0, manifestStr.size() - 4))) {
+            throw corrupt("its checksum does not match its contents");
+        }
+
+        std::size_t inputOffset = 0;
+        if (util::deserializeUInt32(manifestStr, inputOffset) != MANIFEST_MAGIC) {
+            throw corrupt("it does not start with the manifest magic");
+        }
+        Manifest manifest;
+        manifest.version = static_cast<int>(util::deserializeUInt32(manifestStr, inputOffset));
+        if (manifest.version < FIRST_MANIFEST_VERSION || manifest.version > latestVersion) {
+            throw corrupt(std::string("its version ") + std::to_string(manifest.version) + " is not one that has a manifest");
+        }
+        manifest.writeAheadLogSize = util::deserializeUInt64(manifestStr, inputOffset);
+        manifest.writeAheadLogIndex = util::deserializeUInt64(manifestStr, inputOffset);
+        manifest.flushingWriteAheadLogSize = util::deserializeUInt64(manifestStr, inputOffset);
+        auto bucketCount = util::deserializeUInt64(manifestStr, inputOffset);
+        if (manifestStr.size() != manifestBytes(bucketCount)) {
+            throw corrupt(std::string("its size does not match its bucket count of ") + std::to_string(bucketCount));
+        }
+        manifest.taggableBucket = deserializeManifestEntry(manifestStr, inputOffset);
+        manifest.tagBucket = deserializeManifestEntry(manifestStr, inputOffset);
+        for (std::size_t i = 0; i < bucketCount; ++i) {
+            manifest.tagTaggableBuckets.push_back(deserializeManifestEntry(manifestStr, inputOffset));
+            manifest.taggableTagBuckets.push_back(deserializeManifestEntry(manifestStr, inputOffset));
+        }
+        manifest.metricBucket = deserializeManifestEntry(manifestStr, inputOffset);
+
+        return manifest;
+    }
+
+    // Reads the whitespace separated text cache file that versions before the manifest used
+    std::optional<Manifest> readLegacyCacheFile(const std::filesystem::path& cacheFilePath) {
+        auto cacheFile = std::ifstream(cacheFilePath);
+        if (cacheFile.fail()) {
+            return std::nullopt;
+        }
+
+        Manifest manifest;
+        std::string fillerNull;
+        std::size_t currentBucketCount = 0;
+        cacheFile >> manifest.version;
+        if (manifest.version >= FIRST_MANIFEST_VERSION) {
+            throw std::logic_error(std::string("Cache file ") + cacheFilePath.generic_string() + " has version " + std::to_string(manifest.version) + ", which only a manifest can have");
+        }
         cacheFile >> fillerNull;
-        cacheFile >> totalFiles;
+        cacheFile >> manifest.taggableBucket.size;
         cacheFile >> fillerNull;
-        cacheFile >> totalTags;
+        cacheFile >> manifest.tagBucket.size;
         cacheFile >> fillerNull;
         cacheFile >> currentBucketCount;
-    }
-
-    taggableBucket_ = std::make_unique<SingleBucket>(folderPath_ / "buckets" / "taggable-bucket", totalFiles);
-    tagBucket_ = std::make_unique<SingleBucket>(folderPath_ / "buckets" / "tag-bucket", totalTags);
 
-    for (std::size_t i = 0; i < currentBucketCount; ++i) {
-        std::size_t bucketTotalTagsToTaggables = 0;
-        std::size_t bucketTagsToTaggablesComplementCount = 0;
-        std::size_t bucketTotalTaggablesToTags = 0;
-        std::size_t bucketTaggablesToTagsComplementCount = 0;
-        if (!cacheFile.fail()) {
+        for (std::size_t i = 0; i < currentBucketCount; ++i) {
+            BucketManifestEntry tagTaggableBucket;
+            BucketManifestEntry taggableTagBucket;
             cacheFile >> fillerNull;
-            cacheFile >> bucketTotalTagsToTaggables;
+            cacheFile >> tagTaggableBucket.size;
             cacheFile >> fillerNull;
-            cacheFile >> bucketTagsToTaggablesComplementCount;
+            cacheFile >> tagTaggableBucket.complementCount;
             cacheFile >> fillerNull;
-            cacheFile >> bucketTotalTaggablesToTags;
+            cacheFile >> taggableTagBucket.size;
             cacheFile >> fillerNull;
-            cacheFile >> bucketTaggablesToTagsComplementCount;
+            cacheFile >> taggableTagBucket.complementCount;
+            manifest.tagTaggableBuckets.push_back(tagTaggableBucket);
+            manifest.taggableTagBuckets.push_back(taggableTagBucket);
         }
 
-        std::string tagTaggableFolderName = std::string("tag-to-taggable-") + std::to_string(i);
-        std::string taggableTagFolderName = std::string("taggable-to-tag-") + std::to_string(i);
-        tagTaggableBuckets.push_back(PairingBucket(folderPath_ / "buckets" / tagTaggableFolderName, bucketTotalTagsToTaggables, bucketTagsToTaggablesComplementCount, &taggableBucket_->contents()));
-        taggableTagBuckets.push_back(PairingBucket(folderPath_ / "buckets" / taggableTagFolderName, bucketTotalTaggablesToTags, bucketTaggablesToTagsComplementCount, &tagBucket_->contents()));
+        if (cacheFile.fail()) {
+            throw std::logic_error(std::string("Cache file ") + cacheFilePath.generic_string() + " ended before all of its buckets were read");
+        }
+
+        return manifest;
+    }
+
+    // The manifest wins over a legacy cache file left beside it, which is only removed once the manifest replacing it is written
+    std::optional<Manifest> readManifestFile(const std::filesystem::path& manifestPath, const std::filesystem::path& legacyCacheFilePath, int latestVersion) {
+        if (std::filesystem::exists(manifestPath)) {
+            return deserializeManifest(util::readFile(manifestPath), manifestPath, latestVersion);
+        }
+
+        return readLegacyCacheFile(legacyCacheFilePath);
     }
 
-    if (!cacheFile.fail()) {
-        cacheFile.close();
-        priorCacheFile = util::readFile(cacheFilePath_);
+    template <class TBucket>
+    uint64_t timeBucketRead(TBucket& bucket) {
+        auto startTime = std::chrono::steady_clock::now();
+        bucket.contents();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    }
+}
+
+bool TagFileMaintainerOptions::set(std::string_view name, uint64_t value) {
+    if (name == "wal-group-commit-records") {
+        writeAheadLog.groupCommitRecords = value;
+    } else if (name == "wal-group-commit-bytes") {
+        writeAheadLog.groupCommitBytes = value;
+    } else if (name == "wal-group-commit-ms") {
+        writeAheadLog.groupCommitDelay = std::chrono::milliseconds(value);
+    } else if (name == "target-bucket-bytes") {
+        targetBucketBytes = value;
+    } else if (name == "prewarm") {
+        prewarm = value != 0;
+    } else if (name == "prewarm-threads") {
+        prewarmThreads = value;
+    } else if (name == "write-threads") {
+        writeThreads = value;
+    } else if (name == "tag-group-count-threads") {
+        tagGroupCountThreads = value;
+    } else if (name == "search-threads") {
+        searchThreads = value;
+    } else if (name == "memory-budget-bytes") {
+        memoryBudgetBytes = value;
+    } else if (name == "search-cache-entries") {
+        searchCacheEntries = value;
+    } else if (name == "search-cursor-expiry-ms") {
+        searchCursorExpiry = std::chrono::milliseconds(value);
     } else {
+        return false;
+    }
+
+    return true;
+}
+
+TagFileMaintainer::TagFileMaintainer(std::string folderName, TagFileMaintainerOptions options)
+    : folderPath_(std::move(folderName)), taggableIds_(folderPath_ / "taggable-ids.tid"), tagIds_(folderPath_ / "tag-ids.tid"),
+      writeAheadLogs_{std::make_unique<WriteAheadLog>(folderPath_ / "write-ahead.twa", options.writeAheadLog), std::make_unique<WriteAheadLog>(folderPath_ / "write-ahead.1.twa", options.writeAheadLog)},
+      targetBucketBytes_(options.targetBucketBytes), prewarmThreads_(options.prewarmThreads), writeThreads_(options.writeThreads),
+      tagGroupCountThreads_(options.tagGroupCountThreads), searchThreads_(options.searchThreads),
+      memoryBudgetBytes_(options.memoryBudgetBytes), searchCache_(options.searchCacheEntries),
+      searchCursors_(options.searchCursorExpiry)
+{
+    manifestPath_ = folderPath_ / "manifest.tdm";
+    legacyCacheFilePath_ = folderPath_ / "cache.tdb";
+    recoverInterruptedMigration();
+    readManifest();
+    if (manifestVersion_ < FIRST_INTERNAL_ID_VERSION) {
+        migrateToInternalIds();
+        readManifest();
+    }
+
+    taggableIds_.load();
+    tagIds_.load();
+    recoverWriteAhead();
+    if (options.prewarm) {
+        prewarmBuckets();
+    }
+}
+
+TagFileMaintainer::~TagFileMaintainer() {
+    if (!closed_) {
+        close();
+    }
+}
+
+void TagFileMaintainer::readManifest() {
+    auto manifest = readManifestFile(manifestPath_, legacyCacheFilePath_, VERSION);
+    bool manifestFound = manifest.has_value();
+    if (!manifestFound) {
+        manifest = Manifest{VERSION};
+        manifest->tagTaggableBuckets.resize(INITIAL_BUCKET_COUNT);
+        manifest->taggableTagBuckets.resize(INITIAL_BUCKET_COUNT);
+    }
+
+    manifestVersion_ = manifest->version;
+    if (manifest->tagTaggableBuckets.size() < INITIAL_BUCKET_COUNT) {
+        throw std::logic_error(std::string("Manifest has ") + std::to_string(manifest->tagTaggableBuckets.size()) + " buckets, fewer than the " + std::to_string(INITIAL_BUCKET_COUNT) + " buckets a database starts with");
+    }
+    if (manifest->tagTaggableBuckets.size() > MAX_BUCKET_COUNT) {
+        throw std::logic_error(std::string("Manifest has ") + std::to_string(manifest->tagTaggableBuckets.size()) + " buckets, more than can be addressed");
+    }
+    currentBucketCount = manifest->tagTaggableBuckets.size();
+    updateLevelBucketCount();
+
+    tagTaggableBuckets.clear();
+    taggableTagBuckets.clear();
+    auto makeSingleBucket = [this](const std::string& folderName, const BucketManifestEntry& entry) {
+        auto bucket = std::make_unique<SingleBucket>(folderPath_ / "buckets" / folderName, entry.generation, entry.size, idBytes());
+        bucket->expectChecksum(entry.checksum);
+        return bucket;
+    };
+    taggableBucket_ = makeSingleBucket("taggable-bucket", manifest->taggableBucket);
+    tagBucket_ = makeSingleBucket("tag-bucket", manifest->tagBucket);
+    // databases from before the manifest have no metric bucket, which starts out empty
+    metricBucket_ = std::make_unique<MetricBucket>(folderPath_ / "buckets" / "metric-bucket", manifest->metricBucket.generation, manifest->metricBucket.size);
+    metricBucket_->expectChecksum(manifest->metricBucket.checksum);
+
+    auto makePairingBucket = [this](const std::string& prefix, std::size_t i, const BucketManifestEntry& entry, const RoaringBitmap* secondUniverse) {
+        auto bucket = PairingBucket(pairingBucketPath(prefix, i), entry.generation, entry.size, entry.complementCount, secondUniverse, idBytes());
+        bucket.expectChecksum(entry.checksum);
+        return bucket;
+    };
+    for (std::size_t i = 0; i < currentBucketCount; ++i) {
+        // the single buckets may still have a diff to recover, so they are read once recovery is done
+        tagTaggableBuckets.push_back(makePairingBucket("tag-to-taggable-", i, manifest->tagTaggableBuckets.at(i), taggableBucket_->contentsLocation()));
+        taggableTagBuckets.push_back(makePairingBucket("taggable-to-tag-", i, manifest->taggableTagBuckets.at(i), tagBucket_->contentsLocation()));
+    }
+
+    committedWriteAheadLogSize_ = manifest->writeAheadLogSize;
+    committedFlushingWriteAheadLogSize_ = manifest->flushingWriteAheadLogSize;
+    writeAheadLogIndex_ = manifest->writeAheadLogIndex;
+    if (writeAheadLogIndex_ >= writeAheadLogs_.size()) {
+        throw std::logic_error(std::string("Manifest refers to write ahead log ") + std::to_string(writeAheadLogIndex_) + " which does not exist");
+    }
+
+    if (!manifestFound) {
         flushFiles();
     }
 }
 
-void TagFileMaintainer::writePriorCacheFile() {
+std::filesystem::path TagFileMaintainer::pairingBucketPath(const std::string& prefix, std::size_t index) const {
+    return folderPath_ / "buckets" / (prefix + std::to_string(index));
+}
+
+void TagFileMaintainer::updateLevelBucketCount() {
+    levelBucketCount_ = INITIAL_BUCKET_COUNT;
+    while (levelBucketCount_ * 2 <= currentBucketCount) {
+        levelBucketCount_ *= 2;
+    }
+}
+
+// A migration is committed by renaming its manifest into ours, so any leftovers are either rolled back or cleaned up depending on which won
+void TagFileMaintainer::recoverInterruptedMigration() {
+    auto legacyBucketsPath = folderPath_ / "buckets-v1";
+    if (std::filesystem::exists(legacyBucketsPath)) {
+        auto manifest = readManifestFile(manifestPath_, legacyCacheFilePath_, VERSION);
+        if (manifest.has_value() && manifest->version < FIRST_INTERNAL_ID_VERSION) {
+            std::filesystem::remove_all(folderPath_ / "buckets");
+            std::filesystem::rename(legacyBucketsPath, folderPath_ / "buckets");
+        } else {
+            std::filesystem::remove_all(legacyBucketsPath);
+        }
+    }
+
+    std::filesystem::remove_all(folderPath_ / "migration");
+}
+
+// Rebuilds a version 1 database, which is keyed on external ids, into a fresh database keyed on internal ids and swaps it in
+void TagFileMaintainer::migrateToInternalIds() {
+    auto migrationPath = folderPath_ / "migration";
+    recoverDiffFiles();
+
+    std::vector<uint64_t> taggables;
+    taggableBucket_->contents().forEach([&taggables](uint64_t taggable) {
+        if (taggable != EXTERNAL_ID_FAKER) {
+            taggables.push_back(taggable);
+        }
+    });
+    std::vector<uint64_t> tags;
+    tagBucket_->contents().forEach([&tags](uint64_t tag) {
+        if (tag != EXTERNAL_ID_FAKER) {
+            tags.push_back(tag);
+        }
+    });
+    // inserting in ascending order keeps internal ids in the same order as external ids
+    std::sort(taggables.begin(), taggables.end());
+    std::sort(tags.begin(), tags.end());
+
+    std::string pairingsStr;
+    std::size_t location = 0;
+    for (auto& tagTaggableBucket : tagTaggableBuckets) {
+        for (const auto& pair : tagTaggableBucket.contents().allContents()) {
+            if (pair.first == EXTERNAL_ID_FAKER || pair.second.size() == 0) {
+                continue;
+            }
+
+            location = util::serializeUInt64(pair.first, pairingsStr, location);
+            std::size_t taggableCountLocation = location;
+            std::size_t taggableCount = 0;
+            location = util::serializeUInt64(0, pairingsStr, location);
+            pair.second.forEach([&pairingsStr, &location, &taggableCount](uint64_t taggable) {
+                if (taggable != EXTERNAL_ID_FAKER) {
+                    location = util::serializeUInt64(taggable, pairingsStr, location);
+                    ++taggableCount;
+                }
+            });
+            util::serializeUInt64(taggableCount, pairingsStr, taggableCountLocation);
+        }
+    }
+
+    {
+        auto migrated = TagFileMaintainer(migrationPath.generic_string());
+        migrated.beginTransaction();
+        migrated.insertTaggables(serializeSingles(taggables));
+        migrated.insertTags(serializeSingles(tags));
+        migrated.insertPairings(pairingsStr);
+        migrated.endTransaction();
+        migrated.close();
+    }
+
+    auto moveIfExists = [](const std::filesystem::path& from, const std::filesystem::path& to) {
+        if (std::filesystem::exists(from)) {
+            std::filesystem::rename(from, to);
+        }
+    };
+    moveIfExists(folderPath_ / "buckets", folderPath_ / "buckets-v1");
+    moveIfExists(migrationPath / "buckets", folderPath_ / "buckets");
+    moveIfExists(migrationPath / "taggable-ids.tid", folderPath_ / "taggable-ids.tid");
+    moveIfExists(migrationPath / "tag-ids.tid", folderPath_ / "tag-ids.tid");
+    // commits the migration
+    std::filesystem::rename(migrationPath / "manifest.tdm", manifestPath_);
+    std::filesystem::remove_all(folderPath_ / "buckets-v1");
+    std::filesystem::remove_all(migrationPath);
+}
+
+std::size_t TagFileMaintainer::idBytes() const {
+    return manifestVersion_ < FIRST_INTERNAL_ID_VERSION ? EXTERNAL_ID_BYTES : INTERNAL_ID_BYTES;
+}
+
+void TagFileMaintainer::writeManifest() {
     if (inTransaction) {
         return;
     }
 
-    util::writeFile(cacheFilePath_, priorCacheFile);
+    auto bucketEntry = [](const auto& bucket, std::size_t complementCount) {
+        return BucketManifestEntry{bucket.size(), complementCount, bucket.committedGeneration(), bucket.committedChecksum()};
+    };
+    Manifest manifest{VERSION, committedWriteAheadLogSize_, writeAheadLogIndex_, committedFlushingWriteAheadLogSize_};
+    manifest.taggableBucket = bucketEntry(*taggableBucket_, 0);
+    manifest.tagBucket = bucketEntry(*tagBucket_, 0);
+    for (int i = 0; i < currentBucketCount; ++i) {
+        manifest.tagTaggableBuckets.push_back(bucketEntry(tagTaggableBuckets.at(i), tagTaggableBuckets.at(i).startingComplementCount()));
+        manifest.taggableTagBuckets.push_back(bucketEntry(taggableTagBuckets.at(i), taggableTagBuckets.at(i).startingComplementCount()));
+    }
+    manifest.metricBucket = bucketEntry(*metricBucket_, 0);
+
+    // most commands end in the same manifest as the one before them, which needs no rewrite
+    auto manifestStr = serializeManifest(manifest);
+    if (manifestStr == writtenManifest_) {
+        return;
+    }
+
+    // the manifest is replaced in a single rename, so it is always either the prior or the present one
+    {
+        auto manifestFile = AtomicOfstream(manifestPath_);
+        manifestFile << manifestStr;
+    }
+    bool isFirstWrite = writtenManifest_.empty();
+    writtenManifest_ = std::move(manifestStr);
+    if (isFirstWrite) {
+        util::removeFile(legacyCacheFilePath_);
+    }
+}
+
+void TagFileMaintainer::recoverDiffFiles() {
+    for (auto& tagTaggableBucket : tagTaggableBuckets) {
+        tagTaggableBucket.recoverDiffFile();
+    }
+    for (auto& taggableTagBucket : taggableTagBuckets) {
+        taggableTagBucket.recoverDiffFile();
+    }
+    taggableBucket_->recoverDiffFile();
+    tagBucket_->recoverDiffFile();
 }
 
-void TagFileMaintainer::writeCacheFile() {
+// Applies the committed write ahead log records (or write ahead files of older versions) to the buckets and writes them, so that the log can start over
+void TagFileMaintainer::recoverWriteAhead() {
+    bool recoveredEveryRecord = true;
+    if (manifestVersion_ < FIRST_MANIFEST_VERSION) {
+        recoverDiffFiles();
+    } else {
+        // the flushing log's records came before the snapshots the current log's records are against, so both apply to the committed generations
+        bool recoveredFlushingRecords = recoverWriteAheadLog(flushingWriteAheadLog(), committedFlushingWriteAheadLogSize_);
+        recoveredEveryRecord = recoverWriteAheadLog(writeAheadLog(), committedWriteAheadLogSize_) && recoveredFlushingRecords;
+    }
+
+    // any bucket may have been changed by a lost record, so every bucket is read at whatever size it recovers to
+    if (!recoveredEveryRecord) {
+        taggableBucket_->forgetStartingSize();
+        tagBucket_->forgetStartingSize();
+        for (auto* pairingBuckets : {&tagTaggableBuckets, &taggableTagBuckets}) {
+            for (auto& pairingBucket : *pairingBuckets) {
+                pairingBucket.forgetStartingSize();
+            }
+        }
+        metricBucket_->forgetStartingSize();
+    }
+
+    // the pairing buckets rely on these being read before any of their contents are
+    taggableBucket_->contents();
+    tagBucket_->contents();
+    for (auto& tagTaggableBucket : tagTaggableBuckets) {
+        if (tagTaggableBucket.hasRecoveredDiff() || !recoveredEveryRecord) {
+            tagTaggableBucket.contents();
+        }
+    }
+    for (auto& taggableTagBucket : taggableTagBuckets) {
+        if (taggableTagBucket.hasRecoveredDiff() || !recoveredEveryRecord) {
+            taggableTagBucket.contents();
+        }
+    }
+    if (metricBucket_->hasRecoveredDiff() || !recoveredEveryRecord) {
+        metricBucket_->contents();
+    }
+
+    if (manifestVersion_ < VERSION || committedWriteAheadLogSize_ != 0 || committedFlushingWriteAheadLogSize_ != 0) {
+        committedWriteAheadLogSize_ = 0;
+        committedFlushingWriteAheadLogSize_ = 0;
+        writeManifest();
+        manifestVersion_ = VERSION;
+        writeAheadLog().truncate();
+        flushingWriteAheadLog().truncate();
+        purgeUnusedFiles();
+    }
+}
+
+// Returns false when the log ended before its committed size, as it can when the OS went down before the log was synced
+bool TagFileMaintainer::recoverWriteAheadLog(WriteAheadLog& writeAheadLog, std::size_t committedSize) {
+    for (const auto& record : writeAheadLog.recover(committedSize)) {
+        std::size_t inputOffset = 0;
+        while (inputOffset < record.size()) {
+            auto bucketId = util::deserializeUInt32(record, inputOffset);
+            auto deltaSize = util::deserializeUInt64(record, inputOffset);
+            if (deltaSize > record.size() - inputOffset) {
+                throw std::logic_error(std::string("Write ahead log record for bucket ") + std::to_string(bucketId) + " is larger than its record");
+            }
+            recoverBucketDiff(bucketId, std::string_view(record).substr(inputOffset, deltaSize));
+            inputOffset += deltaSize;
+        }
+    }
+
+    return writeAheadLog.size() == committedSize;
+}
+
+void TagFileMaintainer::recoverBucketDiff(uint32_t bucketId, std::string_view deltaStr) {
+    if (bucketId == TAGGABLE_BUCKET_ID) {
+        taggableBucket_->recoverDiff(deltaStr);
+    } else if (bucketId == TAG_BUCKET_ID) {
+        tagBucket_->recoverDiff(deltaStr);
+    } else if (bucketId == METRIC_BUCKET_ID) {
+        metricBucket_->recoverDiff(deltaStr);
+    } else if (bucketId >= tagTaggableBucketId(0) && bucketId < tagTaggableBucketId(tagTaggableBuckets.size())) {
+        tagTaggableBuckets.at(bucketId - tagTaggableBucketId(0)).recoverDiffByFirst(deltaStr, [this](uint64_t tag) -> PairingBucket& {
+            return getTagBucket(tag);
+        });
+    } else if (bucketId >= taggableTagBucketId(0) && bucketId < taggableTagBucketId(taggableTagBuckets.size())) {
+        taggableTagBuckets.at(bucketId - taggableTagBucketId(0)).recoverDiffByFirst(deltaStr, [this](uint64_t taggable) -> PairingBucket& {
+            return getTaggableBucket(taggable);
+        });
+    } else {
+        throw std::logic_error(std::string("Write ahead log refers to bucket ") + std::to_string(bucketId) + " which does not exist");
+    }
+}
+
+// Appends every bucket's diff since the last commit to the write ahead log as one record, then commits it by writing the manifest
+void TagFileMaintainer::commitWriteAhead() {
     if (inTransaction) {
         return;
     }
 
-    auto cacheFile = AtomicOfstream(cacheFilePath_);
-    cacheFile << VERSION
-              << " taggableBucketSize "
-              << taggableBucket_->size()
-              << " tagBucketSize "
-              << tagBucket_->size()
-              << " currentBucketCount "
-              << currentBucketCount;
-    
-    for (int i = 0; i < currentBucketCount; ++i) {
-        cacheFile << " tagTaggableBucket" << i << "Size "
-                  << tagTaggableBuckets.at(i).size()
-                  << " tagTaggableBucket" << i << "StartingComplementCount "
-                  << tagTaggableBuckets.at(i).startingComplementCount()
-                  << " taggableTagBucket" << i << "Size "
-                  << taggableTagBuckets.at(i).size()
-                  << " taggableTagBucket" << i << "StartingComplementCount "
-                  << taggableTagBuckets.at(i).startingComplementCount();
+    std::string record;
+    std::string deltaStr;
+    for (std::size_t i = 0; i < tagTaggableBuckets.size(); ++i) {
+        if (tagTaggableBuckets[i].diffAhead(deltaStr)) {
+            appendWriteAheadDelta(record, tagTaggableBucketId(i), deltaStr);
+        }
+    }
+    for (std::size_t i = 0; i < taggableTagBuckets.size(); ++i) {
+        if (taggableTagBuckets[i].diffAhead(deltaStr)) {
+            appendWriteAheadDelta(record, taggableTagBucketId(i), deltaStr);
+        }
+    }
+    if (taggableBucket_->diffAhead(deltaStr)) {
+        appendWriteAheadDelta(record, TAGGABLE_BUCKET_ID, deltaStr);
+    }
+    if (tagBucket_->diffAhead(deltaStr)) {
+        appendWriteAheadDelta(record, TAG_BUCKET_ID, deltaStr);
+    }
+    if (metricBucket_->diffAhead(deltaStr)) {
+        appendWriteAheadDelta(record, METRIC_BUCKET_ID, deltaStr);
+    }
+
+    if (!record.empty()) {
+        writeAheadLog().append(record);
+        committedWriteAheadLogSize_ = writeAheadLog().size();
+    }
+    writeManifest();
+
+    // the buckets match the manifest between commands, so a finished flush can be committed now
+    finishBackgroundFlush(false);
+}
+
+void TagFileMaintainer::startBackgroundFlush() {
+    if (inTransaction) {
+        return;
+    }
+    finishBackgroundFlush(false);
+    if (flusher_.isRunning()) {
+        return;
+    }
+
+    // a bucket due a split is split by the flush from the snapshot it takes of it, in linear hashing order so one split at a time
+    if (currentBucketCount < getWantedBucketCount()) {
+        splittingIndex_ = currentBucketCount - levelBucketCount_;
+    }
+    auto snapshotStartTime = std::chrono::steady_clock::now();
+    std::vector<std::function<void()>> writes;
+    for (auto* pairingBuckets : {&tagTaggableBuckets, &taggableTagBuckets}) {
+        for (std::size_t i = 0; i < pairingBuckets->size(); ++i) {
+            if (splittingIndex_ != i && pairingBuckets->at(i).isDirty()) {
+                writes.push_back(pairingBuckets->at(i).snapshot());
+            }
+        }
+    }
+    if (splittingIndex_.has_value()) {
+        unsigned short newIndex = currentBucketCount;
+        uint64_t modulus = static_cast<uint64_t>(levelBucketCount_) * 2;
+        writes.push_back(tagTaggableBuckets.at(*splittingIndex_).splitSnapshot(pairingBucketPath("tag-to-taggable-", newIndex), modulus, newIndex));
+        writes.push_back(taggableTagBuckets.at(*splittingIndex_).splitSnapshot(pairingBucketPath("taggable-to-tag-", newIndex), modulus, newIndex));
+    }
+    if (taggableBucket_->isDirty()) {
+        writes.push_back(taggableBucket_->snapshot());
     }
+    if (tagBucket_->isDirty()) {
+        writes.push_back(tagBucket_->snapshot());
+    }
+    if (metricBucket_->isDirty()) {
+        writes.push_back(metricBucket_->snapshot());
+    }
+    if (writes.empty()) {
+        return;
+    }
+    lastSnapshotMilliseconds_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - snapshotStartTime).count();
+    lastSnapshotBuckets_ = writes.size();
+
+    // records from here on are against the snapshots, so they go to the other write ahead log
+    writeAheadLog().sync();
+    committedFlushingWriteAheadLogSize_ = committedWriteAheadLogSize_;
+    writeAheadLogIndex_ = 1 - writeAheadLogIndex_;
+    writeAheadLog().truncate();
+    committedWriteAheadLogSize_ = 0;
+    writeManifest();
+
+    flusher_.start(std::move(writes));
+}
+
+// Commits the snapshots of a background flush once they are written, waiting on them if wait is set
+void TagFileMaintainer::finishBackgroundFlush(bool wait) {
+    if (inTransaction || !flusher_.isRunning() || (!wait && !flusher_.isDone())) {
+        return;
+    }
+
+    flusher_.wait();
+    for (auto& tagTaggableBucket : tagTaggableBuckets) {
+        tagTaggableBucket.finishSnapshot();
+    }
+    for (auto& taggableTagBucket : taggableTagBuckets) {
+        taggableTagBucket.finishSnapshot();
+    }
+    taggableBucket_->finishSnapshot();
+    tagBucket_->finishSnapshot();
+    metricBucket_->finishSnapshot();
+    // the split is committed along with the flush, records written against the layout before it are routed to their buckets on recovery
+    if (splittingIndex_.has_value()) {
+        tagTaggableBuckets.push_back(tagTaggableBuckets.at(*splittingIndex_).finishSplit());
+        taggableTagBuckets.push_back(taggableTagBuckets.at(*splittingIndex_).finishSplit());
+        splittingIndex_.reset();
+        ++currentBucketCount;
+        updateLevelBucketCount();
+    }
+    committedFlushingWriteAheadLogSize_ = 0;
+    writeManifest();
+    flushingWriteAheadLog().truncate();
+    removeStaleBucketFolders();
+}
+
+WriteAheadLog& TagFileMaintainer::writeAheadLog() {
+    return *writeAheadLogs_.at(writeAheadLogIndex_);
+}
+
+WriteAheadLog& TagFileMaintainer::flushingWriteAheadLog() {
+    return *writeAheadLogs_.at(1 - writeAheadLogIndex_);
+}
+
+std::vector<std::pair<std::string, uint64_t>> TagFileMaintainer::prewarmBuckets() {
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::pair<std::string, uint64_t>> bucketTimings;
+    // the pairing buckets rely on these being read before any of their contents are
+    bucketTimings.emplace_back(taggableBucket_->generationPath(0).filename().string(), timeBucketRead(*taggableBucket_));
+    bucketTimings.emplace_back(tagBucket_->generationPath(0).filename().string(), timeBucketRead(*tagBucket_));
+    bucketTimings.emplace_back(metricBucket_->generationPath(0).filename().string(), timeBucketRead(*metricBucket_));
+
+    std::vector<PairingBucket*> pairingBuckets;
+    for (auto& tagTaggableBucket : tagTaggableBuckets) {
+        pairingBuckets.push_back(&tagTaggableBucket);
+    }
+    for (auto& taggableTagBucket : taggableTagBuckets) {
+        pairingBuckets.push_back(&taggableTagBucket);
+    }
+    // every pairing bucket only reads its own files and the single buckets, so they can be read at once
+    std::vector<uint64_t> pairingBucketMilliseconds(pairingBuckets.size());
+    parallelFor(pairingBuckets.size(), prewarmThreads_, [&pairingBuckets, &pairingBucketMilliseconds](std::size_t i) {
+        pairingBucketMilliseconds[i] = timeBucketRead(*pairingBuckets[i]);
+    });
+    for (std::size_t i = 0; i < pairingBuckets.size(); ++i) {
+        bucketTimings.emplace_back(pairingBuckets[i]->generationPath(0).filename().string(), pairingBucketMilliseconds[i]);
+    }
+
+    bucketTimings.emplace(bucketTimings.begin(), "total", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count());
+    return bucketTimings;
+}
+
+void TagFileMaintainer::prewarm(void (*writer)(std::string)) {
+    std::string timingsStr;
+    for (const auto& [name, milliseconds] : prewarmBuckets()) {
+        if (!timingsStr.empty()) {
+            timingsStr += ' ';
+        }
+        timingsStr += name + " " + std::to_string(milliseconds);
+    }
+    writer(std::move(timingsStr));
+}
+
+void TagFileMaintainer::commitWriteAheadGroup() {
+    writeAheadLog().commitGroup();
+}
+
+void TagFileMaintainer::evictColdBuckets() {
+    ++useClock_;
+    std::size_t residentBytes = 0;
+    std::vector<PairingBucket*> evictableBuckets;
+    auto takeUse = [this, &residentBytes](auto& bucket) {
+        auto use = bucket.takeUse(useClock_);
+        if (use.has_value()) {
+            ++(*use ? bucketHits_ : bucketMisses_);
+        }
+        residentBytes += bucket.residentBytes();
+    };
+    for (auto* pairingBuckets : {&tagTaggableBuckets, &taggableTagBuckets}) {
+        for (auto& pairingBucket : *pairingBuckets) {
+            takeUse(pairingBucket);
+            if (pairingBucket.canEvict()) {
+                evictableBuckets.push_back(&pairingBucket);
+            }
+        }
+    }
+    takeUse(*taggableBucket_);
+    takeUse(*tagBucket_);
+    takeUse(*metricBucket_);
+
+    if (memoryBudgetBytes_ == 0 || residentBytes <= memoryBudgetBytes_) {
+        return;
+    }
+
+    // the single buckets are never evicted, as every pairing bucket refers to their contents, nor is the metric bucket, which every metric search reads
+    std::sort(evictableBuckets.begin(), evictableBuckets.end(), [](const PairingBucket* lhs, const PairingBucket* rhs) {
+        return lhs->lastUse() < rhs->lastUse();
+    });
+    for (auto* bucket : evictableBuckets) {
+        if (residentBytes <= memoryBudgetBytes_) {
+            break;
+        }
+
+        residentBytes -= bucket->residentBytes();
+        bucket->evict();
+        ++bucketEvictions_;
+    }
+}
+
+void TagFileMaintainer::readStats(void (*writer)(std::string)) {
+    finishBackgroundFlush(false);
+
+    std::string statsStr;
+    auto addStat = [&statsStr](const char* name, uint64_t value) {
+        if (!statsStr.empty()) {
+            statsStr += ' ';
+        }
+        statsStr += std::string(name) + " " + std::to_string(value);
+    };
+    addStat("flushInProgress", flusher_.isRunning() ? 1 : 0);
+    addStat("flushesStarted", flusher_.flushesStarted());
+    addStat("flushesCompleted", flusher_.flushesCompleted());
+    addStat("flushBucketsWritten", flusher_.bucketsWritten());
+    addStat("flushBucketsToWrite", flusher_.bucketsToWrite());
+    addStat("lastFlushMilliseconds", flusher_.lastFlushMilliseconds());
+    addStat("lastSnapshotMilliseconds", lastSnapshotMilliseconds_);
+    addStat("lastSnapshotBuckets", lastSnapshotBuckets_);
+    addStat("writeAheadLogBytes", committedWriteAheadLogSize_);
+    addStat("flushingWriteAheadLogBytes", committedFlushingWriteAheadLogSize_);
+    addStat("bucketCount", currentBucketCount);
+    addStat("splitInProgress", splittingIndex_.has_value() ? 1 : 0);
+
+    std::size_t residentBuckets = 0;
+    std::size_t residentBytes = 0;
+    auto addResidency = [&residentBuckets, &residentBytes](const auto& bucket) {
+        if (bucket.isResident()) {
+            ++residentBuckets;
+        }
+        residentBytes += bucket.residentBytes();
+    };
+    for (const auto& tagTaggableBucket : tagTaggableBuckets) {
+        addResidency(tagTaggableBucket);
+    }
+    for (const auto& taggableTagBucket : taggableTagBuckets) {
+        addResidency(taggableTagBucket);
+    }
+    addResidency(*taggableBucket_);
+    addResidency(*tagBucket_);
+    addResidency(*metricBucket_);
+    addStat("residentBuckets", residentBuckets);
+    addStat("residentBytes", residentBytes);
+    addStat("memoryBudgetBytes", memoryBudgetBytes_);
+    addStat("bucketHits", bucketHits_);
+    addStat("bucketMisses", bucketMisses_);
+    addStat("bucketEvictions", bucketEvictions_);
+    addStat("searchCacheEntries", searchCache_.size());
+    addStat("searchCacheHits", searchCache_.hits());
+    addStat("searchCacheMisses", searchCache_.misses());
+    addStat("searchCursors", searchCursors_.size());
+    writer(std::move(statsStr));
+}
+
+uint32_t TagFileMaintainer::tagTaggableBucketId(std::size_t index) const {
+    return static_cast<uint32_t>(TAG_BUCKET_ID + 1 + index);
+}
+
+// Past every tag to taggable bucket there could be, so that no bucket's id changes when a split adds one
+uint32_t TagFileMaintainer::taggableTagBucketId(std::size_t index) const {
+    return static_cast<uint32_t>(tagTaggableBucketId(MAX_BUCKET_COUNT) + index);
+}
+
+// {bucket id}{delta size}{delta}
+void TagFileMaintainer::appendWriteAheadDelta(std::string& record, uint32_t bucketId, std::string_view deltaStr) {
+    std::size_t location = util::serializeUInt32(bucketId, record, record.size());
+    util::serializeUInt64(deltaStr.size(), record, location);
+    record.append(deltaStr);
 }
 
 void TagFileMaintainer::insertTaggables(std::string_view input) {
-    auto insertTaggable = [this](uint64_t taggable) {
+    auto insertTaggable = [this](uint64_t externalTaggable) {
+        auto taggable = taggableIds_.toInternalOrInsert(externalTaggable);
         for (auto& bucket : tagTaggableBuckets) {
             bucket.insertComplement(taggable);
         }
         taggableBucket_->insertItem(taggable);
     };
     processSingles(input, insertTaggable);
+    // ids are synced before the write ahead log can be, so no synced record refers to an id the dictionary lost
+    taggableIds_.persist();
 
-    writePriorCacheFile();
-
-    for (auto& bucket : tagTaggableBuckets) {
-        bucket.diffAhead();
-    }
-
-    taggableBucket_->diffAhead();
-    writeCacheFile();
+    commitWriteAhead();
 }
 void TagFileMaintainer::deleteTaggables(std::string_view input) {
-    auto deleteTaggable = [this](uint64_t taggable) {
-        if (!taggableBucket_->contains(taggable)) {
+    auto deleteTaggable = [this](uint64_t externalTaggable) {
+        uint64_t taggable;
+        if (!taggableIds_.toInternal(externalTaggable, taggable) || !taggableBucket_->contains(taggable)) {
             return;
         }
 
@@ -175,6 +982,9 @@ void TagFileMaintainer::deleteTaggables(std::string_view input) {
             }
         }
 
+        for (const auto& metricValue : metricBucket_->contents().taggableValues(taggable)) {
+            metricBucket_->deleteItem(metricValue);
+        }
         taggableBucket_->deleteItem(taggable);
         for (auto& bucket : tagTaggableBuckets) {
             bucket.deleteComplement(taggable);
@@ -182,44 +992,30 @@ void TagFileMaintainer::deleteTaggables(std::string_view input) {
     };
     
     processSingles(input, deleteTaggable);
-    
-    writePriorCacheFile();
-
-    for (auto& bucket : taggableTagBuckets) {
-        bucket.diffAhead();
-    }
-    for (auto& bucket : tagTaggableBuckets) {
-        bucket.diffAhead();
-    }
 
-    taggableBucket_->diffAhead();
-    writeCacheFile();
+    commitWriteAhead();
 }
-void TagFileMaintainer::readTaggables(void (*writer)(const std::string&)) {
-    writer(serializeSingles(taggableBucket_->contents()));
+void TagFileMaintainer::readTaggables(void (*writer)(std::string)) {
+    writer(serializeExternalSingles(taggableBucket_->contents(), taggableIds_));
 }
 
 void TagFileMaintainer::insertTags(std::string_view input) {
-    auto insertTag = [this](uint64_t tag) {
+    auto insertTag = [this](uint64_t externalTag) {
+        auto tag = tagIds_.toInternalOrInsert(externalTag);
         for (auto& bucket : taggableTagBuckets) {
             bucket.insertComplement(tag);
         }
         tagBucket_->insertItem(tag);
     };
     processSingles(input, insertTag);
+    tagIds_.persist();
 
-    writePriorCacheFile();
-
-    for (auto& bucket : taggableTagBuckets) {
-        bucket.diffAhead();
-    }
-
-    tagBucket_->diffAhead();
-    writeCacheFile();
+    commitWriteAhead();
 }
 void TagFileMaintainer::deleteTags(std::string_view input) {
-    auto deleteTag = [this](uint64_t tag) {
-        if (!tagBucket_->contains(tag)) {
+    auto deleteTag = [this](uint64_t externalTag) {
+        uint64_t tag;
+        if (!tagIds_.toInternal(externalTag, tag) || !tagBucket_->contains(tag)) {
             return;
         }
 
@@ -249,108 +1045,259 @@ void TagFileMaintainer::deleteTags(std::string_view input) {
     };
 
     processSingles(input, deleteTag);
-    
-    writePriorCacheFile();
-
-    for (auto& bucket : taggableTagBuckets) {
-        bucket.diffAhead();
-    }
-    for (auto& bucket : tagTaggableBuckets) {
-        bucket.diffAhead();
-    }
 
-    tagBucket_->diffAhead();
-    writeCacheFile();
+    commitWriteAhead();
 }
-void TagFileMaintainer::readTags(void (*writer)(const std::string&)) {
-    writer(serializeSingles(tagBucket_->contents()));
+void TagFileMaintainer::readTags(void (*writer)(std::string)) {
+    writer(serializeExternalSingles(tagBucket_->contents(), tagIds_));
 }
 
 #include <iostream>
 
-void TagFileMaintainer::modifyPairings(std::string_view input, void (PairingBucket::*callback)(std::pair<uint64_t, uint64_t>)) {
+void TagFileMaintainer::modifyPairings(std::string_view input, IdPairContainer::Modification modification) {
     std::size_t inputOffset = 0;
 
     if (input.size() % 8 != 0) {
         throw std::logic_error("Pairing input was not a multiple of 8");
     }
 
+    // every id is resolved before any bucket is touched, so an unknown or deleted id leaves the buckets as they were
+    std::vector<std::pair<uint64_t, uint64_t>> pairings;
+    pairings.reserve(input.size() / 16);
     while (inputOffset < input.size()) {
-        auto tag = util::deserializeUInt64(input, inputOffset);
+        auto externalTag = util::deserializeUInt64(input, inputOffset);
         auto taggableCount = util::deserializeUInt64(input, inputOffset);
+        uint64_t tag;
+        if (!tagIds_.toInternal(externalTag, tag) || !tagBucket_->contains(tag)) {
+            throw std::logic_error(std::string("Tag ") + std::to_string(externalTag) + " must be inserted before it can be paired");
+        }
         for (std::size_t i = 0; i < taggableCount; ++i) {
-            auto taggable = util::deserializeUInt64(input, inputOffset);
-            (getTagBucket(tag).*callback)(std::pair<uint64_t, uint64_t>(tag, taggable));
-            (getTaggableBucket(taggable).*callback)(std::pair<uint64_t, uint64_t>(taggable, tag));
+            auto externalTaggable = util::deserializeUInt64(input, inputOffset);
+            uint64_t taggable;
+            if (!taggableIds_.toInternal(externalTaggable, taggable) || !taggableBucket_->contains(taggable)) {
+                throw std::logic_error(std::string("Taggable ") + std::to_string(externalTaggable) + " must be inserted before it can be paired");
+            }
+            pairings.emplace_back(tag, taggable);
         }
     }
-    
-    writePriorCacheFile();
 
-    for (auto& bucket : tagTaggableBuckets) {
-        bucket.diffAhead();
+    // batches for tag to taggable buckets come first, then batches for taggable to tag buckets
+    std::vector<std::vector<std::pair<uint64_t, uint64_t>>> batches(2 * currentBucketCount);
+    std::vector<std::size_t> batchSizes(batches.size());
+    for (const auto& [tag, taggable] : pairings) {
+        ++batchSizes[getBucketIndex(tag)];
+        ++batchSizes[currentBucketCount + getBucketIndex(taggable)];
     }
-    for (auto& bucket : taggableTagBuckets) {
-        bucket.diffAhead();
+    for (std::size_t i = 0; i < batches.size(); ++i) {
+        batches[i].reserve(batchSizes[i]);
     }
-    writeCacheFile();
+    for (const auto& [tag, taggable] : pairings) {
+        batches[getBucketIndex(tag)].emplace_back(tag, taggable);
+        batches[currentBucketCount + getBucketIndex(taggable)].emplace_back(taggable, tag);
+    }
+
+    // every pair is independent of the others, and toggling the same pair twice undoes itself in any order, so sorting keeps the outcome
+    auto applyBatch = [this, &batches, modification](std::size_t i) {
+        auto& batch = batches[i];
+        if (batch.empty()) {
+            return;
+        }
+
+        std::sort(batch.begin(), batch.end());
+        auto& bucket = i < currentBucketCount ? tagTaggableBuckets.at(i) : taggableTagBuckets.at(i - currentBucketCount);
+        bucket.modifyItems(batch, modification);
+    };
+    // buckets only read the single buckets besides themselves, so their batches can be applied at once
+    if (pairings.size() < PARALLEL_BATCH_PAIRINGS) {
+        for (std::size_t i = 0; i < batches.size(); ++i) {
+            applyBatch(i);
+        }
+    } else {
+        parallelFor(batches.size(), writeThreads_, applyBatch);
+    }
+
+    commitWriteAhead();
 }
 
 void TagFileMaintainer::insertPairings(std::string_view input) {
-    modifyPairings(input, &PairingBucket::insertItem);
+    modifyPairings(input, IdPairContainer::Modification::INSERT);
 }
 
 void TagFileMaintainer::togglePairings(std::string_view input) {
-    modifyPairings(input, &PairingBucket::toggleItem);
+    modifyPairings(input, IdPairContainer::Modification::TOGGLE);
 }
 
 void TagFileMaintainer::deletePairings(std::string_view input) {
-    modifyPairings(input, &PairingBucket::deleteItem);
+    modifyPairings(input, IdPairContainer::Modification::ERASE);
 }
 
-void TagFileMaintainer::readTagGroupsTaggableCountsWithSearch(std::string_view input, void (*writer)(const std::string&)) {
+// Input looks like {metric}{taggable}{value} for each value, a set is one erase and one insert into the metric's sorted values
+void TagFileMaintainer::setMetricValues(std::string_view input) {
+    if (input.size() % 24 != 0) {
+        throw std::logic_error("Metric value input was not a multiple of 24");
+    }
+
+    // every value is checked before any is set, so a bad one leaves the metric bucket as it was
+    std::vector<MetricValue> metricValues;
+    metricValues.reserve(input.size() / 24);
+    std::size_t inputOffset = 0;
+    while (inputOffset < input.size()) {
+        MetricValue metricValue;
+        metricValue.metric = util::deserializeUInt64(input, inputOffset);
+        auto externalTaggable = util::deserializeUInt64(input, inputOffset);
+        metricValue.value = util::deserializeDouble(input, inputOffset);
+        if (metricValue.metric == METRIC_FAKER) {
+            throw std::logic_error(std::string("Metric ") + std::to_string(metricValue.metric) + " is reserved");
+        }
+        if (std::isnan(metricValue.value)) {
+            throw std::logic_error(std::string("Taggable ") + std::to_string(externalTaggable) + " was given a value of metric " + std::to_string(metricValue.metric) + " that is not a number");
+        }
+        if (!taggableIds_.toInternal(externalTaggable, metricValue.taggable) || !taggableBucket_->contains(metricValue.taggable)) {
+            throw std::logic_error(std::string("Taggable ") + std::to_string(externalTaggable) + " must be inserted before it can be given a metric value");
+        }
+        // -0 sorts as 0, so it is kept as 0 for the two to be the same value
+        if (metricValue.value == 0) {
+            metricValue.value = 0;
+        }
+        metricValues.push_back(metricValue);
+    }
+
+    for (const auto& metricValue : metricValues) {
+        bool hasValue = false;
+        for (const auto& previousValue : metricBucket_->contents().taggableValues(metricValue.taggable)) {
+            if (previousValue.metric != metricValue.metric) {
+                continue;
+            }
+
+            if (previousValue.value == metricValue.value) {
+                hasValue = true;
+            } else {
+                metricBucket_->deleteItem(previousValue);
+            }
+        }
+        if (!hasValue) {
+            metricBucket_->insertItem(metricValue);
+        }
+    }
+
+    commitWriteAhead();
+}
+
+// Input looks like {metric}{taggable} for each value
+void TagFileMaintainer::deleteMetricValues(std::string_view input) {
+    if (input.size() % 16 != 0) {
+        throw std::logic_error("Metric value input was not a multiple of 16");
+    }
+
+    std::size_t inputOffset = 0;
+    while (inputOffset < input.size()) {
+        auto metric = util::deserializeUInt64(input, inputOffset);
+        auto externalTaggable = util::deserializeUInt64(input, inputOffset);
+        uint64_t taggable;
+        if (!taggableIds_.toInternal(externalTaggable, taggable)) {
+            continue;
+        }
+
+        for (const auto& previousValue : metricBucket_->contents().taggableValues(taggable)) {
+            if (previousValue.metric == metric) {
+                metricBucket_->deleteItem(previousValue);
+            }
+        }
+    }
+
+    commitWriteAhead();
+}
+
+void TagFileMaintainer::readTagGroupsTaggableCountsWithSearch(std::string_view input, void (*writer)(std::string)) {
     std::size_t inputOffset = 0;
 
     uint64_t tagGroupCount = util::deserializeUInt64(input, inputOffset);
     std::vector<uint64_t> tagGroupsTaggableCounts;
     tagGroupsTaggableCounts.resize(tagGroupCount, 0);
-    std::unordered_map<uint64_t, std::vector<std::size_t>> tagToTagGroupIndices;
-    tagToTagGroupIndices.reserve(tagGroupCount);
+    // each tag group's tags, as the taggables each tag is paired with
+    std::vector<std::vector<std::pair<uint64_t, const IdPairSecond*>>> tagGroupsTags;
+    tagGroupsTags.resize(tagGroupCount);
 
     for (std::size_t i = 0; i < tagGroupCount; ++i) {
         auto tagCount = util::deserializeUInt64(input, inputOffset);
         for (std::size_t j = 0; j < tagCount; ++j) {
-            auto tag = util::deserializeUInt64(input, inputOffset);
-            auto tagGroupIndices = tagToTagGroupIndices.find(tag);
-            if (tagGroupIndices == tagToTagGroupIndices.end()) {
-                tagGroupIndices = tagToTagGroupIndices.insert({tag, std::vector<std::size_t>()}).first;
+            auto externalTag = util::deserializeUInt64(input, inputOffset);
+            uint64_t tag;
+            if (!tagIds_.toInternal(externalTag, tag)) {
+                continue;
+            }
+            const auto* tagsTaggables = getTagBucket(tag).firstContents(tag);
+            if (tagsTaggables != nullptr) {
+                tagGroupsTags[i].emplace_back(tag, tagsTaggables);
             }
-            tagGroupIndices->second.push_back(i);
         }
     }
 
     auto search = search_(input, inputOffset);
     auto result = search.releaseResult();
+    const auto* universe = &taggableBucket_->contents();
+    auto resultSet = SetEvaluation(false, universe, &result);
+
+    // a tag group is counted from its tags' taggables when that reads less than walking the tags of every taggable in the result would
+    // a single tag is always counted that way, as the intersection is counted container by container without being made
+    std::vector<std::size_t> tagSideTagGroupIndices;
+    std::unordered_map<uint64_t, std::vector<std::size_t>> tagToTagGroupIndices;
+    std::size_t tagSideTaggables = 0;
+    for (std::size_t i = 0; i < tagGroupCount; ++i) {
+        std::size_t tagGroupTaggables = 0;
+        for (const auto& [tag, tagsTaggables] : tagGroupsTags[i]) {
+            tagGroupTaggables += tagsTaggables->physicalSize();
+        }
+        if (tagGroupsTags[i].size() <= 1 || tagGroupTaggables <= result.size()) {
+            tagSideTagGroupIndices.push_back(i);
+            tagSideTaggables += tagGroupTaggables;
+            continue;
+        }
+
+        for (const auto& [tag, tagsTaggables] : tagGroupsTags[i]) {
+            tagToTagGroupIndices[tag].push_back(i);
+        }
+    }
 
-    std::unordered_set<std::size_t> tagGroupIndicesToAddTo;
-    auto gatherTagGroupIndices = [&tagToTagGroupIndices, &tagGroupIndicesToAddTo](uint64_t tag) {
-        if (tagToTagGroupIndices.contains(tag)) {
-            for (auto index : tagToTagGroupIndices.at(tag)) {
-                tagGroupIndicesToAddTo.insert(index);
-            }
+    auto countTagSide = [&tagSideTagGroupIndices, &tagGroupsTags, &tagGroupsTaggableCounts, &resultSet, universe](std::size_t i) {
+        auto index = tagSideTagGroupIndices[i];
+        auto tagGroupTaggables = SetEvaluation(false, universe, RoaringBitmap());
+        for (const auto& [tag, tagsTaggables] : tagGroupsTags[index]) {
+            tagGroupTaggables = SetEvaluation::setUnion(std::move(tagGroupTaggables), SetEvaluation(tagsTaggables->isComplement(), universe, &tagsTaggables->physicalContents()));
         }
+        tagGroupsTaggableCounts[index] = SetEvaluation::intersectSize(resultSet, tagGroupTaggables);
     };
-    for (auto taggable : result) {
-        auto& taggableBucket = getTaggableBucket(taggable);
-        const auto* taggablesTags = taggableBucket.firstContents(taggable);
-        if (taggablesTags != nullptr) {
-            taggablesTags->forEach(gatherTagGroupIndices);
+    if (tagSideTaggables < PARALLEL_TAG_GROUP_TAGGABLES) {
+        for (std::size_t i = 0; i < tagSideTagGroupIndices.size(); ++i) {
+            countTagSide(i);
         }
+    } else {
+        parallelFor(tagSideTagGroupIndices.size(), tagGroupCountThreads_, countTagSide);
+    }
 
-        for (auto index : tagGroupIndicesToAddTo) {
-            ++tagGroupsTaggableCounts[index];
+    if (!tagToTagGroupIndices.empty()) {
+        // the last taggable each tag group was counted for, so a taggable with several of a group's tags is counted once
+        std::vector<uint64_t> lastCountedTaggables(tagGroupCount, std::numeric_limits<uint64_t>::max());
+        for (auto taggable : result) {
+            auto& taggableBucket = getTaggableBucket(taggable);
+            const auto* taggablesTags = taggableBucket.firstContents(taggable);
+            if (taggablesTags == nullptr) {
+                continue;
+            }
+
+            taggablesTags->forEach([&tagToTagGroupIndices, &tagGroupsTaggableCounts, &lastCountedTaggables, taggable](uint64_t tag) {
+                auto tagGroupIndices = tagToTagGroupIndices.find(tag);
+                if (tagGroupIndices == tagToTagGroupIndices.end()) {
+                    return;
+                }
+                for (auto index : tagGroupIndices->second) {
+                    if (lastCountedTaggables[index] != taggable) {
+                        lastCountedTaggables[index] = taggable;
+                        ++tagGroupsTaggableCounts[index];
+                    }
+                }
+            });
         }
-        tagGroupIndicesToAddTo.clear();
     }
 
     std::string output;
@@ -359,10 +1306,10 @@ void TagFileMaintainer::readTagGroupsTaggableCountsWithSearch(std::string_view i
         location = util::serializeUInt64(tagGroupTaggableCount, output, location);
     }
 
-    writer(output);
+    writer(std::move(output));
 }
 
-void TagFileMaintainer::readTaggablesTags(std::string_view input, void (*writer)(const std::string&)) {
+void TagFileMaintainer::readTaggablesTags(std::string_view input, void (*writer)(std::string)) {
     std::size_t inputOffset = 0;
 
     std::string output;
@@ -372,28 +1319,41 @@ void TagFileMaintainer::readTaggablesTags(std::string_view input, void (*writer)
         throw std::logic_error(std::string("Input is malformed, not an even interval of 8"));
     }
     while (inputOffset < input.size()) {
-        uint64_t taggable = util::deserializeUInt64(input, inputOffset);
-        auto& taggableBucket = getTaggableBucket(taggable);
-        const auto* taggableTags = taggableBucket.firstContents(taggable);
+        uint64_t externalTaggable = util::deserializeUInt64(input, inputOffset);
+        uint64_t taggable;
+        const IdPairSecond* taggableTags = nullptr;
+        if (taggableIds_.toInternal(externalTaggable, taggable)) {
+            taggableTags = getTaggableBucket(taggable).firstContents(taggable);
+        }
         if (taggableTags != nullptr) {
-            location = util::serializeUInt64(taggable, output, location);
-            location = util::serializeUInt64(taggableTags->size(), output, location);
+            location = util::serializeUInt64(externalTaggable, output, location);
+
+            std::size_t tagsWritten = 0;
+            std::size_t tagsCountLocation = location;
+            const uint64_t PLACEHOLDER_COUNT = 0xFFFFFFFFFFFFFFFFULL;
+            location = util::serializeUInt64(PLACEHOLDER_COUNT, output, location);
             
-            auto serializeTag = [&output, &location](uint64_t tag) {
-                location = util::serializeUInt64(tag, output, location);
+            auto serializeTag = [this, &output, &location, &tagsWritten](uint64_t tag) {
+                uint64_t externalTag;
+                if (tagIds_.toExternal(tag, externalTag)) {
+                    location = util::serializeUInt64(externalTag, output, location);
+                    ++tagsWritten;
+                }
             };
             taggableTags->forEach(serializeTag);
+
+            util::serializeUInt64(tagsWritten, output, tagsCountLocation);
         } else {
-            location = util::serializeUInt64(taggable, output, location);
+            location = util::serializeUInt64(externalTaggable, output, location);
             location = util::serializeUInt64(0, output, location);
         }
     }
 
-    writer(output);
+    writer(std::move(output));
 }
 
 // format is {tags count}{tags}{taggables count}{taggables}
-void TagFileMaintainer::readTaggablesSpecifiedTags(std::string_view input, void (*writer)(const std::string&)) {
+void TagFileMaintainer::readTaggablesSpecifiedTags(std::string_view input, void (*writer)(std::string)) {
     std::size_t inputOffset = 0;
 
     std::string output;
@@ -406,27 +1366,33 @@ void TagFileMaintainer::readTaggablesSpecifiedTags(std::string_view input, void
     std::unordered_set<uint64_t> tagsSpecified;
     tagsSpecified.reserve(tagCount);
     for (std::size_t i = 0; i < tagCount; ++i) {
-        uint64_t tag = util::deserializeUInt64(input, inputOffset);
-        tagsSpecified.insert(tag);
+        uint64_t externalTag = util::deserializeUInt64(input, inputOffset);
+        uint64_t tag;
+        if (tagIds_.toInternal(externalTag, tag)) {
+            tagsSpecified.insert(tag);
+        }
     }
 
     uint64_t taggableCount = util::deserializeUInt64(input, inputOffset);
     std::vector<uint64_t> tagsToWrite;
     for (std::size_t i = 0; i < taggableCount; ++i) {
-        uint64_t taggable = util::deserializeUInt64(input, inputOffset);
-        auto& taggableBucket = getTaggableBucket(taggable);
-        const auto* taggableTags = taggableBucket.firstContents(taggable);
+        uint64_t externalTaggable = util::deserializeUInt64(input, inputOffset);
+        uint64_t taggable;
+        const IdPairSecond* taggableTags = nullptr;
+        if (taggableIds_.toInternal(externalTaggable, taggable)) {
+            taggableTags = getTaggableBucket(taggable).firstContents(taggable);
+        }
         if (taggableTags != nullptr) {
-            location = util::serializeUInt64(taggable, output, location);
+            location = util::serializeUInt64(externalTaggable, output, location);
             
             std::size_t tagsWritten = 0;
             std::size_t tagsCountLocation = location;
             const uint64_t PLACEHOLDER_COUNT = 0xFFFFFFFFFFFFFFFFULL;
             location = util::serializeUInt64(PLACEHOLDER_COUNT, output, location);
 
-            auto serializeTag = [&output, &location, &tagsSpecified, &tagsWritten](uint64_t tag) {
+            auto serializeTag = [this, &output, &location, &tagsSpecified, &tagsWritten](uint64_t tag) {
                 if (tagsSpecified.contains(tag)) {
-                    location = util::serializeUInt64(tag, output, location);
+                    location = util::serializeUInt64(tagIds_.toExternal(tag), output, location);
                     ++tagsWritten;
                 }
             };
@@ -434,19 +1400,21 @@ void TagFileMaintainer::readTaggablesSpecifiedTags(std::string_view input, void
 
             util::serializeUInt64(tagsWritten, output, tagsCountLocation);
         } else {
-            location = util::serializeUInt64(taggable, output, location);
+            location = util::serializeUInt64(externalTaggable, output, location);
             location = util::serializeUInt64(0, output, location);
         }
     }
     
 
-    writer(output);
+    writer(std::move(output));
 }
 
 // Searches tag file maintainer based on a search string where symbols mean the following:
-// Operators are evaluated left to right in the shortest manner possible
+// Operators are evaluated left to right in the shortest manner possible, runs of the same commutative operator are
+// parsed into a single operation whose operands are evaluated smallest first, see search-plan.hpp
 // 'T' Tag: followed by a tag identifier will yield a taggable list of all taggables with that tag
 // 'L' Taggable list: 
+// 'M' Metric range: followed by a metric, a lowest and a highest value will yield the taggables with a value of the metric between them
 // '(' open group
 // ')' close group
 // '~' not
@@ -462,97 +1430,351 @@ namespace {
     const char UNIVERSE_SET = 'U';
     const char TAG_TAGGABLE_LIST = 'T';
     const char TAGGABLE_LIST = 'L';
+    const char METRIC_RANGE = 'M';
     const char OPEN_GROUP = '(';
     const char CLOSE_GROUP = ')';
-    const char COUNT_OP = 'C';
-    const char PERCENTAGE_OP = 'P';
-    const char FILTERED_PERCENTAGE_OP = 'F';
     const char COMPLEMENT_OP = '~';
     const char RIGHT_HAND_SIDE_OP = '\xFF';
-    const std::unordered_map<char, SetEvaluation(*)(SetEvaluation&& set1, SetEvaluation&& set2)> SET_OPERATIONS = {
-        {'^', SetEvaluation::symmetricDifference},
-        {'-', SetEvaluation::difference},
-        {'&', SetEvaluation::intersect},
-        {'|', SetEvaluation::setUnion},
-        {RIGHT_HAND_SIDE_OP, SetEvaluation::rightHandSide}
+    const std::unordered_set<char> SET_OPERATIONS = {'^', '-', '&', '|'};
+    const char ID_ORDER = 'I';
+    const char METRIC_ORDER = 'M';
+
+    std::size_t windowEnd(uint64_t offset, uint64_t limit) {
+        if (limit > std::numeric_limits<std::size_t>::max() - offset) {
+            return std::numeric_limits<std::size_t>::max();
+        }
+        return offset + limit;
+    }
+
+    // A uniform draw from 0 up to bound, which is at most 2^32 as internal ids are 4 bytes
+    // Drawn by hand with Lemire's multiply-shift rather than a standard distribution, whose draws differ between standard libraries
+    uint64_t drawBelow(std::mt19937_64& random, uint64_t bound) {
+        const uint64_t LOW_BITS = 0xFFFFFFFFULL;
+        uint64_t product = (random() >> 32) * bound;
+        if ((product & LOW_BITS) < bound) {
+            // the few products below the threshold would make some draws likelier than others, so they are drawn again
+            uint64_t threshold = ((LOW_BITS + 1) - bound) % bound;
+            while ((product & LOW_BITS) < threshold) {
+                product = (random() >> 32) * bound;
+            }
+        }
+
+        return product >> 32;
+    }
+
+    // The items from offset up to offset + limit in the order less sorts them in
+    // Only the first offset + limit items are kept, in a heap whose top is the last of them, so the rest are never sorted
+    template <class T, class TLess>
+    class SortedWindow {
+        public:
+            SortedWindow(uint64_t offset, uint64_t limit, TLess less)
+                : offset_(offset), windowEnd_(windowEnd(offset, limit)), less_(less)
+            {}
+
+            void add(const T& item) {
+                if (heap_.size() < windowEnd_) {
+                    heap_.push_back(item);
+                    std::push_heap(heap_.begin(), heap_.end(), less_);
+                } else if (windowEnd_ != 0 && less_(item, heap_.front())) {
+                    std::pop_heap(heap_.begin(), heap_.end(), less_);
+                    heap_.back() = item;
+                    std::push_heap(heap_.begin(), heap_.end(), less_);
+                }
+            }
+
+            std::vector<T> take() {
+                std::sort_heap(heap_.begin(), heap_.end(), less_);
+                heap_.erase(heap_.begin(), heap_.begin() + std::min<std::size_t>(offset_, heap_.size()));
+                return std::move(heap_);
+            }
+        private:
+            uint64_t offset_;
+            std::size_t windowEnd_;
+            TLess less_;
+            std::vector<T> heap_;
     };
 }
 
-void TagFileMaintainer::search(std::string_view input, void (*writer)(const std::string&)) {
+void TagFileMaintainer::search(std::string_view input, void (*writer)(std::string)) {
     std::size_t inputOffset = 0;
     auto setEval = search_(input, inputOffset);
     auto taggables = setEval.releaseResult();
-    writer(serializeSingles(taggables));
+    writer(serializeExternalSingles(taggables, taggableIds_));
 }
 
-namespace {
-    struct PreemptiveComparison {
-        bool isPossible;
-        bool comparison;
+void TagFileMaintainer::openSearchCursor(std::string_view input, void (*writer)(std::string)) {
+    std::size_t inputOffset = 0;
+    auto result = search_(input, inputOffset).releaseResult();
+    std::vector<uint64_t> taggables;
+    taggables.reserve(result.size());
+    result.forEach([this, &taggables](uint64_t internal) {
+        uint64_t external;
+        if (taggableIds_.toExternal(internal, external)) {
+            taggables.push_back(external);
+        }
+    });
+    // internal ids are not in the order of the external ids they stand for
+    std::sort(taggables.begin(), taggables.end());
+
+    std::string output;
+    output.resize(16);
+    auto taggableCount = taggables.size();
+    auto location = util::serializeUInt64(searchCursors_.open(std::move(taggables)), output, 0);
+    util::serializeUInt64(taggableCount, output, location);
+    writer(std::move(output));
+}
+
+// Input looks like {cursor id}{offset}{limit}
+void TagFileMaintainer::readSearchCursorPage(std::string_view input, void (*writer)(std::string)) {
+    std::size_t inputOffset = 0;
+    auto cursorId = util::deserializeUInt64(input, inputOffset);
+    auto offset = util::deserializeUInt64(input, inputOffset);
+    auto limit = util::deserializeUInt64(input, inputOffset);
+    writer(searchCursors_.page(cursorId, offset, limit).value_or(""));
+}
+
+void TagFileMaintainer::closeSearchCursor(std::string_view input) {
+    std::size_t inputOffset = 0;
+    searchCursors_.close(util::deserializeUInt64(input, inputOffset));
+}
+
+// Input looks like {order}{metric}{descending}{offset}{limit}{search}, where order is I to order by taggable id and M by the metric's values
+// Writes how many taggables the search found, followed by the ones from offset up to offset + limit in order
+void TagFileMaintainer::searchSorted(std::string_view input, void (*writer)(std::string)) {
+    std::size_t inputOffset = 0;
+    auto order = util::deserializeChar(input, inputOffset);
+    auto metric = util::deserializeUInt64(input, inputOffset);
+    bool descending = util::deserializeChar(input, inputOffset) != 0;
+    auto offset = util::deserializeUInt64(input, inputOffset);
+    auto limit = util::deserializeUInt64(input, inputOffset);
+    if (order != ID_ORDER && order != METRIC_ORDER) {
+        throw std::logic_error(std::string("Unknown search order '") + order + "'");
+    }
+
+    auto result = search_(input, inputOffset).releaseResult();
+    auto window = order == ID_ORDER ? sortedIdWindow_(result, descending, offset, limit) : sortedMetricWindow_(result, metric, descending, offset, limit);
+    std::string output;
+    output.resize(8 * (1 + window.size()));
+    auto location = util::serializeUInt64(result.size(), output, 0);
+    for (auto taggable : window) {
+        location = util::serializeUInt64(taggable, output, location);
+    }
+    writer(std::move(output));
+}
+
+// Input looks like {has seed}{seed}{count}{search}, where a search sampled with the same seed finds the same sample when its taggables are the same
+// Ranks are of internal ids, so that only holds within this database, another with the same taggables may have given them other ids
+// Writes how many taggables the search found, followed by up to count of them in a random order
+void TagFileMaintainer::searchSample(std::string_view input, void (*writer)(std::string)) {
+    std::size_t inputOffset = 0;
+    bool hasSeed = util::deserializeChar(input, inputOffset) != 0;
+    auto seed = util::deserializeUInt64(input, inputOffset);
+    auto count = util::deserializeUInt64(input, inputOffset);
+    auto result = search_(input, inputOffset).releaseResult();
+    std::mt19937_64 random(hasSeed ? seed : std::random_device()());
+
+    // Floyd's algorithm draws count distinct ranks with a single draw each, which are then selected from the result in one pass
+    auto size = result.size();
+    count = std::min<uint64_t>(count, size);
+    std::unordered_set<std::size_t> rankSet;
+    rankSet.reserve(count);
+    for (std::size_t j = size - count; j < size; ++j) {
+        auto rank = drawBelow(random, j + 1);
+        if (!rankSet.insert(rank).second) {
+            rankSet.insert(j);
+        }
+    }
+    std::vector<std::size_t> ranks(rankSet.begin(), rankSet.end());
+    std::sort(ranks.begin(), ranks.end());
+    auto sample = result.select(ranks);
+    // the ranks were selected in ascending order, which is the order of internal ids rather than a random one
+    for (std::size_t i = sample.size(); i > 1; --i) {
+        std::swap(sample[i - 1], sample[drawBelow(random, i)]);
+    }
+
+    std::string output;
+    output.resize(8 * (1 + sample.size()));
+    auto location = util::serializeUInt64(size, output, 0);
+    for (auto internal : sample) {
+        uint64_t external;
+        if (taggableIds_.toExternal(internal, external)) {
+            location = util::serializeUInt64(external, output, location);
+        }
+    }
+    output.resize(location);
+    writer(std::move(output));
+}
+
+std::vector<uint64_t> TagFileMaintainer::sortedIdWindow_(const RoaringBitmap& taggables, bool descending, uint64_t offset, uint64_t limit) const {
+    auto less = [descending](uint64_t lhs, uint64_t rhs) {
+        return descending ? rhs < lhs : lhs < rhs;
     };
+    // internal ids are not in the order of the external ids they stand for, so they cannot be read off in order
+    auto window = SortedWindow<uint64_t, decltype(less)>(offset, limit, less);
+    taggables.forEach([this, &window](uint64_t internal) {
+        uint64_t external;
+        if (taggableIds_.toExternal(internal, external)) {
+            window.add(external);
+        }
+    });
 
-    template <class T>
-    PreemptiveComparison tryPreemptiveCompare(T lhs, std::string_view comparator, T rhs) {
-        if (comparator == "< ") {
-            return PreemptiveComparison {
-                .isPossible = lhs < rhs,
-                .comparison = true
-            };
-        } else if (comparator == "<=") {
-            return PreemptiveComparison {
-                .isPossible = lhs <= rhs,
-                .comparison = true
-            };
-        } else if (comparator == "> ") {
-            return PreemptiveComparison {
-                .isPossible = lhs <= rhs,
-                .comparison = false
-            };
-        } else if (comparator == ">=") {
-            return PreemptiveComparison {
-                .isPossible = lhs < rhs,
-                .comparison = false
-            };
-        } else if (comparator == "==") {
-            return PreemptiveComparison {
-                .isPossible = lhs < rhs,
-                .comparison = false
-            };
-        } else if (comparator == "<>") {
-            return PreemptiveComparison {
-                .isPossible = lhs < rhs,
-                .comparison = true
-            };
-        } else {
-            throw std::logic_error(std::string("Invalid comparator '" + std::string(comparator) + "' was provided to preemptive compare"));
+    return window.take();
+}
+
+// Taggables without a value of the metric come after the rest, and taggables with the same value are ordered by id
+std::vector<uint64_t> TagFileMaintainer::sortedMetricWindow_(const RoaringBitmap& taggables, uint64_t metric, bool descending, uint64_t offset, uint64_t limit) {
+    const auto& columns = metricBucket_->contents();
+    const auto* column = columns.column(metric);
+    if (column == nullptr) {
+        return sortedIdWindow_(taggables, false, offset, limit);
+    }
+
+    // walking the metric's values in order fills the window after about end * values / taggables of them,
+    // which is fewer than looking up every taggable's value once the search found enough of the metric's taggables
+    auto end = windowEnd(offset, limit);
+    auto walkLength = static_cast<double>(end) * static_cast<double>(column->size()) / static_cast<double>(std::max<std::size_t>(taggables.size(), 1));
+    if (walkLength >= static_cast<double>(taggables.size())) {
+        struct SortKey {
+            bool hasValue;
+            double value;
+            uint64_t taggable;
+        };
+        auto less = [descending](const SortKey& lhs, const SortKey& rhs) {
+            if (lhs.hasValue != rhs.hasValue) {
+                return lhs.hasValue;
+            }
+            if (lhs.hasValue && lhs.value != rhs.value) {
+                return descending ? rhs.value < lhs.value : lhs.value < rhs.value;
+            }
+            return lhs.taggable < rhs.taggable;
+        };
+        auto window = SortedWindow<SortKey, decltype(less)>(offset, limit, less);
+        taggables.forEach([this, &window, &columns, metric](uint64_t internal) {
+            uint64_t external;
+            if (taggableIds_.toExternal(internal, external)) {
+                auto value = columns.value(metric, internal);
+                window.add(SortKey{value.has_value(), value.value_or(0), external});
+            }
+        });
+
+        std::vector<uint64_t> windowTaggables;
+        for (const auto& sortKey : window.take()) {
+            windowTaggables.push_back(sortKey.taggable);
         }
+        return windowTaggables;
     }
 
-    template <class T>
-    bool compare(T lhs, std::string_view comparator, T rhs) {
-        if (comparator == "< ") {
-            return lhs < rhs;
-        } else if (comparator == "<=") {
-            return lhs <= rhs;
-        } else if (comparator == "> ") {
-            return lhs > rhs;
-        } else if (comparator == ">=") {
-            return lhs >= rhs;
-        } else if (comparator == "==") {
-            return lhs == rhs;
-        } else if (comparator == "<>") {
-            return lhs != rhs;
-        } else {
-            throw std::logic_error(std::string("Invalid comparator '" + std::string(comparator) + "' was provided to compare"));
+    std::vector<uint64_t> ordered;
+    std::vector<uint64_t> valuedTaggables;
+    std::vector<uint64_t> sameValueTaggables;
+    auto walk = [this, &taggables, &ordered, &valuedTaggables, &sameValueTaggables, end](auto it, auto columnEnd) {
+        while (it != columnEnd && ordered.size() < end) {
+            // the column keeps taggables with the same value in order of internal id, which is not the order of their ids
+            auto value = it->first;
+            sameValueTaggables.clear();
+            for (; it != columnEnd && it->first == value; ++it) {
+                uint64_t external;
+                if (taggables.contains(it->second) && taggableIds_.toExternal(it->second, external)) {
+                    sameValueTaggables.push_back(external);
+                    valuedTaggables.push_back(it->second);
+                }
+            }
+            std::sort(sameValueTaggables.begin(), sameValueTaggables.end());
+            ordered.insert(ordered.end(), sameValueTaggables.begin(), sameValueTaggables.end());
+        }
+        return it == columnEnd;
+    };
+    bool walkedEveryValue = descending ? walk(column->rbegin(), column->rend()) : walk(column->begin(), column->end());
+    ordered.resize(std::min(ordered.size(), end));
+
+    std::vector<uint64_t> windowTaggables(ordered.begin() + std::min<std::size_t>(offset, ordered.size()), ordered.end());
+    if (walkedEveryValue && ordered.size() < end) {
+        // the window reaches into the taggables without a value, which are every taggable the walk did not find
+        auto valuelessTaggables = RoaringBitmap::difference(taggables, RoaringBitmap::fromValues(std::move(valuedTaggables)));
+        auto valuelessOffset = std::max<std::size_t>(offset, ordered.size()) - ordered.size();
+        auto valuelessLimit = end - std::max<std::size_t>(offset, ordered.size());
+        for (auto taggable : sortedIdWindow_(valuelessTaggables, false, valuelessOffset, valuelessLimit)) {
+            windowTaggables.push_back(taggable);
         }
     }
+    return windowTaggables;
+}
+
+void TagFileMaintainer::countSearch(std::string_view input, void (*writer)(std::string)) {
+    std::size_t inputOffset = 0;
+    std::string output;
+    output.resize(8);
+    util::serializeUInt64(countSearch_(input, inputOffset), output, 0);
+    writer(std::move(output));
+}
+
+void TagFileMaintainer::searchExists(std::string_view input, void (*writer)(std::string)) {
+    std::size_t inputOffset = 0;
+    std::string output;
+    output.resize(8);
+    util::serializeUInt64(countSearch_(input, inputOffset) == 0 ? 0 : 1, output, 0);
+    writer(std::move(output));
+}
+
+void TagFileMaintainer::explainSearch(std::string_view input, void (*writer)(std::string)) {
+    std::size_t inputOffset = 0;
+    auto plan = parseSearch_(input, inputOffset);
+    searchPlan::plan(plan, taggableBucket_->contents().size());
+    searchPlan::evaluate(plan, &taggableBucket_->contents(), searchThreads_);
+    writer(searchPlan::explain(plan));
 }
 
 SetEvaluation TagFileMaintainer::search_(std::string_view input, std::size_t& inputOffset) {
-    
-    static auto EMPTY_TAGGABLES = IdPairSecond(&taggableBucket_->contents());
+    auto plan = parseSearch_(input, inputOffset);
+    const auto* universe = &taggableBucket_->contents();
+    if (searchCache_.capacity() == 0) {
+        searchPlan::plan(plan, universe->size());
+        return searchPlan::evaluate(plan, universe, searchThreads_);
+    }
+
+    auto [key, versions] = searchCacheKey_(plan);
+    auto cachedResult = searchCache_.find(key, versions);
+    if (cachedResult.has_value()) {
+        return SetEvaluation(false, universe, std::move(cachedResult.value()));
+    }
+
+    searchPlan::plan(plan, universe->size());
+    auto result = searchPlan::evaluate(plan, universe, searchThreads_).releaseResult();
+    searchCache_.insert(std::move(key), std::move(versions), result);
+    return SetEvaluation(false, universe, std::move(result));
+}
+
+std::size_t TagFileMaintainer::countSearch_(std::string_view input, std::size_t& inputOffset) {
+    auto plan = parseSearch_(input, inputOffset);
     const auto* universe = &taggableBucket_->contents();
-    auto context = SetEvaluation(false, universe, universe);
+    if (searchCache_.capacity() != 0) {
+        auto [key, versions] = searchCacheKey_(plan);
+        auto cachedResult = searchCache_.find(key, versions);
+        if (cachedResult.has_value()) {
+            return cachedResult.value().size();
+        }
+    }
+
+    // a count is not cached, the result it would be cached with is never made
+    searchPlan::plan(plan, universe->size());
+    return searchPlan::count(plan, universe, searchThreads_);
+}
+
+// The key a search's result is cached under, and the versions of the buckets it read from that the result is only valid for
+std::pair<std::string, std::vector<uint64_t>> TagFileMaintainer::searchCacheKey_(const SearchNode& plan) const {
+    // every result depends on the taggables, which are the universe complements are taken from
+    // versions are never repeated, so comparing them sorted is the same as comparing them bucket by bucket
+    std::vector<uint64_t> versions = {taggableBucket_->version()};
+    searchPlan::collectVersions(plan, versions);
+    std::sort(versions.begin(), versions.end());
+    versions.erase(std::unique(versions.begin(), versions.end()), versions.end());
+
+    return {searchPlan::canonicalize(plan), std::move(versions)};
+}
+
+SearchNode TagFileMaintainer::parseSearch_(std::string_view input, std::size_t& inputOffset) {
+    // an empty search is everything, as is an empty group
+    auto context = SearchNode();
     char op = FIRST_OP;
     while (inputOffset < input.size()) {
         if (op == FIRST_OP) {
@@ -565,147 +1787,108 @@ SetEvaluation TagFileMaintainer::search_(std::string_view input, std::size_t& in
             return context;
         }
             
+        auto operand = SearchNode();
         char selection = util::deserializeChar(input, inputOffset);
-        bool isComplement = false;
         if (selection == COMPLEMENT_OP) {
-            isComplement = true;
+            operand.isComplement = true;
             selection = util::deserializeChar(input, inputOffset);
         }
 
         if (selection == TAG_TAGGABLE_LIST) {
-            auto tag = util::deserializeUInt64(input, inputOffset);
-            const auto* taggables = getTagBucket(tag).firstContents(tag);
-            if (taggables == nullptr) {
-                taggables = &EMPTY_TAGGABLES;
+            operand.kind = SearchNode::Kind::TAG;
+            operand.externalTag = util::deserializeUInt64(input, inputOffset);
+            uint64_t tag;
+            if (tagIds_.toInternal(operand.externalTag, tag)) {
+                auto& tagBucket = getTagBucket(tag);
+                operand.taggables = tagBucket.firstContents(tag);
+                operand.version = tagBucket.version();
+            } else {
+                // the tag may be inserted later
+                operand.version = tagBucket_->version();
             }
-            context = SET_OPERATIONS.at(op)(std::move(context), SetEvaluation(taggables->isComplement() ^ isComplement, universe, &taggables->physicalContents()));
         } else if (selection == TAGGABLE_LIST) {
+            operand.kind = SearchNode::Kind::TAGGABLE_LIST;
             auto taggableCount = util::deserializeUInt64(input, inputOffset);
-            std::unordered_set<uint64_t> taggables;
+            std::vector<uint64_t> taggables;
+            taggables.reserve(taggableCount);
             for (std::size_t i = 0; i < taggableCount; ++i) {
-                taggables.insert(util::deserializeUInt64(input, inputOffset));
+                uint64_t taggable;
+                // taggables that were never inserted cannot be part of any result
+                if (taggableIds_.toInternal(util::deserializeUInt64(input, inputOffset), taggable)) {
+                    taggables.push_back(taggable);
+                }
+            }
+            operand.taggableList = RoaringBitmap::fromValues(std::move(taggables));
+        } else if (selection == METRIC_RANGE) {
+            // Metric Range looks like M{metric}{lowest}{highest}, where the taggables with a value from lowest to highest are found
+            operand.kind = SearchNode::Kind::METRIC_RANGE;
+            operand.metric = util::deserializeUInt64(input, inputOffset);
+            operand.lowest = util::deserializeDouble(input, inputOffset);
+            operand.highest = util::deserializeDouble(input, inputOffset);
+            operand.metricColumns = &metricBucket_->contents();
+            operand.version = metricBucket_->version();
+            // the only value the reserved metric ever has is the faker
+            if (operand.metric == METRIC_FAKER) {
+                operand.kind = SearchNode::Kind::EMPTY;
             }
-            context = SET_OPERATIONS.at(op)(std::move(context), SetEvaluation(isComplement, universe, std::move(taggables)));
         } else if (selection == CONDITIONAL_EXPRESSION_LIST_UNION) {
             // Conditional Expression List Union Operations looks like X{expression count}{expressions}{many conditions})
+            operand.kind = SearchNode::Kind::CONDITIONAL_EXPRESSION_LIST_UNION;
             char expressionListOp = 0;
             auto expressionCount = util::deserializeUInt64(input, inputOffset);
-            std::vector<SetEvaluation> expressions;
             for (std::size_t i = 0; i < expressionCount; ++i) {
-                auto expression = search_(input, inputOffset);
-                expressions.push_back(std::move(expression));
+                operand.children.push_back(parseSearch_(input, inputOffset));
             }
 
             while (inputOffset < input.size() && expressionListOp != CLOSE_GROUP) {
                 expressionListOp = util::deserializeChar(input, inputOffset);
 
-                if (expressionListOp == COUNT_OP) {
+                auto condition = SearchCondition{.type = expressionListOp};
+                if (expressionListOp == SearchCondition::COUNT_OP) {
                     // Count Operation looks like C{comparator}{occurrences}{compareExpression})
-                    // Restricts {expressions} to where the expression is represented with {comparator} {occurrences} within {compareExpression}
-                    std::string_view comparator = util::deserializeFixedLengthStringView(input, 2, inputOffset);
-                    auto occurrences = util::deserializeUInt64(input, inputOffset);
-                    
-                    auto compareExpressionContext = search_(input, inputOffset);
-                    const auto& immutableCompareExpressionContext = compareExpressionContext;
-
-                    std::vector<std::size_t> expressionIndicesToRemove;
-                    for (std::size_t i = 0; i < expressions.size(); ++i) {
-                        const auto& expression = expressions[i];
-                        auto preemptiveComparison = tryPreemptiveCompare(expression.size(), comparator, occurrences);
-                        if (preemptiveComparison.isPossible) {
-                            if (!preemptiveComparison.comparison) {
-                                expressionIndicesToRemove.push_back(i);
-                            }
-                            continue;
-                        } else {
-                            auto expressionRepresentation = SetEvaluation::intersect(immutableCompareExpressionContext, expression);
-                            if (!compare(expressionRepresentation.size(), comparator, occurrences)) {
-                                expressionIndicesToRemove.push_back(i);
-                            }
-                        }
-                    }
-                    for (std::size_t i = expressionIndicesToRemove.size(); i-- > 0;) {
-                        expressions[expressionIndicesToRemove[i]] = std::move(expressions.back());
-                        expressions.pop_back();
-                    }
-                } else if (expressionListOp == PERCENTAGE_OP) {
-                    // Percentage Operation looks like {LHS}P{comparator}{percentage}{expression})
-                    // Restricts {tags} to where the tag is represented with {comparator} {percentage} within {LHS}
-                    std::string_view comparator = util::deserializeFixedLengthStringView(input, 2, inputOffset);
-                    auto percentage = util::deserializeFloat(input, inputOffset);
-                    
-                    auto compareExpressionContext = search_(input, inputOffset);
-                    const auto& immutableCompareExpressionContext = compareExpressionContext;
-
-                    std::vector<std::size_t> expressionIndicesToRemove;
-                    for (std::size_t i = 0; i < expressions.size(); ++i) {
-                        const auto& expression = expressions[i];
-                        if (expression.size() == 0) {
-                            expressionIndicesToRemove.push_back(i);
-                            continue;
-                        }
-                    
-                        auto expressionRepresentation = SetEvaluation::intersect(immutableCompareExpressionContext, expression);
-                        if (!compare(static_cast<float>(expressionRepresentation.size()) / static_cast<float>(expression.size()), comparator, percentage)) {
-                            expressionIndicesToRemove.push_back(i);
-                        }
-                    }
-                    for (std::size_t i = expressionIndicesToRemove.size(); i-- > 0;) {
-                        expressions[expressionIndicesToRemove[i]] = std::move(expressions.back());
-                        expressions.pop_back();
-                    }
-                } else if (expressionListOp == FILTERED_PERCENTAGE_OP) {
-                    // Count Operation looks like P{comparator}{percentage}{filteringExpression}){expression})
-                    // Gets a union of all {tags} where the tag's taggables that are filtered by {LHS} are represented with {comparator} {percentage} within {expression}
-                    std::string_view comparator = util::deserializeFixedLengthStringView(input, 2, inputOffset);
-                    auto percentage = util::deserializeFloat(input, inputOffset);
-
-                    auto filteringContext = search_(input, inputOffset);
-                    const auto& immutableFilteringContext = filteringContext;
-                
-                    auto representationContext = search_(input, inputOffset);
-                    const auto& immutableRepresentationContext = representationContext;
-                
-                    std::vector<std::size_t> expressionIndicesToRemove;
-                    for (std::size_t i = 0; i < expressions.size(); ++i) {
-                        const auto& expression = expressions[i];
-                    
-                        auto filteredExpressionContext = SetEvaluation::intersect(immutableFilteringContext, expression);
-                        auto filteredExpressionCount = filteredExpressionContext.size();
-                        if (filteredExpressionCount == 0) {
-                            expressionIndicesToRemove.push_back(i);
-                            continue;
-                        }
-
-                        auto tagsRepresentation = SetEvaluation::intersect(immutableRepresentationContext, std::move(filteredExpressionContext));
-                        if (!compare(static_cast<float>(tagsRepresentation.size()) / static_cast<float>(filteredExpressionCount), comparator, percentage)) {
-                            expressionIndicesToRemove.push_back(i);
-                        }
-                    }
-                    for (std::size_t i = expressionIndicesToRemove.size(); i-- > 0;) {
-                        expressions[expressionIndicesToRemove[i]] = std::move(expressions.back());
-                        expressions.pop_back();
-                    }
+                    condition.comparator = util::deserializeFixedLengthStringView(input, 2, inputOffset);
+                    condition.occurrences = util::deserializeUInt64(input, inputOffset);
+                    condition.contexts.push_back(parseSearch_(input, inputOffset));
+                } else if (expressionListOp == SearchCondition::PERCENTAGE_OP) {
+                    // Percentage Operation looks like P{comparator}{percentage}{expression})
+                    condition.comparator = util::deserializeFixedLengthStringView(input, 2, inputOffset);
+                    condition.percentage = util::deserializeFloat(input, inputOffset);
+                    condition.contexts.push_back(parseSearch_(input, inputOffset));
+                } else if (expressionListOp == SearchCondition::FILTERED_PERCENTAGE_OP) {
+                    // Filtered Percentage Operation looks like F{comparator}{percentage}{filteringExpression}){expression})
+                    condition.comparator = util::deserializeFixedLengthStringView(input, 2, inputOffset);
+                    condition.percentage = util::deserializeFloat(input, inputOffset);
+                    condition.contexts.push_back(parseSearch_(input, inputOffset));
+                    condition.contexts.push_back(parseSearch_(input, inputOffset));
+                } else {
+                    continue;
                 }
-                
-            }
-
-            auto unionExpressionList = SetEvaluation(isComplement, universe, std::unordered_set<uint64_t>());
-            for (const auto& expression : expressions) {
-                unionExpressionList = SetEvaluation::setUnion(std::move(unionExpressionList), expression);
+                operand.conditions.push_back(std::move(condition));
             }
-
-            context = SET_OPERATIONS.at(op)(std::move(context), std::move(unionExpressionList));
         } else if (selection == OPEN_GROUP) {
-            auto subSearch = search_(input, inputOffset);
-            if (isComplement) {
-                subSearch.complement();
-            }
-            context = SET_OPERATIONS.at(op)(std::move(context), std::move(subSearch));
+            bool isComplement = operand.isComplement;
+            operand = parseSearch_(input, inputOffset);
+            operand.isComplement ^= isComplement;
         } else if (selection == UNIVERSE_SET) {
-            context = SET_OPERATIONS.at(op)(std::move(context), SetEvaluation(isComplement, universe, universe));
+            operand.kind = SearchNode::Kind::UNIVERSE;
         } else if (selection == EMPTY_SET) {
-            context = SET_OPERATIONS.at(op)(std::move(context), SetEvaluation(isComplement, universe, &EMPTY_TAGGABLES.physicalContents()));
+            operand.kind = SearchNode::Kind::EMPTY;
+        } else {
+            throw std::logic_error(std::string("Unknown search selection '") + selection + "'");
+        }
+
+        if (op == RIGHT_HAND_SIDE_OP) {
+            context = std::move(operand);
+        } else if (!SET_OPERATIONS.contains(op)) {
+            throw std::logic_error(std::string("Unknown search operation '") + op + "'");
+        } else if (context.kind == SearchNode::Kind::OPERATION && context.op == op && !context.isComplement) {
+            // a run of the same operation is one operation over every operand, which the planner can reorder when it commutes
+            context.children.push_back(std::move(operand));
+        } else {
+            auto operation = SearchNode{.kind = SearchNode::Kind::OPERATION, .op = op};
+            operation.children.push_back(std::move(context));
+            operation.children.push_back(std::move(operand));
+            context = std::move(operation);
         }
     }
 
@@ -713,6 +1896,12 @@ SetEvaluation TagFileMaintainer::search_(std::string_view input, std::size_t& in
 }
 
 void TagFileMaintainer::flushFiles() {
+    if (inTransaction) {
+        return;
+    }
+
+    finishBackgroundFlush(true);
+
     for (auto& tagTaggableBucket : tagTaggableBuckets) {
         tagTaggableBucket.write();
     }
@@ -721,11 +1910,18 @@ void TagFileMaintainer::flushFiles() {
     }
     taggableBucket_->write();
     tagBucket_->write();
-    writeCacheFile();
-    priorCacheFile = util::readFile(cacheFilePath_);
+    metricBucket_->write();
+    // every bucket's main file now has what was written ahead, the manifest must say so before the log is emptied
+    committedWriteAheadLogSize_ = 0;
+    writeManifest();
+    writeAheadLog().truncate();
+    removeStaleBucketFolders();
 }
 
-void TagFileMaintainer::purgeUnusedFiles() const {
+void TagFileMaintainer::purgeUnusedFiles() {
+    // the generations a running flush replaces are only unused once it is committed
+    finishBackgroundFlush(true);
+
     for (const auto& tagTaggableBucket : tagTaggableBuckets) {
         tagTaggableBucket.purgeUnusedFiles();
     }
@@ -734,27 +1930,61 @@ void TagFileMaintainer::purgeUnusedFiles() const {
     }
     taggableBucket_->purgeUnusedFiles();
     tagBucket_->purgeUnusedFiles();
+    metricBucket_->purgeUnusedFiles();
+    removeStaleBucketFolders();
+}
+
+void TagFileMaintainer::removeStaleBucketFolders() const {
+    std::unordered_set<std::string> usedBucketFolders;
+    auto useBucketFolders = [&usedBucketFolders](const auto& bucket) {
+        usedBucketFolders.insert(bucket.generationPath(bucket.committedGeneration()).generic_string());
+        usedBucketFolders.insert(bucket.mainFileLocation().parent_path().generic_string());
+    };
+    for (const auto& tagTaggableBucket : tagTaggableBuckets) {
+        useBucketFolders(tagTaggableBucket);
+    }
+    for (const auto& taggableTagBucket : taggableTagBuckets) {
+        useBucketFolders(taggableTagBucket);
+    }
+    useBucketFolders(*taggableBucket_);
+    useBucketFolders(*tagBucket_);
+    useBucketFolders(*metricBucket_);
+
+    // earlier generations, and folders left behind by splits or flushes that were interrupted before or after their commit
+    if (std::filesystem::exists(folderPath_ / "buckets")) {
+        for (const auto& entry : std::filesystem::directory_iterator(folderPath_ / "buckets")) {
+            if (entry.is_directory() && !usedBucketFolders.contains(entry.path().generic_string())) {
+                std::filesystem::remove_all(entry.path());
+            }
+        }
+    }
 }
 
 unsigned short TagFileMaintainer::getBucketIndex(uint64_t item) const {
-    return static_cast<unsigned short>(item % currentBucketCount);
-}
-
-//uint32_t TagFileMaintainer::getWantedBucketCount() const {
-//    return getWantedBucketSize();
-//}
-//
-//uint32_t TagFileMaintainer::getWantedBucketSize() const {
-//    auto writeBytesPerFile = (Config::getWriteBytesPerSecond() / Config::getWriteFileCountPerSecond()) / 2;
-//    auto readBytesPerFile = (Config::getReadBytesPerSecond() / Config::getReadFileCountPerSecond()) / 2;
-//    auto bucketBytesPerFileUnrounded = std::min(writeBytesPerFile, readBytesPerFile);
-//    auto bucketBytesPerFile = 1;
-//    while (bucketBytesPerFileUnrounded != 0) {
-//        bucketBytesPerFileUnrounded >>= 1;
-//        bucketBytesPerFile <<= 1;
-//    }
-//    return bucketBytesPerFile >> 1;
-//}
+    auto index = item % levelBucketCount_;
+    if (index < static_cast<uint64_t>(currentBucketCount - levelBucketCount_)) {
+        index = item % (levelBucketCount_ * 2);
+    }
+
+    return static_cast<unsigned short>(index);
+}
+
+// Enough buckets that the pairing buckets average no more than the target bucket bytes on disk
+std::size_t TagFileMaintainer::getWantedBucketCount() {
+    // a running flush has yet to write the current generation, so the committed one is what is on disk
+    std::size_t totalBytes = 0;
+    for (auto& tagTaggableBucket : tagTaggableBuckets) {
+        totalBytes += tagTaggableBucket.committedMainFileBytes();
+    }
+    for (auto& taggableTagBucket : taggableTagBuckets) {
+        totalBytes += taggableTagBucket.committedMainFileBytes();
+    }
+
+    // each bucket index has a tag to taggable and a taggable to tag bucket
+    auto bytesPerIndex = 2 * std::max<std::size_t>(targetBucketBytes_, 1);
+    auto wantedBucketCount = (totalBytes + bytesPerIndex - 1) / bytesPerIndex;
+    return std::clamp<std::size_t>(wantedBucketCount, INITIAL_BUCKET_COUNT, MAX_BUCKET_COUNT);
+}
 
 PairingBucket& TagFileMaintainer::getTagBucket(uint64_t tag) {
     return tagTaggableBuckets.at(getBucketIndex(tag));
@@ -778,11 +2008,10 @@ void TagFileMaintainer::beginTransaction() {
     }
     taggableBucket_->beginTransaction();
     tagBucket_->beginTransaction();
+    metricBucket_->beginTransaction();
     inTransaction = true;
 }
 void TagFileMaintainer::endTransaction() {
-    writePriorCacheFile();
-
     for (auto& tagTaggableBucket : tagTaggableBuckets) {
         tagTaggableBucket.endTransaction();
     }
@@ -791,17 +2020,10 @@ void TagFileMaintainer::endTransaction() {
     }
     taggableBucket_->endTransaction();
     tagBucket_->endTransaction();
+    metricBucket_->endTransaction();
     inTransaction = false;
 
-    writeCacheFile();
-}
-
-bool TagFileMaintainer::needsMaintenance() {
-    return false;
-}
-
-void TagFileMaintainer::doMaintenance() {
-
+    commitWriteAhead();
 }
 
 void TagFileMaintainer::close() {
@@ -814,8 +2036,8 @@ void TagFileMaintainer::close() {
     closed_ = true;
 }
 
-PairingBucket::PairingBucket(std::filesystem::path bucketPath, std::size_t startingSize, std::size_t startingComplementCount, const std::unordered_set<uint64_t>* secondUniverse)
-    : Bucket(bucketPath, startingSize), startingComplementCount_(startingComplementCount), secondUniverse_(secondUniverse)
+PairingBucket::PairingBucket(std::filesystem::path bucketPath, std::size_t generation, std::size_t startingSize, std::size_t startingComplementCount, const RoaringBitmap* secondUniverse, std::size_t idBytes)
+    : Bucket(std::move(bucketPath), generation, startingSize), startingComplementCount_(startingComplementCount), secondUniverse_(secondUniverse), idBytes_(idBytes)
 {
     contents_ = IdPairContainer(secondUniverse);
 }
@@ -831,7 +2053,7 @@ void PairingBucket::insertComplement(uint64_t second) {
 
     // need to update only the diffs for those that start with complement
     for (auto first : startingFirstComplements) {
-        diffContents_.insert(std::pair<uint64_t, uint64_t>(first, second));
+        insertDiff(std::pair<uint64_t, uint64_t>(first, second));
     }
 
     const auto& firstComplements = contents_.firstComplements();
@@ -852,7 +2074,7 @@ void PairingBucket::deleteComplement(uint64_t second) {
 
     // need to update only the diffs for those that start with complement
     for (auto first : startingFirstComplements) {
-        util::toggle(diffContents_, std::pair<uint64_t, uint64_t>(first, second));
+        toggleDiff(std::pair<uint64_t, uint64_t>(first, second));
     }
 
     const auto& firstComplements = contents_.firstComplements();
@@ -863,33 +2085,176 @@ void PairingBucket::deleteComplement(uint64_t second) {
 
 }
 
+// The staying half is written to this bucket's next generation and the moving half to the first generation of movingPath
+std::function<void()> PairingBucket::splitSnapshot(std::filesystem::path movingPath, uint64_t modulus, uint64_t movingIndex) {
+    init();
+
+    movingBucket_ = std::make_unique<PairingBucket>(std::move(movingPath), 0, 0, 0, secondUniverse_, idBytes_);
+    movingBucket_->moveToGeneration(1);
+    splitModulus_ = modulus;
+    splitMovingIndex_ = movingIndex;
+    // the copy is taken on the command thread, the write splits it on the flushing one
+    auto snapshotContents = std::make_shared<IdPairContainer>(contents_);
+    moveToGeneration(generation_ + 1);
+    contentsMatchMainFile();
+
+    return [this, snapshotContents, stayingFileName = mainFileName, movingFileName = movingBucket_->mainFileName, faker = FAKER().first]() {
+        auto movingContents = snapshotContents->extractFirsts([this, faker](uint64_t first) {
+            return first != faker && first % splitModulus_ == splitMovingIndex_;
+        });
+        auto stayingStr = serialize(*snapshotContents);
+        snapshotChecksum_ = util::crc32(stayingStr);
+        snapshotMainFileBytes_ = stayingStr.size();
+        util::writeFile(stayingFileName, stayingStr);
+        auto movingStr = serialize(movingContents);
+        movingBucket_->snapshotChecksum_ = util::crc32(movingStr);
+        movingBucket_->snapshotMainFileBytes_ = movingStr.size();
+        movingBucket_->startingSize_ = movingContents.size();
+        util::writeFile(movingFileName, movingStr);
+    };
+}
+
+PairingBucket PairingBucket::finishSplit() {
+    finishSnapshot();
+
+    auto moving = std::move(*movingBucket_);
+    movingBucket_.reset();
+    moving.finishSnapshot();
+    auto faker = FAKER().first;
+    auto moves = [this, faker](uint64_t first) {
+        return first != faker && first % splitModulus_ == splitMovingIndex_;
+    };
+    moving.contents_ = contents_.extractFirsts(moves);
+    moving.isRead = true;
+    moving.contentsIsDirty = contentsIsDirty;
+    version_ = nextBucketVersion();
+
+    // what changed since the snapshot is the diff against the main file each half was written to
+    std::vector<std::pair<uint64_t, uint64_t>> movingDiff;
+    for (const auto& [first, seconds] : diffContents_.allContents()) {
+        if (moves(first)) {
+            for (auto second : seconds) {
+                movingDiff.push_back({first, second});
+            }
+        }
+    }
+    for (const auto& item : movingDiff) {
+        diffContents_.erase(item);
+        moving.diffContents_.insert(item);
+    }
+    for (auto it = startingFirstComplements.begin(); it != startingFirstComplements.end();) {
+        if (moves(*it)) {
+            moving.startingFirstComplements.insert(*it);
+            it = startingFirstComplements.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    startingSize_ -= moving.startingSize_;
+    startingComplementCount_ = startingFirstComplements.size();
+    moving.startingComplementCount_ = moving.startingFirstComplements.size();
+
+    return moving;
+}
+
+void PairingBucket::recoverDiffByFirst(std::string_view deltaStr, const std::function<PairingBucket&(uint64_t)>& bucketOf) {
+    auto faker = FAKER().first;
+    auto delta = deserializeDiff(deltaStr);
+    std::unordered_map<PairingBucket*, IdPairDiffContainer> bucketDeltas;
+    for (const auto& [first, seconds] : delta.allContents()) {
+        // the faker is toggled to tell this bucket's sizes apart, so it stays with it
+        auto* bucket = first == faker ? this : &bucketOf(first);
+        auto& bucketDelta = bucketDeltas[bucket];
+        for (auto second : seconds) {
+            bucketDelta.insert({first, second});
+        }
+    }
+
+    for (const auto& [bucket, bucketDelta] : bucketDeltas) {
+        bucket->recoverDiff(bucketDelta);
+    }
+}
+
+void PairingBucket::modifyItems(const std::vector<std::pair<uint64_t, uint64_t>>& sortedItems, IdPairContainer::Modification modification) {
+    init();
+
+    bool changed = false;
+    contents_.modifyItems(sortedItems, modification, [this, &changed](const std::pair<uint64_t, uint64_t>& item) {
+        toggleDiff(item);
+        changed = true;
+    });
+    if (changed) {
+        contentsIsDirty = true;
+        version_ = nextBucketVersion();
+    }
+}
+
 std::size_t PairingBucket::startingComplementCount() const {
     return startingComplementCount_;
 }
 
 const IdPairSecond* PairingBucket::firstContents(uint64_t first) {
+    // the lazily read firsts only ever grow between writes and evictions, so what is returned stays valid for the read that asked
+    std::lock_guard<std::mutex> lock(*readMutex_);
+    if (!isRead && canReadLazily()) {
+        noteUse();
+        auto lazyIt = lazyFirstContents_.find(first);
+        if (lazyIt == lazyFirstContents_.end()) {
+            lazyIt = lazyFirstContents_.insert({first, fileView_->firstContents(first, secondUniverse_)}).first;
+        }
+
+        return lazyIt->second.has_value() ? &lazyIt->second.value() : nullptr;
+    }
+
     init();
 
     return contents_.firstContents(first);
 }
+
+bool PairingBucket::canReadLazily() {
+    if (lazyChecked_) {
+        return fileView_.has_value();
+    }
+    lazyChecked_ = true;
+
+    if (startingSize_ == 0) {
+        return false;
+    }
+
+    auto mainView = mainFileView();
+    if (!IdPairFileView::isSortedFormat(mainView)) {
+        return false;
+    }
+    auto fileView = IdPairFileView(mainView, idBytes_);
+    // mirrors init(), a main file that does not match the starting size needs its diff applied first
+    if (fileView.size() != startingSize_) {
+        return false;
+    }
+
+    fileView_ = fileView;
+    return true;
+}
 std::pair<uint64_t, uint64_t> PairingBucket::FAKER() const {
+    if (idBytes_ == INTERNAL_ID_BYTES) {
+        return {0xFFFFFFFF, 0xFFFFFFFF};
+    }
     return {0xFFFFFFFFFFFFFFFF, 0xFFFFFFFFFFFFFFFF};
 }
 
 IdPairContainer PairingBucket::deserialize(std::string_view str) const  {
-    return IdPairContainer::deserialize(str, secondUniverse_);
+    return IdPairContainer::deserialize(str, secondUniverse_, idBytes_);
 }
 
 IdPairDiffContainer PairingBucket::deserializeDiff(std::string_view str) const  {
-    return IdPairDiffContainer::deserialize(str, secondUniverse_);
+    return IdPairDiffContainer::deserialize(str, secondUniverse_, idBytes_);
 }
 
 std::string PairingBucket::serialize(const IdPairContainer& contents) const {
-    return contents.serialize();
+    return contents.serialize(idBytes_);
 }
 
 std::string PairingBucket::serializeDiff(const IdPairDiffContainer& diffContents) const {
-    return diffContents.serialize();
+    return diffContents.serialize(idBytes_);
 }
 
 bool PairingBucket::isErased(const IdPairInsertReturnType& eraseReturn) const {
@@ -905,38 +2270,86 @@ void PairingBucket::applyDiff(const IdPairDiffContainer& diffContents) {
     }
 }
 
+void PairingBucket::mergeDiff(IdPairDiffContainer& diffContents, const IdPairDiffContainer& deltaContents) const {
+    for (const auto& pair : deltaContents.allContents()) {
+        auto first = pair.first;
+        for (auto second : pair.second) {
+            util::toggle(diffContents, std::pair<uint64_t, uint64_t>(first, second));
+        }
+    }
+}
+
+void PairingBucket::preContentsRead() {
+    lazyFirstContents_.clear();
+    fileView_.reset();
+    lazyChecked_ = false;
+}
+
 void PairingBucket::postContentsMatchFile() {
     startingFirstComplements = contents_.firstComplements();
     startingComplementCount_ = startingFirstComplements.size();
 }
 
-SingleBucket::SingleBucket(std::filesystem::path bucketPath, std::size_t startingSize)
-    : Bucket(bucketPath, startingSize)
+// startingComplementCount_ is kept, so insertComplement and deleteComplement read the bucket again before they need startingFirstComplements
+void PairingBucket::releaseContents() {
+    contents_ = IdPairContainer(secondUniverse_);
+    startingFirstComplements.clear();
+    preContentsRead();
+}
+
+std::size_t PairingBucket::residentBytes() const {
+    if (isRead) {
+        return contents_.estimatedBytes();
+    }
+
+    // a bucket that was not read holds the mapping of its main file, and a hash node for each first read from it
+    constexpr std::size_t LAZY_FIRST_BYTES = sizeof(decltype(lazyFirstContents_)::value_type) + (2 * sizeof(void*));
+    std::size_t bytes = mainFile_.isOpen() ? mainFile_.view().size() : 0;
+    for (const auto& [first, seconds] : lazyFirstContents_) {
+        bytes += LAZY_FIRST_BYTES;
+        if (seconds.has_value()) {
+            bytes += seconds->physicalContents().physicalBytes();
+        }
+    }
+
+    return bytes;
+}
+
+SingleBucket::SingleBucket(std::filesystem::path bucketPath, std::size_t generation, std::size_t startingSize, std::size_t idBytes)
+    : Bucket(std::move(bucketPath), generation, startingSize), idBytes_(idBytes)
 {}
 
+std::size_t SingleBucket::residentBytes() const {
+    if (!isRead) {
+        return 0;
+    }
+
+    return contents_.physicalBytes();
+}
+
 uint64_t SingleBucket::FAKER() const {
+    if (idBytes_ == INTERNAL_ID_BYTES) {
+        return 0xFFFFFFFF;
+    }
     return 0xFFFFFFFFFFFFFFFF;
 }
 
-std::unordered_set<uint64_t> SingleBucket::deserialize(std::string_view str) const {
-    std::unordered_set<uint64_t> deserializedContents;
-    auto processor = [this, &deserializedContents](uint64_t item) {
-        deserializedContents.insert(item);
-    };
-    processSingles(str, processor);
-
-    return deserializedContents;
+RoaringBitmap SingleBucket::deserialize(std::string_view str) const {
+    auto bitmap = RoaringBitmap::fromValues(deserializeCompressedSingles(str, idBytes_));
+    bitmap.runOptimize();
+    return bitmap;
 }
 std::unordered_set<uint64_t> SingleBucket::deserializeDiff(std::string_view str) const {
-    return deserialize(str);
+    auto singles = deserializeCompressedSingles(str, idBytes_);
+    return std::unordered_set<uint64_t>(singles.begin(), singles.end());
 }
 
-std::string SingleBucket::serialize(const std::unordered_set<uint64_t>& contents) const {
-    return serializeSingles(contents);
+std::string SingleBucket::serialize(const RoaringBitmap& contents) const {
+    return serializeCompressedSingles(std::vector<uint64_t>(contents.begin(), contents.end()), idBytes_);
 }
 
 std::string SingleBucket::serializeDiff(const std::unordered_set<uint64_t>& diffContents) const {
-    return serialize(diffContents);
+    return serializeCompressedSingles(std::vector<uint64_t>(diffContents.begin(), diffContents.end()), idBytes_);
 }
 
 bool SingleBucket::isErased(const std::size_t& eraseReturn) const {
@@ -944,4 +2357,52 @@ bool SingleBucket::isErased(const std::size_t& eraseReturn) const {
 }
 void SingleBucket::applyDiff(const std::unordered_set<uint64_t>& diffContents) {
     defaultApplyDiff(*this, diffContents);
+}
+void SingleBucket::mergeDiff(std::unordered_set<uint64_t>& diffContents, const std::unordered_set<uint64_t>& deltaContents) const {
+    for (auto item : deltaContents) {
+        util::toggle(diffContents, item);
+    }
+}
+
+MetricBucket::MetricBucket(std::filesystem::path bucketPath, std::size_t generation, std::size_t startingSize)
+    : Bucket(std::move(bucketPath), generation, startingSize)
+{}
+
+std::size_t MetricBucket::residentBytes() const {
+    if (!isRead) {
+        return 0;
+    }
+
+    return contents_.estimatedBytes();
+}
+
+MetricValue MetricBucket::FAKER() const {
+    return MetricValue{METRIC_FAKER, EXTERNAL_ID_FAKER, 0};
+}
+
+MetricColumns MetricBucket::deserialize(std::string_view str) const {
+    return MetricColumns::deserialize(str);
+}
+MetricDiffContainer MetricBucket::deserializeDiff(std::string_view str) const {
+    return MetricColumns::deserializeDiff(str);
+}
+
+std::string MetricBucket::serialize(const MetricColumns& contents) const {
+    return contents.serialize();
+}
+
+std::string MetricBucket::serializeDiff(const MetricDiffContainer& diffContents) const {
+    return MetricColumns::serializeDiff(diffContents);
+}
+
+bool MetricBucket::isErased(const std::size_t& eraseReturn) const {
+    return defaultIsErased(eraseReturn);
+}
+void MetricBucket::applyDiff(const MetricDiffContainer& diffContents) {
+    defaultApplyDiff(*this, diffContents);
+}
+void MetricBucket::mergeDiff(MetricDiffContainer& diffContents, const MetricDiffContainer& deltaContents) const {
+    for (const auto& item : deltaContents) {
+        util::toggle(diffContents, item);
+    }
 }
\ No newline at end of file
@@ -3,29 +3,63 @@
 #include <cstdint>
 #include <string>
 #include <filesystem>
+#include <optional>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <array>
+#include <functional>
+#include <limits>
 
 #include "../common/util.hpp"
+#include "id-dictionary.hpp"
 #include "id-pair-container.hpp"
+#include "roaring-bitmap.hpp"
+#include "metric-columns.hpp"
 #include "bucket.hpp"
 #include "set-evaluation.hpp"
+#include "search-plan.hpp"
+#include "search-cache.hpp"
+#include "search-cursors.hpp"
+#include "write-ahead-log.hpp"
+#include "background-flusher.hpp"
 
 class PairingBucket : public Bucket<std::pair<uint64_t, uint64_t>, IdPairContainer, IdPairDiffContainer> {
     public:
-        PairingBucket(std::filesystem::path bucketPath, std::size_t startingSize, std::size_t startingComplementCount, const std::unordered_set<uint64_t>* secondUniverse);
+        PairingBucket(std::filesystem::path bucketPath, std::size_t generation, std::size_t startingSize, std::size_t startingComplementCount, const RoaringBitmap* secondUniverse, std::size_t idBytes);
 
         const IdPairSecond* firstContents(uint64_t first);
         std::size_t startingComplementCount() const;
         void insertComplement(uint64_t second);
         void deleteComplement(uint64_t second);
+        // Applies modification to every item, sorted by first, with the bucket read and its version changed once for all of them
+        void modifyItems(const std::vector<std::pair<uint64_t, uint64_t>>& sortedItems, IdPairContainer::Modification modification);
+        // Like snapshot, but the write splits the contents into the firsts that stay, written to this bucket's next generation,
+        // and the firsts where first % modulus == movingIndex, written to a bucket at movingPath that finishSplit hands over
+        std::function<void()> splitSnapshot(std::filesystem::path movingPath, uint64_t modulus, uint64_t movingIndex);
+        // Commits the staying half and returns the moving half once the split's write is done, splitting what changed since between them
+        PairingBucket finishSplit();
+        // Toggles a delta from diffAhead into the recovered diffs of whichever buckets its firsts belong in now, as a split since
+        // it was written may have moved some of them out of this bucket
+        void recoverDiffByFirst(std::string_view deltaStr, const std::function<PairingBucket&(uint64_t)>& bucketOf);
+        std::size_t residentBytes() const override;
     private:
         std::size_t startingComplementCount_;
-        const std::unordered_set<uint64_t>* secondUniverse_;
+        const RoaringBitmap* secondUniverse_;
+        std::size_t idBytes_;
         std::unordered_set<uint64_t> startingFirstComplements;
-        
+        // the bucket a split snapshot is writing the moving firsts to, and which firsts those are
+        std::unique_ptr<PairingBucket> movingBucket_;
+        uint64_t splitModulus_ = 0;
+        uint64_t splitMovingIndex_ = 0;
+        // Lets firstContents answer from the mapped main file before the bucket is read, when the main file needs no diff applied
+        bool lazyChecked_ = false;
+        std::optional<IdPairFileView> fileView_;
+        std::unordered_map<uint64_t, std::optional<IdPairSecond>> lazyFirstContents_;
+
+        bool canReadLazily();
         std::pair<uint64_t, uint64_t> FAKER() const override;
 
         IdPairContainer deserialize(std::string_view str) const override;
@@ -35,73 +69,220 @@ class PairingBucket : public Bucket<std::pair<uint64_t, uint64_t>, IdPairContain
 
         bool isErased(const IdPairInsertReturnType& eraseReturn) const override;
         void applyDiff(const IdPairDiffContainer& diffContents) override;
+        void mergeDiff(IdPairDiffContainer& diffContents, const IdPairDiffContainer& deltaContents) const override;
+        void preContentsRead() override;
         void postContentsMatchFile() override;
+        void releaseContents() override;
 };
 
-class SingleBucket : public Bucket<uint64_t, std::unordered_set<uint64_t>, std::unordered_set<uint64_t>> {
+class SingleBucket : public Bucket<uint64_t, RoaringBitmap, std::unordered_set<uint64_t>> {
     public:
-        SingleBucket(std::filesystem::path bucketPath, std::size_t startingSize);
+        SingleBucket(std::filesystem::path bucketPath, std::size_t generation, std::size_t startingSize, std::size_t idBytes);
+        std::size_t residentBytes() const override;
 
     private:
+        std::size_t idBytes_;
+
         uint64_t FAKER() const override;
 
-        std::unordered_set<uint64_t> deserialize(std::string_view str) const override;
+        RoaringBitmap deserialize(std::string_view str) const override;
         std::unordered_set<uint64_t> deserializeDiff(std::string_view str) const override;
-        std::string serialize(const std::unordered_set<uint64_t>& contents) const override;
+        std::string serialize(const RoaringBitmap& contents) const override;
         std::string serializeDiff(const std::unordered_set<uint64_t>& diffContents) const override;
 
         bool isErased(const std::size_t& eraseReturn) const override;
         void applyDiff(const std::unordered_set<uint64_t>& diffContents) override;
+        void mergeDiff(std::unordered_set<uint64_t>& diffContents, const std::unordered_set<uint64_t>& deltaContents) const override;
+};
+
+class MetricBucket : public Bucket<MetricValue, MetricColumns, MetricDiffContainer> {
+    public:
+        MetricBucket(std::filesystem::path bucketPath, std::size_t generation, std::size_t startingSize);
+        std::size_t residentBytes() const override;
+
+    private:
+        MetricValue FAKER() const override;
+
+        MetricColumns deserialize(std::string_view str) const override;
+        MetricDiffContainer deserializeDiff(std::string_view str) const override;
+        std::string serialize(const MetricColumns& contents) const override;
+        std::string serializeDiff(const MetricDiffContainer& diffContents) const override;
+
+        bool isErased(const std::size_t& eraseReturn) const override;
+        void applyDiff(const MetricDiffContainer& diffContents) override;
+        void mergeDiff(MetricDiffContainer& diffContents, const MetricDiffContainer& deltaContents) const override;
+};
+
+struct TagFileMaintainerOptions {
+    WriteAheadLogOptions writeAheadLog;
+    // pairing buckets are split once they average more than this many bytes on disk
+    std::size_t targetBucketBytes = 4 * 1024 * 1024;
+    // every bucket is read at startup rather than on first touch
+    bool prewarm = false;
+    // threads to read buckets with when prewarming, 0 uses one per hardware thread
+    std::size_t prewarmThreads = 0;
+    // threads to apply large batches of pairing writes with, 0 uses one per hardware thread
+    std::size_t writeThreads = 0;
+    // threads to count large tag groups' taggables within a search with, 0 uses one per hardware thread
+    std::size_t tagGroupCountThreads = 0;
+    // threads to check the conditions of long conditional expression lists in a search with, 0 uses one per hardware thread
+    std::size_t searchThreads = 0;
+    // clean pairing buckets that were used least recently are evicted between commands while buckets take more bytes than this, 0 never evicts
+    std::size_t memoryBudgetBytes = 0;
+    // searches whose results are kept until a bucket they read from changes, 0 keeps none
+    std::size_t searchCacheEntries = 64;
+    // search cursors that go unread for this long are dropped
+    std::chrono::milliseconds searchCursorExpiry = std::chrono::minutes(10);
+
+    // Sets the option named as it is passed to perftags, as in wal-group-commit-ms, returning false for an unknown name
+    bool set(std::string_view name, uint64_t value);
 };
 
 class TagFileMaintainer {
     public:
-        TagFileMaintainer(std::string folderName);
+        TagFileMaintainer(std::string folderName, TagFileMaintainerOptions options = TagFileMaintainerOptions());
         ~TagFileMaintainer();
 
         void insertTaggables(std::string_view input);
         void deleteTaggables(std::string_view input);
-        void readTaggables(void (*writer)(const std::string&));
+        void readTaggables(void (*writer)(std::string));
         void insertTags(std::string_view input);
         void deleteTags(std::string_view input);
-        void readTags(void (*writer)(const std::string&));
+        void readTags(void (*writer)(std::string));
         void insertPairings(std::string_view input);
         void togglePairings(std::string_view input);
         void deletePairings(std::string_view input);
-        void readTagGroupsTaggableCountsWithSearch(std::string_view input, void (*writer)(const std::string&));
-        void readTaggablesTags(std::string_view input, void (*writer)(const std::string&));
-        void readTaggablesSpecifiedTags(std::string_view input, void (*writer)(const std::string&));
-        void search(std::string_view input, void (*writer)(const std::string&));
+        // Gives each taggable its value of a metric, replacing any value it had of that metric
+        void setMetricValues(std::string_view input);
+        void deleteMetricValues(std::string_view input);
+        void readTagGroupsTaggableCountsWithSearch(std::string_view input, void (*writer)(std::string));
+        void readTaggablesTags(std::string_view input, void (*writer)(std::string));
+        void readTaggablesSpecifiedTags(std::string_view input, void (*writer)(std::string));
+        void search(std::string_view input, void (*writer)(std::string));
+        // Writes how many taggables a search finds, without making the set of them
+        void countSearch(std::string_view input, void (*writer)(std::string));
+        // Writes a window of a search's taggables in order of their ids or of a metric's values, without sorting the rest of them
+        void searchSorted(std::string_view input, void (*writer)(std::string));
+        // Writes a uniformly random sample of a search's taggables, picked by rank without the rest of them being read
+        void searchSample(std::string_view input, void (*writer)(std::string));
+        // Writes 1 when a search finds any taggable and 0 otherwise
+        void searchExists(std::string_view input, void (*writer)(std::string));
+        // Runs a search, writing the plan it ran with each operation's estimated and actual size
+        void explainSearch(std::string_view input, void (*writer)(std::string));
+        // Runs a search and keeps its taggables sorted under a cursor, writing the cursor's id and how many taggables it has
+        void openSearchCursor(std::string_view input, void (*writer)(std::string));
+        // Writes a page of a cursor's taggables, or nothing when the cursor expired
+        void readSearchCursorPage(std::string_view input, void (*writer)(std::string));
+        void closeSearchCursor(std::string_view input);
         void flushFiles();
-        void purgeUnusedFiles() const;
+        // Writes snapshots of the dirty buckets on another thread, the flush is committed by a later command once the writes are done
+        // A bucket past the target size is split from its snapshot on the same thread, and the split is committed with the flush
+        // Taking the snapshots copies the contents of every dirty bucket, so the command starting the flush still blocks for that copy
+        void startBackgroundFlush();
+        void readStats(void (*writer)(std::string));
+        // Reads every bucket on a thread pool, writing how many milliseconds each took
+        void prewarm(void (*writer)(std::string));
+        // Called between commands, evicts the least recently used clean pairing buckets until the buckets fit the memory budget
+        void evictColdBuckets();
+        // Called between commands, syncs the write ahead log once its group commit delay has passed, so records are not left unsynced while no writes come
+        void commitWriteAheadGroup();
+        void purgeUnusedFiles();
         void beginTransaction();
         void endTransaction();
-        bool needsMaintenance();
-        void doMaintenance();
         void close();
     protected:
-        void readCacheFile();
-        std::string priorCacheFile = "";
-        void writePriorCacheFile();
-        void writeCacheFile();
+        void readManifest();
+        std::filesystem::path pairingBucketPath(const std::string& prefix, std::size_t index) const;
+        void updateLevelBucketCount();
+        std::size_t getWantedBucketCount();
+        void recoverInterruptedMigration();
+        void migrateToInternalIds();
+        std::size_t idBytes() const;
+        void writeManifest();
+        void recoverDiffFiles();
+        void recoverWriteAhead();
+        bool recoverWriteAheadLog(WriteAheadLog& writeAheadLog, std::size_t committedSize);
+        void recoverBucketDiff(uint32_t bucketId, std::string_view deltaStr);
+        void commitWriteAhead();
+        void finishBackgroundFlush(bool wait);
+        std::vector<std::pair<std::string, uint64_t>> prewarmBuckets();
+        void removeStaleBucketFolders() const;
+        WriteAheadLog& writeAheadLog();
+        WriteAheadLog& flushingWriteAheadLog();
+        uint32_t tagTaggableBucketId(std::size_t index) const;
+        uint32_t taggableTagBucketId(std::size_t index) const;
+        static void appendWriteAheadDelta(std::string& record, uint32_t bucketId, std::string_view deltaStr);
         SetEvaluation search_(std::string_view input, std::size_t& inputOffset);
+        std::size_t countSearch_(std::string_view input, std::size_t& inputOffset);
+        std::pair<std::string, std::vector<uint64_t>> searchCacheKey_(const SearchNode& plan) const;
+        std::vector<uint64_t> sortedIdWindow_(const RoaringBitmap& taggables, bool descending, uint64_t offset, uint64_t limit) const;
+        std::vector<uint64_t> sortedMetricWindow_(const RoaringBitmap& taggables, uint64_t metric, bool descending, uint64_t offset, uint64_t limit);
+        SearchNode parseSearch_(std::string_view input, std::size_t& inputOffset);
         unsigned short getBucketIndex(uint64_t item) const;
         const PairingBucket& getTagBucket(uint64_t tag) const;
         PairingBucket& getTagBucket(uint64_t tag);
         const PairingBucket& getTaggableBucket(uint64_t file) const;
         PairingBucket& getTaggableBucket(uint64_t file);
 
-        void modifyPairings(std::string_view input, void (PairingBucket::*callback)(std::pair<uint64_t, uint64_t>));
+        void modifyPairings(std::string_view input, IdPairContainer::Modification modification);
 
         const static int VERSION;
+        // Buckets are identified in write ahead log records by these ids, followed by the tag to taggable then taggable to tag buckets
+        // A record keeps the pairing bucket layout it was written with, and each of its firsts goes to the bucket it belongs in now on recovery
+        const static uint32_t TAGGABLE_BUCKET_ID = 0;
+        const static uint32_t TAG_BUCKET_ID = 1;
+        // the last id, so that splitting pairing buckets never moves it
+        const static uint32_t METRIC_BUCKET_ID = 0xFFFFFFFF;
+        const static unsigned short INITIAL_BUCKET_COUNT = 16;
+        static constexpr std::size_t MAX_BUCKET_COUNT = std::numeric_limits<unsigned short>::max();
+        // pairing writes smaller than this are applied on the calling thread, as starting threads would cost more than it saves
+        const static std::size_t PARALLEL_BATCH_PAIRINGS = 65536;
+        // tag groups with fewer taggables than this between them are counted on the calling thread
+        const static std::size_t PARALLEL_TAG_GROUP_TAGGABLES = 65536;
 
         bool closed_ = false;
         bool inTransaction = false;
         std::filesystem::path folderPath_;
-        std::filesystem::path cacheFilePath_;
-        unsigned short currentBucketCount = 16;
+        std::filesystem::path manifestPath_;
+        // the text cache file the manifest replaced, which is read when there is no manifest yet
+        std::filesystem::path legacyCacheFilePath_;
+        int manifestVersion_;
+        // the last manifest written, so an unchanged manifest is not rewritten
+        std::string writtenManifest_;
+        IdDictionary taggableIds_;
+        IdDictionary tagIds_;
+        // records are appended to one write ahead log while the other holds the records a background flush is writing out
+        std::array<std::unique_ptr<WriteAheadLog>, 2> writeAheadLogs_;
+        std::size_t writeAheadLogIndex_ = 0;
+        std::size_t committedWriteAheadLogSize_ = 0;
+        std::size_t committedFlushingWriteAheadLogSize_ = 0;
+        // how long the command that started the last background flush spent copying the dirty buckets into snapshots
+        uint64_t lastSnapshotMilliseconds_ = 0;
+        uint64_t lastSnapshotBuckets_ = 0;
+        std::size_t targetBucketBytes_;
+        std::size_t prewarmThreads_;
+        std::size_t writeThreads_;
+        std::size_t tagGroupCountThreads_;
+        std::size_t searchThreads_;
+        std::size_t memoryBudgetBytes_;
+        // counts evictColdBuckets calls, which is when each bucket's last use is recorded
+        uint64_t useClock_ = 0;
+        uint64_t bucketHits_ = 0;
+        uint64_t bucketMisses_ = 0;
+        uint64_t bucketEvictions_ = 0;
+        SearchCache searchCache_;
+        SearchCursors searchCursors_;
+        // buckets are split one at a time through linear hashing, where the buckets before currentBucketCount - levelBucketCount_
+        // have been split into the next level
+        unsigned short currentBucketCount = INITIAL_BUCKET_COUNT;
+        unsigned short levelBucketCount_ = INITIAL_BUCKET_COUNT;
+        // the index of the buckets the running flush is splitting
+        std::optional<unsigned short> splittingIndex_;
         std::vector<PairingBucket> tagTaggableBuckets;
         std::vector<PairingBucket> taggableTagBuckets;
         std::unique_ptr<SingleBucket> taggableBucket_;
         std::unique_ptr<SingleBucket> tagBucket_;
+        std::unique_ptr<MetricBucket> metricBucket_;
+        // declared last so a running flush is joined before the buckets it writes are destroyed
+        BackgroundFlusher flusher_;
 };
\ No newline at end of file
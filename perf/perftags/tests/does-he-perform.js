@@ -1,5 +1,5 @@
-import { appendFileSync, statSync } from "fs";
-import { strTaggablePairingsToStrTagPairings, getPairingsFromStrPairings, getStrPairingsFromPairings, TEST_DEFAULT_PERF_TAGS_ARGS, getTotalDirectoryBytes, TEST_DEFAULT_DATABASE_DIR } from "./helpers.js";
+import { appendFileSync, existsSync, readFileSync, renameSync, rmSync, statSync, writeFileSync } from "fs";
+import { strTaggablePairingsToStrTagPairings, getPairingsFromStrPairings, getStrPairingsFromPairings, TEST_DEFAULT_PERF_TAGS_ARGS, getTotalDirectoryBytes, TEST_DEFAULT_DATABASE_DIR, getBucketFolders } from "./helpers.js";
 import PerfTags from "../../../src/perf-binding/perf-tags.js"
 /** @import {TestFunction} from "./helpers.js" */
 
@@ -421,8 +421,13 @@ const TESTS = {
         await perfTags.deleteTags([4n], false);
         await perfTags.deleteTags([5n], false);
         await perfTags.__flushAndPurgeUnusedFiles();
-        if (statSync(`${TEST_DEFAULT_DATABASE_DIR}/buckets/tag-bucket/bucket.tbd`).size > 8) {
-            throw "Size of tag bucket should not be greater than 8 after deletion and flush";
+        const tagBucketFolders = getBucketFolders("tag-bucket");
+        if (tagBucketFolders.length !== 1) {
+            throw "Purge should leave only the current generation of the tag bucket";
+        }
+        // a 24 byte header, then a control byte and up to 4 delta bytes for the one fake id left
+        if (statSync(`${tagBucketFolders[0]}/bucket.tbd`).size > 29) {
+            throw "Size of tag bucket should not be greater than 29 after deletion and flush";
         }
     },
     "search_functions_correctly": async (createPerfTags) => {
@@ -589,12 +594,10 @@ const TESTS = {
         perfTags.__kill();
         perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
         await perfTags.insertTagPairings(PerfTags.getTagPairingsFromTaggablePairings(new Map([[1n, [11n, 12n, 13n, 14n,]]])), false);
-        // cache file is 1 -> 1-14, but db file is 1 -> 1-10
-        // if we crash here, in between, it could think cache file is 1-14, when in reality the only two valid states to return to are 1 => 1-10 or 1 => 1-15
-        // so we need to write the cache file back to 1 -> 1-10 before writing the .ta file
-        // override to fail between writing complement pairings and singles
+        // cache file commits 1 -> 1-14 through the write ahead log, but db file is 1 -> 1-10
+        // override to fail after the pairings are appended to the write ahead log but before the cache file commits them
         await perfTags.__override("fail_tags_insert_between_pairings_and_singles_writes");
-        // add another tag but with failure mode on, should cause mismatch between cache file being 1-14, but tbd file only containing 1-10
+        // add another tag but with failure mode on, leaves an uncommitted record at the end of the write ahead log
         perfTags.__expectError();
         const result = await perfTags.insertTags([15n], false);
         // if passed, then the override didn't work
@@ -605,22 +608,15 @@ const TESTS = {
         // reopen perfTags
         perfTags.__kill();
         perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
-        // read tags should yield 1 => 1-10 cache variant
+        // read tags should yield the last committed 1 => 1-14, without any of the uncommitted record
         const {taggablePairings} = await perfTags.readTaggablesTags([1n]);
-        if (taggablePairings.size != 1
-         || taggablePairings.get(1n).length !== 10
-         || taggablePairings.get(1n).indexOf(1n) === -1
-         || taggablePairings.get(1n).indexOf(2n) === -1
-         || taggablePairings.get(1n).indexOf(3n) === -1
-         || taggablePairings.get(1n).indexOf(4n) === -1
-         || taggablePairings.get(1n).indexOf(5n) === -1
-         || taggablePairings.get(1n).indexOf(6n) === -1
-         || taggablePairings.get(1n).indexOf(7n) === -1
-         || taggablePairings.get(1n).indexOf(8n) === -1
-         || taggablePairings.get(1n).indexOf(9n) === -1
-         || taggablePairings.get(1n).indexOf(10n) === -1
-        ) {
-            throw "Could not find one of the assigned taggable's tags"
+        if (taggablePairings.size != 1 || taggablePairings.get(1n).length !== 14) {
+            throw "Taggable did not have exactly its committed tags";
+        }
+        for (let tag = 1n; tag <= 14n; ++tag) {
+            if (taggablePairings.get(1n).indexOf(tag) === -1) {
+                throw "Could not find one of the assigned taggable's tags";
+            }
         }
     },
     "simple_tag_occurrences_compared_to_n": async (createPerfTags) => {
@@ -1022,5 +1018,904 @@ const TESTS = {
             throw "Wrong count of tag with tag groups taggable counts";
         }
     },
+    "read_flushed_pairings_after_exit_then_modify": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await perfTags.insertTagPairings(new Map([
+            [1n,[1n,2n,3n]],
+            [2n,[3n,4n]],
+        ]), false);
+        await perfTags.close();
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        // reads straight from the flushed bucket files before any bucket is fully read
+        let {taggables} = await perfTags.search(PerfTags.searchTag(2n));
+        if (taggables.length !== 2
+         || taggables.indexOf(3n) === -1
+         || taggables.indexOf(4n) === -1
+        ) {
+            throw "Search of flushed tag did not return taggables 3 and 4";
+        }
+
+        await perfTags.deleteTagPairings(new Map([[2n,[3n]]]), false);
+        ({taggables} = await perfTags.search(PerfTags.searchTag(2n)));
+        if (taggables.length !== 1 || taggables[0] !== 4n) {
+            throw "Search after deleting pairing did not return only taggable 4";
+        }
+        const {taggablePairings} = await perfTags.readTaggablesTags([3n]);
+        if (taggablePairings.get(3n).length !== 1 || taggablePairings.get(3n)[0] !== 1n) {
+            throw "Taggable 3 did not have only tag 1 after deleting pairing";
+        }
+    },
+    "write_ahead_log_is_emptied_by_flush": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await perfTags.insertTagPairings(new Map([[1n,[1n,2n]]]), false);
+        await perfTags.toggleTagPairings(new Map([[1n,[2n,3n]]]), false);
+        if (statSync(`${TEST_DEFAULT_DATABASE_DIR}/write-ahead.twa`).size === 0) {
+            throw "Write ahead log did not grow from writes";
+        }
+        await perfTags.__flushAndPurgeUnusedFiles();
+        // the flush finishes on another thread, and is committed at the first command after it does
+        let stats = (await perfTags.stats()).stats;
+        while (stats.flushesCompleted < 1 || stats.flushInProgress !== 0) {
+            await new Promise(resolve => setTimeout(resolve, 10));
+            stats = (await perfTags.stats()).stats;
+        }
+        if (stats.flushesStarted !== 1 || stats.flushBucketsWritten !== stats.flushBucketsToWrite || stats.lastSnapshotBuckets !== stats.flushBucketsToWrite || stats.flushingWriteAheadLogBytes !== 0) {
+            throw `Background flush stats were not as expected: ${JSON.stringify(stats)}`;
+        }
+        if (statSync(`${TEST_DEFAULT_DATABASE_DIR}/write-ahead.twa`).size !== 0) {
+            throw "Write ahead log was not emptied by flush";
+        }
+        perfTags.__kill();
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const {taggablePairings} = await perfTags.readTaggablesTags([1n, 3n]);
+        if (taggablePairings.get(1n).length !== 1 || taggablePairings.get(1n)[0] !== 1n
+         || taggablePairings.get(3n).length !== 1 || taggablePairings.get(3n)[0] !== 1n) {
+            throw "Flushed pairings were not read back after kill";
+        }
+    },
+    "write_ahead_log_torn_by_an_os_crash_recovers_its_whole_records": async (createPerfTags) => {
+        const writeAheadLogFile = `${TEST_DEFAULT_DATABASE_DIR}/write-ahead.twa`;
+        const tagTaggableCount = async (perfTags, tag) => (await perfTags.search(PerfTags.searchTag(tag))).taggables.length;
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await perfTags.insertTagPairings(new Map([[1n, [1n, 2n]]]), false);
+        await perfTags.insertTagPairings(new Map([[2n, [3n]]]), false);
+        perfTags.__kill();
+        await new Promise(resolve => setTimeout(resolve, 100));
+        // the manifest commits both records, but the OS only got part of the last one to disk
+        const logSize = statSync(writeAheadLogFile).size;
+        writeFileSync(writeAheadLogFile, readFileSync(writeAheadLogFile).subarray(0, logSize - 3));
+
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        if (await tagTaggableCount(perfTags, 1n) !== 2 || await tagTaggableCount(perfTags, 2n) !== 0) {
+            throw "A short write ahead log did not recover up to its last whole record";
+        }
+        await perfTags.insertTagPairings(new Map([[3n, [4n]]]), false);
+        perfTags.__kill();
+        await new Promise(resolve => setTimeout(resolve, 100));
+        const log = readFileSync(writeAheadLogFile);
+        log[log.length - 1] ^= 0xFF;
+        writeFileSync(writeAheadLogFile, log);
+
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        if (await tagTaggableCount(perfTags, 1n) !== 2 || await tagTaggableCount(perfTags, 3n) !== 0) {
+            throw "A write ahead log record failing its checksum was not treated as the end of the log";
+        }
+        await perfTags.insertTagPairings(new Map([[3n, [4n]]]), false);
+        if (await tagTaggableCount(perfTags, 3n) !== 1) {
+            throw "Writes after recovering a torn write ahead log were not read";
+        }
+    },
+    "buckets_split_past_target_size_and_survive_reopen": async (createPerfTags) => {
+        const splittingArgs = [...TEST_DEFAULT_PERF_TAGS_ARGS, {"target-bucket-bytes": 64}];
+        let perfTags = createPerfTags(...splittingArgs);
+        /** @type {Map<bigint, bigint[]>} */
+        const taggablePairings = new Map();
+        for (let taggable = 1n; taggable <= 200n; ++taggable) {
+            taggablePairings.set(taggable, [taggable % 7n + 1n, taggable % 13n + 10n, taggable + 100n]);
+        }
+        await perfTags.insertTagPairings(PerfTags.getTagPairingsFromTaggablePairings(taggablePairings), false);
+        // each flush splits a single bucket, sized by what the flush before it wrote
+        for (let i = 0; i < 5; ++i) {
+            await perfTags.__flushAndPurgeUnusedFiles();
+        }
+        if (getBucketFolders("tag-to-taggable-19").length !== 1 || getBucketFolders("tag-to-taggable-0").length !== 1 || existsSync(`${TEST_DEFAULT_DATABASE_DIR}/buckets/tag-to-taggable-0`)) {
+            throw "Buckets were not split past the target bucket size";
+        }
+        // a write after a split goes through the write ahead log on the new layout
+        await perfTags.deleteTagPairings(new Map([[3n, [2n]]]), false);
+        taggablePairings.set(2n, [10n + 2n % 13n, 102n]);
+
+        perfTags.__kill();
+        perfTags = createPerfTags(...splittingArgs);
+        const {taggablePairings: readTaggablePairings} = await perfTags.readTaggablesTags([...taggablePairings.keys()]);
+        for (const [taggable, tags] of taggablePairings) {
+            const readTags = readTaggablePairings.get(taggable);
+            if (readTags === undefined || readTags.length !== tags.length || tags.some(tag => readTags.indexOf(tag) === -1)) {
+                throw `Taggable ${taggable} did not keep its tags through splits`;
+            }
+        }
+        const {taggables} = await perfTags.search(PerfTags.searchTag(1n));
+        if (taggables.length !== 28 || taggables.some(taggable => taggable % 7n !== 0n)) {
+            throw "Search of tag after splits did not return its taggables";
+        }
+    },
+    "writes_while_a_bucket_splits_in_the_background_survive_kill": async (createPerfTags) => {
+        const splittingArgs = [...TEST_DEFAULT_PERF_TAGS_ARGS, {"target-bucket-bytes": 64}];
+        let perfTags = createPerfTags(...splittingArgs);
+        /** @type {Map<bigint, bigint[]>} */
+        const taggablePairings = new Map();
+        for (let taggable = 1n; taggable <= 200n; ++taggable) {
+            taggablePairings.set(taggable, [taggable % 7n + 1n, taggable + 100n]);
+        }
+        await perfTags.insertTagPairings(PerfTags.getTagPairingsFromTaggablePairings(taggablePairings), false);
+        await perfTags.__flushAndPurgeUnusedFiles();
+        const expectTags = async (message) => {
+            const {taggablePairings: readPairings} = await perfTags.readTaggablesTags([...taggablePairings.keys()]);
+            for (const [taggable, tags] of taggablePairings) {
+                const readTags = readPairings.get(taggable) ?? [];
+                if (readTags.length !== tags.length || tags.some(tag => readTags.indexOf(tag) === -1)) {
+                    throw `Taggable ${taggable} had tags ${readTags} instead of ${tags} ${message}`;
+                }
+            }
+        };
+
+        // the flush splits a bucket on its own thread, and these are written against the layout from before the split while it does
+        await perfTags.flushData();
+        const insertedPairings = new Map([[50n, [...taggablePairings.keys()]]]);
+        await perfTags.insertTagPairings(insertedPairings, false);
+        for (const tags of taggablePairings.values()) {
+            tags.push(50n);
+        }
+        let stats = (await perfTags.stats()).stats;
+        while (stats.flushInProgress !== 0) {
+            await new Promise(resolve => setTimeout(resolve, 10));
+            stats = (await perfTags.stats()).stats;
+        }
+        if (stats.bucketCount !== 17 || stats.splitInProgress !== 0) {
+            throw `The background split was not committed with its flush: ${JSON.stringify(stats)}`;
+        }
+        // and these against the layout after it, in the same write ahead log
+        const deletedTaggables = [...taggablePairings.keys()].filter(taggable => taggable % 3n === 0n);
+        await perfTags.deleteTagPairings(new Map([[50n, deletedTaggables]]), false);
+        for (const taggable of deletedTaggables) {
+            taggablePairings.get(taggable).pop();
+        }
+        await expectTags("before kill");
+
+        perfTags.__kill();
+        perfTags = createPerfTags(...splittingArgs);
+        await expectTags("after kill following a background split");
+        if ((await perfTags.stats()).stats.bucketCount !== 17) {
+            throw "The background split was not there after kill";
+        }
+    },
+    "writes_during_background_flush_survive_kill": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        /** @type {Map<bigint, bigint[]>} */
+        const taggablePairings = new Map();
+        for (let taggable = 1n; taggable <= 500n; ++taggable) {
+            taggablePairings.set(taggable, [taggable % 5n + 1n, taggable + 10n]);
+        }
+        await perfTags.insertTagPairings(PerfTags.getTagPairingsFromTaggablePairings(taggablePairings), false);
+        await perfTags.flushData();
+        // these go to the other write ahead log while the flush may still be writing
+        await perfTags.deleteTagPairings(new Map([[1n, [5n, 10n]]]), false);
+        await perfTags.insertTagPairings(new Map([[3n, [1n]]]), false);
+        taggablePairings.set(5n, [15n]);
+        taggablePairings.set(10n, [20n]);
+        taggablePairings.set(1n, [2n, 11n, 3n]);
+        perfTags.__kill();
+
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const {taggablePairings: readPairings} = await perfTags.readTaggablesTags([...taggablePairings.keys()]);
+        for (const [taggable, tags] of taggablePairings) {
+            const readTags = readPairings.get(taggable) ?? [];
+            if (readTags.length !== tags.length || tags.some(tag => readTags.indexOf(tag) === -1)) {
+                throw `Taggable ${taggable} had tags ${readTags} instead of ${tags} after kill during background flush`;
+            }
+        }
+    },
+    "prewarm_reads_every_bucket_with_timings": async (createPerfTags) => {
+        const prewarmArgs = [...TEST_DEFAULT_PERF_TAGS_ARGS, {"prewarm": 1, "prewarm-threads": 4}];
+        let perfTags = createPerfTags(...prewarmArgs);
+        /** @type {Map<bigint, bigint[]>} */
+        const taggablePairings = new Map();
+        for (let taggable = 1n; taggable <= 100n; ++taggable) {
+            taggablePairings.set(taggable, [taggable % 17n + 1n, taggable + 50n]);
+        }
+        await perfTags.insertTagPairings(PerfTags.getTagPairingsFromTaggablePairings(taggablePairings), false);
+        await perfTags.__flushAndPurgeUnusedFiles();
+        // buckets are read at startup through the prewarm option
+        perfTags.__kill();
+        perfTags = createPerfTags(...prewarmArgs);
+        const {bucketMilliseconds} = await perfTags.prewarm();
+        if (bucketMilliseconds["total"] === undefined || bucketMilliseconds["tag-bucket"] === undefined
+         || bucketMilliseconds["tag-to-taggable-0"] === undefined || bucketMilliseconds["taggable-to-tag-15"] === undefined) {
+            throw `Prewarm did not report every bucket: ${JSON.stringify(bucketMilliseconds)}`;
+        }
+        const {taggablePairings: readPairings} = await perfTags.readTaggablesTags([...taggablePairings.keys()]);
+        for (const [taggable, tags] of taggablePairings) {
+            const readTags = readPairings.get(taggable) ?? [];
+            if (readTags.length !== tags.length || tags.some(tag => readTags.indexOf(tag) === -1)) {
+                throw `Taggable ${taggable} had tags ${readTags} instead of ${tags} after prewarm`;
+            }
+        }
+    },
+    "legacy_cache_file_is_upgraded_to_manifest": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await perfTags.insertTagPairings(new Map([[1n, [1n, 2n]], [2n, [2n, 3n]]]), false);
+        await perfTags.close();
+
+        // rewrites the manifest as the text cache file of version 2, which is what databases had before the manifest,
+        // with each bucket's main file moved back to the folder buckets were written to before generations
+        const manifest = readFileSync(`${TEST_DEFAULT_DATABASE_DIR}/manifest.tdm`);
+        const bucketCount = Number(manifest.readBigUInt64LE(32));
+        const entry = (i, bucketName) => {
+            const offset = 40 + (29 * i);
+            const generation = manifest.readBigUInt64LE(offset + 16);
+            if (generation !== 0n) {
+                const bucketPath = `${TEST_DEFAULT_DATABASE_DIR}/buckets/${bucketName}`;
+                rmSync(bucketPath, {recursive: true, force: true});
+                renameSync(`${bucketPath}.${generation}`, bucketPath);
+            }
+            return {size: manifest.readBigUInt64LE(offset), complementCount: manifest.readBigUInt64LE(offset + 8)};
+        };
+        let cacheFile = `2 taggableBucketSize ${entry(0, "taggable-bucket").size} tagBucketSize ${entry(1, "tag-bucket").size} currentBucketCount ${bucketCount}`;
+        for (let i = 0; i < bucketCount; ++i) {
+            const tagTaggable = entry(2 + (2 * i), `tag-to-taggable-${i}`);
+            const taggableTag = entry(3 + (2 * i), `taggable-to-tag-${i}`);
+            cacheFile += ` tagTaggableBucket${i}Size ${tagTaggable.size} tagTaggableBucket${i}StartingComplementCount ${tagTaggable.complementCount}`;
+            cacheFile += ` taggableTagBucket${i}Size ${taggableTag.size} taggableTagBucket${i}StartingComplementCount ${taggableTag.complementCount}`;
+        }
+        writeFileSync(`${TEST_DEFAULT_DATABASE_DIR}/cache.tdb`, cacheFile);
+        rmSync(`${TEST_DEFAULT_DATABASE_DIR}/manifest.tdm`);
+
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const {taggablePairings} = await perfTags.readTaggablesTags([1n, 2n, 3n]);
+        if (taggablePairings.get(1n).length !== 1 || taggablePairings.get(2n).length !== 2 || taggablePairings.get(3n).length !== 1) {
+            throw "Pairings were not read back through the legacy cache file";
+        }
+        if (!existsSync(`${TEST_DEFAULT_DATABASE_DIR}/manifest.tdm`) || existsSync(`${TEST_DEFAULT_DATABASE_DIR}/cache.tdb`)) {
+            throw "Legacy cache file was not replaced by the manifest";
+        }
+    },
+    "pairing_buckets_are_delta_compressed": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const taggables = [];
+        for (let taggable = 1n; taggable <= 1000n; ++taggable) {
+            taggables.push(taggable);
+        }
+        await perfTags.insertTagPairings(new Map([[1n, taggables]]), false);
+        await perfTags.__flushAndPurgeUnusedFiles();
+        let tagTaggableBytes = 0;
+        for (let i = 0; i < 16; ++i) {
+            for (const bucketFolder of getBucketFolders(`tag-to-taggable-${i}`)) {
+                if (existsSync(`${bucketFolder}/bucket.tbd`)) {
+                    tagTaggableBytes += statSync(`${bucketFolder}/bucket.tbd`).size;
+                }
+            }
+        }
+        // 1000 consecutive taggables fixed width would take 4000 bytes, as deltas they take a byte each and a control byte for every 4
+        if (tagTaggableBytes > 2000) {
+            throw `Tag to taggable buckets took ${tagTaggableBytes} bytes for 1000 consecutive taggables`;
+        }
+        perfTags.__kill();
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const {taggablePairings} = await perfTags.readTaggablesTags(taggables);
+        if (taggables.some(taggable => taggablePairings.get(taggable)?.[0] !== 1n)) {
+            throw "Compressed pairings were not read back";
+        }
+    },
+    "large_pairing_batches_match_single_pairing_semantics": async (createPerfTags) => {
+        let perfTags = createPerfTags(...[...TEST_DEFAULT_PERF_TAGS_ARGS, {"write-threads": 4}]);
+        // past the size where pairing writes are applied across threads
+        /** @type {Map<bigint, bigint[]>} */
+        const tagPairings = new Map();
+        for (let tag = 1n; tag <= 300n; ++tag) {
+            const taggables = [];
+            for (let taggable = 1n; taggable <= 250n; ++taggable) {
+                taggables.push(taggable);
+            }
+            tagPairings.set(tag, taggables);
+        }
+        await perfTags.insertTagPairings(tagPairings, false);
+        // toggling a pair twice in one batch leaves it as it was, and toggling once flips it
+        /** @type {Map<bigint, bigint[]>} */
+        const togglePairings = new Map();
+        for (let tag = 1n; tag <= 300n; ++tag) {
+            const taggables = [];
+            for (let taggable = 1n; taggable <= 250n; ++taggable) {
+                taggables.push(taggable);
+                if (taggable % 2n === 0n) {
+                    taggables.push(taggable);
+                }
+            }
+            togglePairings.set(tag, taggables);
+        }
+        togglePairings.get(7n).push(251n);
+        await perfTags.insertTaggables([251n], false);
+        await perfTags.toggleTagPairings(togglePairings, false);
+        const {taggablePairings} = await perfTags.readTaggablesTags([1n, 2n, 251n]);
+        if (taggablePairings.get(1n)?.length > 0) {
+            throw "Pairs toggled once in a batch were not removed";
+        }
+        if (taggablePairings.get(2n).length !== 300) {
+            throw "Pairs toggled twice in a batch did not stay";
+        }
+        if (taggablePairings.get(251n).length !== 1 || taggablePairings.get(251n)[0] !== 7n) {
+            throw "A new pair toggled in a batch was not inserted";
+        }
+    },
+    "cold_buckets_are_evicted_past_the_memory_budget": async (createPerfTags) => {
+        let perfTags = createPerfTags(...[...TEST_DEFAULT_PERF_TAGS_ARGS, {"memory-budget-bytes": 1}]);
+        /** @type {Map<bigint, bigint[]>} */
+        const tagPairings = new Map();
+        const taggables = [];
+        for (let taggable = 1n; taggable <= 64n; ++taggable) {
+            taggables.push(taggable);
+        }
+        for (let tag = 1n; tag <= 64n; ++tag) {
+            tagPairings.set(tag, taggables);
+        }
+        await perfTags.insertTagPairings(tagPairings, false);
+        // only buckets that match their main file can be evicted
+        await perfTags.__flushAndPurgeUnusedFiles();
+        await perfTags.readTaggablesTags(taggables);
+        const {stats} = await perfTags.stats();
+        if (stats.bucketEvictions === 0) {
+            throw "No buckets were evicted with a one byte memory budget";
+        }
+        if (stats.memoryBudgetBytes !== 1) {
+            throw `Memory budget was reported as ${stats.memoryBudgetBytes}`;
+        }
+        // the read above used taggable to tag buckets that were evicted after the flush
+        if (stats.bucketMisses === 0) {
+            throw "Reading evicted buckets was not counted as a miss";
+        }
+        const {taggablePairings} = await perfTags.readTaggablesTags(taggables);
+        if (taggables.some(taggable => taggablePairings.get(taggable)?.length !== 64)) {
+            throw "Evicted buckets were not read back";
+        }
+        const {tagGroupsTaggableCounts} = await perfTags.readTagGroupsTaggableCounts([[1n, 2n, 3n]]);
+        if (tagGroupsTaggableCounts[0] !== 64) {
+            throw `Evicted tag buckets were read back with ${tagGroupsTaggableCounts[0]} taggables`;
+        }
+    },
+    "lazily_read_buckets_are_counted_and_evicted_past_the_memory_budget": async (createPerfTags) => {
+        let perfTags = createPerfTags(...[...TEST_DEFAULT_PERF_TAGS_ARGS, {"memory-budget-bytes": 1}]);
+        /** @type {Map<bigint, bigint[]>} */
+        const tagPairings = new Map();
+        const taggables = [];
+        for (let taggable = 1n; taggable <= 64n; ++taggable) {
+            taggables.push(taggable);
+        }
+        for (let tag = 1n; tag <= 64n; ++tag) {
+            tagPairings.set(tag, taggables);
+        }
+        await perfTags.insertTagPairings(tagPairings, false);
+        await perfTags.__flushAndPurgeUnusedFiles();
+        // reopened buckets answer single taggables from their mapped main file without being read
+        await perfTags.reopen();
+        const {stats: reopenedStats} = await perfTags.stats();
+        await perfTags.readTaggablesTags([1n]);
+        // buckets are evicted after a command replies, so it is the stats after the next command that count them
+        await perfTags.stats();
+        const {stats} = await perfTags.stats();
+        if (stats.bucketEvictions === reopenedStats.bucketEvictions) {
+            throw "A lazily read bucket was not evicted with a one byte memory budget";
+        }
+        const {taggablePairings} = await perfTags.readTaggablesTags(taggables);
+        if (taggables.some(taggable => taggablePairings.get(taggable)?.length !== 64)) {
+            throw "Evicted lazily read buckets were not read back";
+        }
+    },
+    "reads_with_request_ids_run_alongside_each_other_and_writes": async (createPerfTags) => {
+        let perfTags = createPerfTags(...[...TEST_DEFAULT_PERF_TAGS_ARGS, {"read-threads": 4}]);
+        /** @type {Map<bigint, bigint[]>} */
+        const tagPairings = new Map();
+        for (let tag = 1n; tag <= 32n; ++tag) {
+            const taggables = [];
+            for (let taggable = 1n; taggable <= 100n; ++taggable) {
+                if (taggable % tag === 0n) {
+                    taggables.push(taggable);
+                }
+            }
+            tagPairings.set(tag, taggables);
+        }
+        await perfTags.insertTagPairings(tagPairings, false);
+
+        const reads = [];
+        for (let tag = 1n; tag <= 32n; ++tag) {
+            reads.push(perfTags.search(PerfTags.searchTag(tag)).then(({ok, taggables}) => {
+                if (!ok || taggables.length !== tagPairings.get(tag).length) {
+                    throw `Search of tag ${tag} run alongside other reads returned ${taggables.length} taggables`;
+                }
+            }));
+            reads.push(perfTags.readTaggablesTags([tag]).then(({ok, taggablePairings}) => {
+                const expectedTagCount = [...tagPairings.values()].filter(taggables => taggables.includes(tag)).length;
+                if (!ok || taggablePairings.get(tag).length !== expectedTagCount) {
+                    throw `Read of taggable ${tag} run alongside other reads had the wrong tags`;
+                }
+            }));
+        }
+        // a write sent while the reads are outstanding is seen by any read sent after it finishes
+        const write = perfTags.insertTagPairings(new Map([[33n, [1n, 2n, 3n]]]), false);
+        await Promise.all([...reads, write]);
+        const {taggables} = await perfTags.search(PerfTags.searchTag(33n));
+        if (taggables.length !== 3) {
+            throw "A read sent after a write did not see it";
+        }
+    },
+    "a_failing_read_is_answered_without_taking_perftags_down": async (createPerfTags) => {
+        for (const args of [[{"read-threads": 2}], [{"read-threads": 2, "framed-ipc": 1}]]) {
+            const perfTags = createPerfTags(...[...TEST_DEFAULT_PERF_TAGS_ARGS, ...args]);
+            await perfTags.insertTagPairings(new Map([[1n, [1n, 2n, 3n]]]), false);
+
+            // 'Z' is not an order search_sorted knows
+            const badInput = Buffer.alloc(26);
+            badInput.write("Z", 0, "binary");
+            const {ok} = await perfTags.__request("search_sorted", Buffer.concat([badInput, Buffer.from(PerfTags.searchTag(1n), "binary")]), 5000);
+            if (ok) {
+                throw "A read that threw was answered as if it had not";
+            }
+            await perfTags.flushData();
+            const {ok: searchOk, taggables} = await perfTags.search(PerfTags.searchTag(1n));
+            if (!searchOk || taggables.length !== 3) {
+                throw "Commands after a failed read did not run";
+            }
+            await perfTags.close();
+        }
+    },
+    "a_timed_out_read_does_not_answer_the_read_after_it": async (createPerfTags) => {
+        const perfTags = createPerfTags(...[...TEST_DEFAULT_PERF_TAGS_ARGS, {"read-threads": 2}]);
+        /** @type {Map<bigint, bigint[]>} */
+        const tagPairings = new Map();
+        const taggables = [];
+        for (let taggable = 1n; taggable <= 4096n; ++taggable) {
+            taggables.push(taggable);
+        }
+        for (let tag = 1n; tag <= 256n; ++tag) {
+            tagPairings.set(tag, taggables);
+        }
+        tagPairings.set(1000n, [5000n]);
+        await perfTags.insertTagPairings(tagPairings, false);
+
+        // reading every pairing takes longer than no time at all, so its reply comes in while the searches after it wait on theirs
+        const taggablesInput = Buffer.alloc(8 * taggables.length);
+        taggables.forEach((taggable, i) => taggablesInput.writeBigUInt64LE(taggable, 8 * i));
+        const {ok} = await perfTags.__request("read_taggables_tags", taggablesInput, 0);
+        if (ok) {
+            throw "A read that timed out was answered as if it had not";
+        }
+        for (let i = 0; i < 8; ++i) {
+            const {ok: searchOk, taggables: searchTaggables} = await perfTags.search(PerfTags.searchTag(1000n));
+            if (!searchOk || searchTaggables.length !== 1 || searchTaggables[0] !== 5000n) {
+                throw "A search was not answered with its own taggables after a read timed out";
+            }
+        }
+        await perfTags.close();
+    },
+    "framed_ipc_runs_commands_without_input_or_output_files": async (createPerfTags) => {
+        const framedArgs = [...TEST_DEFAULT_PERF_TAGS_ARGS, {"framed-ipc": 1}];
+        let perfTags = createPerfTags(...framedArgs);
+        await perfTags.insertTagPairings(new Map([[1n, [1n, 2n, 3n]], [2n, [2n, 3n]]]), false);
+        await perfTags.toggleTagPairings(new Map([[2n, [4n]]]), false);
+        const [{taggables}, {taggablePairings}, {tagGroupsTaggableCounts}] = await Promise.all([
+            perfTags.search(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)])),
+            perfTags.readTaggablesTags([2n, 4n]),
+            perfTags.readTagGroupsTaggableCounts([[1n], [2n]])
+        ]);
+        if (taggables.length !== 2 || taggables[0] !== 2n || taggables[1] !== 3n) {
+            throw "Framed search returned the wrong taggables";
+        }
+        if (taggablePairings.get(2n)?.length !== 2 || taggablePairings.get(4n)?.[0] !== 2n) {
+            throw "Framed read of taggables tags returned the wrong tags";
+        }
+        if (tagGroupsTaggableCounts[0] !== 3 || tagGroupsTaggableCounts[1] !== 3) {
+            throw "Framed tag group counts were wrong";
+        }
+        const {ok, stats} = await perfTags.stats();
+        if (!ok || stats.bucketCount === undefined) {
+            throw "Framed stats were not returned";
+        }
+        await perfTags.close();
+        for (const fileName of [TEST_DEFAULT_PERF_TAGS_ARGS[1], TEST_DEFAULT_PERF_TAGS_ARGS[3], TEST_DEFAULT_PERF_TAGS_ARGS[4]]) {
+            if (existsSync(fileName) || existsSync(`${fileName}.1`)) {
+                throw `Framed commands went through ${fileName}`;
+            }
+        }
+
+        perfTags = createPerfTags(...framedArgs);
+        const {taggables: reopenedTaggables} = await perfTags.search(PerfTags.searchTag(2n));
+        if (reopenedTaggables.length !== 3) {
+            throw "Framed writes were not there after reopening";
+        }
+    },
+    "in_process_addon_runs_commands_without_a_perftags_process": async (createPerfTags) => {
+        // the addon is an optional target, built with make addon
+        if (!existsSync(PerfTags.ADDON_NAME)) {
+            console.log(`Skipping in process test, ${PerfTags.ADDON_NAME} is not built`);
+            return;
+        }
+        const inProcessArgs = [`./${PerfTags.ADDON_NAME}`, ...TEST_DEFAULT_PERF_TAGS_ARGS.slice(1), {"in-process": 1, "target-bucket-bytes": 4194304}];
+        let perfTags = createPerfTags(...inProcessArgs);
+        await perfTags.insertTagPairings(new Map([[1n, [1n, 2n, 3n]], [2n, [2n, 3n]]]), false);
+        const [{taggables}, {taggablePairings}, {tagGroupsTaggableCounts}] = await Promise.all([
+            perfTags.searchIds(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)])),
+            perfTags.readTaggablesTags([2n]),
+            perfTags.readTagGroupsTaggableCounts([[1n], [2n]])
+        ]);
+        if (!(taggables instanceof BigUint64Array) || taggables.length !== 2 || taggables[0] !== 2n || taggables[1] !== 3n) {
+            throw "In process search returned the wrong taggables";
+        }
+        if (taggablePairings.get(2n)?.length !== 2) {
+            throw "In process read of taggables tags returned the wrong tags";
+        }
+        if (tagGroupsTaggableCounts[0] !== 3 || tagGroupsTaggableCounts[1] !== 2) {
+            throw "In process tag group counts were wrong";
+        }
+        await perfTags.close();
+
+        perfTags = createPerfTags(...inProcessArgs);
+        const {taggables: reopenedTaggables} = await perfTags.search(PerfTags.searchTag(1n));
+        if (reopenedTaggables.length !== 3) {
+            throw "In process writes were not there after reopening";
+        }
+    },
+    "explain_shows_the_smallest_operands_evaluated_first": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const taggables = [];
+        for (let i = 1n; i <= 100n; ++i) {
+            taggables.push(i);
+        }
+        await perfTags.insertTagPairings(new Map([[1n, taggables], [2n, [1n, 2n, 3n]], [3n, taggables.slice(0, 50)]]), false);
+        const search = PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(3n), PerfTags.searchTag(2n)]);
+        const {taggables: searchTaggables} = await perfTags.search(search);
+        if (searchTaggables.length !== 3) {
+            throw "Reordered intersection returned the wrong taggables";
+        }
+        const {ok, plan} = await perfTags.explain(search);
+        const planLines = plan.split("\n");
+        if (!ok || planLines[0] !== "intersect estimated 3 actual 3" || planLines[1] !== "  tag 2 estimated 3 actual 3" || planLines[2] !== "  tag 3 estimated 50 actual 50" || planLines[3] !== "  tag 1 estimated 100 actual 100") {
+            throw `Intersection was not planned smallest first: ${plan}`;
+        }
+
+        const {plan: emptyPlan} = await perfTags.explain(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(4n)]));
+        if (emptyPlan.split("\n")[2] !== "  tag 1 estimated 100 actual skipped") {
+            throw `Intersection did not stop at an empty operand: ${emptyPlan}`;
+        }
+
+        const {taggables: mixedTaggables} = await perfTags.search(`${PerfTags.searchTag(2n)}|${PerfTags.searchTag(3n)}&${PerfTags.searchComplement(PerfTags.searchTag(2n))}-${PerfTags.searchTag(4n)}`);
+        if (mixedTaggables.length !== 47 || mixedTaggables.indexOf(2n) !== -1) {
+            throw "Mixed operations were not evaluated left to right";
+        }
+    },
+    "search_cache_answers_repeated_searches_until_their_tags_change": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await perfTags.insertTagPairings(new Map([[1n, [1n, 2n, 3n]], [2n, [2n, 3n, 4n]]]), false);
+        await perfTags.search(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)]));
+        const {taggables} = await perfTags.search(PerfTags.searchIntersect([PerfTags.searchTag(2n), PerfTags.searchTag(1n)]));
+        let {stats} = await perfTags.stats();
+        if (stats.searchCacheHits !== 1 || stats.searchCacheMisses !== 1 || taggables.length !== 2) {
+            throw "Search with its operands reordered was not answered from the cache";
+        }
+
+        await perfTags.insertTagPairings(new Map([[2n, [1n]]]), false);
+        const {taggables: changedTaggables} = await perfTags.search(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)]));
+        if (changedTaggables.length !== 3) {
+            throw "Search was answered from the cache after its tags changed";
+        }
+
+        const {taggables: missingTagTaggables} = await perfTags.search(PerfTags.searchTag(3n));
+        await perfTags.insertTagPairings(new Map([[3n, [4n]]]), false);
+        const {taggables: insertedTagTaggables} = await perfTags.search(PerfTags.searchTag(3n));
+        if (missingTagTaggables.length !== 0 || insertedTagTaggables.length !== 1) {
+            throw "Search was answered from the cache after its tag was inserted";
+        }
+        ({stats} = await perfTags.stats());
+        if (stats.searchCacheHits !== 1) {
+            throw "Searches after their tags changed should not have been answered from the cache";
+        }
+    },
+    "search_cursors_return_sorted_pages_until_closed_or_expired": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS.slice(0, 7), {"search-cursor-expiry-ms": 500});
+        await perfTags.insertTagPairings(new Map([[1n, [9n, 3n, 7n, 1n, 5n]]]), false);
+        const {ok, cursorId, taggableCount} = await perfTags.openSearchCursor(PerfTags.searchTag(1n));
+        if (!ok || taggableCount !== 5) {
+            throw "Search cursor did not count every taggable";
+        }
+        const firstPage = await perfTags.readSearchCursorPage(cursorId, 0, 2);
+        const lastPage = await perfTags.readSearchCursorPage(cursorId, 4, 2);
+        const pastEnd = await perfTags.readSearchCursorPage(cursorId, 10, 2);
+        if (!firstPage.found || firstPage.taggables.join() !== "1,3" || lastPage.taggables.join() !== "9" || pastEnd.taggables.length !== 0 || pastEnd.taggableCount !== 5) {
+            throw "Search cursor pages were not slices of the sorted taggables";
+        }
+
+        await perfTags.closeSearchCursor(cursorId);
+        if ((await perfTags.readSearchCursorPage(cursorId, 0, 2)).found) {
+            throw "Search cursor was found after it was closed";
+        }
+
+        const {cursorId: expiringCursorId} = await perfTags.openSearchCursor(PerfTags.searchTag(1n));
+        await new Promise(resolve => setTimeout(resolve, 1000));
+        if ((await perfTags.readSearchCursorPage(expiringCursorId, 0, 2)).found) {
+            throw "Search cursor was found after it expired";
+        }
+    },
+    "search_count_and_search_exists_agree_with_search": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await perfTags.insertTagPairings(new Map([[1n, [1n, 2n, 3n]], [2n, [2n, 3n, 4n]], [3n, [5n]]]), false);
+        const searches = [
+            PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)]),
+            PerfTags.searchUnion([PerfTags.searchTag(1n), PerfTags.searchTag(2n)]),
+            PerfTags.searchIntersect([PerfTags.searchComplement(PerfTags.searchTag(1n)), PerfTags.searchComplement(PerfTags.searchTag(2n))]),
+            PerfTags.searchComplement(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)])),
+            `${PerfTags.searchTag(1n)}-${PerfTags.searchTag(2n)}`,
+            `${PerfTags.searchTag(1n)}^${PerfTags.searchTag(2n)}`,
+            PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(4n)])
+        ];
+        for (const search of searches) {
+            const {taggables} = await perfTags.search(search);
+            const {ok, count} = await perfTags.searchCount(search);
+            const {exists} = await perfTags.searchExists(search);
+            if (!ok || count !== taggables.length || exists !== (taggables.length !== 0)) {
+                throw `Search count ${count} or existence ${exists} did not agree with the ${taggables.length} taggables searched`;
+            }
+        }
+    },
+    "tag_group_counts_agree_whether_counted_from_tags_or_taggables": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS.slice(0, 7), {"tag-group-count-threads": 4});
+        const taggables = [];
+        for (let i = 1n; i <= 70000n; ++i) {
+            taggables.push(i);
+        }
+        const lastTaggables = [];
+        for (let i = 69995n; i <= 70005n; ++i) {
+            lastTaggables.push(i);
+        }
+        await perfTags.insertTagPairings(new Map([[1n, taggables], [2n, taggables.slice(0, 10)], [3n, lastTaggables], [4n, [70010n]]]), false);
+        const tagGroups = [[1n], [2n, 3n], [1n, 4n], [2n, 4n], [5n]];
+        const {tagGroupsTaggableCounts} = await perfTags.readTagGroupsTaggableCounts(tagGroups);
+        if (tagGroupsTaggableCounts.join() !== "70000,21,70001,11,0") {
+            throw `Tag group counts over every taggable were wrong: ${tagGroupsTaggableCounts.join()}`;
+        }
+
+        // groups with more taggables than the search found are counted from the taggables found
+        const {tagGroupsTaggableCounts: searchedCounts} = await perfTags.readTagGroupsTaggableCounts(tagGroups, PerfTags.searchTaggableList([1n, 5n, 70003n, 70010n]));
+        if (searchedCounts.join() !== "2,3,3,3,0") {
+            throw `Tag group counts within a search were wrong: ${searchedCounts.join()}`;
+        }
+    },
+    "array_intersections_match_across_block_and_skewed_sizes": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const everyTaggable = [];
+        for (let i = 1n; i <= 4000n; ++i) {
+            everyTaggable.push(i);
+        }
+        await perfTags.insertTagPairings(new Map([
+            [4n, everyTaggable],
+            [1n, everyTaggable.filter(taggable => taggable % 2n === 0n)],
+            [2n, everyTaggable.filter(taggable => taggable % 3n === 0n)],
+            [3n, [7n, 3000n]]
+        ]), false);
+
+        const {taggables} = await perfTags.search(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)]));
+        const {count} = await perfTags.searchCount(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(2n)]));
+        if (taggables.length !== 666 || count !== 666 || taggables.some(taggable => taggable % 6n !== 0n)) {
+            throw `Intersection of evenly spread tags was wrong, ${taggables.length} taggables and a count of ${count}`;
+        }
+
+        const {taggables: skewedTaggables} = await perfTags.search(PerfTags.searchIntersect([PerfTags.searchTag(1n), PerfTags.searchTag(3n)]));
+        if (skewedTaggables.join() !== "3000") {
+            throw `Intersection of a small tag with a large one was wrong: ${skewedTaggables.join()}`;
+        }
+    },
+    "long_conditional_expression_lists_are_checked_across_threads": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS.slice(0, 7), {"search-threads": 4});
+        /** @type {Map<bigint, bigint[]>} */
+        const tagPairings = new Map();
+        for (let tag = 1n; tag <= 300n; ++tag) {
+            const taggables = [];
+            for (let taggable = tag; taggable <= tag + tag % 5n; ++taggable) {
+                taggables.push(taggable);
+            }
+            tagPairings.set(tag, taggables);
+        }
+        await perfTags.insertTagPairings(tagPairings, false);
+
+        const tags = [...tagPairings.keys()];
+        const atLeastThree = [PerfTags.searchExpressionListUnionConditionExpressionOccurrencesComparedToNWithinCompareExpression(PerfTags.SEARCH_UNIVERSE, ">=", 3)];
+        const expected = new Set(tags.filter(tag => tagPairings.get(tag).length >= 3).flatMap(tag => tagPairings.get(tag)));
+        const {taggables} = await perfTags.search(PerfTags.searchConditionalExpressionListUnion(tags.map(tag => PerfTags.searchTag(tag)), atLeastThree));
+        if (taggables.length !== expected.size || taggables.some(taggable => !expected.has(taggable))) {
+            throw `Conditional expression list found ${taggables.length} taggables rather than ${expected.size}`;
+        }
+
+        // a complemented expression makes the union a complement of what it leaves out
+        const {taggables: withComplement} = await perfTags.search(PerfTags.searchConditionalExpressionListUnion([...tags.map(tag => PerfTags.searchTag(tag)), PerfTags.searchComplement(PerfTags.searchTag(1n))], atLeastThree));
+        const left = tagPairings.get(1n).filter(taggable => !expected.has(taggable));
+        const taggableCount = new Set([...tagPairings.values()].flat()).size;
+        if (withComplement.length !== taggableCount - left.length || left.some(taggable => withComplement.indexOf(taggable) !== -1)) {
+            throw `Conditional expression list with a complement found ${withComplement.length} taggables`;
+        }
+    },
+    "operations_built_up_in_place_match_their_sets": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        /** @type {Map<bigint, bigint[]>} */
+        const tagPairings = new Map();
+        for (let tag = 1n; tag <= 4n; ++tag) {
+            const taggables = [];
+            for (let taggable = 1n; taggable <= 600n; ++taggable) {
+                if ((taggable * (tag + 1n)) % 7n < tag + 1n) {
+                    taggables.push(taggable);
+                }
+            }
+            tagPairings.set(tag, taggables);
+        }
+        await perfTags.insertTagPairings(tagPairings, false);
+
+        const universe = new Set([...tagPairings.values()].flat());
+        const tagSet = (tag, isComplement) => new Set([...universe].filter(taggable => tagPairings.get(tag).includes(taggable) !== isComplement));
+        const tagSearch = (tag, isComplement) => isComplement ? PerfTags.searchComplement(PerfTags.searchTag(tag)) : PerfTags.searchTag(tag);
+        const SET_OPERATIONS = {
+            "|": (lhs, rhs) => new Set([...lhs, ...rhs]),
+            "&": (lhs, rhs) => new Set([...lhs].filter(taggable => rhs.has(taggable))),
+            "-": (lhs, rhs) => new Set([...lhs].filter(taggable => !rhs.has(taggable))),
+            "^": (lhs, rhs) => new Set([...[...lhs].filter(taggable => !rhs.has(taggable)), ...[...rhs].filter(taggable => !lhs.has(taggable))])
+        };
+        for (const op of Object.keys(SET_OPERATIONS)) {
+            for (let complements = 0; complements < 16; ++complements) {
+                const operands = [1n, 2n, 3n, 4n].map((tag, i) => ({tag, isComplement: ((complements >> i) & 1) === 1}));
+                const search = operands.map(({tag, isComplement}) => tagSearch(tag, isComplement)).join(op);
+                const expected = operands.slice(1).reduce((set, {tag, isComplement}) => SET_OPERATIONS[op](set, tagSet(tag, isComplement)), tagSet(operands[0].tag, operands[0].isComplement));
+                const {taggables} = await perfTags.search(search);
+                if (taggables.length !== expected.size || taggables.some(taggable => !expected.has(taggable))) {
+                    throw `Search ${op} with complements ${complements} found ${taggables.length} taggables rather than ${expected.size}`;
+                }
+            }
+        }
+    },
+    "metric_ranges_search_a_sorted_column_of_values_that_survives_restarts": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const taggables = [];
+        for (let taggable = 1n; taggable <= 20n; ++taggable) {
+            taggables.push(taggable);
+        }
+        await perfTags.insertTagPairings(new Map([[1n, taggables], [2n, taggables.filter(taggable => taggable % 2n === 0n)]]), false);
+        // metric 7 gives each taggable half its id, metric 8 the negative of its id
+        await perfTags.setMetricValues(taggables.flatMap(taggable => [
+            {metric: 7n, taggable, value: Number(taggable) / 2},
+            {metric: 8n, taggable, value: -Number(taggable)}
+        ]), false);
+        // setting a value again replaces the one before it
+        await perfTags.setMetricValues([{metric: 7n, taggable: 20n, value: 4}, {metric: 7n, taggable: 1n, value: 100}], false);
+        await perfTags.deleteMetricValues([{metric: 7n, taggable: 8n}], false);
+
+        const expectRange = async (search, expected, when) => {
+            const {taggables: found} = await perfTags.search(search);
+            const sorted = [...found].sort((a, b) => Number(a - b));
+            if (sorted.join() !== expected.join()) {
+                throw `Metric range search ${when} found ${sorted.join()} rather than ${expected.join()}`;
+            }
+            const {count} = await perfTags.searchCount(search);
+            if (count !== expected.length) {
+                throw `Metric range count ${when} was ${count} rather than ${expected.length}`;
+            }
+        };
+        const checkRanges = async (when) => {
+            await expectRange(PerfTags.searchMetricRange(7n, 3, 5), [6n, 7n, 9n, 10n, 20n], when);
+            await expectRange(PerfTags.searchIntersect([PerfTags.searchMetricRange(7n, 3, 5), PerfTags.searchTag(2n)]), [6n, 10n, 20n], when);
+            await expectRange(PerfTags.searchComplement(PerfTags.searchMetricRange(8n, -Infinity, -3)), [1n, 2n], when);
+            await expectRange(PerfTags.searchMetricRange(7n, 50, Infinity), [1n], when);
+            await expectRange(PerfTags.searchMetricRange(7n, 5, 3), [], when);
+            await expectRange(PerfTags.searchMetricRange(9n, -Infinity, Infinity), [], when);
+        };
+        await checkRanges("before a restart");
+
+        // values are recovered from the write ahead log, then read back from the metric bucket's main file
+        perfTags.__kill();
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await checkRanges("after a kill");
+        await perfTags.__flushAndPurgeUnusedFiles();
+        perfTags.__kill();
+        perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        await checkRanges("after a flush");
+
+        // a deleted taggable takes its values with it
+        await perfTags.deleteTaggables([9n], false);
+        await expectRange(PerfTags.searchMetricRange(7n, 3, 5), [6n, 7n, 10n, 20n], "after a taggable was deleted");
+        await perfTags.insertTaggables([9n], false);
+        await expectRange(PerfTags.searchMetricRange(8n, -9, -9), [], "after a deleted taggable was inserted again");
+    },
+    "sorted_search_windows_match_sorting_every_taggable": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const taggables = [];
+        for (let taggable = 1n; taggable <= 200n; ++taggable) {
+            taggables.push(taggable);
+        }
+        // inserted in reverse, so internal ids are in the opposite order of the ids they stand for
+        await perfTags.insertTaggables([...taggables].reverse(), false);
+        await perfTags.insertTagPairings(new Map([[1n, taggables], [2n, taggables.filter(taggable => taggable % 10n === 0n)]]), false);
+        // the values repeat, and the last 50 taggables have none
+        const values = new Map(taggables.filter(taggable => taggable <= 150n).map(taggable => [taggable, Number((taggable * 37n) % 50n) - 20]));
+        await perfTags.setMetricValues([...values].map(([taggable, value]) => ({metric: 5n, taggable, value})), false);
+
+        const byId = (lhs, rhs) => lhs < rhs ? -1 : lhs > rhs ? 1 : 0;
+        const byValue = (descending) => (lhs, rhs) => {
+            if (values.has(lhs) !== values.has(rhs)) {
+                return values.has(lhs) ? -1 : 1;
+            }
+            if (values.has(lhs) && values.get(lhs) !== values.get(rhs)) {
+                return descending ? values.get(rhs) - values.get(lhs) : values.get(lhs) - values.get(rhs);
+            }
+            return byId(lhs, rhs);
+        };
+        // tag 1 finds enough of the metric's taggables for its values to be walked, tag 2 few enough for its taggables to be looked up
+        for (const tag of [1n, 2n]) {
+            const search = PerfTags.searchTag(tag);
+            const {taggables: found} = await perfTags.search(search);
+            for (const [offset, limit] of [[0, 10], [140, 30], [195, 50], [0, 1000], [5, 0]]) {
+                const orders = [
+                    [{}, [...found].sort(byId)],
+                    [{descending: true}, [...found].sort(byId).reverse()],
+                    [{metric: 5n}, [...found].sort(byValue(false))],
+                    [{metric: 5n, descending: true}, [...found].sort(byValue(true))],
+                    [{metric: 6n}, [...found].sort(byId)]
+                ];
+                for (const [order, sorted] of orders) {
+                    const {ok, taggableCount, taggables: window} = await perfTags.searchSorted(search, {...order, offset, limit});
+                    const expected = sorted.slice(offset, offset + limit);
+                    if (!ok || taggableCount !== found.length || window.join() !== expected.join()) {
+                        throw `Sorted window ${offset} ${limit} of tag ${tag} by ${JSON.stringify(order, (_, value) => typeof value === "bigint" ? Number(value) : value)} was ${window.join()} rather than ${expected.join()}`;
+                    }
+                }
+            }
+        }
+    },
+    "search_samples_are_distinct_members_picked_uniformly": async (createPerfTags) => {
+        let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
+        const taggables = [];
+        for (let taggable = 1n; taggable <= 20000n; ++taggable) {
+            taggables.push(taggable);
+        }
+        // a run of every taggable, a bitmap of every third, and an array of a few
+        await perfTags.insertTagPairings(new Map([[1n, taggables], [2n, taggables.filter(taggable => taggable % 3n === 0n)], [3n, [5n, 50n, 500n, 5000n]]]), false);
+        const searches = [
+            PerfTags.searchTag(1n),
+            PerfTags.searchTag(2n),
+            PerfTags.searchTag(3n),
+            PerfTags.searchComplement(PerfTags.searchTag(2n)),
+            PerfTags.searchTag(4n)
+        ];
+        for (const search of searches) {
+            const {taggables: found} = await perfTags.search(search);
+            const foundSet = new Set(found);
+            for (const count of [0, 1, 3, 50, 30000]) {
+                const {ok, taggableCount, taggables: sample} = await perfTags.searchSample(search, count, 7);
+                if (!ok || taggableCount !== found.length || sample.length !== Math.min(count, found.length)
+                 || new Set(sample).size !== sample.length || sample.some(taggable => !foundSet.has(taggable))) {
+                    throw `Sample of ${count} from ${found.length} taggables was not that many distinct taggables of the search: ${sample.slice(0, 10).join()}`;
+                }
+                const {taggables: reseeded} = await perfTags.searchSample(search, count, 7);
+                if (reseeded.join() !== sample.join()) {
+                    throw `Sample of ${count} from ${found.length} taggables changed with the same seed`;
+                }
+            }
+        }
+
+        // every taggable is as likely to be sampled as any other
+        const picks = new Map([[5n, 0], [50n, 0], [500n, 0], [5000n, 0]]);
+        for (let seed = 0; seed < 400; ++seed) {
+            const {taggables: [taggable]} = await perfTags.searchSample(PerfTags.searchTag(3n), 1, seed);
+            picks.set(taggable, picks.get(taggable) + 1);
+        }
+        if ([...picks.values()].some(pickCount => pickCount < 50 || pickCount > 150)) {
+            throw `Samples of one taggable were not spread evenly: ${[...picks].join(" ")}`;
+        }
+        const {taggables: unseeded} = await perfTags.searchSample(PerfTags.searchTag(1n), 5);
+        if (unseeded.length !== 5) {
+            throw `Unseeded sample had ${unseeded.length} taggables`;
+        }
+    },
 };
 export default TESTS;
\ No newline at end of file
@@ -34,6 +34,23 @@ const TESTS = {
             throw `Test case failed, no error on insert_tag_pairings without parents`;
         }
     },
+    "insert_tag_pairings_with_a_deleted_tag_pairs_nothing": async (createPerfTags) => {
+        // in process, the tag file maintainer outlives a write that failed, along with anything the write did before it failed
+        let perfTags = createPerfTags(`./${PerfTags.ADDON_NAME}`, ...TEST_DEFAULT_PERF_TAGS_ARGS.slice(1), {"in-process": 1});
+        await perfTags.insertTaggables([1n]);
+        await perfTags.insertTags([1n, 2n], false);
+        await perfTags.deleteTags([2n], false);
+
+        perfTags.__expectError();
+        const ok = await perfTags.__insertTagPairings(new Map([[1n, [1n]], [2n, [1n]]]));
+        if (ok) {
+            throw `Test case failed, no error on insert_tag_pairings with a deleted tag`;
+        }
+        const {taggables} = await perfTags.search(PerfTags.searchTag(1n));
+        if (taggables.length !== 0) {
+            throw `Test case failed, insert_tag_pairings with a deleted tag paired ${taggables}`;
+        }
+    },
     "insert_tag_pairings_without_file_parents": async (createPerfTags) => {
         let perfTags = createPerfTags(...TEST_DEFAULT_PERF_TAGS_ARGS);
         const tagPairings = getPairingsFromStrPairings({'tag00001': ['tgbl0001']});
@@ -84,8 +101,8 @@ const TESTS = {
             throw "Test case failed, file tags not found after writing";
         }
 
-        // write input, read input, read output, database dir, and archive dir
-        if (!existsSync(NEW_ARGS[1]) || !existsSync(NEW_ARGS[3]) || !existsSync(NEW_ARGS[4]) || !existsSync(NEW_ARGS[5]) || !existsSync(NEW_ARGS[6])) {
+        // write input, read input, read output, database dir, and archive dir, where reads go to files numbered by their request id
+        if (!existsSync(NEW_ARGS[1]) || !existsSync(`${NEW_ARGS[3]}.1`) || !existsSync(`${NEW_ARGS[4]}.1`) || !existsSync(NEW_ARGS[5]) || !existsSync(NEW_ARGS[6])) {
             throw "Test case failed, one of the specified input locations was not found";
         }
     },
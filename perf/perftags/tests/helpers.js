@@ -2,6 +2,7 @@ import {deserializeUint64, serializeUint64} from "../../../src/client/js/client-
 import PerfTags from "../../../src/perf-binding/perf-tags.js";
 import { getAllFileEntries } from "../../../src/util.js";
 import {stat} from "fs/promises";
+import {readdirSync} from "fs";
 /**
  * @typedef {(...args: ConstructorParameters<typeof PerfTags>) => PerfTags} PerfTagsCtor
  * @typedef {(createPerfTags: PerfTagsCtor) => Promise<void>} TestFunction
@@ -66,6 +67,17 @@ export async function getTotalDirectoryBytes(directory) {
     return totalBytes;
 }
 
+/**
+ * Buckets are written to a new generation folder named `${bucketName}.${generation}` on each flush, and after a purge only the current one is left
+ * @param {string} bucketName
+ * @returns {string[]}
+ */
+export function getBucketFolders(bucketName) {
+    return readdirSync(`${TEST_DEFAULT_DATABASE_DIR}/buckets`)
+        .filter(folderName => folderName === bucketName || folderName.startsWith(`${bucketName}.`))
+        .map(folderName => `${TEST_DEFAULT_DATABASE_DIR}/buckets/${folderName}`);
+}
+
 /**
  * @param {Record<string, string[]} filePairings 
  */
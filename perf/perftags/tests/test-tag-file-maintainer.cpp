@@ -27,8 +27,8 @@ namespace {
     }
 }
 
-TestTagFileMaintainer::TestTagFileMaintainer(std::string folderName)
-    : TagFileMaintainer(std::move(folderName))
+TestTagFileMaintainer::TestTagFileMaintainer(std::string folderName, TagFileMaintainerOptions options)
+    : TagFileMaintainer(std::move(folderName), options)
 {}
 
 void TestTagFileMaintainer::insertTags(std::string_view input) {
@@ -40,22 +40,27 @@ void TestTagFileMaintainer::insertTags(std::string_view input) {
     }
 }
 void TestTagFileMaintainer::insertTagsFailBetweenPairingsAndSinglesWrites(std::string_view input) {
-    auto insertTag = [this](uint64_t tag) {
+    auto insertTag = [this](uint64_t externalTag) {
+        auto tag = tagIds_.toInternalOrInsert(externalTag);
         for (auto& bucket : taggableTagBuckets) {
             bucket.insertComplement(tag);
         }
         tagBucket_->insertItem(tag);
     };
     processSingles(input, insertTag);
+    tagIds_.persist();
 
-    writePriorCacheFile();
-
-    for (auto& bucket : taggableTagBuckets) {
-        bucket.diffAhead();
+    // the pairing buckets make it into the write ahead log, but the record is never committed
+    std::string record;
+    std::string deltaStr;
+    for (std::size_t i = 0; i < taggableTagBuckets.size(); ++i) {
+        if (taggableTagBuckets[i].diffAhead(deltaStr)) {
+            appendWriteAheadDelta(record, taggableTagBucketId(i), deltaStr);
+        }
     }
+    writeAheadLog().append(record);
 
     throw std::logic_error("COMPLETELY STAGED ERROR");
 
-    tagBucket_->diffAhead();
-    writeCacheFile();
+    commitWriteAhead();
 }
\ No newline at end of file
@@ -3,7 +3,7 @@
 
 class TestTagFileMaintainer : public TagFileMaintainer {
     public:
-        TestTagFileMaintainer(std::string folderName);
+        TestTagFileMaintainer(std::string folderName, TagFileMaintainerOptions options = TagFileMaintainerOptions());
 
         std::string overrideMode = "";
         void insertTags(std::string_view input);
@@ -0,0 +1,144 @@
+#include "write-ahead-log.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "../common/util.hpp"
+
+WriteAheadLog::WriteAheadLog(std::filesystem::path filePath, WriteAheadLogOptions options)
+    : filePath_(std::move(filePath)), options_(options)
+{}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (file_ != nullptr) {
+        sync();
+        close();
+    }
+}
+
+std::vector<std::string> WriteAheadLog::recover(std::size_t committedSize) {
+    close();
+
+    std::vector<std::string> payloads;
+    std::string logStr;
+    if (std::filesystem::exists(filePath_)) {
+        logStr = util::readFile(filePath_);
+    }
+
+    // records are committed before they are synced, so after the OS goes down the log can end short of its committed size or in
+    // a torn record, and whatever was lost is lost the same as unsynced records are, leaving the log to end at the last whole record
+    std::size_t logEnd = std::min(committedSize, logStr.size());
+    std::size_t inputOffset = 0;
+    while (inputOffset + RECORD_HEADER_SIZE <= logEnd) {
+        std::size_t recordOffset = inputOffset;
+        auto payloadSize = util::deserializeUInt32(logStr, recordOffset);
+        auto checksum = util::deserializeUInt32(logStr, recordOffset);
+        if (payloadSize > logEnd - recordOffset) {
+            break;
+        }
+        auto payload = std::string_view(logStr).substr(recordOffset, payloadSize);
+        if (util::crc32(payload) != checksum) {
+            break;
+        }
+        payloads.push_back(std::string(payload));
+        inputOffset = recordOffset + payloadSize;
+    }
+
+    // anything past the committed size was appended without its command finishing
+    if (logStr.size() > inputOffset) {
+        std::filesystem::resize_file(filePath_, inputOffset);
+    }
+    size_ = inputOffset;
+
+    return payloads;
+}
+
+void WriteAheadLog::append(std::string_view payload) {
+    open();
+
+    std::string header;
+    std::size_t location = 0;
+    location = util::serializeUInt32(static_cast<uint32_t>(payload.size()), header, location);
+    location = util::serializeUInt32(util::crc32(payload), header, location);
+
+    // flushed every append so that the record survives the process dying, only syncing to disk is grouped
+    if (std::fwrite(header.data(), 1, header.size(), file_) != header.size()
+     || std::fwrite(payload.data(), 1, payload.size(), file_) != payload.size()
+     || std::fflush(file_) != 0) {
+        throw std::logic_error(std::string("Failed to append to write ahead log ") + filePath_.generic_string());
+    }
+
+    size_ += header.size() + payload.size();
+    ++unsyncedRecords_;
+    unsyncedBytes_ += header.size() + payload.size();
+    commitGroup();
+}
+
+void WriteAheadLog::commitGroup() {
+    if (unsyncedRecords_ == 0) {
+        return;
+    }
+
+    if (unsyncedRecords_ >= options_.groupCommitRecords
+     || unsyncedBytes_ >= options_.groupCommitBytes
+     || std::chrono::steady_clock::now() - lastSync_ >= options_.groupCommitDelay) {
+        sync();
+    }
+}
+
+void WriteAheadLog::sync() {
+    if (file_ != nullptr && unsyncedRecords_ != 0) {
+        std::fflush(file_);
+        #ifdef _WIN32
+        _commit(_fileno(file_));
+        #else
+        fdatasync(fileno(file_));
+        #endif
+    }
+
+    unsyncedRecords_ = 0;
+    unsyncedBytes_ = 0;
+    lastSync_ = std::chrono::steady_clock::now();
+}
+
+void WriteAheadLog::truncate() {
+    close();
+    if (std::filesystem::exists(filePath_)) {
+        std::filesystem::resize_file(filePath_, 0);
+    }
+
+    size_ = 0;
+    unsyncedRecords_ = 0;
+    unsyncedBytes_ = 0;
+}
+
+std::size_t WriteAheadLog::size() const {
+    return size_;
+}
+
+void WriteAheadLog::open() {
+    if (file_ != nullptr) {
+        return;
+    }
+
+    std::filesystem::create_directories(std::filesystem::absolute(filePath_).parent_path());
+    file_ = std::fopen(filePath_.string().c_str(), "ab");
+    if (file_ == nullptr) {
+        throw std::logic_error(std::string("Could not open write ahead log ") + filePath_.generic_string());
+    }
+}
+
+void WriteAheadLog::close() {
+    if (file_ == nullptr) {
+        return;
+    }
+
+    std::fclose(file_);
+    file_ = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct WriteAheadLogOptions {
+    // appended records are synced to disk together once any of these are reached since the last sync
+    std::size_t groupCommitRecords = 64;
+    std::size_t groupCommitBytes = 4 * 1024 * 1024;
+    std::chrono::milliseconds groupCommitDelay = std::chrono::milliseconds(1000);
+};
+
+// Append-only log of checksummed records, framed as {payload size}{crc32 of payload}{payload}
+// Records are handed to the OS as soon as they are appended, and synced to disk in groups
+class WriteAheadLog {
+    public:
+        WriteAheadLog(std::filesystem::path filePath, WriteAheadLogOptions options);
+        WriteAheadLog(const WriteAheadLog& writeAheadLog) = delete;
+        WriteAheadLog& operator=(const WriteAheadLog& writeAheadLog) = delete;
+        ~WriteAheadLog();
+
+        // Returns the payloads of the whole records within the first committedSize bytes and truncates anything after them,
+        // where a record that is torn or fails its checksum ends the log
+        std::vector<std::string> recover(std::size_t committedSize);
+        void append(std::string_view payload);
+        // Syncs if any group commit threshold has been reached
+        void commitGroup();
+        void sync();
+        void truncate();
+        std::size_t size() const;
+
+        static const std::size_t RECORD_HEADER_SIZE = 8;
+    private:
+        void open();
+        void close();
+
+        std::filesystem::path filePath_;
+        WriteAheadLogOptions options_;
+        std::FILE* file_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t unsyncedRecords_ = 0;
+        std::size_t unsyncedBytes_ = 0;
+        std::chrono::steady_clock::time_point lastSync_ = std::chrono::steady_clock::now();
+};
\ No newline at end of file
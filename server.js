@@ -44,7 +44,8 @@ async function main() {
             path.join(DATABASE_DIR, "perftags-read-input.txt"),
             path.join(DATABASE_DIR, "perftags-read-output.txt"),
             path.join(DATABASE_DIR, "perftags"),
-            "archive-commands"
+            "archive-commands",
+            {"framed-ipc": 1}
         ),
         perfImg: new PerfImg(
             `perf/perfimg/${PerfImg.EXE_NAME}`,
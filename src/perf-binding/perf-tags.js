@@ -1,10 +1,11 @@
 import { spawn } from 'child_process';
+import { createRequire } from 'module';
 import { existsSync } from 'fs';
 import path from 'path';
 import { mapNullCoalesce, serializeUint64, T_MINUTE } from '../client/js/client-util.js';
 import { Mutex } from 'async-mutex';
 import { mkdir, readFile, writeFile } from 'fs/promises';
-import { serializeFloat } from '../util.js';
+import { serializeDouble, serializeFloat } from '../util.js';
 
 /** @import {Databases} from "../db/db-util.js" */
 /** @import {ClientComparator} from "../api/zod-types.js" */
@@ -22,25 +23,95 @@ export default class PerfTags {
     #readOutputFileName;
     #databaseDirectory;
     #archiveDirectory;
+    /** @type {Record<string, number>} */
+    #options;
     #stdinWrites = 0;
     #data = "";
     #writeMutex = new Mutex();
-    #readMutex = new Mutex();
+    #nextReadRequestId = 0;
+    /** @type {number[]} request ids whose files can be reused, so there are only as many request files as reads ever ran at once */
+    #freeReadRequestIds = [];
+    #framed = false;
+    #nextFrameRequestId = 0;
+    #frameData = Buffer.alloc(0);
+    /** @type {Map<number, (ok: boolean, output: Buffer) => void>} */
+    #frameReplies = new Map();
+    #inProcess = false;
+    /** the tag file maintainer hosted by perftags.node when in process, see perf/perftags/addon.cpp */
+    #addon;
     #unflushedData = false;
 
     static EXE_NAME = process.platform === "win32" ? "perftags.exe" : "perftags";
+    static ADDON_NAME = "perftags.node";
     static NEWLINE = process.platform === "win32" ? "\r\n" : "\n";
     static WRITE_OK_RESULT = `WRITE_OK!${PerfTags.NEWLINE}`;
     static READ_OK_RESULT = `READ_OK!${PerfTags.NEWLINE}`;
+    // the ops in the order of their op codes in perf/perftags/framed-ipc.cpp
+    static FRAME_OPS = [
+        "exit",
+        "insert_taggables",
+        "delete_taggables",
+        "insert_tags",
+        "delete_tags",
+        "insert_tag_pairings",
+        "toggle_tag_pairings",
+        "delete_tag_pairings",
+        "flush_files",
+        "purge_unused_files",
+        "begin_transaction",
+        "end_transaction",
+        "override",
+        "read_taggables_tags",
+        "read_taggables_specified_tags",
+        "read_tag_groups_taggable_counts",
+        "search",
+        "stats",
+        "prewarm",
+        "explain",
+        "search_cursor_open",
+        "search_cursor_page",
+        "search_cursor_close",
+        "search_count",
+        "search_exists",
+        "set_metric_values",
+        "delete_metric_values",
+        "search_sorted",
+        "search_sample"
+    ];
+    static FRAME_HEADER_BYTES = 17;
+    static FRAME_STATUS_OK = 0;
 
     __open() {
         this.#closed = false;
         this.#closing = false;
-        this.#perfTags = spawn(this.#path, [this.#writeInputFileName, this.#writeOutputFileName, this.#readInputFileName, this.#readOutputFileName, this.#databaseDirectory]);
+        if (this.#inProcess) {
+            const {"in-process": _inProcess, ...options} = this.#options;
+            const {TagFileMaintainer} = createRequire(import.meta.url)(path.resolve(this.#path));
+            this.#addon = new TagFileMaintainer(this.#databaseDirectory, options);
+        } else {
+            this.#spawn();
+        }
+
+        setInterval(async () => {
+            if (this.#unflushedData && !this.#closed) {
+                await this.flushData();
+            }
+        }, 15000);
+    }
+
+    #spawn() {
+        const optionArgs = Object.entries(this.#options).map(([name, value]) => `${name}=${value}`);
+        this.#perfTags = spawn(this.#path, [this.#writeInputFileName, this.#writeOutputFileName, this.#readInputFileName, this.#readOutputFileName, this.#databaseDirectory, ...optionArgs]);
         if (this.#perfTags.pid === undefined) {
             throw "Perf tags did not start with spawn arguments"
         }
+        this.#frameData = Buffer.alloc(0);
         this.#perfTags.stdout.on("data", (chunk) => {
+            if (this.#framed) {
+                this.#receiveFrames(chunk);
+                return;
+            }
+
             this.#data += chunk;
             for (const dataCallback of this.#dataCallbacks) {
                 dataCallback();  
@@ -65,17 +136,15 @@ export default class PerfTags {
 
             this.#closed = true;
             ++this.#exitCount;
+            for (const frameReply of this.#frameReplies.values()) {
+                frameReply(false, Buffer.alloc(0));
+            }
+            this.#frameReplies.clear();
             for (const dataCallback of this.#dataCallbacks) {
                 dataCallback();  
             }
             this.#exitCallback();
         });
-
-        setInterval(async () => {
-            if (this.#unflushedData && !this.#closed) {
-                await this.flushData();
-            }
-        }, 15000);
     }
 
     async reopen() {
@@ -83,14 +152,22 @@ export default class PerfTags {
         this.__open();
     }
 
-    constructor(path, writeInputFileName, writeOutputFileName, readInputFileName, readOutputFileName, databaseDirectory, archiveDirectory) {
-        this.#path = path ?? `./${PerfTags.EXE_NAME}`;
+    /**
+     * @param {Record<string, number>=} options perftags options passed as name=value, such as "target-bucket-bytes" or "wal-group-commit-ms",
+     * where "framed-ipc" sends commands as binary frames over stdin and stdout rather than through the input and output files,
+     * and "in-process" runs the tag file maintainer in this process through the addon at path, built with make addon in perf/perftags
+     */
+    constructor(path, writeInputFileName, writeOutputFileName, readInputFileName, readOutputFileName, databaseDirectory, archiveDirectory, options) {
+        this.#options = options ?? {};
+        this.#inProcess = Boolean(this.#options["in-process"]);
+        this.#path = path ?? `./${this.#inProcess ? PerfTags.ADDON_NAME : PerfTags.EXE_NAME}`;
         this.#writeInputFileName = writeInputFileName ?? "perftags-write-input.txt";
         this.#writeOutputFileName = writeOutputFileName ?? "perftags-write-output.txt";
         this.#readInputFileName = readInputFileName ?? "perftags-read-input.txt";
         this.#readOutputFileName = readOutputFileName ?? "perftags-read-output.txt";
         this.#databaseDirectory = databaseDirectory ?? "database/tag-pairings";
         this.#archiveDirectory = archiveDirectory;
+        this.#framed = Boolean(this.#options["framed-ipc"]);
 
         this.__open();
     }
@@ -121,28 +198,53 @@ export default class PerfTags {
      * @param {number} timeout 
      * @returns {Promise<boolean>}
      */
-    __dataOrTimeout(data, timeout) {
+    async __dataOrTimeout(data, timeout) {
+        return (await this.__anyDataOrTimeout([data], timeout)) === 0;
+    }
+
+    /**
+     * @param {string[]} datas 
+     * @param {number} timeout 
+     * @returns {Promise<number>} the index of whichever of datas came first, or -1 on timeout
+     */
+    __anyDataOrTimeout(datas, timeout) {
         return new Promise(resolve => {
+            // a callback left behind would go on consuming whatever it waited for, from whoever waits for it next
+            const removeDataCallback = () => {
+                const callbackIndex = this.#dataCallbacks.findIndex(callback => callback === myDataCallback);
+                if (callbackIndex !== -1) {
+                    this.#dataCallbacks.splice(callbackIndex, 1);
+                }
+            };
             const timeoutHandle = setTimeout(() => {
-                resolve(false);
+                removeDataCallback();
+                resolve(-1);
             }, timeout);
 
             const myDataCallback = () => {
-                if (this.#data.startsWith(data)) {
-                    this.#data = this.#data.slice(data.length);
-                    // delete self from data callbacks
-                    const callbackIndex = this.#dataCallbacks.findIndex(callback => callback === myDataCallback);
-                    if (callbackIndex !== -1) {
-                        this.#dataCallbacks.splice(callbackIndex, 1);
+                let dataIndex = -1;
+                let matchedIndex = -1;
+                for (let i = 0; i < datas.length && dataIndex === -1; ++i) {
+                    // replies to reads with a request id can come back out of order, so data is matched as any whole line
+                    dataIndex = this.#data.startsWith(datas[i]) ? 0 : this.#data.indexOf(`${PerfTags.NEWLINE}${datas[i]}`);
+                    if (dataIndex > 0) {
+                        dataIndex += PerfTags.NEWLINE.length;
                     }
+                    matchedIndex = i;
+                }
+                if (dataIndex !== -1) {
+                    const data = datas[matchedIndex];
+                    this.#data = `${this.#data.slice(0, dataIndex)}${this.#data.slice(dataIndex + data.length)}`;
+                    removeDataCallback();
                     clearTimeout(timeoutHandle);
                     for (const dataCallback of this.#dataCallbacks) {
                         dataCallback();
                     }
-                    resolve(true);
+                    resolve(matchedIndex);
                 } else if (this.#closed) {
+                    removeDataCallback();
                     clearTimeout(timeoutHandle);
-                    resolve(false);
+                    resolve(-1);
                 }
             };
             this.#dataCallbacks.push(myDataCallback);
@@ -189,9 +291,7 @@ export default class PerfTags {
     }
 
     async __insertTaggables(taggables) {
-        await this.__writeToWriteInputFile(PerfTags.#serializeSingles(taggables));
-        await this.__writeLineToStdin("insert_taggables");
-        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("insert_taggables", PerfTags.#serializeSingles(taggables));
     }
     
     /**
@@ -216,9 +316,7 @@ export default class PerfTags {
     }
 
     async __insertTags(tags) {
-        await this.__writeToWriteInputFile(PerfTags.#serializeSingles(tags));
-        await this.__writeLineToStdin("insert_tags");
-        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("insert_tags", PerfTags.#serializeSingles(tags));
     }
 
     /**
@@ -268,9 +366,7 @@ export default class PerfTags {
      * @param {Map<bigint, bigint[]>} tagPairings
      */
     async __insertTagPairings(tagPairings) {
-        await this.__writeToWriteInputFile(PerfTags.#serializeTagPairings(tagPairings));
-        await this.__writeLineToStdin("insert_tag_pairings");
-        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("insert_tag_pairings", PerfTags.#serializeTagPairings(tagPairings));
     }
 
     /**
@@ -300,9 +396,7 @@ export default class PerfTags {
      * @param {Map<bigint, bigint[]>} tagPairings
      */
     async __toggleTagPairings(tagPairings) {
-        await this.__writeToWriteInputFile(PerfTags.#serializeTagPairings(tagPairings));
-        await this.__writeLineToStdin("toggle_tag_pairings");
-        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("toggle_tag_pairings", PerfTags.#serializeTagPairings(tagPairings));
     }
 
     /**
@@ -329,9 +423,57 @@ export default class PerfTags {
      * @param {Map<bigint, bigint[]>} tagPairings
      */
     async __deleteTagPairings(tagPairings) {
-        await this.__writeToWriteInputFile(PerfTags.#serializeTagPairings(tagPairings));
-        await this.__writeLineToStdin("delete_tag_pairings");
-        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("delete_tag_pairings", PerfTags.#serializeTagPairings(tagPairings));
+    }
+
+    /**
+     * Gives each taggable its value of a metric, replacing any value it had of that metric, the taggables must already be inserted
+     * @param {{metric: bigint, taggable: bigint, value: number}[]} metricValues
+     * @param {number} inTransaction
+     */
+    async setMetricValues(metricValues, inTransaction) {
+        if (inTransaction === 0) {
+            await this.#writeMutex.acquire();
+        }
+
+        let offset = 0;
+        const buffer = Buffer.allocUnsafe(metricValues.length * 24);
+        for (const {metric, taggable, value} of metricValues) {
+            offset = buffer.writeBigUInt64LE(metric, offset);
+            offset = buffer.writeBigUInt64LE(taggable, offset);
+            offset = buffer.writeDoubleLE(value, offset);
+        }
+        const result = await this.__write("set_metric_values", buffer.toString("binary"));
+        this.#unflushedData = true;
+
+        if (inTransaction === 0) {
+            this.#writeMutex.release();
+        }
+        return result;
+    }
+
+    /**
+     * @param {{metric: bigint, taggable: bigint}[]} metricTaggables
+     * @param {number} inTransaction
+     */
+    async deleteMetricValues(metricTaggables, inTransaction) {
+        if (inTransaction === 0) {
+            await this.#writeMutex.acquire();
+        }
+
+        let offset = 0;
+        const buffer = Buffer.allocUnsafe(metricTaggables.length * 16);
+        for (const {metric, taggable} of metricTaggables) {
+            offset = buffer.writeBigUInt64LE(metric, offset);
+            offset = buffer.writeBigUInt64LE(taggable, offset);
+        }
+        const result = await this.__write("delete_metric_values", buffer.toString("binary"));
+        this.#unflushedData = true;
+
+        if (inTransaction === 0) {
+            this.#writeMutex.release();
+        }
+        return result;
     }
 
     /**
@@ -346,9 +488,7 @@ export default class PerfTags {
             await this.#writeMutex.acquire();
         }
 
-        await this.__writeToWriteInputFile(PerfTags.#serializeSingles(tags));
-        await this.__writeLineToStdin("delete_tags");
-        const result = await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        const result = await this.__write("delete_tags", PerfTags.#serializeSingles(tags));
         this.#unflushedData = true;
 
         if (inTransaction === 0) {
@@ -369,9 +509,7 @@ export default class PerfTags {
             await this.#writeMutex.acquire();
         }
 
-        await this.__writeToWriteInputFile(PerfTags.#serializeSingles(taggables));
-        await this.__writeLineToStdin("delete_taggables");
-        const result = await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        const result = await this.__write("delete_taggables", PerfTags.#serializeSingles(taggables));
         this.#unflushedData = true;
 
         if (inTransaction === 0) {
@@ -386,14 +524,10 @@ export default class PerfTags {
      */
     async readTagGroupsTaggableCounts(tagGroups, search) {
         search ??= "";
-        await this.#readMutex.acquire();
 
         const tagGroupsTagsSerialized = tagGroups.map(tags => `${serializeUint64(BigInt(tags.length))}${PerfTags.#serializeSingles(tags)}`).join('');
         
-        await this.__writeToReadInputFile(`${serializeUint64(BigInt(tagGroups.length))}${tagGroupsTagsSerialized}${search}`);
-        await this.__writeLineToStdin("read_tag_groups_taggable_counts");
-        const ok = await this.__dataOrTimeout(PerfTags.READ_OK_RESULT, 1000);
-        let tagsTaggableCountsStr = await this.__readFromOutputFile();
+        const {ok, output: tagsTaggableCountsStr} = await this.__request("read_tag_groups_taggable_counts", `${serializeUint64(BigInt(tagGroups.length))}${tagGroupsTagsSerialized}${search}`, 1000);
         /** @type {number[]} */
         const tagGroupsTaggableCounts = [];
         for (let i = 0; i < tagsTaggableCountsStr.length;) {
@@ -402,7 +536,6 @@ export default class PerfTags {
             tagGroupsTaggableCounts.push(taggableGroupCount);
         }
 
-        this.#readMutex.release();
         return {ok, tagGroupsTaggableCounts};
     }
 
@@ -410,12 +543,7 @@ export default class PerfTags {
      * @param {bigint[]} taggables
      */
     async readTaggablesTags(taggables) {
-        await this.#readMutex.acquire();
-
-        await this.__writeToReadInputFile(PerfTags.#serializeSingles(taggables));
-        await this.__writeLineToStdin("read_taggables_tags");
-        const ok = await this.__dataOrTimeout(PerfTags.READ_OK_RESULT, THIRTY_MINUTES);
-        let taggablesTagsStr = await this.__readFromOutputFile();
+        const {ok, output: taggablesTagsStr} = await this.__request("read_taggables_tags", PerfTags.#serializeSingles(taggables), THIRTY_MINUTES);
         /** @type {Map<bigint, bigint[]>} */
         const taggablePairings = new Map();
         for (let i = 0; i < taggablesTagsStr.length;) {
@@ -433,7 +561,6 @@ export default class PerfTags {
             taggablePairings.set(taggable, tags);
         }
 
-        this.#readMutex.release();
         return {ok, taggablePairings};
     }
 
@@ -442,11 +569,11 @@ export default class PerfTags {
      * @param {bigint[]} tags
      */
     async readTaggablesSpecifiedTags(taggables, tags) {
-        await this.#readMutex.acquire();
-        await this.__writeToReadInputFile(`${serializeUint64(BigInt(tags.length))}${PerfTags.#serializeSingles(tags)}${serializeUint64(BigInt(taggables.length))}${PerfTags.#serializeSingles(taggables)}`);
-        await this.__writeLineToStdin("read_taggables_specified_tags");
-        const ok = await this.__dataOrTimeout(PerfTags.READ_OK_RESULT, THIRTY_MINUTES);
-        let taggablesTagsStr = await this.__readFromOutputFile();
+        const {ok, output: taggablesTagsStr} = await this.__request(
+            "read_taggables_specified_tags",
+            `${serializeUint64(BigInt(tags.length))}${PerfTags.#serializeSingles(tags)}${serializeUint64(BigInt(taggables.length))}${PerfTags.#serializeSingles(taggables)}`,
+            THIRTY_MINUTES
+        );
         /** @type {Map<bigint, bigint[]>} */
         const taggablePairings = new Map();
         for (let i = 0; i < taggablesTagsStr.length;) {
@@ -464,7 +591,6 @@ export default class PerfTags {
             taggablePairings.set(taggable, tags);
         }
 
-        this.#readMutex.release();
         return {ok, taggablePairings};
     }
 
@@ -473,20 +599,171 @@ export default class PerfTags {
      * @param {boolean=} inTransaction
      */
     async search(searchCriteria) {
-        await this.#readMutex.acquire();
+        const {ok, taggables} = await this.searchIds(searchCriteria);
+        return {ok, taggables: [...taggables]};
+    }
+
+    /**
+     * Like search, but the taggables are a view over the output perftags wrote rather than an array of them,
+     * which is not copied at all when in process
+     * @param {string} searchCriteria
+     */
+    async searchIds(searchCriteria) {
+        const {ok, output} = await this.__request("search", Buffer.from(searchCriteria, 'binary'), THIRTY_MINUTES);
+        // a BigUint64Array has to start on a multiple of 8 bytes, which a frame's payload may not, and reads the little endian ids as is on a little endian host
+        const taggablesStr = output.byteOffset % 8 === 0 ? output : new Uint8Array(output);
+        return {ok, taggables: new BigUint64Array(taggablesStr.buffer, taggablesStr.byteOffset, taggablesStr.length / 8)};
+    }
+
+    /**
+     * Counts the taggables a search finds without them ever being gathered
+     * @param {string} searchCriteria
+     */
+    async searchCount(searchCriteria) {
+        const {ok, output} = await this.__request("search_count", Buffer.from(searchCriteria, 'binary'), THIRTY_MINUTES);
+        return {ok, count: ok ? Number(output.readBigUInt64LE(0)) : 0};
+    }
+
+    /**
+     * @param {string} searchCriteria
+     */
+    async searchExists(searchCriteria) {
+        const {ok, output} = await this.__request("search_exists", Buffer.from(searchCriteria, 'binary'), THIRTY_MINUTES);
+        return {ok, exists: ok && output.readBigUInt64LE(0) !== 0n};
+    }
+
+    /**
+     * Reads a window of a search's taggables in order of a metric's values, or of their ids when no metric is given,
+     * without the rest of them being sorted or sent. Taggables without a value of the metric come after the rest, by id
+     * @param {string} searchCriteria
+     * @param {{metric?: bigint, descending?: boolean, offset?: number, limit: number}} order
+     */
+    async searchSorted(searchCriteria, {metric, descending, offset, limit}) {
+        const input = Buffer.allocUnsafe(26);
+        let location = input.write(metric === undefined ? "I" : "M", 0, "binary");
+        location = input.writeBigUInt64LE(metric ?? 0n, location);
+        location = input.writeUInt8(descending ? 1 : 0, location);
+        location = input.writeBigUInt64LE(BigInt(offset ?? 0), location);
+        input.writeBigUInt64LE(BigInt(limit), location);
+        const {ok, output} = await this.__request("search_sorted", Buffer.concat([input, Buffer.from(searchCriteria, 'binary')]), THIRTY_MINUTES);
+
+        /** @type {bigint[]} */
+        const taggables = [];
+        for (let i = 8; i < output.length; i += 8) {
+            taggables.push(output.readBigUInt64LE(i));
+        }
+        return {ok, taggableCount: ok ? Number(output.readBigUInt64LE(0)) : 0, taggables};
+    }
+
+    /**
+     * Reads up to count uniformly random taggables of a search in a random order, without the rest of them being sent.
+     * The same seed samples the same taggables for as long as the search finds the same ones in the same database,
+     * another database with the same taggables may number them differently and sample others
+     * @param {string} searchCriteria
+     * @param {number} count
+     * @param {(number | bigint)=} seed
+     */
+    async searchSample(searchCriteria, count, seed) {
+        const input = Buffer.allocUnsafe(17);
+        let location = input.writeUInt8(seed === undefined ? 0 : 1, 0);
+        location = input.writeBigUInt64LE(BigInt.asUintN(64, BigInt(seed ?? 0)), location);
+        input.writeBigUInt64LE(BigInt(count), location);
+        const {ok, output} = await this.__request("search_sample", Buffer.concat([input, Buffer.from(searchCriteria, 'binary')]), THIRTY_MINUTES);
 
-        await this.__writeToReadInputFile(Buffer.from(searchCriteria, 'binary'));
-        await this.__writeLineToStdin("search");
-        const ok = await this.__dataOrTimeout(PerfTags.READ_OK_RESULT, THIRTY_MINUTES);
-        let taggablesStr = await this.__readFromOutputFile();
         /** @type {bigint[]} */
         const taggables = [];
-        for (let i = 0; i  < taggablesStr.length; i += 8) {
-            taggables.push(taggablesStr.readBigUInt64LE(i));
+        for (let i = 8; i < output.length; i += 8) {
+            taggables.push(output.readBigUInt64LE(i));
+        }
+        return {ok, taggableCount: ok ? Number(output.readBigUInt64LE(0)) : 0, taggables};
+    }
+
+    /**
+     * Runs a search, returning the plan it ran as an indented tree of operations with their estimated and actual sizes
+     * @param {string} searchCriteria
+     */
+    async explain(searchCriteria) {
+        const {ok, output} = await this.__request("explain", Buffer.from(searchCriteria, 'binary'), THIRTY_MINUTES);
+        return {ok, plan: output.toString()};
+    }
+
+    /**
+     * Runs a search and keeps its taggables inside perftags, sorted, to be read a page at a time with readSearchCursorPage
+     * The cursor is dropped once closed, or once it goes unread for longer than the "search-cursor-expiry-ms" option
+     * @param {string} searchCriteria
+     */
+    async openSearchCursor(searchCriteria) {
+        const {ok, output} = await this.__request("search_cursor_open", Buffer.from(searchCriteria, 'binary'), THIRTY_MINUTES);
+        if (!ok) {
+            return {ok, cursorId: 0n, taggableCount: 0};
         }
 
-        this.#readMutex.release();
-        return {ok, taggables};
+        return {ok, cursorId: output.readBigUInt64LE(0), taggableCount: Number(output.readBigUInt64LE(8))};
+    }
+
+    /**
+     * @param {bigint} cursorId
+     * @param {number} offset
+     * @param {number} limit
+     * @returns {Promise<{ok: boolean, found: boolean, taggableCount: number, taggables: bigint[]}>} found is false once the cursor expired
+     */
+    async readSearchCursorPage(cursorId, offset, limit) {
+        const input = Buffer.allocUnsafe(24);
+        input.writeBigUInt64LE(cursorId, 0);
+        input.writeBigUInt64LE(BigInt(offset), 8);
+        input.writeBigUInt64LE(BigInt(limit), 16);
+        const {ok, output} = await this.__request("search_cursor_page", input, THIRTY_MINUTES);
+        if (output.length === 0) {
+            return {ok, found: false, taggableCount: 0, taggables: []};
+        }
+
+        /** @type {bigint[]} */
+        const taggables = [];
+        for (let i = 8; i < output.length; i += 8) {
+            taggables.push(output.readBigUInt64LE(i));
+        }
+        return {ok, found: true, taggableCount: Number(output.readBigUInt64LE(0)), taggables};
+    }
+
+    /**
+     * @param {bigint} cursorId
+     */
+    async closeSearchCursor(cursorId) {
+        const input = Buffer.allocUnsafe(8);
+        input.writeBigUInt64LE(cursorId, 0);
+        return (await this.__request("search_cursor_close", input, THIRTY_MINUTES)).ok;
+    }
+
+    /**
+     * Reads every bucket ahead of the first search, returning how many milliseconds each bucket took to read
+     */
+    async prewarm() {
+        const {ok, output} = await this.__request("prewarm", "", THIRTY_MINUTES);
+        const timingsStr = output.toString();
+        /** @type {Record<string, number>} */
+        const bucketMilliseconds = {};
+        const tokens = timingsStr.split(" ").filter(token => token.length > 0);
+        for (let i = 0; i + 1 < tokens.length; i += 2) {
+            bucketMilliseconds[tokens[i]] = Number(tokens[i + 1]);
+        }
+
+        return {ok, bucketMilliseconds};
+    }
+
+    /**
+     * Reads counters about background flushes, the write ahead logs, which buckets are held in memory, and the search cache
+     */
+    async stats() {
+        const {ok, output} = await this.__request("stats", "", THIRTY_MINUTES);
+        const statsStr = output.toString();
+        /** @type {Record<string, number>} */
+        const stats = {};
+        const tokens = statsStr.split(" ").filter(token => token.length > 0);
+        for (let i = 0; i + 1 < tokens.length; i += 2) {
+            stats[tokens[i]] = Number(tokens[i + 1]);
+        }
+
+        return {ok, stats};
     }
 
     /**
@@ -503,6 +780,16 @@ export default class PerfTags {
         return `L${serializeUint64(BigInt(taggables.length))}${PerfTags.#serializeSingles(taggables)}`;
     }
 
+    /**
+     * The taggables with a value of metric from lowest to highest, both included
+     * @param {bigint} metric
+     * @param {number} lowest
+     * @param {number} highest
+     */
+    static searchMetricRange(metric, lowest, highest) {
+        return `M${serializeUint64(metric)}${serializeDouble(lowest)}${serializeDouble(highest)}`;
+    }
+
     /**
      * @param {string} expression 
      */
@@ -617,15 +904,13 @@ export default class PerfTags {
 
     async beginTransaction() {
         await this.#writeMutex.acquire();
-        await this.__writeLineToStdin("begin_transaction");
-        const result = await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        const result = await this.__write("begin_transaction");
         return {result};
     }
 
     async endTransaction() {
-        await this.__writeLineToStdin("end_transaction");
-        await this.__flushData();
-        const result = await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        await this.__write("end_transaction");
+        const result = await this.__flushData();
         this.#writeMutex.release();
         return result;
     }
@@ -666,10 +951,9 @@ export default class PerfTags {
         }
         this.#closing = true;
 
-        await this.__writeLineToStdin("exit");
-        await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        await this.__write("exit");
         this.#closed = true;
-        const result = await this.__nonErrorExitOrTimeout(THIRTY_MINUTES);
+        const result = this.#inProcess ? true : await this.__nonErrorExitOrTimeout(THIRTY_MINUTES);
         this.#writeMutex.release();
         return result;
     }
@@ -686,21 +970,164 @@ export default class PerfTags {
         await writeFile(this.#writeInputFileName, buffer, {encoding: "binary"});
     }
     /**
-     * @param {Buffer} buffer 
+     * Sends a write, which runs once every write and read sent before it has
+     * @param {string} op
+     * @param {(Buffer | string)=} input
      */
-    async __writeToReadInputFile(buffer) {
-        await mkdir(path.dirname(this.#readInputFileName), {recursive: true});
-        await writeFile(this.#readInputFileName, buffer, {encoding: "binary"});
+    async __write(op, input) {
+        if (this.#inProcess) {
+            return (await this.__command(op, input, this.#writeInputFileName)).ok;
+        }
+        if (this.#framed) {
+            return (await this.__frame(op, input, this.#writeInputFileName, THIRTY_MINUTES)).ok;
+        }
+
+        if (input !== undefined) {
+            await this.__writeToWriteInputFile(input);
+        }
+        await this.__archiveCommand(op, input, this.#writeInputFileName);
+        this.#perfTags.stdin.write(`${op}${PerfTags.NEWLINE}`);
+        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
     }
-    async __readFromOutputFile() {
-        return await readFile(this.#readOutputFileName);
+
+    /**
+     * Runs a read alongside any other reads and writes, with its own input and output files so that it can finish out of order
+     * @param {string} op
+     * @param {Buffer | string} input
+     * @param {number} timeout
+     */
+    async __request(op, input, timeout) {
+        if (this.#inProcess) {
+            return await this.__command(op, input, this.#readInputFileName);
+        }
+        if (this.#framed) {
+            return await this.__frame(op, input, this.#readInputFileName, timeout);
+        }
+
+        const requestId = this.#freeReadRequestIds.pop() ?? ++this.#nextReadRequestId;
+        const requestInputFileName = `${this.#readInputFileName}.${requestId}`;
+        const requestOutputFileName = `${this.#readOutputFileName}.${requestId}`;
+        await mkdir(path.dirname(requestInputFileName), {recursive: true});
+        await writeFile(requestInputFileName, input, {encoding: "binary"});
+        await this.__archiveCommand(op, input, this.#readInputFileName);
+        this.#perfTags.stdin.write(`${op} ${requestId}${PerfTags.NEWLINE}`);
+        // a read that failed replies READ_ERROR! rather than READ_OK!, with what it threw on stderr
+        const replies = [
+            `READ_OK! ${requestId}${PerfTags.NEWLINE}`,
+            `READ_ERROR! ${requestId}${PerfTags.NEWLINE}`
+        ];
+        const replyIndex = await this.__anyDataOrTimeout(replies, timeout);
+        if (replyIndex === -1) {
+            // the read is still running and will reply on its id, which is only reused once that reply is consumed, or never if it is not
+            this.__anyDataOrTimeout(replies, THIRTY_MINUTES).then(lateReplyIndex => {
+                if (lateReplyIndex !== -1) {
+                    this.#freeReadRequestIds.push(requestId);
+                }
+            });
+            return {ok: false, output: Buffer.alloc(0)};
+        }
+
+        const ok = replyIndex === 0;
+        const output = ok ? await readFile(requestOutputFileName) : Buffer.alloc(0);
+        this.#freeReadRequestIds.push(requestId);
+        return {ok, output};
     }
 
     /**
-     * @param {string} data 
+     * Sends op as a binary frame, see perf/perftags/framed-ipc.hpp, resolving with the payload of the reply with the same request id
+     * @param {string} op
+     * @param {(Buffer | string)=} input
+     * @param {string} inputFileName the file the input would have been sent through in file mode, for archiving
+     * @param {number} timeout
+     * @returns {Promise<{ok: boolean, output: Buffer}>}
      */
-    async __writeLineToStdin(data) {
-        return await this.__writeToStdin(`${data}${PerfTags.NEWLINE}`);
+    async __frame(op, input, inputFileName, timeout) {
+        const opCode = PerfTags.FRAME_OPS.indexOf(op);
+        if (opCode === -1) {
+            throw `Op ${op} has no frame op code`;
+        }
+        const payload = typeof input === "string" ? Buffer.from(input, "binary") : (input ?? Buffer.alloc(0));
+        const requestId = ++this.#nextFrameRequestId;
+        const header = Buffer.allocUnsafe(PerfTags.FRAME_HEADER_BYTES);
+        header.writeBigUInt64LE(BigInt(payload.length), 0);
+        header.writeUInt8(opCode, 8);
+        header.writeBigUInt64LE(BigInt(requestId), 9);
+
+        const reply = new Promise(resolve => {
+            const timeoutHandle = setTimeout(() => {
+                this.#frameReplies.delete(requestId);
+                resolve({ok: false, output: Buffer.alloc(0)});
+            }, timeout);
+            this.#frameReplies.set(requestId, (ok, output) => {
+                clearTimeout(timeoutHandle);
+                resolve({ok, output});
+            });
+        });
+        await this.__archiveCommand(op, payload, inputFileName);
+        this.#perfTags.stdin.write(header);
+        this.#perfTags.stdin.write(payload);
+        return await reply;
+    }
+
+    /**
+     * Runs op on the tag file maintainer in this process, on a libuv worker thread, where output is a Buffer over the bytes it wrote
+     * @param {string} op
+     * @param {(Buffer | string)=} input
+     * @param {string} inputFileName the file the input would have been sent through in file mode, for archiving
+     * @returns {Promise<{ok: boolean, output: Buffer}>}
+     */
+    async __command(op, input, inputFileName) {
+        const payload = typeof input === "string" ? Buffer.from(input, "binary") : (input ?? Buffer.alloc(0));
+        await this.__archiveCommand(op, payload, inputFileName);
+        try {
+            return {ok: true, output: (await this.#addon.command(op, payload)) ?? Buffer.alloc(0)};
+        } catch (err) {
+            for (const listener of this.#stderrListeners) {
+                listener(`${err}${PerfTags.NEWLINE}`);
+            }
+            return {ok: false, output: Buffer.alloc(0)};
+        }
+    }
+
+    /**
+     * @param {Buffer} chunk
+     */
+    #receiveFrames(chunk) {
+        this.#frameData = this.#frameData.length === 0 ? chunk : Buffer.concat([this.#frameData, chunk]);
+        while (this.#frameData.length >= PerfTags.FRAME_HEADER_BYTES) {
+            const payloadBytes = Number(this.#frameData.readBigUInt64LE(0));
+            if (this.#frameData.length < PerfTags.FRAME_HEADER_BYTES + payloadBytes) {
+                break;
+            }
+
+            const status = this.#frameData.readUInt8(8);
+            const requestId = Number(this.#frameData.readBigUInt64LE(9));
+            const payload = this.#frameData.subarray(PerfTags.FRAME_HEADER_BYTES, PerfTags.FRAME_HEADER_BYTES + payloadBytes);
+            this.#frameData = this.#frameData.subarray(PerfTags.FRAME_HEADER_BYTES + payloadBytes);
+            const frameReply = this.#frameReplies.get(requestId);
+            if (frameReply !== undefined) {
+                this.#frameReplies.delete(requestId);
+                frameReply(status === PerfTags.FRAME_STATUS_OK, payload);
+            }
+        }
+    }
+
+    /**
+     * Archives a command as the op line and input file it is sent as in file mode, so an archive replays the same however it was sent
+     * @param {string} op
+     * @param {(Buffer | string)=} input
+     * @param {string} inputFileName
+     */
+    async __archiveCommand(op, input, inputFileName) {
+        ++this.#stdinWrites;
+        if (this.#archiveDirectory === undefined) {
+            return;
+        }
+
+        await mkdir(this.#archiveDirectory, {recursive: true});
+        const commandNumber = this.#stdinWrites.toString().padStart(5, '0');
+        await writeFile(path.join(this.#archiveDirectory, `command-${commandNumber}.txt`), `${op}${PerfTags.NEWLINE}`);
+        await writeFile(path.join(this.#archiveDirectory, `${path.basename(inputFileName)}-${commandNumber}.txt`), input ?? "", {encoding: "binary"});
     }
 
     /**
@@ -729,23 +1156,22 @@ export default class PerfTags {
     }
 
     async __flushData() {
-        await this.__writeLineToStdin("flush_files");
-        await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("flush_files");
     }
 
     async __flushAndPurgeUnusedFiles() {
         await this.flushData();
-        await this.__writeLineToStdin("purge_unused_files");
-        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("purge_unused_files");
     }
 
     async __override(overrideString) {
-        await this.__writeToWriteInputFile(overrideString);
-        await this.__writeLineToStdin("override");
-        return await this.__dataOrTimeout(PerfTags.WRITE_OK_RESULT, THIRTY_MINUTES);
+        return await this.__write("override", overrideString);
     }
 
     __kill() {
+        if (this.#inProcess) {
+            throw "Perf tags in process cannot be killed";
+        }
         this.#expectingError = true;
         this.#perfTags.kill();
     }